@@ -0,0 +1,408 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "Assert333.h"
+#include "Allocator.h"
+#include "Allocator_priv.h"
+
+// The vtable entries for each of our allocators.
+static void *MallocAlloc(void *context, size_t size);
+static void MallocDealloc(void *context, void *ptr, size_t size);
+static void *ArenaAlloc(void *context, size_t size);
+static void ArenaDealloc(void *context, void *ptr, size_t size);
+static void *PoolAlloc(void *context, size_t size);
+static void PoolDealloc(void *context, void *ptr, size_t size);
+
+// Internal helper that mallocs a chunk with (at least) size usable
+// bytes and pushes it on the front of *chunks.  Returns NULL if out of
+// memory.
+static AllocChunk *NewChunk(AllocChunk **chunks, size_t size);
+
+// Internal helper that moves the first chunk with at least size usable
+// bytes from *spares to the front of *chunks.  Returns NULL if there is
+// no such chunk.
+static AllocChunk *ReuseChunk(AllocChunk **chunks, AllocChunk **spares,
+                              size_t size);
+
+// Internal helpers for pools created with options.  MapPages maps len
+// bytes (a multiple of POOL_HUGE_PAGE) as the pool's options say, and
+// returns NULL if out of memory.  UnmapPages undoes it.
+static void *MapPages(Pool pool, size_t len);
+static void UnmapPages(void *addr, size_t len);
+
+// Internal helper that maps len bytes of ordinary memory, aligned to a
+// huge page so that transparent huge pages can back all of it.
+static void *MapAligned(size_t len);
+
+// Internal helper that applies the pool's NUMA policy to a fresh
+// mapping.  Returns false if the policy couldn't be applied.
+static bool ApplyNumaPolicy(Pool pool, void *addr, size_t len);
+
+// Internal helper that rounds a big allocation up to whole huge pages.
+static size_t HugePageRoundUp(size_t size);
+
+// Internal helper that frees a list of chunks.
+static void FreeChunks(AllocChunk *chunks);
+
+// Internal helper to find the usable bytes of a chunk.
+static unsigned char *ChunkBytes(AllocChunk *chunk);
+
+const Allocator kMallocAllocator = { &MallocAlloc, &MallocDealloc };
+const Allocator kArenaAllocator = { &ArenaAlloc, &ArenaDealloc };
+const Allocator kPoolAllocator = { &PoolAlloc, &PoolDealloc };
+
+static void *MallocAlloc(void *context, size_t size) {
+  return malloc(size);
+}
+
+static void MallocDealloc(void *context, void *ptr, size_t size) {
+  free(ptr);
+}
+
+Arena AllocateArena(size_t chunk_bytes) {
+  Arena arena = (Arena) malloc(sizeof(ArenaRecord));
+  if (arena == NULL)
+    return NULL;
+  arena->chunks = NULL;
+  arena->spares = NULL;
+  arena->used = 0;
+  arena->chunk_bytes = (chunk_bytes > 0) ? ALLOC_ROUND_UP(chunk_bytes) :
+                                           ALLOC_ALIGNMENT;
+  arena->total_used = 0;
+  return arena;
+}
+
+void FreeArena(Arena arena) {
+  Assert333(arena != NULL);
+  FreeChunks(arena->chunks);
+  FreeChunks(arena->spares);
+  free(arena);
+}
+
+void ResetArena(Arena arena) {
+  AllocChunk *next;
+
+  Assert333(arena != NULL);
+  while (arena->chunks != NULL) {
+    next = arena->chunks->next;
+    arena->chunks->next = arena->spares;
+    arena->spares = arena->chunks;
+    arena->chunks = next;
+  }
+  arena->used = 0;
+  arena->total_used = 0;
+}
+
+size_t ArenaBytesUsed(Arena arena) {
+  Assert333(arena != NULL);
+  return arena->total_used;
+}
+
+size_t AllocatorOverhead(const Allocator *allocator, size_t size) {
+  size_t chunk;
+
+  Assert333(allocator != NULL);
+  if (allocator == &kArenaAllocator ||
+      (allocator == &kPoolAllocator && size <= POOL_MAX_SMALL))
+    return ALLOC_ROUND_UP(size > 0 ? size : 1) - size;
+  if (allocator == &kMallocAllocator || allocator == &kPoolAllocator) {
+    // a size word in front, rounded up to the alignment, with a minimum
+    // chunk of four words.
+    chunk = ALLOC_ROUND_UP(size + sizeof(size_t));
+    if (chunk < 4 * sizeof(size_t))
+      chunk = 4 * sizeof(size_t);
+    return chunk - size;
+  }
+  return 0;
+}
+
+static void *ArenaAlloc(void *context, size_t size) {
+  Arena arena = (Arena) context;
+  size_t chunk_size;
+  void *ptr;
+
+  Assert333(arena != NULL);
+  size = ALLOC_ROUND_UP(size);
+  if (arena->chunks == NULL || arena->chunks->size - arena->used < size) {
+    // start a new chunk, reusing a spare one if we can.  A big
+    // allocation gets a chunk of its own.
+    chunk_size = (size > arena->chunk_bytes) ? size : arena->chunk_bytes;
+    if (ReuseChunk(&arena->chunks, &arena->spares, size) == NULL &&
+        NewChunk(&arena->chunks, chunk_size) == NULL)
+      return NULL;
+    arena->used = 0;
+  }
+  ptr = ChunkBytes(arena->chunks) + arena->used;
+  arena->used += size;
+  arena->total_used += size;
+  return ptr;
+}
+
+static void ArenaDealloc(void *context, void *ptr, size_t size) {
+  // individual allocations are released all at once, by FreeArena.
+}
+
+Pool AllocatePool(void) {
+  Pool pool;
+  int i;
+
+  pool = (Pool) malloc(sizeof(PoolRecord));
+  if (pool == NULL)
+    return NULL;
+  for (i = 0; i < POOL_NUM_CLASSES; i++)
+    pool->free_lists[i] = NULL;
+  pool->slabs = NULL;
+  pool->used = 0;
+  pool->mapped = false;
+  memset(&pool->options, 0, sizeof(pool->options));
+  memset(&pool->stats, 0, sizeof(pool->stats));
+  return pool;
+}
+
+Pool AllocatePoolWithOptions(const PoolOptions *options) {
+  Pool pool;
+
+  Assert333(options != NULL);
+  pool = AllocatePool();
+  if (pool == NULL)
+    return NULL;
+  pool->mapped = true;
+  pool->options = *options;
+  return pool;
+}
+
+void FreePool(Pool pool) {
+  AllocChunk *next;
+
+  Assert333(pool != NULL);
+  if (!pool->mapped) {
+    FreeChunks(pool->slabs);
+  } else {
+    while (pool->slabs != NULL) {
+      next = pool->slabs->next;
+      UnmapPages(pool->slabs, POOL_HUGE_PAGE);
+      pool->slabs = next;
+    }
+  }
+  free(pool);
+}
+
+void GetPoolPageStats(Pool pool, PoolPageStats *stats) {
+  Assert333(pool != NULL);
+  Assert333(stats != NULL);
+  *stats = pool->stats;
+}
+
+static void *PoolAlloc(void *context, size_t size) {
+  Pool pool = (Pool) context;
+  size_t c;
+  void *ptr;
+
+  Assert333(pool != NULL);
+  if (size > POOL_MAX_SMALL) {
+    if (pool->mapped && size >= POOL_MIN_MAPPED)
+      return MapPages(pool, HugePageRoundUp(size));
+    return malloc(size);
+  }
+
+  size = ALLOC_ROUND_UP(size > 0 ? size : 1);
+  c = size / ALLOC_ALIGNMENT - 1;
+  if (pool->free_lists[c] != NULL) {
+    // reuse a freed block of this class.
+    ptr = pool->free_lists[c];
+    pool->free_lists[c] = *(void **) ptr;
+    return ptr;
+  }
+
+  // carve a new block off the current slab.  Whatever is left at the
+  // end of a full slab is simply wasted.
+  if (pool->slabs == NULL || pool->slabs->size - pool->used < size) {
+    if (!pool->mapped) {
+      if (NewChunk(&pool->slabs, POOL_SLAB_BYTES) == NULL)
+        return NULL;
+    } else {
+      AllocChunk *slab = (AllocChunk *) MapPages(pool, POOL_HUGE_PAGE);
+      if (slab == NULL)
+        return NULL;
+      slab->size = POOL_HUGE_PAGE - ALLOC_CHUNK_HEADER;
+      slab->next = pool->slabs;
+      pool->slabs = slab;
+    }
+    pool->used = 0;
+  }
+  ptr = ChunkBytes(pool->slabs) + pool->used;
+  pool->used += size;
+  return ptr;
+}
+
+static void PoolDealloc(void *context, void *ptr, size_t size) {
+  Pool pool = (Pool) context;
+  size_t c;
+
+  Assert333(pool != NULL);
+  if (ptr == NULL)
+    return;
+  if (size > POOL_MAX_SMALL) {
+    if (pool->mapped && size >= POOL_MIN_MAPPED) {
+      UnmapPages(ptr, HugePageRoundUp(size));
+    } else {
+      free(ptr);
+    }
+    return;
+  }
+  c = ALLOC_ROUND_UP(size > 0 ? size : 1) / ALLOC_ALIGNMENT - 1;
+  *(void **) ptr = pool->free_lists[c];
+  pool->free_lists[c] = ptr;
+}
+
+static AllocChunk *NewChunk(AllocChunk **chunks, size_t size) {
+  AllocChunk *chunk;
+
+  if (size > (size_t) -1 - ALLOC_CHUNK_HEADER)
+    return NULL;
+  chunk = (AllocChunk *) malloc(ALLOC_CHUNK_HEADER + size);
+  if (chunk == NULL)
+    return NULL;
+  chunk->size = size;
+  chunk->next = *chunks;
+  *chunks = chunk;
+  return chunk;
+}
+
+static void *MapPages(Pool pool, size_t len) {
+  void *addr = MAP_FAILED;
+  bool hugetlb = false;
+
+#ifdef MAP_HUGETLB
+  // explicit huge pages come from the system's reserved pool, which is
+  // often empty; if so, fall back to transparent ones.
+  if (pool->options.pages == POOL_PAGES_EXPLICIT) {
+    addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    hugetlb = (addr != MAP_FAILED);
+  }
+#endif
+  if (addr == MAP_FAILED) {
+    addr = MapAligned(len);
+    if (addr == NULL)
+      return NULL;
+#ifdef MADV_HUGEPAGE
+    if (pool->options.pages != POOL_PAGES_DEFAULT &&
+        madvise(addr, len, MADV_HUGEPAGE) == 0)
+      pool->stats.madvised_bytes += len;
+#endif
+  }
+
+  // the policy has to be in place before the pages are first touched.
+  if (pool->options.numa_policy != POOL_NUMA_DEFAULT &&
+      ApplyNumaPolicy(pool, addr, len))
+    pool->stats.numa_bytes += len;
+
+  pool->stats.mapped_bytes += len;
+  if (hugetlb)
+    pool->stats.hugetlb_bytes += len;
+  return addr;
+}
+
+static void UnmapPages(void *addr, size_t len) {
+  munmap(addr, len);
+}
+
+static void *MapAligned(size_t len) {
+  unsigned char *addr, *aligned;
+  size_t head, tail;
+
+  // over-map by a huge page, then trim both ends.
+  addr = (unsigned char *) mmap(NULL, len + POOL_HUGE_PAGE,
+                                PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == (unsigned char *) MAP_FAILED)
+    return NULL;
+  aligned = (unsigned char *)
+      (((uintptr_t) addr + POOL_HUGE_PAGE - 1) &
+       ~(uintptr_t) (POOL_HUGE_PAGE - 1));
+  head = aligned - addr;
+  tail = POOL_HUGE_PAGE - head;
+  if (head > 0)
+    munmap(addr, head);
+  if (tail > 0)
+    munmap(aligned + len, tail);
+  return aligned;
+}
+
+static bool ApplyNumaPolicy(Pool pool, void *addr, size_t len) {
+#ifdef SYS_mbind
+  unsigned long nodemask;
+  int mode;
+
+  mode = (pool->options.numa_policy == POOL_NUMA_BIND) ? MPOL_BIND :
+                                                         MPOL_INTERLEAVE;
+  // the kernel ignores nodes that don't exist, so "all of them" is
+  // every bit set.
+  nodemask = (pool->options.numa_nodes != 0) ?
+      (unsigned long) pool->options.numa_nodes : ~0UL;
+  return syscall(SYS_mbind, addr, len, mode, &nodemask,
+                 sizeof(nodemask) * 8 + 1, 0) == 0;
+#else
+  return false;
+#endif
+}
+
+static size_t HugePageRoundUp(size_t size) {
+  return (size + POOL_HUGE_PAGE - 1) & ~(size_t) (POOL_HUGE_PAGE - 1);
+}
+
+static AllocChunk *ReuseChunk(AllocChunk **chunks, AllocChunk **spares,
+                              size_t size) {
+  AllocChunk **link, *chunk;
+
+  for (link = spares; *link != NULL; link = &(*link)->next) {
+    if ((*link)->size >= size) {
+      chunk = *link;
+      *link = chunk->next;
+      chunk->next = *chunks;
+      *chunks = chunk;
+      return chunk;
+    }
+  }
+  return NULL;
+}
+
+static void FreeChunks(AllocChunk *chunks) {
+  AllocChunk *next;
+
+  while (chunks != NULL) {
+    next = chunks->next;
+    free(chunks);
+    chunks = next;
+  }
+}
+
+static unsigned char *ChunkBytes(AllocChunk *chunk) {
+  return (unsigned char *) chunk + ALLOC_CHUNK_HEADER;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_ALLOCATOR_H_
+#define _HW1_ALLOCATOR_H_
+
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for uint64_t
+
+// An Allocator is a small vtable that LinkedLists and HashTables use for
+// all of their internal memory (list heads, nodes, iterators, key/value
+// records and bucket arrays), so that customers can route that memory
+// somewhere other than malloc.  Each function gets an opaque context
+// pointer, which is handed to the list or table alongside the vtable.
+
+// Allocate size bytes, suitably aligned for any type.  Return NULL if
+// out of memory.
+typedef void *(*AllocFnPtr)(void *context, size_t size);
+
+// Release ptr, which was returned by the matching AllocFnPtr for the
+// same context and the same size.
+typedef void (*DeallocFnPtr)(void *context, void *ptr, size_t size);
+
+typedef struct {
+  AllocFnPtr   alloc_function;
+  DeallocFnPtr dealloc_function;
+} Allocator;
+
+// The default allocator: plain malloc() and free().  Its context is
+// ignored, and may be NULL.
+extern const Allocator kMallocAllocator;
+
+// Estimate how many bytes beyond size an allocation of size bytes from
+// one of the allocators below really takes up, counting rounding and
+// per-allocation headers.  For malloc this is an estimate based on a
+// typical malloc's chunk layout.  Returns 0 for allocators it doesn't
+// know about.
+size_t AllocatorOverhead(const Allocator *allocator, size_t size);
+
+// A bump arena.  Allocations are carved sequentially out of large
+// chunks; freeing an individual allocation does nothing, and all of the
+// arena's memory is released at once by FreeArena.  Use kArenaAllocator
+// with an Arena as its context.
+struct arena;
+typedef struct arena *Arena;
+extern const Allocator kArenaAllocator;
+
+// Create an arena that grabs memory chunk_bytes at a time (or more, for
+// allocations bigger than that).  Returns NULL on error.
+Arena AllocateArena(size_t chunk_bytes);
+
+// Release all of the arena's memory.  Everything allocated from it is
+// invalid afterwards.
+void FreeArena(Arena arena);
+
+// Empty the arena for reuse.  Everything allocated from it is invalid
+// afterwards, but the arena keeps its chunks and hands them out again,
+// rather than returning them to the OS.
+void ResetArena(Arena arena);
+
+// Return the number of bytes handed out by the arena so far.
+size_t ArenaBytesUsed(Arena arena);
+
+// A size-class pool.  Small allocations are rounded up to a multiple of
+// 16 bytes and carved out of slabs; freed blocks go on a free list for
+// their size class and are reused by later allocations of that class.
+// Big allocations go straight to malloc.  Use kPoolAllocator with a
+// Pool as its context.  A pool is not thread-safe.
+struct pool;
+typedef struct pool *Pool;
+extern const Allocator kPoolAllocator;
+
+// Create an empty pool.  Returns NULL on error.
+Pool AllocatePool(void);
+
+// Release all of the pool's slabs.  Everything allocated from it is
+// invalid afterwards.
+void FreePool(Pool pool);
+
+// Options for where a pool gets its memory from.  A pool created with
+// options maps its slabs, and its big allocations (64 KB and up, e.g.
+// a HashTable's bucket array), directly with mmap(), so that they can
+// be backed by huge pages and placed on particular NUMA nodes.  Every
+// option falls back quietly to ordinary pages or the default NUMA
+// policy when the system can't provide it; GetPoolPageStats reports
+// what the pool actually got.
+typedef enum {
+  POOL_PAGES_DEFAULT,       // ordinary pages
+  POOL_PAGES_TRANSPARENT,   // ask for transparent huge pages
+                            // (madvise(MADV_HUGEPAGE))
+  POOL_PAGES_EXPLICIT       // reserved huge pages (MAP_HUGETLB), falling
+                            // back to transparent ones
+} PoolPageMode;
+
+typedef enum {
+  POOL_NUMA_DEFAULT,        // the thread's own NUMA policy
+  POOL_NUMA_BIND,           // only the nodes in numa_nodes
+  POOL_NUMA_INTERLEAVE      // round-robin across the nodes in numa_nodes
+} PoolNumaPolicy;
+
+typedef struct {
+  PoolPageMode    pages;
+  PoolNumaPolicy  numa_policy;
+  uint64_t        numa_nodes;   // bitmask of NUMA nodes, for bind and
+                                // interleave; 0 means all of them
+} PoolOptions;
+
+// What a pool created with options has mapped so far.
+typedef struct {
+  size_t mapped_bytes;    // bytes mapped with mmap()
+  size_t hugetlb_bytes;   // ...of which are explicit (MAP_HUGETLB) pages
+  size_t madvised_bytes;  // ...of which were madvise()d for THP
+  size_t numa_bytes;      // ...of which have the NUMA policy applied
+} PoolPageStats;
+
+// Create an empty pool that gets its memory as options says.  Returns
+// NULL on error.
+Pool AllocatePoolWithOptions(const PoolOptions *options);
+
+// Return what a pool has mapped so far; all zeroes for a pool created
+// without options.
+void GetPoolPageStats(Pool pool, PoolPageStats *stats);
+
+#endif  // _HW1_ALLOCATOR_H_
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_ALLOCATOR_PRIV_H_
+#define _HW1_ALLOCATOR_PRIV_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "./Allocator.h"
+
+// Define the internal structs behind Arenas and Pools.
+
+// Everything handed out is aligned to this many bytes.
+#define ALLOC_ALIGNMENT     16
+
+// A chunk of memory that an arena or pool carves allocations from.
+// The usable bytes start ALLOC_CHUNK_HEADER bytes into the chunk.
+typedef struct alloc_chunk {
+  struct alloc_chunk *next;   // the next (older) chunk, or NULL
+  size_t              size;   // # of usable bytes in this chunk
+} AllocChunk;
+
+#define ALLOC_ROUND_UP(n) \
+  (((n) + ALLOC_ALIGNMENT - 1) & ~(size_t) (ALLOC_ALIGNMENT - 1))
+#define ALLOC_CHUNK_HEADER  ALLOC_ROUND_UP(sizeof(AllocChunk))
+
+// This is the struct we use to represent an arena.
+typedef struct arena {
+  AllocChunk *chunks;       // chunks, newest first; we bump in the first
+  AllocChunk *spares;       // chunks kept by ResetArena, not yet reused
+  size_t      used;         // bytes used in the newest chunk
+  size_t      chunk_bytes;  // the default size of a new chunk
+  size_t      total_used;   // bytes handed out, over all chunks
+} ArenaRecord;
+
+// Pools serve sizes up to POOL_MAX_SMALL bytes from slabs of
+// POOL_SLAB_BYTES; bigger sizes go to malloc.
+#define POOL_MAX_SMALL      512
+#define POOL_NUM_CLASSES    (POOL_MAX_SMALL / ALLOC_ALIGNMENT)
+#define POOL_SLAB_BYTES     (64 * 1024)
+
+// Pools created with options use huge-page-sized slabs, mapped with
+// mmap(), and map sizes from POOL_MIN_MAPPED up directly, rounded up
+// to a whole number of huge pages.  Sizes in between go to malloc.
+#define POOL_HUGE_PAGE      (2 * 1024 * 1024)
+#define POOL_MIN_MAPPED     (64 * 1024)
+
+// This is the struct we use to represent a pool.  Freed blocks are
+// linked through their first word.
+typedef struct pool {
+  void         *free_lists[POOL_NUM_CLASSES];  // per-class freed blocks
+  AllocChunk   *slabs;                         // slabs, newest first
+  size_t        used;                          // bytes used in the newest
+  bool          mapped;         // created with options?
+  PoolOptions   options;        // if so, the options
+  PoolPageStats stats;          // and what we've mapped
+} PoolRecord;
+
+#endif  // _HW1_ALLOCATOR_PRIV_H_
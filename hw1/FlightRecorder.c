@@ -0,0 +1,322 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "Assert333.h"
+#include "FlightRecorder.h"
+#include "FlightRecorder_priv.h"
+
+// One thread's ring buffer.  Rings are never freed: when a thread exits
+// its ring is released, with its records, for the next new thread to
+// reuse.  That way the list of rings only ever grows, and can be walked
+// without a lock, even by a signal handler.
+typedef struct fr_ring {
+  FlightRecord     records[FR_RING_SIZE];
+  uint64_t         next;     // the number of records ever written
+  int              in_use;   // claimed by a live thread?
+  uint32_t         thread;   // the thread that claimed it
+  struct fr_ring  *link;     // the next ring on fr_rings
+} FlightRecorderRing;
+
+int fr_enabled = 0;
+uint64_t fr_threshold_cycles = 0;
+__thread uint64_t fr_thread_resize = 0;
+
+static uint64_t fr_long_chain = UINT64_MAX;
+static uint64_t fr_cycles_per_us = 0;
+static pthread_once_t fr_calibrate_once = PTHREAD_ONCE_INIT;
+
+static FlightRecorderRing *fr_rings = NULL;
+static __thread FlightRecorderRing *fr_thread_ring = NULL;
+
+// A key whose destructor releases a thread's ring when the thread exits.
+static pthread_key_t fr_key;
+static pthread_once_t fr_key_once = PTHREAD_ONCE_INIT;
+
+// The file descriptor the signal handler dumps to.
+static volatile sig_atomic_t fr_signal_fd = -1;
+
+// Internal helper that measures fr_cycles_per_us.
+static void Calibrate(void);
+
+// Internal helpers that create fr_key, and release an exiting thread's
+// ring.
+static void MakeRingKey(void);
+static void ReleaseRing(void *ring);
+
+// Internal helper that claims a ring for the calling thread, or returns
+// NULL if out of memory.
+static FlightRecorderRing *ClaimRing(void);
+
+// The signal handler installed by DumpFlightRecorderOnSignal.
+static void DumpOnSignal(int signum);
+
+// Internal helpers for DumpFlightRecorder, which can't use stdio: append
+// a string, or a number in decimal or hex, to buf at *len.
+static void AppendString(char *buf, size_t *len, const char *s);
+static void AppendNumber(char *buf, size_t *len, uint64_t n, int base);
+
+// Internal helper that writes len bytes of buf to fd, or returns false.
+static bool WriteAll(int fd, const char *buf, size_t len);
+
+void StartFlightRecorder(uint64_t threshold_ns, uint64_t long_chain) {
+  uint64_t threshold;
+
+  pthread_once(&fr_calibrate_once, &Calibrate);
+
+  // threshold_ns * cycles/us / 1000, without overflowing.
+  threshold = (threshold_ns / 1000) * fr_cycles_per_us +
+              (threshold_ns % 1000) * fr_cycles_per_us / 1000;
+  __atomic_store_n(&fr_long_chain, long_chain, __ATOMIC_RELAXED);
+  __atomic_store_n(&fr_threshold_cycles, threshold, __ATOMIC_RELAXED);
+  __atomic_store_n(&fr_enabled, 1, __ATOMIC_RELEASE);
+}
+
+void StopFlightRecorder(void) {
+  __atomic_store_n(&fr_enabled, 0, __ATOMIC_RELEASE);
+}
+
+uint64_t FlightRecorderCyclesPerUs(void) {
+  pthread_once(&fr_calibrate_once, &Calibrate);
+  return fr_cycles_per_us;
+}
+
+void FlightRecorderNote(FlightRecorderOp op, uint64_t key, uint64_t start,
+                        uint64_t cycles, uint64_t chain_length) {
+  FlightRecorderRing *ring = fr_thread_ring;
+  FlightRecord *record;
+
+  if (ring == NULL) {
+    ring = ClaimRing();
+    if (ring == NULL)
+      return;  // out of memory; drop the record
+  }
+
+  record = &ring->records[ring->next % FR_RING_SIZE];
+  record->timestamp = start;
+  record->cycles = cycles;
+  record->key = key;
+  record->chain_length = chain_length;
+  record->thread = ring->thread;
+  record->op = (uint16_t) op;
+  record->flags = 0;
+  if (fr_thread_resize >= start)
+    record->flags |= FR_RESIZED;
+  if (chain_length >= __atomic_load_n(&fr_long_chain, __ATOMIC_RELAXED))
+    record->flags |= FR_LONG_CHAIN;
+
+  // publish the record.
+  __atomic_store_n(&ring->next, ring->next + 1, __ATOMIC_RELEASE);
+}
+
+size_t GetFlightRecords(FlightRecord *records, size_t max) {
+  FlightRecorderRing *ring;
+  uint64_t next, i;
+  size_t count = 0;
+
+  Assert333(records != NULL || max == 0);
+  for (ring = __atomic_load_n(&fr_rings, __ATOMIC_ACQUIRE);
+       ring != NULL && count < max;
+       ring = ring->link) {
+    next = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+    i = (next > FR_RING_SIZE) ? next - FR_RING_SIZE : 0;
+    for (; i < next && count < max; i++)
+      records[count++] = ring->records[i % FR_RING_SIZE];
+  }
+  return count;
+}
+
+bool DumpFlightRecorder(int fd) {
+  static const char *kOpNames[] = { "ht_insert", "ht_lookup", "ht_remove" };
+  FlightRecorderRing *ring;
+  const FlightRecord *r;
+  uint64_t next, i, per_us;
+  char buf[256];
+  size_t len;
+
+  // fr_cycles_per_us is 0 if the recorder was never started, in which
+  // case there's nothing to dump either.
+  per_us = fr_cycles_per_us ? fr_cycles_per_us : 1;
+  len = 0;
+  AppendString(buf, &len, "flight recorder: ");
+  AppendNumber(buf, &len, per_us, 10);
+  AppendString(buf, &len, " cycles/us\n");
+  if (!WriteAll(fd, buf, len))
+    return false;
+
+  for (ring = __atomic_load_n(&fr_rings, __ATOMIC_ACQUIRE); ring != NULL;
+       ring = ring->link) {
+    next = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+    i = (next > FR_RING_SIZE) ? next - FR_RING_SIZE : 0;
+    for (; i < next; i++) {
+      r = &ring->records[i % FR_RING_SIZE];
+      len = 0;
+      AppendString(buf, &len, "thread ");
+      AppendNumber(buf, &len, r->thread, 10);
+      AppendString(buf, &len, " at ");
+      AppendNumber(buf, &len, r->timestamp, 10);
+      AppendString(buf, &len, " ");
+      AppendString(buf, &len, (r->op <= FR_HT_REMOVE) ? kOpNames[r->op] : "?");
+      AppendString(buf, &len, " key 0x");
+      AppendNumber(buf, &len, r->key, 16);
+      AppendString(buf, &len, " took ");
+      AppendNumber(buf, &len, r->cycles, 10);
+      AppendString(buf, &len, " cycles (");
+      AppendNumber(buf, &len, r->cycles / per_us, 10);
+      AppendString(buf, &len, " us) chain ");
+      AppendNumber(buf, &len, r->chain_length, 10);
+      if (r->flags & FR_RESIZED)
+        AppendString(buf, &len, " resized");
+      if (r->flags & FR_LONG_CHAIN)
+        AppendString(buf, &len, " long_chain");
+      AppendString(buf, &len, "\n");
+      if (!WriteAll(fd, buf, len))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool DumpFlightRecorderOnSignal(int signum, int fd) {
+  struct sigaction sa;
+
+  Assert333(fd >= 0);
+  fr_signal_fd = fd;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = &DumpOnSignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  return sigaction(signum, &sa, NULL) == 0;
+}
+
+static void DumpOnSignal(int signum) {
+  int saved_errno = errno;
+
+  DumpFlightRecorder(fr_signal_fd);
+  errno = saved_errno;
+}
+
+static void Calibrate(void) {
+  struct timespec start, now, pause = { 0, 1000000 };  // 1 ms
+  uint64_t start_cycles, cycles, ns;
+
+  // time the cycle counter against the monotonic clock for a few
+  // milliseconds.
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  start_cycles = FRCycles();
+  do {
+    nanosleep(&pause, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = (uint64_t) (now.tv_sec - start.tv_sec) * 1000000000ULL +
+         now.tv_nsec - start.tv_nsec;
+  } while (ns < 5000000);
+  cycles = FRCycles() - start_cycles;
+  fr_cycles_per_us = cycles / (ns / 1000);
+  if (fr_cycles_per_us == 0)
+    fr_cycles_per_us = 1;
+}
+
+static FlightRecorderRing *ClaimRing(void) {
+  FlightRecorderRing *ring;
+  int unused = 0;
+
+  pthread_once(&fr_key_once, &MakeRingKey);
+
+  // reuse a released ring if there is one, or else make a new one.
+  for (ring = __atomic_load_n(&fr_rings, __ATOMIC_ACQUIRE); ring != NULL;
+       ring = ring->link) {
+    unused = 0;
+    if (__atomic_compare_exchange_n(&ring->in_use, &unused, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
+  }
+  if (ring == NULL) {
+    ring = (FlightRecorderRing *) calloc(1, sizeof(FlightRecorderRing));
+    if (ring == NULL)
+      return NULL;
+    ring->in_use = 1;
+    ring->link = __atomic_load_n(&fr_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&fr_rings, &ring->link, ring, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      // ring->link now holds the latest head; try again.
+    }
+  }
+
+  ring->thread = (uint32_t) syscall(SYS_gettid);
+  pthread_setspecific(fr_key, ring);
+  fr_thread_ring = ring;
+  return ring;
+}
+
+static void MakeRingKey(void) {
+  Assert333(pthread_key_create(&fr_key, &ReleaseRing) == 0);
+}
+
+static void ReleaseRing(void *arg) {
+  FlightRecorderRing *ring = (FlightRecorderRing *) arg;
+
+  if (fr_thread_ring == ring)
+    fr_thread_ring = NULL;
+  __atomic_store_n(&ring->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void AppendString(char *buf, size_t *len, const char *s) {
+  // lines are well short of the 256 byte buffer; stop rather than
+  // overflow it.
+  while (*s != '\0' && *len < 256)
+    buf[(*len)++] = *s++;
+}
+
+static void AppendNumber(char *buf, size_t *len, uint64_t n, int base) {
+  char digits[21];
+  int i = 0;
+
+  do {
+    digits[i++] = "0123456789abcdef"[n % base];
+    n /= base;
+  } while (n != 0);
+  while (i > 0 && *len < 256)
+    buf[(*len)++] = digits[--i];
+}
+
+static bool WriteAll(int fd, const char *buf, size_t len) {
+  ssize_t written;
+
+  while (len > 0) {
+    written = write(fd, buf, len);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    buf += written;
+    len -= written;
+  }
+  return true;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _HW1_FLIGHTRECORDER_H_
+#define _HW1_FLIGHTRECORDER_H_
+
+#include <stdbool.h>    // for bool, true, false
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // so we can use uint64_t, etc.
+
+// The flight recorder keeps a record of every HashTable operation that
+// takes longer than a threshold, so that the occasional slow insert (for
+// instance, one that triggered a resize) can be explained after the
+// fact.  Each thread records into a ring buffer of its own, which holds
+// its last FR_RING_SIZE slow operations.
+//
+// While the recorder is running, an operation costs an extra pair of
+// cycle counter reads (rdtsc on x86); only operations over the threshold
+// do any more work than that.  Building the library with
+// -DFR_NO_RECORDER compiles the recorder out of HashTable.c altogether.
+
+// The number of records each thread's ring buffer holds.
+#define FR_RING_SIZE  256
+
+// The operations that are recorded.
+typedef enum {
+  FR_HT_INSERT,   // InsertHashTable
+  FR_HT_LOOKUP,   // LookupHashTable
+  FR_HT_REMOVE    // RemoveFromHashTable
+} FlightRecorderOp;
+
+// Flags describing what a slow operation ran into.
+#define FR_RESIZED     0x1   // the operation resized the table
+#define FR_LONG_CHAIN  0x2   // the key's chain was long (see below)
+
+// One slow operation.  Times are in cycle counter ticks; see
+// FlightRecorderCyclesPerUs() to convert them.
+typedef struct {
+  uint64_t  timestamp;      // the cycle counter when the operation began
+  uint64_t  cycles;         // how long the operation took
+  uint64_t  key;            // the key (hash) operated on
+  uint64_t  chain_length;   // the length of the key's chain afterwards
+  uint32_t  thread;         // the thread (kernel thread id) that did it
+  uint16_t  op;             // a FlightRecorderOp
+  uint16_t  flags;          // FR_RESIZED | FR_LONG_CHAIN
+} FlightRecord;
+
+// Start (or reconfigure) the recorder.  From now on, every operation
+// that takes threshold_ns nanoseconds or longer is recorded, and
+// flagged FR_LONG_CHAIN if its chain held long_chain or more entries.
+// A threshold of 0 records every operation.
+void StartFlightRecorder(uint64_t threshold_ns, uint64_t long_chain);
+
+// Stop recording.  The records made so far are kept, and can still be
+// read and dumped.
+void StopFlightRecorder(void);
+
+// Return the number of cycle counter ticks per microsecond.
+uint64_t FlightRecorderCyclesPerUs(void);
+
+// Copy up to max records into records, and return the number copied.
+// Each thread's records are copied oldest first.  A thread recording
+// while its ring is being copied may leave one of its records torn.
+size_t GetFlightRecords(FlightRecord *records, size_t max);
+
+// Write every thread's records as text to the file descriptor fd, one
+// line per record.  This is async-signal-safe, so it can be called from
+// a signal handler (or a debugger).  Returns true on success, false on
+// a write error.
+bool DumpFlightRecorder(int fd);
+
+// Install a handler that dumps the recorder to fd (with
+// DumpFlightRecorder) whenever the process receives signal signum, for
+// instance SIGUSR1.  Returns true on success, false on error.
+bool DumpFlightRecorderOnSignal(int signum, int fd);
+
+#endif  // _HW1_FLIGHTRECORDER_H_
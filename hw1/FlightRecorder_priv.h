@@ -0,0 +1,90 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _HW1_FLIGHTRECORDER_PRIV_H_
+#define _HW1_FLIGHTRECORDER_PRIV_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "./FlightRecorder.h"
+
+// Is the recorder running, and the threshold in cycles.
+extern int fr_enabled;
+extern uint64_t fr_threshold_cycles;
+
+// The cycle counter when the calling thread last began a resize.
+extern __thread uint64_t fr_thread_resize;
+
+// Read the cycle counter.  Where there isn't one we know how to read,
+// fall back to the monotonic clock in nanoseconds.
+static inline uint64_t FRCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (ticks));
+  return ticks;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Record a slow operation for the calling thread.
+void FlightRecorderNote(FlightRecorderOp op, uint64_t key, uint64_t start,
+                        uint64_t cycles, uint64_t chain_length);
+
+// How HashTable.c times an operation:
+//
+//   FR_BEGIN(start);
+//   ... do the operation ...
+//   FR_END(start, FR_HT_INSERT, key, chain_length);
+//
+// chain_length is only evaluated if the operation is recorded.  And
+// FR_NOTE_RESIZE() marks that the calling thread is resizing a table.
+#ifdef FR_NO_RECORDER
+#define FR_BEGIN(start) ((void) 0)
+#define FR_END(start, op, key, chain_length) ((void) 0)
+#define FR_NOTE_RESIZE() ((void) 0)
+#else
+#define FR_BEGIN(start) \
+  uint64_t start = __atomic_load_n(&fr_enabled, __ATOMIC_RELAXED) ? \
+                   FRCycles() : 0
+#define FR_END(start, op, key, chain_length)                             \
+  do {                                                                   \
+    if ((start) != 0) {                                                  \
+      uint64_t fr_cycles_ = FRCycles() - (start);                        \
+      if (fr_cycles_ >=                                                  \
+          __atomic_load_n(&fr_threshold_cycles, __ATOMIC_RELAXED))       \
+        FlightRecorderNote((op), (key), (start), fr_cycles_,             \
+                           (chain_length));                              \
+    }                                                                    \
+  } while (0)
+#define FR_NOTE_RESIZE()                                                 \
+  do {                                                                   \
+    if (__atomic_load_n(&fr_enabled, __ATOMIC_RELAXED))                  \
+      fr_thread_resize = FRCycles();                                     \
+  } while (0)
+#endif
+
+#endif  // _HW1_FLIGHTRECORDER_PRIV_H_
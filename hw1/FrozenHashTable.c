@@ -0,0 +1,380 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "Assert333.h"
+#include "HashTable.h"
+#include "FrozenHashTable.h"
+#include "FrozenHashTable_priv.h"
+
+// How many seeds we try before growing the vertex set.  A random
+// 3-hypergraph with 1.23 vertices per edge peels with high probability,
+// so for all but tiny tables the first seed almost always works.
+#define FHT_SEEDS_PER_SIZE  16
+
+// a free function that does nothing
+static void NullFree(void *freeme) { }
+
+// A 64-bit mixing function (the splitmix64 finalizer); used to derive
+// the vertex hashes from a key.
+static uint64_t Mix64(uint64_t x);
+
+// Internal helper to read and write the 2-bit value of vertex v.
+static uint32_t GetG(const uint64_t *g, uint64_t v);
+static void SetG(uint64_t *g, uint64_t v, uint32_t val);
+
+// Internal helper to count the number of assigned vertices among the
+// first num_fields 2-bit fields of a packed word.
+static uint64_t CountAssigned(uint64_t word, uint32_t num_fields);
+
+// Internal helper that tries to build the perfect hash function for
+// the num_elements keys in entries, using the given seed and part
+// size.  On success, fills in table->g and table->ranks and returns
+// true; returns false if the hypergraph couldn't be peeled or if we
+// ran out of memory (in which case *oom is set to true).
+static bool TryBuild(FrozenHashTable table, HTKeyValue *entries,
+                     bool *oom);
+
+FrozenHashTable HashTableFreeze(HashTable table) {
+  FrozenHashTable ft;
+  HTKeyValue *entries;
+  HTIter iter;
+  uint64_t i, n;
+  int attempt;
+  bool oom = false, built = false;
+
+  Assert333(table != NULL);  // be defensive
+
+  ft = (FrozenHashTable) malloc(sizeof(FrozenHashTableRecord));
+  if (ft == NULL) {
+    return NULL;
+  }
+  n = NumElementsInHashTable(table);
+  ft->num_elements = n;
+  ft->seed = 0;
+  ft->part_size = 0;
+  ft->num_words = 0;
+  ft->g = NULL;
+  ft->ranks = NULL;
+  ft->entries = NULL;
+
+  if (n > 0) {
+    // copy the key/values out of the chains into a contiguous array.
+    entries = (HTKeyValue *) malloc(n * sizeof(HTKeyValue));
+    if (entries == NULL) {
+      free(ft);
+      return NULL;
+    }
+    iter = HashTableMakeIterator(table);
+    if (iter == NULL) {
+      free(entries);
+      free(ft);
+      return NULL;
+    }
+    for (i = 0; i < n; i++) {
+      Assert333(HTIteratorGet(iter, &entries[i]) == 1);
+      HTIteratorNext(iter);
+    }
+    HTIteratorFree(iter);
+
+    // build the perfect hash function.  We start with 1.23 vertices per
+    // key, and if a handful of seeds fail to produce a peelable
+    // hypergraph, we grow the vertex set by ~10% and try again.
+    ft->part_size = (n * 123 / 100 + 2) / 3 + 1;
+    while (!built && !oom) {
+      for (attempt = 0; attempt < FHT_SEEDS_PER_SIZE; attempt++) {
+        ft->seed = Mix64(ft->seed + ft->part_size + attempt);
+        if (TryBuild(ft, entries, &oom) || oom) {
+          built = !oom;
+          break;
+        }
+      }
+      if (!built)
+        ft->part_size += ft->part_size / 10 + 1;
+    }
+    if (oom) {
+      free(entries);
+      free(ft);
+      return NULL;
+    }
+
+    // place each key/value in the slot the perfect hash assigns it.
+    ft->entries = (HTKeyValue *) malloc(n * sizeof(HTKeyValue));
+    if (ft->entries == NULL) {
+      free(entries);
+      free(ft->g);
+      free(ft->ranks);
+      free(ft);
+      return NULL;
+    }
+    for (i = 0; i < n; i++) {
+      ft->entries[FHTKeyToSlot(ft, entries[i].key)] = entries[i];
+    }
+    free(entries);
+  }
+
+  // the frozen table now owns the values; free the chained table
+  // without touching them.
+  FreeHashTable(table, &NullFree);
+  return ft;
+}
+
+void FreeFrozenHashTable(FrozenHashTable table,
+                         ValueFreeFnPtr value_free_function) {
+  uint64_t i;
+
+  Assert333(table != NULL);  // be defensive
+  Assert333(value_free_function != NULL);
+
+  for (i = 0; i < table->num_elements; i++) {
+    value_free_function(table->entries[i].value);
+  }
+  free(table->entries);
+  free(table->g);
+  free(table->ranks);
+  free(table);
+}
+
+uint64_t NumElementsInFrozenHashTable(FrozenHashTable table) {
+  Assert333(table != NULL);
+  return table->num_elements;
+}
+
+int LookupFrozenHashTable(FrozenHashTable table,
+                          uint64_t key,
+                          HTKeyValue *keyvalue) {
+  HTKeyValue *slot;
+
+  Assert333(table != NULL);
+  Assert333(keyvalue != NULL);
+
+  if (table->num_elements == 0) {
+    return 0;
+  }
+
+  // exactly one probe: the perfect hash gives us the only slot the
+  // key could be in, and we just check whether it's really there.
+  slot = &table->entries[FHTKeyToSlot(table, key)];
+  if (slot->key != key) {
+    return 0;
+  }
+  *keyvalue = *slot;
+  return 1;
+}
+
+uint64_t FrozenHashTableIndexBits(FrozenHashTable table) {
+  uint64_t num_ranks;
+
+  Assert333(table != NULL);
+  num_ranks = (table->num_words + FHT_WORDS_PER_RANK - 1) /
+    FHT_WORDS_PER_RANK;
+  return 64 * (table->num_words + num_ranks) +
+    8 * sizeof(FrozenHashTableRecord);
+}
+
+void FHTKeyToVertices(uint64_t key, uint64_t seed, uint64_t part_size,
+                      uint64_t vertices[3]) {
+  uint64_t h = Mix64(key ^ seed);
+
+  vertices[0] = h % part_size;
+  h = Mix64(h + 0x9E3779B97F4A7C15ULL);
+  vertices[1] = part_size + h % part_size;
+  h = Mix64(h + 0x9E3779B97F4A7C15ULL);
+  vertices[2] = 2 * part_size + h % part_size;
+}
+
+uint64_t FHTKeyToSlot(FrozenHashTable table, uint64_t key) {
+  uint64_t vertices[3], v, block, w, rank;
+  uint32_t j;
+
+  FHTKeyToVertices(key, table->seed, table->part_size, vertices);
+  j = (GetG(table->g, vertices[0]) +
+       GetG(table->g, vertices[1]) +
+       GetG(table->g, vertices[2])) % 3;
+  v = vertices[j];
+
+  // rank(v) = # assigned vertices before v.  Start from the block's
+  // precomputed count and add in the (at most 7) whole words and the
+  // partial word before v.
+  block = v / FHT_VERTICES_PER_RANK;
+  rank = table->ranks[block];
+  for (w = block * FHT_WORDS_PER_RANK; w < v / FHT_VERTICES_PER_WORD; w++) {
+    rank += CountAssigned(table->g[w], FHT_VERTICES_PER_WORD);
+  }
+  rank += CountAssigned(table->g[w], v % FHT_VERTICES_PER_WORD);
+
+  // keys not in the table can land on any vertex, including the few
+  // vertices past the last assigned one; clamp so the caller always
+  // gets a valid slot to compare against.
+  if (rank >= table->num_elements)
+    rank = table->num_elements - 1;
+  return rank;
+}
+
+static bool TryBuild(FrozenHashTable table, HTKeyValue *entries,
+                     bool *oom) {
+  uint64_t  num_vertices = 3 * table->part_size;
+  uint64_t  n = table->num_elements;
+  uint32_t *degree;
+  uint64_t *xor_edges, *stack, *order;
+  uint8_t  *order_pos;
+  uint64_t  vertices[3], i, v, e, sp = 0, num_peeled = 0, w, count;
+  uint32_t  j, sum;
+
+  table->num_words =
+    (num_vertices + FHT_VERTICES_PER_WORD - 1) / FHT_VERTICES_PER_WORD;
+  degree = (uint32_t *) calloc(num_vertices, sizeof(uint32_t));
+  xor_edges = (uint64_t *) calloc(num_vertices, sizeof(uint64_t));
+  stack = (uint64_t *) malloc(num_vertices * sizeof(uint64_t));
+  order = (uint64_t *) malloc(n * sizeof(uint64_t));
+  order_pos = (uint8_t *) malloc(n * sizeof(uint8_t));
+  if (degree == NULL || xor_edges == NULL || stack == NULL ||
+      order == NULL || order_pos == NULL) {
+    *oom = true;
+    goto cleanup;
+  }
+
+  // build the hypergraph.  Rather than keeping an adjacency list per
+  // vertex, we keep its degree and the xor of its incident edge ids;
+  // once the degree drops to 1, the xor *is* the remaining edge.
+  for (e = 0; e < n; e++) {
+    FHTKeyToVertices(entries[e].key, table->seed, table->part_size,
+                     vertices);
+    for (j = 0; j < 3; j++) {
+      degree[vertices[j]]++;
+      xor_edges[vertices[j]] ^= e;
+    }
+  }
+
+  // peel: repeatedly remove an edge that has a vertex of degree 1,
+  // remembering the order and which of the edge's vertices was free.
+  for (v = 0; v < num_vertices; v++) {
+    if (degree[v] == 1)
+      stack[sp++] = v;
+  }
+  while (sp > 0) {
+    v = stack[--sp];
+    if (degree[v] != 1)
+      continue;
+    e = xor_edges[v];
+    order[num_peeled] = e;
+    order_pos[num_peeled] = (uint8_t) (v / table->part_size);
+    num_peeled++;
+    FHTKeyToVertices(entries[e].key, table->seed, table->part_size,
+                     vertices);
+    for (j = 0; j < 3; j++) {
+      degree[vertices[j]]--;
+      xor_edges[vertices[j]] ^= e;
+      if (degree[vertices[j]] == 1)
+        stack[sp++] = vertices[j];
+    }
+  }
+  if (num_peeled < n) {
+    // the hypergraph has a non-empty 2-core; try another seed.
+    goto cleanup;
+  }
+
+  // assign g values in reverse peeling order.  Each edge's free vertex
+  // is untouched by every edge assigned before it, so we can always
+  // pick g[free] to make the sum select it.
+  free(table->g);
+  free(table->ranks);
+  table->ranks = NULL;
+  table->g = (uint64_t *) malloc(table->num_words * sizeof(uint64_t));
+  if (table->g == NULL) {
+    *oom = true;
+    goto cleanup;
+  }
+  for (w = 0; w < table->num_words; w++) {
+    table->g[w] = ~0ULL;  // every vertex starts out FHT_UNASSIGNED
+  }
+  for (i = n; i > 0; i--) {
+    e = order[i - 1];
+    FHTKeyToVertices(entries[e].key, table->seed, table->part_size,
+                     vertices);
+    sum = GetG(table->g, vertices[0]) + GetG(table->g, vertices[1]) +
+      GetG(table->g, vertices[2]);
+    j = order_pos[i - 1];
+    SetG(table->g, vertices[j], (j + 9 - (sum % 3)) % 3);
+  }
+
+  // precompute the rank of the first vertex in each block.
+  table->ranks = (uint64_t *) malloc(
+      ((table->num_words + FHT_WORDS_PER_RANK - 1) / FHT_WORDS_PER_RANK) *
+      sizeof(uint64_t));
+  if (table->ranks == NULL) {
+    free(table->g);
+    table->g = NULL;
+    *oom = true;
+    goto cleanup;
+  }
+  count = 0;
+  for (w = 0; w < table->num_words; w++) {
+    if (w % FHT_WORDS_PER_RANK == 0)
+      table->ranks[w / FHT_WORDS_PER_RANK] = count;
+    count += CountAssigned(table->g[w], FHT_VERTICES_PER_WORD);
+  }
+  Assert333(count == n);  // exactly one assigned vertex per key
+
+ cleanup:
+  free(degree);
+  free(xor_edges);
+  free(stack);
+  free(order);
+  free(order_pos);
+  return (!*oom) && (num_peeled == n) && (table->ranks != NULL);
+}
+
+static uint64_t Mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+  return x;
+}
+
+static uint32_t GetG(const uint64_t *g, uint64_t v) {
+  return (uint32_t) ((g[v / FHT_VERTICES_PER_WORD] >>
+                      (2 * (v % FHT_VERTICES_PER_WORD))) & 3U);
+}
+
+static void SetG(uint64_t *g, uint64_t v, uint32_t val) {
+  uint64_t shift = 2 * (v % FHT_VERTICES_PER_WORD);
+  uint64_t *word = &g[v / FHT_VERTICES_PER_WORD];
+
+  *word = (*word & ~(3ULL << shift)) | ((uint64_t) val << shift);
+}
+
+static uint64_t CountAssigned(uint64_t word, uint32_t num_fields) {
+  uint64_t both_bits;
+
+  if (num_fields == 0)
+    return 0;
+  if (num_fields < FHT_VERTICES_PER_WORD)
+    word &= (1ULL << (2 * num_fields)) - 1;
+
+  // a field is unassigned iff both of its bits are set.
+  both_bits = word & (word >> 1) & 0x5555555555555555ULL;
+  return num_fields - (uint64_t) __builtin_popcountll(both_bits);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_FROZENHASHTABLE_H_
+#define _HW1_FROZENHASHTABLE_H_
+
+#include <stdint.h>     // so we can use uint64_t, etc.
+
+#include "./HashTable.h"  // for HashTable, HTKeyValue, ValueFreeFnPtr
+
+// A FrozenHashTable is an immutable, read-only version of a HashTable.
+// Tables that are built once and only read afterwards can be frozen to
+// get single-probe lookups with no chains to walk.
+//
+// Internally, a FrozenHashTable uses a minimal perfect hash function
+// (of the BDZ / 3-hypergraph variety) to map each of the n keys to a
+// distinct slot in [0, n), and stores the key/values in a dense array
+// indexed by that slot.  The hash function itself costs about 3 bits
+// per key on top of the key/value array.
+//
+// As with HashTable, we hide the implementation behind an opaque
+// pointer; the struct is defined in FrozenHashTable_priv.h.
+struct frozen_htrec;
+typedef struct frozen_htrec *FrozenHashTable;
+
+// Freeze a populated HashTable.
+//
+// Arguments:
+//
+// - table: the HashTable to freeze.  On success, the table is freed
+//   and ownership of every value in it moves to the returned
+//   FrozenHashTable; it is unsafe to use table after a successful
+//   call.  On failure, the table is left untouched.
+//
+// Returns NULL on error (e.g., out of memory), non-NULL on success.
+FrozenHashTable HashTableFreeze(HashTable table);
+
+// Free a FrozenHashTable.
+//
+// Arguments:
+//
+// - table: the FrozenHashTable to free.  It is unsafe to use table
+//   after this function returns.
+//
+// - value_free_function: invoked once for each value in the table.
+void FreeFrozenHashTable(FrozenHashTable table,
+                         ValueFreeFnPtr value_free_function);
+
+// Return the number of elements in the frozen table.
+uint64_t NumElementsInFrozenHashTable(FrozenHashTable table);
+
+// Looks up a key in the FrozenHashTable.  This computes the perfect
+// hash of the key and checks exactly one slot.
+//
+// Arguments:
+//
+// - table: the FrozenHashTable to look in
+//
+// - key: the key to look up
+//
+// - keyvalue: if the key is present, a copy of the key/value is
+//   returned to the caller via this return parameter.  The key/value
+//   stays in the table, so it is not safe for the caller to free
+//   keyvalue->value.
+//
+// Returns:
+//
+//  - 0 if the key wasn't found in the FrozenHashTable
+//
+//  - +1 if the key was found, and therefore the associated key/value
+//    was returned to the caller via that keyvalue return parameter.
+int LookupFrozenHashTable(FrozenHashTable table,
+                          uint64_t key,
+                          HTKeyValue *keyvalue);
+
+// Return the size, in bits, of the perfect hash function (i.e., all
+// memory used by the table other than the dense key/value array).
+// Divide by NumElementsInFrozenHashTable to get the bits per key.
+uint64_t FrozenHashTableIndexBits(FrozenHashTable table);
+
+#endif  // _HW1_FROZENHASHTABLE_H_
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_FROZENHASHTABLE_PRIV_H_
+#define _HW1_FROZENHASHTABLE_PRIV_H_
+
+#include <stdint.h>
+
+#include "./HashTable.h"
+#include "./FrozenHashTable.h"
+
+// Define the internal, private structs and helper functions associated
+// with a FrozenHashTable.
+
+// Each key hashes to one vertex in each of three equal-sized parts of
+// the vertex set, i.e., to a 3-edge of a hypergraph.  Every vertex holds
+// a 2-bit value g[v]; for a key with vertices (v0, v1, v2), the key's
+// slot is rank(v_j) where j = (g[v0] + g[v1] + g[v2]) mod 3 and rank(v)
+// is the number of "assigned" vertices before v.  Unassigned vertices
+// hold the value 3 (which is 0 mod 3), so they don't disturb the sum.
+#define FHT_UNASSIGNED         3U
+#define FHT_VERTICES_PER_WORD  32U    // 2 bits per vertex in a uint64_t
+#define FHT_VERTICES_PER_RANK  256U   // one rank entry per 256 vertices
+#define FHT_WORDS_PER_RANK \
+  (FHT_VERTICES_PER_RANK / FHT_VERTICES_PER_WORD)
+
+// This is the struct that we use to represent a frozen hash table.
+typedef struct frozen_htrec {
+  uint64_t    num_elements;  // # of key/values in the table
+  uint64_t    seed;          // seed for the three vertex hashes
+  uint64_t    part_size;     // # vertices in each of the three parts
+  uint64_t    num_words;     // # of uint64_t words in g
+  uint64_t   *g;             // packed 2-bit vertex values
+  uint64_t   *ranks;         // # assigned vertices before each block
+  HTKeyValue *entries;       // dense array of num_elements key/values
+} FrozenHashTableRecord;
+
+// Compute the three hypergraph vertices that a key maps to, given a
+// seed and a part size.  vertices[i] lies in [i*part_size,
+// (i+1)*part_size).
+void FHTKeyToVertices(uint64_t key, uint64_t seed, uint64_t part_size,
+                      uint64_t vertices[3]);
+
+// Return the slot in [0, num_elements) that key maps to.  For keys not
+// in the table, this returns some arbitrary slot in that range.
+uint64_t FHTKeyToSlot(FrozenHashTable table, uint64_t key);
+
+#endif  // _HW1_FROZENHASHTABLE_PRIV_H_
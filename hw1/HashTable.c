@@ -21,10 +21,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
 
 #include "Assert333.h"
+#include "FlightRecorder_priv.h"
 #include "HashTable.h"
 #include "HashTable_priv.h"
+#include "HashTableLog_priv.h"
+#include "HashTableStats_priv.h"
+#include "LinkedList_priv.h"
 
 // A private utility function to grow the hashtable (increase
 // the number of buckets) if its load factor has become too high.
@@ -35,20 +41,101 @@ static void NullFree(void *freeme) { }
 
 // Internal helper function to calculate insert bucket and
 // get its linked list chain. Must check table for NULL prior
-// to the call.
+// to the call.  In a sparse table the chain is allocated if
+// the bucket doesn't have one yet; *insertchain is NULL if
+// that fails.
 static void GetInsertChain(HashTable table, uint64_t key, LinkedList *insertchain);
 
-HashTable AllocateHashTable(uint32_t num_buckets) {
+// Internal helper to get the chain for a key without allocating
+// one; returns NULL for an empty bucket of a sparse table.
+static LinkedList GetChain(HashTable table, uint64_t key);
+
+// Internal helper that returns the number of elements on a
+// chain, which may be NULL.
+static uint64_t ChainLength(LinkedList chain);
+
+// Internal helper that returns the first bucket at or after i that may
+// hold a chain, or table->num_buckets if there is none.  For a sparse
+// table it skips groups of buckets that were never touched; for any
+// other table it is just i.
+static uint64_t NextBucket(HashTable table, uint64_t i);
+
+// Internal helper that allocates an empty sparse table with
+// num_buckets buckets.
+static HashTable AllocateSparseHashTable(uint64_t num_buckets);
+
+// Internal helper that walks chain for key, leaving iter (which the
+// caller provides, usually on the stack) at its node.  Returns false
+// if the key isn't there.
+static bool FindKey(LinkedList chain, uint64_t key, LLIter iter);
+
+// Internal helpers that allocate and free an iterator record.  Those of
+// an arena-backed table come from malloc, like the table record, since
+// the arena would never get them back.
+static HTIterRecord *AllocateIterRecord(HashTable table);
+static void FreeIterRecord(HTIterRecord *iter);
+
+// Internal helper that points iter's bucket iterator at the head of
+// bucket i, which must not be empty.
+static void StartBucket(HTIterRecord *iter, uint64_t i);
+
+#ifndef HT_NO_STATS
+// Internal helper that looks for key in chain like LookupKey does,
+// and also returns the number of keys it compared through probes.
+static int LookupKeyCountingProbes(LinkedList chain, uint64_t key,
+                                   HTKeyValue **resultkeyvalue,
+                                   uint64_t *probes);
+
+// Internal helper that returns the time in nanoseconds, for timing
+// resizes.
+static uint64_t NowNs(void);
+#endif
+
+// Internal helper that does the work of InsertHashTable.  Resizing
+// uses it directly to move entries, so that they aren't counted as
+// inserts by telemetry.
+static int InsertEntry(HashTable table, HTKeyValue newkeyvalue,
+                       HTKeyValue *oldkeyvalue);
+
+// Internal helper for InsertEntry that appends a new entry, whose key
+// isn't in the table, to chain and, if the table is logged, logs the
+// insert.  Returns false, with the chain as it was and nothing logged,
+// if out of memory or the log append fails.
+static bool AppendNewEntry(HashTable table, LinkedList chain,
+                           HTKeyValuePtr entry);
+
+// Internal helpers that do the work of LookupHashTable and
+// RemoveFromHashTable, which time them for the flight recorder.
+static int LookupEntry(HashTable table, uint64_t key, HTKeyValue *keyvalue);
+static int RemoveEntry(HashTable table, uint64_t key, HTKeyValue *keyvalue);
+
+// Internal helper that allocates ht->num_buckets empty chains, and the
+// bucket array to hold them, from the table's allocator.  Returns false
+// (having freed anything it allocated) if out of memory.
+static bool AllocateBuckets(HashTable ht);
+
+// Internal helper that calls value_free_function on every value in the
+// table, leaving the entries themselves alone.
+static void FreeValues(HashTable table, ValueFreeFnPtr value_free_function);
+
+HashTable AllocateHashTable(uint64_t num_buckets) {
+  return AllocateHashTableWithAllocator(num_buckets, &kMallocAllocator, NULL);
+}
+
+HashTable AllocateHashTableWithAllocator(uint64_t num_buckets,
+                                         const Allocator *allocator,
+                                         void *context) {
   HashTable ht;
-  uint32_t  i;
 
   // defensive programming
+  Assert333(allocator != NULL);
   if (num_buckets == 0) {
     return NULL;
   }
 
   // allocate the hash table record
-  ht = (HashTable) malloc(sizeof(HashTableRecord));
+  TM_COUNT(TM_ALLOCATIONS);
+  ht = (HashTable) allocator->alloc_function(context, sizeof(HashTableRecord));
   if (ht == NULL) {
     return NULL;
   }
@@ -56,60 +143,313 @@ HashTable AllocateHashTable(uint32_t num_buckets) {
   // initialize the record
   ht->num_buckets = num_buckets;
   ht->num_elements = 0;
-  ht->buckets =
-    (LinkedList *) malloc(num_buckets * sizeof(LinkedList));
-  if (ht->buckets == NULL) {
+  ht->log = NULL;
+  ht->stats = NULL;
+  ht->allocator = allocator;
+  ht->alloc_ctx = context;
+  ht->arena = NULL;
+  ht->touched = NULL;
+  if (!AllocateBuckets(ht)) {
     // make sure we don't leak!
+    HTDealloc(ht, ht, sizeof(HashTableRecord));
+    return NULL;
+  }
+
+  return (HashTable) ht;
+}
+
+HashTable AllocateHashTableInArena(uint64_t num_buckets, size_t chunk_bytes) {
+  HashTable ht;
+  Arena     arena;
+
+  if (num_buckets == 0) {
+    return NULL;
+  }
+
+  // the table record itself comes from malloc, so that it survives the
+  // arena being reset by HashTableClear.
+  arena = AllocateArena(chunk_bytes);
+  if (arena == NULL) {
+    return NULL;
+  }
+  ht = (HashTable) malloc(sizeof(HashTableRecord));
+  if (ht == NULL) {
+    FreeArena(arena);
+    return NULL;
+  }
+  ht->num_buckets = num_buckets;
+  ht->num_elements = 0;
+  ht->log = NULL;
+  ht->stats = NULL;
+  ht->allocator = &kArenaAllocator;
+  ht->alloc_ctx = arena;
+  ht->arena = arena;
+  ht->touched = NULL;
+  if (!AllocateBuckets(ht)) {
+    FreeArena(arena);
+    free(ht);
+    return NULL;
+  }
+  return ht;
+}
+
+HashTable AllocateHashTableSized(uint64_t num_elements) {
+  // the table resizes once it holds 3 elements per bucket.
+  return AllocateSparseHashTable(num_elements / 3 + 1);
+}
+
+static HashTable AllocateSparseHashTable(uint64_t num_buckets) {
+  HashTable ht;
+  uint64_t  num_words;
+
+  if (num_buckets == 0 || num_buckets > SIZE_MAX / sizeof(LinkedList)) {
+    return NULL;
+  }
+  ht = (HashTable) malloc(sizeof(HashTableRecord));
+  if (ht == NULL) {
+    return NULL;
+  }
+  num_words = (num_buckets + 64 * HT_SPARSE_GROUP - 1) /
+              (64 * HT_SPARSE_GROUP);
+  ht->touched = (uint64_t *) calloc(num_words, sizeof(uint64_t));
+  if (ht->touched == NULL) {
+    free(ht);
+    return NULL;
+  }
+  ht->num_buckets = num_buckets;
+  ht->num_elements = 0;
+  ht->log = NULL;
+  ht->stats = NULL;
+  ht->allocator = &kMallocAllocator;
+  ht->alloc_ctx = NULL;
+  ht->arena = NULL;
+  if (!AllocateBuckets(ht)) {
+    free(ht->touched);
     free(ht);
     return NULL;
   }
-  for (i = 0; i < num_buckets; i++) {
-    ht->buckets[i] = AllocateLinkedList();
+  return ht;
+}
+
+void *HashTableArenaAlloc(HashTable table, size_t size) {
+  Assert333(table != NULL);
+  Assert333(table->arena != NULL);
+  return HTAlloc(table, size);
+}
+
+static bool AllocateBuckets(HashTable ht) {
+  uint64_t i;
+
+  if (ht->num_buckets > SIZE_MAX / sizeof(LinkedList)) {
+    return false;
+  }
+  if (HTIsSparse(ht)) {
+    // reserve the array without committing it; untouched pages read as
+    // zeroes, i.e., as NULL buckets.
+    void *array = mmap(NULL, ht->num_buckets * sizeof(LinkedList),
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (array == MAP_FAILED) {
+      return false;
+    }
+    ht->buckets = (LinkedList *) array;
+    ht->num_chains = 0;
+    ht->num_used_buckets = 0;
+    ht->num_touched_groups = 0;
+    return true;
+  }
+
+  ht->buckets =
+    (LinkedList *) HTAlloc(ht, ht->num_buckets * sizeof(LinkedList));
+  if (ht->buckets == NULL) {
+    return false;
+  }
+  for (i = 0; i < ht->num_buckets; i++) {
+    ht->buckets[i] = AllocateLinkedListWithAllocator(ht->allocator,
+                                                     ht->alloc_ctx);
     if (ht->buckets[i] == NULL) {
       // allocating one of our bucket chain lists failed,
       // so we need to free everything we allocated so far
-      // before returning NULL to indicate failure.  Since
-      // we know the chains are empty, we'll pass in a
-      // free function pointer that does nothing; it should
-      // never be called.
-      uint32_t j;
+      // before returning failure.  Since we know the chains
+      // are empty, we'll pass in a free function pointer that
+      // does nothing; it should never be called.
+      uint64_t j;
       for (j = 0; j < i; j++) {
         FreeLinkedList(ht->buckets[j], NullFree);
       }
-      free(ht);
-      return NULL;
+      HTDealloc(ht, ht->buckets, ht->num_buckets * sizeof(LinkedList));
+      return false;
     }
   }
-
-  return (HashTable) ht;
+  ht->num_chains = ht->num_buckets;
+  ht->num_used_buckets = 0;
+  ht->num_touched_groups = 0;
+  return true;
 }
 
 void FreeHashTable(HashTable table,
                    ValueFreeFnPtr value_free_function) {
-  uint32_t i;
-
   Assert333(table != NULL);  // be defensive
 
+  if (table->arena != NULL) {
+    // arena-backed: everything but the record goes with the arena.
+    if (value_free_function != NULL)
+      FreeValues(table, value_free_function);
+    FreeArena(table->arena);
+    free(table->stats);
+    free(table);
+    return;
+  }
+
+  HTFreeChains(table, 0, table->num_buckets, value_free_function);
+  HTFreeRecord(table);
+}
+
+void HTFreeChains(HashTable table, uint64_t begin, uint64_t end,
+                  ValueFreeFnPtr value_free_function) {
+  uint64_t i;
+
   // loop through and free the chains on each bucket
-  for (i = 0; i < table->num_buckets; i++) {
+  for (i = NextBucket(table, begin); i < end; i = NextBucket(table, i + 1)) {
     LinkedList  bl = table->buckets[i];
     HTKeyValue *nextKV;
 
+    if (bl == NULL)
+      continue;  // an empty bucket of a sparse table
+
     // pop elements off the the chain list, then free the list
     while (NumElementsInLinkedList(bl) > 0) {
       Assert333(PopLinkedList(bl, (void **) &nextKV));
       value_free_function(nextKV->value);
-      free(nextKV);
+      HTDealloc(table, nextKV, sizeof(HTKeyValue));
     }
     // the chain list is empty, so we can pass in the
     // null free function to FreeLinkedList.
     FreeLinkedList(bl, NullFree);
   }
+}
+
+void HTFreeRecord(HashTable table) {
+  free(table->stats);
+  if (HTIsSparse(table)) {
+    munmap(table->buckets, table->num_buckets * sizeof(LinkedList));
+    free(table->touched);
+    free(table);
+    return;
+  }
 
   // free the bucket array within the table record,
   // then free the table record itself.
-  free(table->buckets);
-  free(table);
+  HTDealloc(table, table->buckets, table->num_buckets * sizeof(LinkedList));
+  HTDealloc(table, table, sizeof(HashTableRecord));
+}
+
+void HashTableMemoryStats(HashTable table, HTMemoryStats *stats) {
+  uint64_t array_bytes, num_words, record_overhead, in_arena;
+
+  Assert333(table != NULL);
+  Assert333(stats != NULL);
+
+  array_bytes = table->num_buckets * sizeof(LinkedList);
+  stats->record_bytes = sizeof(HashTableRecord);
+  stats->chain_bytes = table->num_chains * sizeof(LinkedListHead);
+  stats->node_bytes = table->num_elements * sizeof(LinkedListNode);
+  stats->entry_bytes = table->num_elements * sizeof(HTKeyValue);
+  if (HTIsSparse(table)) {
+    // only the groups of buckets that have been written to are
+    // committed; the rest of the array is just reserved.  Add in the
+    // touched bitmap.
+    num_words = (table->num_buckets + 64 * HT_SPARSE_GROUP - 1) /
+                (64 * HT_SPARSE_GROUP);
+    stats->bucket_array_bytes =
+      table->num_touched_groups * HT_SPARSE_GROUP * sizeof(LinkedList) +
+      num_words * sizeof(uint64_t);
+    stats->overhead_bytes = 0;
+    record_overhead = 0;
+  } else {
+    // an arena-backed table's record comes from malloc, not the arena.
+    record_overhead = (table->arena != NULL) ?
+      AllocatorOverhead(&kMallocAllocator, sizeof(HashTableRecord)) :
+      LLAllocatorOverhead(table->allocator, sizeof(HashTableRecord));
+    stats->bucket_array_bytes = array_bytes;
+    stats->overhead_bytes =
+      record_overhead + LLAllocatorOverhead(table->allocator, array_bytes);
+  }
+  stats->overhead_bytes +=
+    table->num_chains *
+    LLAllocatorOverhead(table->allocator, sizeof(LinkedListHead)) +
+    table->num_elements *
+    (LLAllocatorOverhead(table->allocator, sizeof(LinkedListNode)) +
+     LLAllocatorOverhead(table->allocator, sizeof(HTKeyValue)));
+
+  // everything but the record comes out of an arena-backed table's
+  // arena, which has also handed out whatever the table has since let
+  // go of, and values from HashTableArenaAlloc.
+  stats->arena_extra_bytes = 0;
+  if (table->arena != NULL) {
+    in_arena = stats->bucket_array_bytes + stats->chain_bytes +
+               stats->node_bytes + stats->entry_bytes +
+               stats->overhead_bytes - record_overhead;
+    if (ArenaBytesUsed(table->arena) > in_arena)
+      stats->arena_extra_bytes = ArenaBytesUsed(table->arena) - in_arena;
+  }
+  stats->total_bytes = stats->record_bytes + stats->bucket_array_bytes +
+                       stats->chain_bytes + stats->node_bytes +
+                       stats->entry_bytes + stats->overhead_bytes +
+                       stats->arena_extra_bytes;
+  stats->num_buckets = table->num_buckets;
+  stats->num_empty_buckets = table->num_buckets - table->num_used_buckets;
+}
+
+void HashTableClear(HashTable table, ValueFreeFnPtr value_free_function) {
+  uint64_t i;
+
+  Assert333(table != NULL);
+  Assert333(table->log == NULL);
+
+  if (table->arena != NULL) {
+    // arena-backed: reset the arena and rebuild empty chains in it.
+    // The arena kept every chunk the old bucket array and chains were
+    // carved from, so rebuilding them reuses those chunks.
+    if (value_free_function != NULL)
+      FreeValues(table, value_free_function);
+    ResetArena(table->arena);
+    table->num_elements = 0;
+    Assert333(AllocateBuckets(table));
+    HT_STATS(table, HTStatsRecountChains(table));
+    return;
+  }
+
+  // pop every element off of every chain, keeping the chains.
+  Assert333(value_free_function != NULL);
+  for (i = NextBucket(table, 0); i < table->num_buckets;
+       i = NextBucket(table, i + 1)) {
+    HTKeyValue *nextKV;
+
+    if (table->buckets[i] == NULL)
+      continue;
+    while (PopLinkedList(table->buckets[i], (void **) &nextKV)) {
+      value_free_function(nextKV->value);
+      HTDealloc(table, nextKV, sizeof(HTKeyValue));
+    }
+  }
+  table->num_elements = 0;
+  table->num_used_buckets = 0;
+  HT_STATS(table, HTStatsRecountChains(table));
+}
+
+static void FreeValues(HashTable table, ValueFreeFnPtr value_free_function) {
+  LinkedListNodePtr node;
+  uint64_t i;
+
+  for (i = NextBucket(table, 0); i < table->num_buckets;
+       i = NextBucket(table, i + 1)) {
+    if (table->buckets[i] == NULL)
+      continue;
+    for (node = table->buckets[i]->head; node != NULL; node = node->next) {
+      value_free_function(((HTKeyValue *) node->payload)->value);
+    }
+  }
 }
 
 uint64_t NumElementsInHashTable(HashTable table) {
@@ -157,18 +497,40 @@ uint64_t HashKeyToBucketNum(HashTable ht, uint64_t key) {
 }
 
 int InsertHashTable(HashTable table, HTKeyValue newkeyvalue, HTKeyValue *oldkeyvalue) {
+  FR_BEGIN(start);
+  int result = InsertEntry(table, newkeyvalue, oldkeyvalue);
+
+  if (result != 0)
+    TM_COUNT(TM_HT_INSERTS);
+  FR_END(start, FR_HT_INSERT, newkeyvalue.key,
+         ChainLength(GetChain(table, newkeyvalue.key)));
+  return result;
+}
+
+static int InsertEntry(HashTable table, HTKeyValue newkeyvalue,
+                       HTKeyValue *oldkeyvalue) {
   LinkedList insertchain;
 
   Assert333(table != NULL);
 	Assert333(oldkeyvalue != NULL);
+
+	// if the table is logged, nothing may go in the log unless the insert
+	// goes through, so everything that can fail is done before the insert
+	// is logged, and the one thing that can't be (linking a new entry into
+	// its chain, which allocates a node) is undone if logging fails.
   ResizeHashtable(table);
 
 	// calculate which bucket we're inserting into,
 	// grab its linked list chain
 	GetInsertChain(table, newkeyvalue.key, &insertchain);
+	if (insertchain == NULL) {
+		// couldn't allocate the chain; return failure
+		return 0;
+	}
 
 	// prep the new element to insert to the chain
-	HTKeyValuePtr payload_ptr = (HTKeyValuePtr) malloc(sizeof(HTKeyValue));
+	HTKeyValuePtr payload_ptr =
+		(HTKeyValuePtr) HTAlloc(table, sizeof(HTKeyValue));
 	if (payload_ptr == NULL) {
 		// allocation failed; return failure
 		return 0;
@@ -180,13 +542,15 @@ int InsertHashTable(HashTable table, HTKeyValue newkeyvalue, HTKeyValue *oldkeyv
 
 	if (NumElementsInLinkedList(insertchain) == 0) {
 		// empty chain; no need to search for recurring key
-		if (AppendLinkedList(insertchain, (void *) payload_ptr)) {
+		if (AppendNewEntry(table, insertchain, payload_ptr)) {
 			// append success; increment num_elements and return success
 			table->num_elements++;
+			table->num_used_buckets++;
+			HT_STATS(table, HTStatsNoteChainGrew(table->stats, 1));
 			return 1;
 		} else {
 			// append failed; prevent memory leak and return failure
-			free(payload_ptr);
+			HTDealloc(table, payload_ptr, sizeof(HTKeyValue));
 			payload_ptr = NULL;
 			return 0;
 		}
@@ -197,138 +561,323 @@ int InsertHashTable(HashTable table, HTKeyValue newkeyvalue, HTKeyValue *oldkeyv
 
 		if (result == -1) {
 			// error while looking up key; prevent memory leak and return failure
-			free(payload_ptr);
+			HTDealloc(table, payload_ptr, sizeof(HTKeyValue));
 			payload_ptr = NULL;
 			return 0;
 		} else if (result == 0) {
 			// no existing key/value with that key; append new keyvalue to list
-			if (AppendLinkedList(insertchain, (void *) payload_ptr)) {
+			if (AppendNewEntry(table, insertchain, payload_ptr)) {
 				// append success; increment num_elements and return success
 				table->num_elements++;
+				HT_STATS(table, HTStatsNoteChainGrew(table->stats,
+				                  NumElementsInLinkedList(insertchain)));
 				return 1;
 			} else {
 				// append failed; return failure and prevent memory leak
-				free(payload_ptr);
+				HTDealloc(table, payload_ptr, sizeof(HTKeyValue));
 				payload_ptr = NULL;
 				return 0;
 			}
 		} else {
-			// found existing key/value with that key; copy old keyvalue
-			// and replace with new keyvalue
+			// found existing key/value with that key.  We won't need the
+			// new entry; and replacing the value can't fail, so log it now.
+			HTDealloc(table, payload_ptr, sizeof(HTKeyValue));
+			payload_ptr = NULL;
+			if (table->log != NULL &&
+			    !HTLogAppendInsert(table->log, newkeyvalue)) {
+				return 0;
+			}
+
+			// copy old keyvalue and replace with new keyvalue, and tell
+			// the caller that an existing keyvalue has been replaced
 			*oldkeyvalue = *recurringkeyvalue;
 			recurringkeyvalue->value = (void *) newkeyvalue.value;
-			
-			// prevent memory leak and tell the caller that an existing
-			// keyvalue has been replaced
-			free(payload_ptr);
-			payload_ptr = NULL;
 			return 2;
 		}
 	}
 }
 
 int LookupHashTable(HashTable table, uint64_t key, HTKeyValue *keyvalue) {
+  FR_BEGIN(start);
+  int result = LookupEntry(table, key, keyvalue);
+
+  FR_END(start, FR_HT_LOOKUP, key, ChainLength(GetChain(table, key)));
+  return result;
+}
+
+static bool AppendNewEntry(HashTable table, LinkedList chain,
+                           HTKeyValuePtr entry) {
+  void *unlinked;
+
+  if (!AppendLinkedList(chain, (void *) entry))
+    return false;
+  if (table->log != NULL && !HTLogAppendInsert(table->log, *entry)) {
+    // the entry went on the end of the chain, so that's where it comes
+    // back off.
+    SliceLinkedList(chain, &unlinked);
+    Assert333(unlinked == entry);
+    return false;
+  }
+  return true;
+}
+
+static int LookupEntry(HashTable table, uint64_t key, HTKeyValue *keyvalue) {
   LinkedList insertchain;
 	HTKeyValue *resultkeyvalue;
   Assert333(table != NULL);
 	Assert333(keyvalue != NULL);
 
-	// calculate which bucket we're inserting into,
+	// calculate which bucket we're looking in,
 	// grab its linked list chain
-	GetInsertChain(table, key, &insertchain);
+	insertchain = GetChain(table, key);
 
-	if (NumElementsInLinkedList(insertchain) == 0) {
+	if (ChainLength(insertchain) == 0) {
 		// empty chain; return not found
+		HT_STATS(table, HTStatsNoteLookup(table->stats, false, 0));
+		TM_COUNT(TM_HT_LOOKUP_MISSES);
 		return 0;
 	} else {
 		// chain has >= 1 elements; search the chain
-		int result = LookupKey(insertchain, key, &resultkeyvalue, false);
+		int result;
+#ifndef HT_NO_STATS
+		if (table->stats != NULL) {
+			uint64_t probes;
+			result = LookupKeyCountingProbes(insertchain, key, &resultkeyvalue,
+			                                 &probes);
+			HTStatsNoteLookup(table->stats, result == 1, probes);
+		} else {
+			result = LookupKey(insertchain, key, &resultkeyvalue, false);
+		}
+#else
+		result = LookupKey(insertchain, key, &resultkeyvalue, false);
+#endif
 		// copy the payload if found
 		if (result == 1)
 			*keyvalue = *resultkeyvalue;
+		TM_COUNT(result == 1 ? TM_HT_LOOKUP_HITS : TM_HT_LOOKUP_MISSES);
 		return result;
 	}
 }
 
 int RemoveFromHashTable(HashTable table, uint64_t key, HTKeyValue *keyvalue) {
+  FR_BEGIN(start);
+  int result = RemoveEntry(table, key, keyvalue);
+
+  FR_END(start, FR_HT_REMOVE, key, ChainLength(GetChain(table, key)));
+  return result;
+}
+
+static int RemoveEntry(HashTable table, uint64_t key, HTKeyValue *keyvalue) {
   LinkedList insertchain;
 	HTKeyValue *resultkeyvalue;
-	int result;
+	LLIterSt iterst;
   Assert333(table != NULL);
 	Assert333(keyvalue != NULL);
 
-	// calculate which bucket we're inserting into,
+	// calculate which bucket we're removing from,
 	// grab its linked list chain
-	GetInsertChain(table, key, &insertchain);
+	insertchain = GetChain(table, key);
 
-	if (NumElementsInLinkedList(insertchain) == 0) {
+	if (ChainLength(insertchain) == 0 ||
+	    !FindKey(insertchain, key, &iterst)) {
 		// nothing to remove; return not found
 		return 0;
-	} else {
-		// chain has >= elements; search the chain and remove
-		result = LookupKey(insertchain, key, &resultkeyvalue, true);
-		if (result == 1) {
-			// copy/free the payload if remove was successful
-			*keyvalue = *resultkeyvalue;
-			free(resultkeyvalue);
-			resultkeyvalue = NULL;
-			table->num_elements--;
-		}
-		return result;
 	}
+
+	// if the table is logged, log the removal before we touch the chain.
+	// The iterator stays on the key's node, so the chain is only walked
+	// once either way.
+	if (table->log != NULL && !HTLogAppendRemove(table->log, key))
+		return -1;
+
+	// unlink the node, and copy/free the payload
+	LLIteratorGetPayload(&iterst, (void **) &resultkeyvalue);
+	LLIteratorDelete(&iterst, NullFree);
+	*keyvalue = *resultkeyvalue;
+	HTDealloc(table, resultkeyvalue, sizeof(HTKeyValue));
+	resultkeyvalue = NULL;
+	table->num_elements--;
+	if (NumElementsInLinkedList(insertchain) == 0)
+		table->num_used_buckets--;
+	HT_STATS(table, HTStatsNoteChainShrank(table->stats,
+	                  NumElementsInLinkedList(insertchain)));
+	TM_COUNT(TM_HT_REMOVES);
+	return 1;
 }
 
 static void GetInsertChain(HashTable table, uint64_t key, LinkedList *insertchain) {
-	uint32_t insertbucket;
+	uint64_t insertbucket, group;
 
   // calculate which bucket we're inserting into,
   // grab and return its linked list chain through
 	// the parameter
 	insertbucket = HashKeyToBucketNum(table, key);
 	*insertchain = table->buckets[insertbucket];
-	Assert333(*insertchain != NULL);
+	if (*insertchain == NULL) {
+		// an empty bucket of a sparse table; give it a chain
+		Assert333(HTIsSparse(table));
+		*insertchain = AllocateLinkedListWithAllocator(table->allocator,
+		                                               table->alloc_ctx);
+		if (*insertchain == NULL)
+			return;
+		table->buckets[insertbucket] = *insertchain;
+		table->num_chains++;
+		group = insertbucket / HT_SPARSE_GROUP;
+		if ((table->touched[group / 64] & (1ULL << (group % 64))) == 0) {
+			table->touched[group / 64] |= 1ULL << (group % 64);
+			table->num_touched_groups++;
+		}
+	}
 }
 
-int LookupKey(LinkedList chain, uint64_t key, HTKeyValue **resultkeyvalue, bool removeonfind) {
-	// make an iterator pointed to the head of the list
-	LLIter iter = LLMakeIterator(chain, 0);
-	if (iter == NULL) {
-		// failed to create iterator; return failure
-		return -1;
-	}
+void HTStatsRecountChains(HashTable table) {
+  HTStats *stats = table->stats;
+  uint64_t i, length, num_used = 0;
+  int s;
+
+  Assert333(stats != NULL);
+  for (s = 0; s < HT_STATS_SLOTS; s++)
+    stats->chain_hist[s] = 0;
+  for (i = NextBucket(table, 0); i < table->num_buckets;
+       i = NextBucket(table, i + 1)) {
+    length = ChainLength(table->buckets[i]);
+    if (length == 0)
+      continue;
+    stats->chain_hist[HT_STATS_SLOT(length)]++;
+    if (length > stats->max_chain_length)
+      stats->max_chain_length = length;
+    num_used++;
+  }
+  stats->chain_hist[0] = table->num_buckets - num_used;
+}
 
-	// iterate through the bucket to find the element with the specified key
-	LLIteratorGetPayload(iter, (void **) resultkeyvalue);
-	while ((*resultkeyvalue)->key != key) {
-		if (!LLIteratorNext(iter)) {
-			// searched through all of the bucket; return not found
-			LLIteratorFree(iter);
-			iter = NULL;
-			return 0;
-		} else {
-			LLIteratorGetPayload(iter, (void **) resultkeyvalue);
-		}
+#ifndef HT_NO_STATS
+static int LookupKeyCountingProbes(LinkedList chain, uint64_t key,
+                                   HTKeyValue **resultkeyvalue,
+                                   uint64_t *probes) {
+  LinkedListNodePtr node;
+
+  *probes = 0;
+  for (node = chain->head; node != NULL; node = node->next) {
+    (*probes)++;
+    if (((HTKeyValue *) node->payload)->key == key) {
+      *resultkeyvalue = (HTKeyValue *) node->payload;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif  // HT_NO_STATS
+
+static LinkedList GetChain(HashTable table, uint64_t key) {
+	return table->buckets[HashKeyToBucketNum(table, key)];
+}
+
+static uint64_t ChainLength(LinkedList chain) {
+	return (chain == NULL) ? 0 : NumElementsInLinkedList(chain);
+}
+
+static uint64_t NextBucket(HashTable table, uint64_t i) {
+  uint64_t group, word, num_words, bits, first;
+
+  if (!HTIsSparse(table) || i >= table->num_buckets)
+    return i;
+
+  // find the first touched group at or after i's.
+  group = i / HT_SPARSE_GROUP;
+  word = group / 64;
+  num_words = (table->num_buckets + 64 * HT_SPARSE_GROUP - 1) /
+              (64 * HT_SPARSE_GROUP);
+  bits = table->touched[word] & (~0ULL << (group % 64));
+  while (bits == 0) {
+    if (++word >= num_words)
+      return table->num_buckets;
+    bits = table->touched[word];
+  }
+  first = (word * 64 + __builtin_ctzll(bits)) * HT_SPARSE_GROUP;
+  return (first > i) ? first : i;
+}
+
+int LookupKey(LinkedList chain, uint64_t key, HTKeyValue **resultkeyvalue, bool removeonfind) {
+	// the iterator lives on the stack, so that lookups don't allocate.
+	LLIterSt iterst;
+	if (!FindKey(chain, key, &iterst)) {
+		// searched through all of the bucket; return not found
+		return 0;
 	}
+	LLIteratorGetPayload(&iterst, (void **) resultkeyvalue);
 
 	// optionally remove the found element
 	if (removeonfind) {
-		LLIteratorDelete(iter, NullFree);
+		LLIteratorDelete(&iterst, NullFree);
 	}
 
 	// return found
-	LLIteratorFree(iter);
-	iter = NULL;
 	return 1;
 }
 
+static HTIterRecord *AllocateIterRecord(HashTable table) {
+  HTIterRecord *iter;
+
+  if (table->arena != NULL) {
+    TM_COUNT(TM_ALLOCATIONS);
+    iter = (HTIterRecord *) malloc(sizeof(HTIterRecord));
+  } else {
+    iter = (HTIterRecord *) HTAlloc(table, sizeof(HTIterRecord));
+  }
+  return iter;
+}
+
+static void FreeIterRecord(HTIterRecord *iter) {
+  if (iter->ht->arena != NULL)
+    free(iter);
+  else
+    HTDealloc(iter->ht, iter, sizeof(HTIterRecord));
+}
+
+static void StartBucket(HTIterRecord *iter, uint64_t i) {
+  Assert333(ChainLength(iter->ht->buckets[i]) > 0);
+  iter->bucket_itst.list = iter->ht->buckets[i];
+  iter->bucket_itst.node = iter->ht->buckets[i]->head;
+  iter->bucket_it = &iter->bucket_itst;
+}
+
+static bool FindKey(LinkedList chain, uint64_t key, LLIter iter) {
+	HTKeyValue *keyvalue;
+
+	if (NumElementsInLinkedList(chain) == 0) {
+		// nothing to look through
+		return false;
+	}
+	iter->list = chain;
+	iter->node = chain->head;
+
+	// iterate through the bucket to find the element with the specified key
+	LLIteratorGetPayload(iter, (void **) &keyvalue);
+	while (keyvalue->key != key) {
+		if (!LLIteratorNext(iter)) {
+			return false;
+		}
+		LLIteratorGetPayload(iter, (void **) &keyvalue);
+	}
+	return true;
+}
+
 HTIter HashTableMakeIterator(HashTable table) {
   HTIterRecord *iter;
-  uint32_t      i;
+  uint64_t      i;
 
   Assert333(table != NULL);  // be defensive
 
-  // malloc the iterator
-  iter = (HTIterRecord *) malloc(sizeof(HTIterRecord));
+  // allocate the iterator
+  iter = AllocateIterRecord(table);
   if (iter == NULL) {
     return NULL;
   }
@@ -346,43 +895,33 @@ HTIter HashTableMakeIterator(HashTable table) {
   // table, so find the first element and point the iterator at it.
   iter->is_valid = true;
   iter->ht = table;
-  for (i = 0; i < table->num_buckets; i++) {
-    if (NumElementsInLinkedList(table->buckets[i]) > 0) {
+  for (i = NextBucket(table, 0); i < table->num_buckets;
+       i = NextBucket(table, i + 1)) {
+    if (ChainLength(table->buckets[i]) > 0) {
       iter->bucket_num = i;
       break;
     }
   }
   Assert333(i < table->num_buckets);  // make sure we found it.
-  iter->bucket_it = LLMakeIterator(table->buckets[iter->bucket_num], 0UL);
-  if (iter->bucket_it == NULL) {
-    // out of memory!
-    free(iter);
-    return NULL;
-  }
+  StartBucket(iter, iter->bucket_num);
   return iter;
 }
 
 void HTIteratorFree(HTIter iter) {
   Assert333(iter != NULL);
-  if (iter->bucket_it != NULL) {
-    LLIteratorFree(iter->bucket_it);
-    iter->bucket_it = NULL;
-  }
+  iter->bucket_it = NULL;
   iter->is_valid = false;
-  free(iter);
+  FreeIterRecord(iter);
 }
 
 int HTIteratorNext(HTIter iter) {
   Assert333(iter != NULL);
-	uint32_t i;
+	uint64_t i;
 
 	// check that the table is not empty/iterator is not past end
 	if (HTIteratorPastEnd(iter) == 1) {
 		iter->is_valid = false;
-		if (iter->bucket_it != NULL) {
-			LLIteratorFree(iter->bucket_it);
-    	iter->bucket_it = NULL;
-		}
+		iter->bucket_it = NULL;
 		return 0;
 	}
 
@@ -393,16 +932,15 @@ int HTIteratorNext(HTIter iter) {
 	}	
 
 	// iterator points to the tail of the current bucket
-  for (i = iter->bucket_num + 1; i < iter->ht->num_buckets; i++) {
-    if (NumElementsInLinkedList(iter->ht->buckets[i]) > 0) {
+  for (i = NextBucket(iter->ht, iter->bucket_num + 1);
+       i < iter->ht->num_buckets;
+       i = NextBucket(iter->ht, i + 1)) {
+    if (ChainLength(iter->ht->buckets[i]) > 0) {
       iter->bucket_num = i;
       break;
     }
 	}
 
-	// the old iterator must be freed
-	LLIteratorFree(iter->bucket_it);
-
 	if (i >= iter->ht->num_buckets) {
 		// degenerate case; the iterator has advanced past of the hash table; set invalid
 		iter->is_valid = false;
@@ -411,12 +949,7 @@ int HTIteratorNext(HTIter iter) {
 	} else {
 		// general case; the iterator moves onto the next bucket
 		iter->bucket_num = i;
-	  iter->bucket_it = LLMakeIterator(iter->ht->buckets[iter->bucket_num], 0UL);
-  	if (iter->bucket_it == NULL) {
-    	// out of memory!
-			iter->is_valid = false;
-    	return 0;
- 		}
+		StartBucket(iter, i);
 
 		// return success
   	return 1;
@@ -481,15 +1014,26 @@ int HTIteratorDelete(HTIter iter, HTKeyValue *keyvalue) {
 }
 
 static void ResizeHashtable(HashTable ht) {
-  // Resize if the load factor is > 3.
-  if (ht->num_elements < 3 * ht->num_buckets)
+  // Resize if the load factor is > 3.  (Dividing, rather than
+  // multiplying num_buckets, can't overflow.)
+  if (ht->num_elements / 3 < ht->num_buckets)
     return;
+  if (ht->num_buckets > UINT64_MAX / 9)
+    return;
+  FR_NOTE_RESIZE();
+#ifndef HT_NO_STATS
+  uint64_t start = (ht->stats != NULL) ? NowNs() : 0;
+#endif
 
   // This is the resize case.  Allocate a new hashtable,
   // iterate over the old hashtable, do the surgery on
   // the old hashtable record and free up the new hashtable
   // record.
-  HashTable newht = AllocateHashTable(ht->num_buckets * 9);
+  HashTable newht =
+    HTIsSparse(ht) ? AllocateSparseHashTable(ht->num_buckets * 9) :
+                     AllocateHashTableWithAllocator(ht->num_buckets * 9,
+                                                    ht->allocator,
+                                                    ht->alloc_ctx);
 
   // Give up if out of memory.
   if (newht == NULL)
@@ -508,7 +1052,7 @@ static void ResizeHashtable(HashTable ht) {
     HTKeyValue item, dummy;
 
     Assert333(HTIteratorGet(it, &item) == 1);
-    if (InsertHashTable(newht, item, &dummy) != 1) {
+    if (InsertEntry(newht, item, &dummy) != 1) {
       // failure, free up everything, return.
       HTIteratorFree(it);
       FreeHashTable(newht, &NullFree);
@@ -528,8 +1072,25 @@ static void ResizeHashtable(HashTable ht) {
     tmp = *ht;
     *ht = *newht;
     *newht = tmp;
-    FreeHashTable(newht, &NullFree);
+    ht->log = newht->log;  // the log stays with the table
+    newht->log = NULL;
+    ht->arena = newht->arena;  // and so does the arena
+    newht->arena = NULL;
+    ht->stats = newht->stats;  // and so do the statistics
+    newht->stats = NULL;
+    if (ht->arena == NULL) {
+      FreeHashTable(newht, &NullFree);
+    }
+    // otherwise the old chains and newht's record all came from the
+    // arena, and are released with it.
   }
 
+  TM_COUNT(TM_HT_RESIZES);
+#ifndef HT_NO_STATS
+  if (ht->stats != NULL) {
+    HTStatsRecountChains(ht);
+    HTStatsNoteResize(ht->stats, NowNs() - start);
+  }
+#endif
   return;
 }
@@ -24,6 +24,8 @@
 #include <stdbool.h>    // for bool, true, false
 #include <stdint.h>     // so we can use uint64_t, etc.
 
+#include "./Allocator.h"  // for Allocator
+
 // A HashTable is a simple chained hash table with a static number of buckets.
 // We provide the interface; your job is to provide the implementation.
 //
@@ -53,7 +55,70 @@ typedef void(*ValueFreeFnPtr)(void *value);
 //   hashtable by 3, so that post-resize load factor is 1/3.
 //
 // Returns NULL on error, non-NULL on success.
-HashTable AllocateHashTable(uint32_t num_buckets);
+HashTable AllocateHashTable(uint64_t num_buckets);
+
+// Allocate and return a new HashTable whose memory -- the table record,
+// its bucket array and chains, its key/value records and its iterators
+// -- all comes from the given allocator rather than from malloc.  The
+// table keeps using the allocator when it resizes.
+//
+// Arguments:
+//
+// - num_buckets: as for AllocateHashTable.
+//
+// - allocator: the allocator's vtable; see Allocator.h.  It must stay
+//   valid for as long as the table does.
+//
+// - context: the context pointer to pass to the allocator's functions.
+//
+// Returns NULL on error, non-NULL on success.
+HashTable AllocateHashTableWithAllocator(uint64_t num_buckets,
+                                         const Allocator *allocator,
+                                         void *context);
+
+// Allocate and return a new arena-backed HashTable.  All of the table's
+// internal memory comes from an arena that the table owns (see
+// Allocator.h), and values can come from it too, via
+// HashTableArenaAlloc.  Freeing or clearing the table releases the
+// whole arena at once, rather than entry by entry.
+//
+// Removing entries from an arena-backed table doesn't free their
+// memory, and neither does resizing it; that all waits until the table
+// is freed or cleared.  So arena-backed tables suit short-lived scratch
+// tables that are built, used and thrown away.  Iterating a table takes
+// nothing from its arena, so a long-lived table can be iterated over
+// as often as you like.
+//
+// Arguments:
+//
+// - num_buckets: as for AllocateHashTable.
+//
+// - chunk_bytes: how much memory the arena grabs at a time.
+//
+// Returns NULL on error, non-NULL on success.
+HashTable AllocateHashTableInArena(uint64_t num_buckets, size_t chunk_bytes);
+
+// Allocate and return a new HashTable sized up front for num_elements
+// entries, so that it doesn't resize until it holds more than that.
+//
+// The table's bucket array is reserved from the OS without being
+// committed, and each bucket's chain is only allocated once a key lands
+// in it, so the memory the table uses grows with the entries inserted
+// rather than with its number of buckets.  That makes this the way to
+// build tables with billions of buckets.  The table's memory comes from
+// malloc (and mmap, for the bucket array).
+//
+// Arguments:
+//
+// - num_elements: the number of entries to size the table for.
+//
+// Returns NULL on error, non-NULL on success.
+HashTable AllocateHashTableSized(uint64_t num_elements);
+
+// Allocate size bytes from an arena-backed table's arena, e.g. for a
+// value to store in the table.  The memory is released when the table
+// is freed or cleared.  Returns NULL if out of memory.
+void *HashTableArenaAlloc(HashTable table, size_t size);
 
 // Free a HashTable.
 //
@@ -63,9 +128,26 @@ HashTable AllocateHashTable(uint32_t num_buckets);
 //   after this function returns.
 //
 // - value_free_function:  this argument is a pointer to a value
-//   freeing function; see above for details.
+//   freeing function; see above for details.  For an arena-backed
+//   table whose values need no freeing (say, they came from
+//   HashTableArenaAlloc), pass NULL: the table is then released in
+//   O(1), without visiting its entries.
 void FreeHashTable(HashTable table, ValueFreeFnPtr value_free_function);
 
+// Remove every entry from a HashTable, leaving it empty but ready for
+// reuse.  The table keeps its buckets, and an arena-backed table keeps
+// its arena's memory for the entries to come, instead of giving it back
+// to the OS.
+//
+// Arguments:
+//
+// - table: the HashTable to clear.
+//
+// - value_free_function: called on each value, as for FreeHashTable.
+//   As there, NULL is allowed for arena-backed tables, and skips
+//   visiting the entries.
+void HashTableClear(HashTable table, ValueFreeFnPtr value_free_function);
+
 // Figure out the number of elements in the hash table.
 //
 // Arguments:
@@ -77,6 +159,41 @@ void FreeHashTable(HashTable table, ValueFreeFnPtr value_free_function);
 // - table size (>=0); note that this is an unsigned 64-bit integer.
 uint64_t NumElementsInHashTable(HashTable table);
 
+// The memory a HashTable uses for its own bookkeeping, not counting the
+// values it points to.
+typedef struct {
+  uint64_t record_bytes;        // the table record
+  uint64_t bucket_array_bytes;  // the bucket array (for a sized table,
+                                // just the parts of it in use)
+  uint64_t chain_bytes;         // the buckets' chain list records
+  uint64_t node_bytes;          // the chains' nodes
+  uint64_t entry_bytes;         // the key/value records
+  uint64_t overhead_bytes;      // estimated allocator overhead on the
+                                // above
+  uint64_t arena_extra_bytes;   // for an arena-backed table, the rest of
+                                // what its arena has handed out; else 0
+  uint64_t total_bytes;         // the sum of the above
+  uint64_t num_buckets;         // # of buckets
+  uint64_t num_empty_buckets;   // # of buckets with nothing in them
+} HTMemoryStats;
+
+// Report the memory a HashTable is using.  The table keeps the counts
+// this needs as it goes, so this takes constant time.
+//
+// An arena-backed table doesn't give memory back as entries are
+// removed or the table resizes (see AllocateHashTableInArena).  For
+// such a table, arena_extra_bytes counts that stranded memory, along
+// with any values allocated with HashTableArenaAlloc, so that
+// total_bytes is everything the table's arena has handed out, plus
+// the table record.
+//
+// Arguments:
+//
+// - table: the table to query
+//
+// - stats: the numbers are returned through this parameter
+void HashTableMemoryStats(HashTable table, HTMemoryStats *stats);
+
 // HashTables store key/value pairs.  We'll define a key to be an
 // unsigned 64-bit integer; it's up to the customer to figure out how
 // to produce an appropriate hash key, but below we provide an
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Assert333.h"
+#include "HashTable.h"
+#include "HashTableImage.h"
+#include "HashTableImage_priv.h"
+
+// We write images through a large stdio buffer so that the writes
+// that reach the kernel are big and sequential.
+#define HT_IMAGE_WRITE_BUFSIZE  (1 << 20)
+
+// Round a blob length up to the 8-byte alignment we keep blobs at.
+#define HT_IMAGE_ALIGN(len)  (((len) + 7) & ~((uint64_t) 7))
+
+// Internal helper to write len bytes to f, followed by enough zero
+// bytes to pad it out to HT_IMAGE_ALIGN(len).  Returns false on error.
+static bool WritePadded(FILE *f, const void *bytes, uint64_t len);
+
+// Internal helper to check that an image header is self-consistent and
+// describes a file of exactly size bytes.
+static bool ValidateHeader(const HTImageHeader *header, size_t size);
+
+bool WriteHashTableImage(HashTable table, const char *path,
+                         ValueBytesFnPtr value_bytes_function) {
+  HTImageHeader header;
+  HTImageEntry  entry;
+  HTKeyValue   *sorted = NULL, kv;
+  uint64_t     *index = NULL, i, b, len, blob_size = 0;
+  const void   *bytes;
+  HTIter        iter;
+  FILE         *f = NULL;
+  char         *tmppath = NULL;
+  bool          ok = false;
+
+  Assert333(table != NULL);
+  Assert333(path != NULL);
+  Assert333(value_bytes_function != NULL);
+
+  // size the bucket index at one bucket per element, so the average
+  // lookup scans a single entry.
+  memset(&header, 0, sizeof(header));
+  header.magic = HT_IMAGE_MAGIC;
+  header.version = HT_IMAGE_VERSION;
+  header.num_elements = NumElementsInHashTable(table);
+  header.num_buckets = (header.num_elements > 0) ? header.num_elements : 1;
+  header.index_offset = sizeof(HTImageHeader);
+  header.entry_offset =
+    header.index_offset + (header.num_buckets + 1) * sizeof(uint64_t);
+  header.blob_offset =
+    header.entry_offset + header.num_elements * sizeof(HTImageEntry);
+
+  // counting-sort the key/values by image bucket: first count the
+  // entries in each bucket, then turn the counts into start positions.
+  index = (uint64_t *) calloc(header.num_buckets + 1, sizeof(uint64_t));
+  sorted = (HTKeyValue *) malloc(
+      (header.num_elements > 0 ? header.num_elements : 1) *
+      sizeof(HTKeyValue));
+  if (index == NULL || sorted == NULL)
+    goto cleanup;
+
+  for (i = 0; i < 2; i++) {
+    iter = HashTableMakeIterator(table);
+    if (iter == NULL)
+      goto cleanup;
+    while (!HTIteratorPastEnd(iter)) {
+      Assert333(HTIteratorGet(iter, &kv) == 1);
+      b = HTImageKeyToBucket(kv.key, header.num_buckets);
+      if (i == 0) {
+        index[b + 1]++;
+      } else {
+        sorted[index[b]++] = kv;
+      }
+      HTIteratorNext(iter);
+    }
+    HTIteratorFree(iter);
+
+    if (i == 0) {
+      for (b = 1; b <= header.num_buckets; b++)
+        index[b] += index[b - 1];
+    }
+  }
+  // placing the entries advanced each bucket's start to the next
+  // bucket's start; shift them back down by one bucket.
+  for (b = header.num_buckets; b > 0; b--)
+    index[b] = index[b - 1];
+  index[0] = 0;
+
+  // write to a temporary file and rename it into place at the end.
+  tmppath = (char *) malloc(strlen(path) + 5);
+  if (tmppath == NULL)
+    goto cleanup;
+  snprintf(tmppath, strlen(path) + 5, "%s.tmp", path);
+  f = fopen(tmppath, "wb");
+  if (f == NULL)
+    goto cleanup;
+  setvbuf(f, NULL, _IOFBF, HT_IMAGE_WRITE_BUFSIZE);
+
+  // the header is rewritten once we know the size of the blob region.
+  if (fwrite(&header, sizeof(header), 1, f) != 1)
+    goto cleanup;
+  if (fwrite(index, sizeof(uint64_t), header.num_buckets + 1, f) !=
+      header.num_buckets + 1)
+    goto cleanup;
+  for (i = 0; i < header.num_elements; i++) {
+    value_bytes_function(sorted[i].value, &len);
+    entry.key = sorted[i].key;
+    entry.value_offset = blob_size;
+    entry.value_len = len;
+    if (fwrite(&entry, sizeof(entry), 1, f) != 1)
+      goto cleanup;
+    blob_size += HT_IMAGE_ALIGN(len);
+  }
+  for (i = 0; i < header.num_elements; i++) {
+    bytes = value_bytes_function(sorted[i].value, &len);
+    if (!WritePadded(f, bytes, len))
+      goto cleanup;
+  }
+
+  header.file_size = header.blob_offset + blob_size;
+  if (fseek(f, 0, SEEK_SET) != 0 ||
+      fwrite(&header, sizeof(header), 1, f) != 1 ||
+      fflush(f) != 0 ||
+      fsync(fileno(f)) != 0)
+    goto cleanup;
+  ok = true;
+
+ cleanup:
+  if (f != NULL) {
+    if (fclose(f) != 0)
+      ok = false;
+    if (ok) {
+      ok = (rename(tmppath, path) == 0);
+    }
+    if (!ok) {
+      unlink(tmppath);
+    }
+  }
+  free(tmppath);
+  free(sorted);
+  free(index);
+  return ok;
+}
+
+HTImage OpenHashTableImage(const char *path) {
+  HTImage image;
+  struct stat st;
+  void *base;
+  int fd;
+
+  Assert333(path != NULL);
+
+  fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(HTImageHeader)) {
+    close(fd);
+    return NULL;
+  }
+
+  // a shared, read-only mapping: the pages come straight from the page
+  // cache, and are shared with every other process mapping the file.
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);  // the mapping keeps its own reference to the file
+  if (base == MAP_FAILED)
+    return NULL;
+  if (!ValidateHeader((const HTImageHeader *) base, st.st_size)) {
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  image = (HTImage) malloc(sizeof(HTImageRecord));
+  if (image == NULL) {
+    munmap(base, st.st_size);
+    return NULL;
+  }
+  image->base = (const unsigned char *) base;
+  image->size = st.st_size;
+  image->header = (const HTImageHeader *) base;
+  image->index =
+    (const uint64_t *) (image->base + image->header->index_offset);
+  image->entries =
+    (const HTImageEntry *) (image->base + image->header->entry_offset);
+  image->blobs = image->base + image->header->blob_offset;
+  return image;
+}
+
+void CloseHashTableImage(HTImage image) {
+  Assert333(image != NULL);
+  munmap((void *) image->base, image->size);
+  free(image);
+}
+
+uint64_t NumElementsInHashTableImage(HTImage image) {
+  Assert333(image != NULL);
+  return image->header->num_elements;
+}
+
+int LookupHashTableImage(HTImage image,
+                         uint64_t key,
+                         const void **value,
+                         uint64_t *len) {
+  const HTImageEntry *entry;
+  uint64_t b, i, end, blob_size;
+
+  Assert333(image != NULL);
+  Assert333(value != NULL);
+  Assert333(len != NULL);
+
+  b = HTImageKeyToBucket(key, image->header->num_buckets);
+  end = image->index[b + 1];
+  if (end > image->header->num_elements)
+    return 0;
+  for (i = image->index[b]; i < end; i++) {
+    entry = &image->entries[i];
+    if (entry->key == key) {
+      // don't trust the entry to point inside the mapping.
+      blob_size = image->header->file_size - image->header->blob_offset;
+      if (entry->value_offset > blob_size ||
+          entry->value_len > blob_size - entry->value_offset)
+        return 0;
+      *value = image->blobs + entry->value_offset;
+      *len = entry->value_len;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+uint64_t HTImageKeyToBucket(uint64_t key, uint64_t num_buckets) {
+  return key % num_buckets;
+}
+
+static bool WritePadded(FILE *f, const void *bytes, uint64_t len) {
+  static const unsigned char zeros[8] = { 0 };
+  uint64_t pad = HT_IMAGE_ALIGN(len) - len;
+
+  if (len > 0 && fwrite(bytes, 1, len, f) != len)
+    return false;
+  if (pad > 0 && fwrite(zeros, 1, pad, f) != pad)
+    return false;
+  return true;
+}
+
+static bool ValidateHeader(const HTImageHeader *header, size_t size) {
+  uint64_t index_end, entry_end;
+
+  if (header->magic != HT_IMAGE_MAGIC ||
+      header->version != HT_IMAGE_VERSION ||
+      header->file_size != size ||
+      header->num_buckets == 0)
+    return false;
+
+  // check every region lies inside the file, in order, being careful
+  // that a corrupt count can't overflow the arithmetic.
+  if (header->num_buckets >= size / sizeof(uint64_t) ||
+      header->num_elements > size / sizeof(HTImageEntry))
+    return false;
+  index_end =
+    header->index_offset + (header->num_buckets + 1) * sizeof(uint64_t);
+  entry_end =
+    header->entry_offset + header->num_elements * sizeof(HTImageEntry);
+  if (header->index_offset != sizeof(HTImageHeader) ||
+      header->entry_offset != index_end ||
+      header->blob_offset != entry_end ||
+      header->blob_offset > size)
+    return false;
+  return true;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_HASHTABLEIMAGE_H_
+#define _HW1_HASHTABLEIMAGE_H_
+
+#include <stdbool.h>    // for bool, true, false
+#include <stdint.h>     // so we can use uint64_t, etc.
+
+#include "./HashTable.h"  // for HashTable
+
+// A HashTable image is a position-independent, on-disk copy of a
+// HashTable.  Every reference inside the image is a byte offset rather
+// than a pointer, so an image can be mmap()'ed at any address and
+// queried directly, with no parsing, rehashing, or per-entry
+// allocation.  Because the mapping is read-only and shared, every
+// process on a host that opens the same image shares one copy of it in
+// the page cache.
+//
+// HashTable values are opaque (void *) pointers, so customers need to
+// tell us how to turn a value into bytes when writing an image.  The
+// pointed-to function returns a pointer to the value's bytes and sets
+// *len to how many there are; the bytes must stay valid until the next
+// call.  It may be called more than once per value, and must return
+// the same bytes each time.  Each value is stored as a blob in the
+// image's blob region; fixed-size values are just blobs that all have
+// the same length.
+typedef const void *(*ValueBytesFnPtr)(void *value, uint64_t *len);
+
+// The inverse of a ValueBytesFnPtr, used when rebuilding a HashTable
+// from bytes on disk: given len bytes, allocate and return a new value
+// equivalent to the one they were produced from, or NULL if out of
+// memory.  The bytes are only valid for the duration of the call.
+typedef void *(*ValueFromBytesFnPtr)(const void *bytes, uint64_t len);
+
+// An opened image.  As usual, the struct is defined in the private
+// header HashTableImage_priv.h.
+struct ht_image;
+typedef struct ht_image *HTImage;
+
+// Write an image of a HashTable to a file.  The image is written to a
+// temporary file next to path and renamed into place once it is
+// complete, so readers never see a partial image.
+//
+// Arguments:
+//
+// - table: the HashTable to write out; it is not modified.
+//
+// - path: the file to write the image to.
+//
+// - value_bytes_function: converts each value to bytes; see above.
+//
+// Returns false on failure (e.g., an I/O error), true on success.
+bool WriteHashTableImage(HashTable table, const char *path,
+                         ValueBytesFnPtr value_bytes_function);
+
+// Open an image previously written by WriteHashTableImage.  This maps
+// the file read-only and validates its header; it does not read or
+// parse the entries.
+//
+// Arguments:
+//
+// - path: the image file to open.
+//
+// Returns NULL on error (the file can't be opened or mapped, or isn't
+// a valid image), non-NULL on success.
+HTImage OpenHashTableImage(const char *path);
+
+// Unmap an image.  It is unsafe to use the image, or any value
+// pointer returned by LookupHashTableImage, after this returns.
+void CloseHashTableImage(HTImage image);
+
+// Return the number of key/values in the image.
+uint64_t NumElementsInHashTableImage(HTImage image);
+
+// Looks up a key in an image.  This is the image equivalent of
+// LookupHashTable.
+//
+// Arguments:
+//
+// - image: the image to look in
+//
+// - key: the key to look up
+//
+// - value: if the key is present, a pointer to the value's bytes is
+//   returned through this parameter.  The bytes live inside the
+//   read-only mapping; they are valid until the image is closed, and
+//   must not be written to.
+//
+// - len: if the key is present, the length of the value's bytes is
+//   returned through this parameter.
+//
+// Returns:
+//
+//  - 0 if the key wasn't found in the image
+//
+//  - +1 if the key was found, and *value and *len were set.
+int LookupHashTableImage(HTImage image,
+                         uint64_t key,
+                         const void **value,
+                         uint64_t *len);
+
+#endif  // _HW1_HASHTABLEIMAGE_H_
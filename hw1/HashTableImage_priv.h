@@ -0,0 +1,78 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_HASHTABLEIMAGE_PRIV_H_
+#define _HW1_HASHTABLEIMAGE_PRIV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./HashTableImage.h"
+
+// Define the on-disk layout of an image, and the in-memory struct for
+// an opened image.
+//
+// An image is laid out as:
+//
+//   [HTImageHeader]
+//   [bucket index: num_buckets + 1 uint64_t entry numbers]
+//   [entries: num_elements HTImageEntry structs, grouped by bucket]
+//   [blob region: the value bytes, each blob 8-byte aligned]
+//
+// Bucket b holds the entries numbered [index[b], index[b+1]), so a
+// lookup hashes the key to a bucket and scans a (short) contiguous run
+// of entries.  All offsets are in bytes from the start of the file
+// except HTImageEntry.value_offset, which is relative to the start of
+// the blob region.  Integers are stored in the host's byte order.
+
+#define HT_IMAGE_MAGIC    0x474D495F33333348ULL  // "H333_IMG"
+#define HT_IMAGE_VERSION  1U
+
+typedef struct {
+  uint64_t magic;          // HT_IMAGE_MAGIC
+  uint64_t version;        // HT_IMAGE_VERSION
+  uint64_t num_elements;   // # of entries in the image
+  uint64_t num_buckets;    // # of buckets in the bucket index
+  uint64_t index_offset;   // file offset of the bucket index
+  uint64_t entry_offset;   // file offset of the entry array
+  uint64_t blob_offset;    // file offset of the blob region
+  uint64_t file_size;      // total size of the image, in bytes
+} HTImageHeader;
+
+typedef struct {
+  uint64_t key;            // the key in the key/value pair
+  uint64_t value_offset;   // offset of the value within the blob region
+  uint64_t value_len;      // length of the value, in bytes
+} HTImageEntry;
+
+// This is the struct we use to represent an opened (mapped) image.
+typedef struct ht_image {
+  const unsigned char *base;     // start of the mapping
+  size_t               size;     // length of the mapping
+  const HTImageHeader *header;   // == base
+  const uint64_t      *index;    // the bucket index
+  const HTImageEntry  *entries;  // the entry array
+  const unsigned char *blobs;    // the blob region
+} HTImageRecord;
+
+// Map a key to its bucket in an image with num_buckets buckets.
+uint64_t HTImageKeyToBucket(uint64_t key, uint64_t num_buckets);
+
+#endif  // _HW1_HASHTABLEIMAGE_PRIV_H_
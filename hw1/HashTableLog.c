@@ -0,0 +1,414 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Assert333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "HashTableLog.h"
+#include "HashTableLog_priv.h"
+
+// Internal helper that appends one record to the log's buffer and then
+// waits for it as the policy requires.  value/len are ignored for
+// remove records.
+static bool AppendRecord(HTLog log, uint8_t type, uint64_t key,
+                         const void *value, uint64_t len);
+
+// Internal helper that makes sure every record up to and including
+// lsn has been written (and synced, if sync is true).  Must be called
+// with log->lock held; it drops and retakes the lock while it does
+// I/O.  Returns false if the log has failed.
+static bool FlushLocked(HTLog log, uint64_t lsn, bool sync);
+
+// The body of the HT_LOG_SYNC_INTERVAL background thread.
+static void *SyncerMain(void *arg);
+
+// Internal helper to write all len bytes of buf to fd.
+static bool WriteAll(int fd, const unsigned char *buf, size_t len);
+
+// Internal helper that computes a record's checksum.
+static uint32_t Checksum(const unsigned char *bytes, uint64_t len);
+
+HTLog OpenHashTableLog(const char *path,
+                       HTLogSyncPolicy policy,
+                       uint32_t interval_ms,
+                       ValueBytesFnPtr value_bytes_function) {
+  uint64_t magic = HT_LOG_MAGIC;
+  struct stat st;
+  HTLog log;
+
+  Assert333(path != NULL);
+  Assert333(value_bytes_function != NULL);
+
+  log = (HTLog) malloc(sizeof(HTLogRecord));
+  if (log == NULL)
+    return NULL;
+  memset(log, 0, sizeof(HTLogRecord));
+  log->policy = policy;
+  log->interval_ms = (interval_ms > 0) ? interval_ms : 1;
+  log->value_bytes_function = value_bytes_function;
+
+  log->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (log->fd == -1) {
+    free(log);
+    return NULL;
+  }
+
+  // a brand new log gets a magic number; an existing one must have it.
+  if (fstat(log->fd, &st) != 0)
+    goto fail;
+  if (st.st_size == 0) {
+    if (!WriteAll(log->fd, (unsigned char *) &magic, sizeof(magic)) ||
+        fdatasync(log->fd) != 0)
+      goto fail;
+  } else if (pread(log->fd, &magic, sizeof(magic), 0) != sizeof(magic) ||
+             magic != HT_LOG_MAGIC) {
+    goto fail;
+  }
+
+  log->buf_cap = log->spare_cap = 4096;
+  log->buf = (unsigned char *) malloc(log->buf_cap);
+  log->spare = (unsigned char *) malloc(log->spare_cap);
+  if (log->buf == NULL || log->spare == NULL)
+    goto fail;
+
+  pthread_mutex_init(&log->lock, NULL);
+  pthread_cond_init(&log->flushed, NULL);
+  pthread_cond_init(&log->wake, NULL);
+  if (policy == HT_LOG_SYNC_INTERVAL) {
+    if (pthread_create(&log->syncer, NULL, &SyncerMain, log) != 0) {
+      pthread_cond_destroy(&log->wake);
+      pthread_cond_destroy(&log->flushed);
+      pthread_mutex_destroy(&log->lock);
+      goto fail;
+    }
+    log->has_syncer = true;
+  }
+  return log;
+
+ fail:
+  close(log->fd);
+  free(log->buf);
+  free(log->spare);
+  free(log);
+  return NULL;
+}
+
+bool CloseHashTableLog(HTLog log) {
+  bool ok;
+
+  Assert333(log != NULL);
+
+  if (log->has_syncer) {
+    pthread_mutex_lock(&log->lock);
+    log->closing = true;
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->syncer, NULL);
+  }
+
+  pthread_mutex_lock(&log->lock);
+  ok = FlushLocked(log, log->appended_lsn, true);
+  pthread_mutex_unlock(&log->lock);
+  if (close(log->fd) != 0)
+    ok = false;
+
+  pthread_cond_destroy(&log->wake);
+  pthread_cond_destroy(&log->flushed);
+  pthread_mutex_destroy(&log->lock);
+  free(log->buf);
+  free(log->spare);
+  free(log);
+  return ok;
+}
+
+bool SyncHashTableLog(HTLog log) {
+  bool ok;
+
+  Assert333(log != NULL);
+  pthread_mutex_lock(&log->lock);
+  ok = FlushLocked(log, log->appended_lsn, true);
+  pthread_mutex_unlock(&log->lock);
+  return ok;
+}
+
+uint64_t HashTableLogNumSyncs(HTLog log) {
+  uint64_t num_syncs;
+
+  Assert333(log != NULL);
+  pthread_mutex_lock(&log->lock);
+  num_syncs = log->num_syncs;
+  pthread_mutex_unlock(&log->lock);
+  return num_syncs;
+}
+
+void HashTableAttachLog(HashTable table, HTLog log) {
+  Assert333(table != NULL);
+  table->log = log;
+}
+
+bool HTLogAppendInsert(HTLog log, HTKeyValue newkeyvalue) {
+  const void *bytes;
+  uint64_t len;
+
+  bytes = log->value_bytes_function(newkeyvalue.value, &len);
+  return AppendRecord(log, HT_LOG_RECORD_INSERT, newkeyvalue.key,
+                      bytes, len);
+}
+
+bool HTLogAppendRemove(HTLog log, uint64_t key) {
+  return AppendRecord(log, HT_LOG_RECORD_REMOVE, key, NULL, 0);
+}
+
+int64_t ReplayHashTableLog(const char *path,
+                           HashTable table,
+                           ValueFromBytesFnPtr value_from_bytes_function,
+                           ValueFreeFnPtr value_free_function) {
+  const unsigned char *base, *rec;
+  HTKeyValue kv, old;
+  struct stat st;
+  uint64_t off, good, key;
+  uint32_t len, checksum;
+  int64_t applied = 0;
+  int fd, res;
+
+  Assert333(path != NULL);
+  Assert333(table != NULL);
+  Assert333(table->log == NULL);  // don't log what we're replaying
+  Assert333(value_from_bytes_function != NULL);
+  Assert333(value_free_function != NULL);
+
+  fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return (errno == ENOENT) ? 0 : -1;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+  if ((uint64_t) st.st_size < sizeof(uint64_t)) {
+    // a crash while creating the log; there's nothing in it.
+    close(fd);
+    return (truncate(path, 0) == 0) ? 0 : -1;
+  }
+  base = (const unsigned char *) mmap(NULL, st.st_size, PROT_READ,
+                                      MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return -1;
+  madvise((void *) base, st.st_size, MADV_SEQUENTIAL);
+  if (*(const uint64_t *) base != HT_LOG_MAGIC) {
+    munmap((void *) base, st.st_size);
+    return -1;
+  }
+
+  // apply records until we run off the end or hit a bad one.
+  good = off = sizeof(uint64_t);
+  while (st.st_size - off >= HT_LOG_HEADER_BYTES + HT_LOG_TRAILER_BYTES) {
+    rec = base + off;
+    memcpy(&key, rec + 1, sizeof(key));
+    memcpy(&len, rec + 9, sizeof(len));
+    if (st.st_size - off - HT_LOG_HEADER_BYTES - HT_LOG_TRAILER_BYTES < len)
+      break;  // torn record
+    memcpy(&checksum, rec + HT_LOG_HEADER_BYTES + len, sizeof(checksum));
+    if (checksum != Checksum(rec, HT_LOG_HEADER_BYTES + len))
+      break;  // torn or corrupt record
+
+    if (rec[0] == HT_LOG_RECORD_INSERT) {
+      kv.key = key;
+      kv.value = value_from_bytes_function(rec + HT_LOG_HEADER_BYTES, len);
+      res = (kv.value != NULL) ? InsertHashTable(table, kv, &old) : 0;
+      if (res == 0) {
+        if (kv.value != NULL)
+          value_free_function(kv.value);
+        munmap((void *) base, st.st_size);
+        return -1;
+      }
+      if (res == 2)
+        value_free_function(old.value);
+    } else if (rec[0] == HT_LOG_RECORD_REMOVE) {
+      if (RemoveFromHashTable(table, key, &old) == 1)
+        value_free_function(old.value);
+    } else {
+      break;  // a garbage record with a matching checksum: stop here.
+    }
+    off += HT_LOG_HEADER_BYTES + len + HT_LOG_TRAILER_BYTES;
+    good = off;
+    applied++;
+  }
+  munmap((void *) base, st.st_size);
+
+  // chop off any torn tail so that new records follow the good ones.
+  if (good < (uint64_t) st.st_size && truncate(path, good) != 0)
+    return -1;
+  return applied;
+}
+
+static bool AppendRecord(HTLog log, uint8_t type, uint64_t key,
+                         const void *value, uint64_t len) {
+  size_t rec_len, needed;
+  unsigned char *rec, *newbuf;
+  uint32_t len32, checksum;
+  uint64_t lsn;
+  bool ok = true;
+
+  if (len > UINT32_MAX)
+    return false;
+  len32 = (uint32_t) len;
+  rec_len = HT_LOG_HEADER_BYTES + len + HT_LOG_TRAILER_BYTES;
+
+  pthread_mutex_lock(&log->lock);
+  if (log->failed) {
+    pthread_mutex_unlock(&log->lock);
+    return false;
+  }
+
+  // make room for the record, then encode it into the buffer.
+  needed = log->buf_len + rec_len;
+  if (needed > log->buf_cap) {
+    size_t newcap = log->buf_cap;
+    while (newcap < needed)
+      newcap *= 2;
+    newbuf = (unsigned char *) realloc(log->buf, newcap);
+    if (newbuf == NULL) {
+      pthread_mutex_unlock(&log->lock);
+      return false;
+    }
+    log->buf = newbuf;
+    log->buf_cap = newcap;
+  }
+  rec = log->buf + log->buf_len;
+  rec[0] = type;
+  memcpy(rec + 1, &key, sizeof(key));
+  memcpy(rec + 9, &len32, sizeof(len32));
+  if (len > 0)
+    memcpy(rec + HT_LOG_HEADER_BYTES, value, len);
+  checksum = Checksum(rec, HT_LOG_HEADER_BYTES + len);
+  memcpy(rec + HT_LOG_HEADER_BYTES + len, &checksum, sizeof(checksum));
+  log->buf_len += rec_len;
+  lsn = ++log->appended_lsn;
+
+  // now wait for it as long as the policy says to.
+  if (log->policy == HT_LOG_SYNC_ALWAYS) {
+    ok = FlushLocked(log, lsn, true);
+  } else if (log->buf_len >= HT_LOG_BATCH_BYTES) {
+    ok = FlushLocked(log, lsn, false);
+  }
+  pthread_mutex_unlock(&log->lock);
+  return ok;
+}
+
+static bool FlushLocked(HTLog log, uint64_t lsn, bool sync) {
+  unsigned char *batch;
+  size_t batch_len, batch_cap;
+  uint64_t target;
+  bool ok;
+
+  while (log->written_lsn < lsn || (sync && log->synced_lsn < lsn)) {
+    if (log->failed)
+      return false;
+    if (log->flushing) {
+      // someone else is flushing; their batch may well cover us.
+      pthread_cond_wait(&log->flushed, &log->lock);
+      continue;
+    }
+
+    // become the leader: take every record appended so far.
+    log->flushing = true;
+    batch = log->buf;
+    batch_len = log->buf_len;
+    batch_cap = log->buf_cap;
+    log->buf = log->spare;
+    log->buf_cap = log->spare_cap;
+    log->buf_len = 0;
+    target = log->appended_lsn;
+    pthread_mutex_unlock(&log->lock);
+
+    ok = WriteAll(log->fd, batch, batch_len);
+    if (ok && sync)
+      ok = (fdatasync(log->fd) == 0);
+
+    pthread_mutex_lock(&log->lock);
+    log->spare = batch;
+    log->spare_cap = batch_cap;
+    if (ok) {
+      log->written_lsn = target;
+      if (sync) {
+        log->synced_lsn = target;
+        log->num_syncs++;
+      }
+    } else {
+      log->failed = true;
+    }
+    log->flushing = false;
+    pthread_cond_broadcast(&log->flushed);
+  }
+  return !log->failed;
+}
+
+static void *SyncerMain(void *arg) {
+  HTLog log = (HTLog) arg;
+  struct timespec deadline;
+
+  pthread_mutex_lock(&log->lock);
+  while (!log->closing) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += log->interval_ms / 1000;
+    deadline.tv_nsec += (log->interval_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&log->wake, &log->lock, &deadline);
+    if (!log->closing && log->synced_lsn < log->appended_lsn)
+      FlushLocked(log, log->appended_lsn, true);
+  }
+  pthread_mutex_unlock(&log->lock);
+  return NULL;
+}
+
+static bool WriteAll(int fd, const unsigned char *buf, size_t len) {
+  ssize_t res;
+
+  while (len > 0) {
+    res = write(fd, buf, len);
+    if (res == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    buf += res;
+    len -= res;
+  }
+  return true;
+}
+
+static uint32_t Checksum(const unsigned char *bytes, uint64_t len) {
+  return (uint32_t) FNVHash64((unsigned char *) bytes, (unsigned int) len);
+}
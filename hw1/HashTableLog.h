@@ -0,0 +1,131 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_HASHTABLELOG_H_
+#define _HW1_HASHTABLELOG_H_
+
+#include <stdbool.h>    // for bool, true, false
+#include <stdint.h>     // so we can use uint64_t, etc.
+
+#include "./HashTable.h"       // for HashTable, ValueFreeFnPtr
+#include "./HashTableImage.h"  // for ValueBytesFnPtr, ValueFromBytesFnPtr
+
+// A HashTable log is an optional write-ahead log that makes a HashTable
+// durable.  Once a log is attached to a table, every InsertHashTable
+// and RemoveFromHashTable (including removes done through
+// HTIteratorDelete) appends a compact binary record to the log file
+// before it changes the table.  After a crash, ReplayHashTableLog
+// rebuilds the table from the log.
+//
+// Records are collected in memory and written out in batches, and a
+// single fdatasync() covers every record in a batch ("group commit").
+// When several threads wait on the log at once, one of them writes and
+// syncs on behalf of all of them.  The sync policy decides how often
+// that happens:
+//
+// - HT_LOG_SYNC_ALWAYS: an operation does not return until its record
+//   has been synced to disk.  Nothing acknowledged is ever lost.
+//
+// - HT_LOG_SYNC_INTERVAL: a background thread syncs the log every
+//   interval_ms milliseconds.  A crash loses at most the last
+//   interval's worth of operations.
+//
+// - HT_LOG_SYNC_NEVER: records are written to the file whenever the
+//   in-memory batch fills up, but never explicitly synced; durability
+//   is left to the OS (and to SyncHashTableLog / CloseHashTableLog).
+typedef enum {
+  HT_LOG_SYNC_ALWAYS,
+  HT_LOG_SYNC_INTERVAL,
+  HT_LOG_SYNC_NEVER
+} HTLogSyncPolicy;
+
+// An open log.  As usual, the struct is defined in the private header
+// HashTableLog_priv.h.
+struct ht_log;
+typedef struct ht_log *HTLog;
+
+// Open a log for appending, creating the file if it doesn't exist.  If
+// the file has records in it already (say, from before a crash), call
+// ReplayHashTableLog on it first; new records are appended after the
+// existing ones.
+//
+// Arguments:
+//
+// - path: the log file.
+//
+// - policy, interval_ms: the sync policy; see above.  interval_ms is
+//   ignored unless policy is HT_LOG_SYNC_INTERVAL.
+//
+// - value_bytes_function: converts values to bytes for insert records;
+//   see HashTableImage.h.
+//
+// Returns NULL on error, non-NULL on success.
+HTLog OpenHashTableLog(const char *path,
+                       HTLogSyncPolicy policy,
+                       uint32_t interval_ms,
+                       ValueBytesFnPtr value_bytes_function);
+
+// Write out and sync any buffered records, then close the log.  The
+// log must not be attached to any table when it is closed.
+//
+// Returns false if any write or sync to the log ever failed, true
+// otherwise.
+bool CloseHashTableLog(HTLog log);
+
+// Write out and sync every record appended so far, regardless of the
+// log's policy.  Returns false on an I/O error.
+bool SyncHashTableLog(HTLog log);
+
+// Return the number of times the log has been synced to disk.  Useful
+// for seeing how many records each group commit covered.
+uint64_t HashTableLogNumSyncs(HTLog log);
+
+// Attach a log to a table, or detach it by passing NULL.  A log should
+// be attached to at most one table at a time.  While it is attached,
+// InsertHashTable and RemoveFromHashTable return failure (0 and -1,
+// respectively) without changing the table if their record can't be
+// logged.
+void HashTableAttachLog(HashTable table, HTLog log);
+
+// Replay a log into a table, applying its inserts and removes in order.
+// The table should have no log attached.  If the log ends in a torn or
+// corrupt record (e.g., the process crashed mid-write), replay stops
+// there and the file is truncated back to the last good record, so
+// that the log can be reopened and appended to.
+//
+// Arguments:
+//
+// - path: the log file to replay.  A missing file is an empty log.
+//
+// - table: the table to apply the records to.
+//
+// - value_from_bytes_function: rebuilds values from insert records.
+//
+// - value_free_function: frees values that are replaced or removed
+//   during replay.
+//
+// Returns the number of records applied, or -1 on error (an I/O
+// error, a file that isn't a log, or running out of memory).
+int64_t ReplayHashTableLog(const char *path,
+                           HashTable table,
+                           ValueFromBytesFnPtr value_from_bytes_function,
+                           ValueFreeFnPtr value_free_function);
+
+#endif  // _HW1_HASHTABLELOG_H_
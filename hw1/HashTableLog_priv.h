@@ -0,0 +1,100 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_HASHTABLELOG_PRIV_H_
+#define _HW1_HASHTABLELOG_PRIV_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./HashTable.h"
+#include "./HashTableLog.h"
+
+// Define the on-disk record format and the internal structs and helper
+// functions associated with a HashTable log.
+//
+// A log file starts with the 8-byte HT_LOG_MAGIC, followed by records:
+//
+//   [type: 1 byte][key: 8 bytes][value length: 4 bytes]
+//   [value: <value length> bytes][checksum: 4 bytes]
+//
+// Remove records have a value length of 0.  The checksum is the low 32
+// bits of the FNV hash of everything before it in the record; it lets
+// replay detect a record that was only partly written.  Integers are
+// stored in the host's byte order.
+
+#define HT_LOG_MAGIC          0x4C41575F33333348ULL  // "H333_WAL"
+#define HT_LOG_RECORD_INSERT  1
+#define HT_LOG_RECORD_REMOVE  2
+#define HT_LOG_HEADER_BYTES   13   // type + key + value length
+#define HT_LOG_TRAILER_BYTES  4    // checksum
+
+// Once this many bytes of records are buffered, they are written out
+// even if the policy doesn't call for a sync yet.
+#define HT_LOG_BATCH_BYTES    (1 << 20)
+
+// This is the struct that we use to represent an open log.
+//
+// Records are appended to buf.  To flush, one thread (the "leader")
+// swaps buf with the empty spare buffer, drops the lock, and writes and
+// syncs the batch; threads that need a flush while one is in progress
+// wait for it, then either find their records covered or lead the next
+// batch themselves.  Records are numbered by a log sequence number
+// (LSN) so that each thread can tell whether its records are covered.
+typedef struct ht_log {
+  int              fd;            // the log file, opened O_APPEND
+  HTLogSyncPolicy  policy;        // when to sync
+  uint32_t         interval_ms;   // for HT_LOG_SYNC_INTERVAL
+  ValueBytesFnPtr  value_bytes_function;
+
+  pthread_mutex_t  lock;          // protects everything below
+  pthread_cond_t   flushed;       // signalled when a flush finishes
+  pthread_cond_t   wake;          // wakes the interval sync thread
+
+  unsigned char   *buf;           // records not yet handed to a flush
+  size_t           buf_len, buf_cap;
+  unsigned char   *spare;         // the buffer being flushed, or empty
+  size_t           spare_cap;
+
+  uint64_t         appended_lsn;  // LSN of the last record appended
+  uint64_t         written_lsn;   // records <= this have been written
+  uint64_t         synced_lsn;    // records <= this have been synced
+  uint64_t         num_syncs;     // # of fdatasync()s so far
+  bool             flushing;      // is a leader flushing right now?
+  bool             failed;        // has a write or sync ever failed?
+
+  bool             has_syncer;    // is the interval thread running?
+  bool             closing;       // tells the interval thread to exit
+  pthread_t        syncer;        // the interval sync thread
+} HTLogRecord;
+
+// Append an insert (or replace) record for newkeyvalue to the log, and
+// wait for it to be as durable as the log's policy requires.  Called
+// by InsertHashTable before it modifies the table.  Returns false on
+// failure (out of memory or an I/O error).
+bool HTLogAppendInsert(HTLog log, HTKeyValue newkeyvalue);
+
+// Append a remove record for key to the log; otherwise the same as
+// HTLogAppendInsert.  Called by RemoveFromHashTable once it has
+// checked the key is present, before it modifies the table.
+bool HTLogAppendRemove(HTLog log, uint64_t key);
+
+#endif  // _HW1_HASHTABLELOG_PRIV_H_
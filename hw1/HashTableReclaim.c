@@ -0,0 +1,184 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "Assert333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "HashTableReclaim.h"
+#include "LinkedList.h"
+
+// Each reclaimer thread claims this many buckets at a time.
+#define HT_RECLAIM_CHUNK        4096
+
+// The most reclaimer threads we start for one table.
+#define HT_RECLAIM_MAX_THREADS  64
+
+// This is the struct we use to represent a free in progress.
+typedef struct ht_reclaim {
+  HashTable        table;          // the table being freed
+  ValueFreeFnPtr   value_free_function;
+  uint64_t         next_bucket;    // the next chunk to claim (atomic)
+
+  pthread_mutex_t  lock;           // protects num_running and done
+  pthread_cond_t   finished;       // signalled when done becomes true
+  unsigned int     num_running;    // # of threads still freeing chains
+  bool             done;           // has the table been freed?
+
+  unsigned int     num_threads;    // # of threads started
+  pthread_t        threads[HT_RECLAIM_MAX_THREADS];
+} HTReclaimRecord;
+
+// The body of a reclaimer thread.
+static void *ReclaimThread(void *arg);
+
+// Internal helper that frees chunks of buckets until there are none
+// left to claim.
+static void FreeChunks(HTReclaim reclaim);
+
+// Internal helper that notes that count reclaimer threads have run out
+// of buckets to free.  The last one out frees the rest of the table.
+static void FinishThreads(HTReclaim reclaim, unsigned int count);
+
+HTReclaim FreeHashTableAsync(HashTable table,
+                             ValueFreeFnPtr value_free_function,
+                             unsigned int num_threads) {
+  HTReclaim reclaim;
+  unsigned int i;
+
+  Assert333(table != NULL);
+  Assert333(table->log == NULL);
+  Assert333(value_free_function != NULL || table->arena != NULL);
+
+  reclaim = (HTReclaim) malloc(sizeof(HTReclaimRecord));
+  if (reclaim == NULL) {
+    FreeHashTable(table, value_free_function);
+    return NULL;
+  }
+
+  // only tables whose allocator can take frees from several threads at
+  // once are freed in parallel.  An arena-backed table is freed all at
+  // once, so there's nothing to split up.
+  if (num_threads == 0)
+    num_threads = 1;
+  if (num_threads > HT_RECLAIM_MAX_THREADS)
+    num_threads = HT_RECLAIM_MAX_THREADS;
+  if (table->arena != NULL ||
+      (table->allocator != &kMallocAllocator &&
+       table->allocator != &kLLNodeSlabAllocator))
+    num_threads = 1;
+
+  reclaim->table = table;
+  reclaim->value_free_function = value_free_function;
+  reclaim->next_bucket = 0;
+  pthread_mutex_init(&reclaim->lock, NULL);
+  pthread_cond_init(&reclaim->finished, NULL);
+  reclaim->num_running = num_threads;
+  reclaim->done = false;
+
+  for (i = 0; i < num_threads; i++) {
+    if (pthread_create(&reclaim->threads[i], NULL, &ReclaimThread,
+                       reclaim) != 0)
+      break;
+  }
+  reclaim->num_threads = i;
+  if (i < num_threads) {
+    // we couldn't start them all.  If we started none, do the work
+    // ourselves.
+    if (i == 0)
+      FreeChunks(reclaim);
+    FinishThreads(reclaim, num_threads - i);
+  }
+  return reclaim;
+}
+
+bool HTReclaimIsDone(HTReclaim reclaim) {
+  bool done;
+
+  Assert333(reclaim != NULL);
+  pthread_mutex_lock(&reclaim->lock);
+  done = reclaim->done;
+  pthread_mutex_unlock(&reclaim->lock);
+  return done;
+}
+
+void HTReclaimWait(HTReclaim reclaim) {
+  unsigned int i;
+
+  Assert333(reclaim != NULL);
+  pthread_mutex_lock(&reclaim->lock);
+  while (!reclaim->done)
+    pthread_cond_wait(&reclaim->finished, &reclaim->lock);
+  pthread_mutex_unlock(&reclaim->lock);
+
+  for (i = 0; i < reclaim->num_threads; i++)
+    pthread_join(reclaim->threads[i], NULL);
+  pthread_cond_destroy(&reclaim->finished);
+  pthread_mutex_destroy(&reclaim->lock);
+  free(reclaim);
+}
+
+static void *ReclaimThread(void *arg) {
+  HTReclaim reclaim = (HTReclaim) arg;
+
+  FreeChunks(reclaim);
+  FinishThreads(reclaim, 1);
+  return NULL;
+}
+
+static void FreeChunks(HTReclaim reclaim) {
+  HashTable table = reclaim->table;
+  uint64_t begin, end;
+
+  if (table->arena != NULL)
+    return;  // FinishThreads frees the whole arena at once.
+
+  while (true) {
+    begin = __atomic_fetch_add(&reclaim->next_bucket, HT_RECLAIM_CHUNK,
+                               __ATOMIC_RELAXED);
+    if (begin >= table->num_buckets)
+      break;
+    end = begin + HT_RECLAIM_CHUNK;
+    if (end > table->num_buckets)
+      end = table->num_buckets;
+    HTFreeChains(table, begin, end, reclaim->value_free_function);
+  }
+}
+
+static void FinishThreads(HTReclaim reclaim, unsigned int count) {
+  pthread_mutex_lock(&reclaim->lock);
+  reclaim->num_running -= count;
+  if (reclaim->num_running == 0) {
+    // every chain is gone; free what's left.
+    if (reclaim->table->arena != NULL) {
+      FreeHashTable(reclaim->table, reclaim->value_free_function);
+    } else {
+      HTFreeRecord(reclaim->table);
+    }
+    reclaim->table = NULL;
+    reclaim->done = true;
+    pthread_cond_broadcast(&reclaim->finished);
+  }
+  pthread_mutex_unlock(&reclaim->lock);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_HASHTABLERECLAIM_H_
+#define _HW1_HASHTABLERECLAIM_H_
+
+#include <stdbool.h>    // for bool, true, false
+
+#include "./HashTable.h"  // for HashTable, ValueFreeFnPtr
+
+// Freeing a big HashTable means visiting and freeing every one of its
+// entries, which can keep the calling thread busy for seconds.
+// FreeHashTableAsync hands that work to background threads instead:
+// the caller gets control back right away, and gets a handle it can
+// use to wait for the table to be completely freed.
+
+// A handle to an asynchronous free in progress.
+struct ht_reclaim;
+typedef struct ht_reclaim *HTReclaim;
+
+// Free a HashTable in the background.  The table must not be used
+// (and must not have a log attached) once this is called.
+//
+// Arguments:
+//
+// - table: the HashTable to free.
+//
+// - value_free_function: as for FreeHashTable.  It runs on the
+//   reclaimer threads, so if there are several of them it must be safe
+//   to call from several threads at once.
+//
+// - num_threads: how many threads to free the table with; each frees
+//   ranges of buckets, a chunk at a time.  Tables whose allocator isn't
+//   thread-safe (anything but the malloc and node slab allocators) are
+//   always freed by a single thread.
+//
+// Returns a handle for the free, which must eventually be passed to
+// HTReclaimWait.  Returns NULL if there wasn't the memory to start a
+// background free; in that case the table has been freed synchronously
+// instead, before returning.
+HTReclaim FreeHashTableAsync(HashTable table,
+                             ValueFreeFnPtr value_free_function,
+                             unsigned int num_threads);
+
+// Returns true if the table has been completely freed, without
+// waiting.
+bool HTReclaimIsDone(HTReclaim reclaim);
+
+// Wait for the table to be completely freed, then release the handle.
+void HTReclaimWait(HTReclaim reclaim);
+
+#endif  // _HW1_HASHTABLERECLAIM_H_
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "Assert333.h"
+#include "HashTable.h"
+#include "HashTableImage.h"
+#include "HashTableImage_priv.h"
+#include "HashTableSnapshot.h"
+
+// This is the struct we use to represent a running (or finished)
+// snapshot.
+typedef struct ht_snapshot {
+  pid_t pid;       // the child writing the snapshot
+  bool  done;      // has the child been reaped?
+  bool  success;   // if done, did the child succeed?
+} HTSnapshotRecord;
+
+// Internal helper that records the child's exit status.
+static void RecordStatus(HTSnapshot snapshot, int status);
+
+HTSnapshot HashTableSnapshotAsync(HashTable table, const char *path,
+                                  ValueBytesFnPtr value_bytes_function) {
+  HTSnapshot snapshot;
+
+  Assert333(table != NULL);
+  Assert333(path != NULL);
+  Assert333(value_bytes_function != NULL);
+
+  snapshot = (HTSnapshot) malloc(sizeof(HTSnapshotRecord));
+  if (snapshot == NULL)
+    return NULL;
+  snapshot->done = false;
+  snapshot->success = false;
+
+  // flush stdio so the child doesn't inherit (and re-flush) anything.
+  fflush(NULL);
+  snapshot->pid = fork();
+  if (snapshot->pid == -1) {
+    free(snapshot);
+    return NULL;
+  }
+  if (snapshot->pid == 0) {
+    // the child: its copy of the table is frozen at the moment of the
+    // fork.  Write it out and leave without running atexit handlers.
+    _exit(WriteHashTableImage(table, path, value_bytes_function) ?
+          EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  return snapshot;
+}
+
+bool HashTableSnapshotIsDone(HTSnapshot snapshot) {
+  pid_t res;
+  int status;
+
+  Assert333(snapshot != NULL);
+  if (!snapshot->done) {
+    res = waitpid(snapshot->pid, &status, WNOHANG);
+    if (res == snapshot->pid) {
+      RecordStatus(snapshot, status);
+    } else if (res == -1 && errno != EINTR) {
+      // somebody else reaped our child; we can't know how it went.
+      snapshot->done = true;
+    }
+  }
+  return snapshot->done;
+}
+
+bool HashTableSnapshotWait(HTSnapshot snapshot) {
+  bool success;
+  pid_t res;
+  int status;
+
+  Assert333(snapshot != NULL);
+  while (!snapshot->done) {
+    res = waitpid(snapshot->pid, &status, 0);
+    if (res == snapshot->pid) {
+      RecordStatus(snapshot, status);
+    } else if (res == -1 && errno != EINTR) {
+      snapshot->done = true;
+    }
+  }
+  success = snapshot->success;
+  free(snapshot);
+  return success;
+}
+
+HashTable LoadHashTableSnapshot(const char *path,
+                                ValueFromBytesFnPtr value_from_bytes_function,
+                                ValueFreeFnPtr value_free_function) {
+  const HTImageEntry *entry;
+  HTKeyValue kv, old;
+  HashTable table;
+  HTImage image;
+  uint64_t i, num_buckets, blob_size;
+  int res;
+
+  Assert333(path != NULL);
+  Assert333(value_from_bytes_function != NULL);
+  Assert333(value_free_function != NULL);
+
+  image = OpenHashTableImage(path);
+  if (image == NULL)
+    return NULL;
+  madvise((void *) image->base, image->size, MADV_SEQUENTIAL);
+
+  // size the table up front: with as many buckets as the image has, the
+  // load factor ends up at 1 and the table never needs to grow.  Since
+  // the image's entries are grouped by (key % num_buckets), that also
+  // means we fill the table one bucket at a time.
+  num_buckets = image->header->num_buckets;
+  table = AllocateHashTable(num_buckets);
+  if (table == NULL) {
+    CloseHashTableImage(image);
+    return NULL;
+  }
+
+  // then walk the entries sequentially.
+  blob_size = image->header->file_size - image->header->blob_offset;
+  for (i = 0; i < image->header->num_elements; i++) {
+    entry = &image->entries[i];
+    kv.key = entry->key;
+    kv.value = NULL;
+    if (entry->value_offset <= blob_size &&
+        entry->value_len <= blob_size - entry->value_offset) {
+      kv.value = value_from_bytes_function(
+          image->blobs + entry->value_offset, entry->value_len);
+    }
+    res = (kv.value == NULL) ? 0 : InsertHashTable(table, kv, &old);
+    if (res != 1) {
+      // a value that didn't go in is still ours to free.  A duplicate
+      // key (which a valid image never has) did go in, and displaced
+      // the earlier value, which is ours now instead.
+      if (res == 0 && kv.value != NULL)
+        value_free_function(kv.value);
+      if (res == 2)
+        value_free_function(old.value);
+      FreeHashTable(table, value_free_function);
+      CloseHashTableImage(image);
+      return NULL;
+    }
+  }
+  CloseHashTableImage(image);
+  return table;
+}
+
+static void RecordStatus(HTSnapshot snapshot, int status) {
+  snapshot->done = true;
+  snapshot->success =
+    WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_HASHTABLESNAPSHOT_H_
+#define _HW1_HASHTABLESNAPSHOT_H_
+
+#include <stdbool.h>    // for bool, true, false
+
+#include "./HashTable.h"       // for HashTable
+#include "./HashTableImage.h"  // for ValueBytesFnPtr, ValueFromBytesFnPtr
+
+// Background snapshots of a HashTable, in the style of Redis's BGSAVE.
+//
+// HashTableSnapshotAsync fork()s.  The child process writes an image
+// of the table (see HashTableImage.h) to disk and exits, while the
+// parent returns right away and can keep mutating the table.  The
+// kernel shares memory between the two copy-on-write, so the child
+// sees the table exactly as it was at the fork, and the parent only
+// pays to copy the pages it actually modifies while the child runs.
+//
+// Because the child is a copy of a possibly multi-threaded parent, it
+// only ever runs the image writer and then _exit()s; in particular, no
+// other thread may be mutating the table while HashTableSnapshotAsync
+// runs, and the value-to-bytes function must not take locks that
+// other threads of the parent might hold.
+struct ht_snapshot;
+typedef struct ht_snapshot *HTSnapshot;
+
+// Start a background snapshot of a table.
+//
+// Arguments:
+//
+// - table: the table to snapshot.  The caller may modify it as soon as
+//   this function returns.
+//
+// - path: the file to write the snapshot image to.  It is replaced
+//   atomically once the snapshot is complete.
+//
+// - value_bytes_function: converts values to bytes; see
+//   HashTableImage.h.
+//
+// Returns NULL if the snapshot couldn't be started (e.g., fork()
+// failed), or a handle that must eventually be passed to
+// HashTableSnapshotWait.
+HTSnapshot HashTableSnapshotAsync(HashTable table, const char *path,
+                                  ValueBytesFnPtr value_bytes_function);
+
+// Check, without blocking, whether a snapshot has finished.
+//
+// Returns true if the snapshot is done (successfully or not), false if
+// it is still being written.
+bool HashTableSnapshotIsDone(HTSnapshot snapshot);
+
+// Wait for a snapshot to finish, and free its handle.  It is unsafe to
+// use the handle after this function returns.
+//
+// Returns true if the snapshot was written successfully, false
+// otherwise.
+bool HashTableSnapshotWait(HTSnapshot snapshot);
+
+// Load a snapshot (or any other image written by WriteHashTableImage)
+// back into a new HashTable.  The table's bucket array is allocated
+// once, at its final size, so the load never has to resize.
+//
+// Arguments:
+//
+// - path: the snapshot file to load.
+//
+// - value_from_bytes_function: rebuilds each value from its bytes.
+//
+// - value_free_function: used to free the values loaded so far if the
+//   load fails part way through.
+//
+// Returns NULL on error (the file isn't a valid image, holds a key
+// twice, or out of memory), or a new HashTable that the caller is
+// responsible for freeing.
+HashTable LoadHashTableSnapshot(const char *path,
+                                ValueFromBytesFnPtr value_from_bytes_function,
+                                ValueFreeFnPtr value_free_function);
+
+#endif  // _HW1_HASHTABLESNAPSHOT_H_
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "Assert333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "HashTableStats.h"
+#include "HashTableStats_priv.h"
+
+// Internal helpers that update counters with relaxed atomics.
+static void Add(uint64_t *counter, uint64_t n);
+static void Max(uint64_t *counter, uint64_t value);
+
+// Internal helper that writes a histogram as a JSON array.
+static void WriteJSONHistogram(FILE *f, const char *name,
+                               const uint64_t *hist, const char *suffix);
+
+bool HashTableEnableStats(HashTable table) {
+  Assert333(table != NULL);
+#ifdef HT_NO_STATS
+  return false;
+#else
+  if (table->stats != NULL)
+    return true;
+  table->stats = (HTStats *) calloc(1, sizeof(HTStats));
+  if (table->stats == NULL)
+    return false;
+  HTStatsRecountChains(table);
+  return true;
+#endif
+}
+
+bool HashTableGetStats(HashTable table, HTStats *stats) {
+  const uint64_t *src;
+  uint64_t *dst;
+  size_t i;
+
+  Assert333(table != NULL);
+  Assert333(stats != NULL);
+  if (table->stats == NULL)
+    return false;
+
+  // every field is a uint64_t counter; copy them one at a time.
+  src = (const uint64_t *) table->stats;
+  dst = (uint64_t *) stats;
+  for (i = 0; i < sizeof(HTStats) / sizeof(uint64_t); i++)
+    dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+  return true;
+}
+
+bool HTStatsWriteText(const HTStats *stats, FILE *f) {
+  int i;
+
+  Assert333(stats != NULL);
+  Assert333(f != NULL);
+  fprintf(f, "lookups: %" PRIu64 " hits, %.2f probes/hit; "
+          "%" PRIu64 " misses, %.2f probes/miss; max %" PRIu64 " probes\n",
+          stats->lookups_hit,
+          stats->lookups_hit ?
+            (double) stats->probes_hit / stats->lookups_hit : 0.0,
+          stats->lookups_miss,
+          stats->lookups_miss ?
+            (double) stats->probes_miss / stats->lookups_miss : 0.0,
+          stats->max_probes);
+  fprintf(f, "chain lengths:");
+  for (i = 0; i < HT_STATS_SLOTS; i++) {
+    fprintf(f, " %d%s:%" PRIu64, i, (i == HT_STATS_SLOTS - 1) ? "+" : "",
+            stats->chain_hist[i]);
+  }
+  fprintf(f, "; max %" PRIu64 "\n", stats->max_chain_length);
+  fprintf(f, "resizes: %" PRIu64 ", %.3f ms total, %.3f ms max\n",
+          stats->num_resizes, stats->resize_ns / 1e6,
+          stats->max_resize_ns / 1e6);
+  return ferror(f) == 0;
+}
+
+bool HTStatsWriteJSON(const HTStats *stats, FILE *f) {
+  Assert333(stats != NULL);
+  Assert333(f != NULL);
+  fprintf(f, "{\"lookups_hit\": %" PRIu64 ", \"lookups_miss\": %" PRIu64
+          ", \"probes_hit\": %" PRIu64 ", \"probes_miss\": %" PRIu64
+          ", \"max_probes\": %" PRIu64 ", ",
+          stats->lookups_hit, stats->lookups_miss, stats->probes_hit,
+          stats->probes_miss, stats->max_probes);
+  WriteJSONHistogram(f, "probe_hist_hit", stats->probe_hist_hit, ", ");
+  WriteJSONHistogram(f, "probe_hist_miss", stats->probe_hist_miss, ", ");
+  WriteJSONHistogram(f, "chain_hist", stats->chain_hist, ", ");
+  fprintf(f, "\"max_chain_length\": %" PRIu64 ", \"num_resizes\": %" PRIu64
+          ", \"resize_ns\": %" PRIu64 ", \"max_resize_ns\": %" PRIu64 "}\n",
+          stats->max_chain_length, stats->num_resizes, stats->resize_ns,
+          stats->max_resize_ns);
+  return ferror(f) == 0;
+}
+
+void HTStatsNoteLookup(HTStats *stats, bool hit, uint64_t probes) {
+  if (hit) {
+    Add(&stats->lookups_hit, 1);
+    Add(&stats->probes_hit, probes);
+    Add(&stats->probe_hist_hit[HT_STATS_SLOT(probes)], 1);
+  } else {
+    Add(&stats->lookups_miss, 1);
+    Add(&stats->probes_miss, probes);
+    Add(&stats->probe_hist_miss[HT_STATS_SLOT(probes)], 1);
+  }
+  Max(&stats->max_probes, probes);
+}
+
+void HTStatsNoteChainGrew(HTStats *stats, uint64_t length) {
+  Assert333(length > 0);
+  Add(&stats->chain_hist[HT_STATS_SLOT(length - 1)], -1);
+  Add(&stats->chain_hist[HT_STATS_SLOT(length)], 1);
+  Max(&stats->max_chain_length, length);
+}
+
+void HTStatsNoteChainShrank(HTStats *stats, uint64_t length) {
+  Add(&stats->chain_hist[HT_STATS_SLOT(length + 1)], -1);
+  Add(&stats->chain_hist[HT_STATS_SLOT(length)], 1);
+}
+
+void HTStatsNoteResize(HTStats *stats, uint64_t ns) {
+  Add(&stats->num_resizes, 1);
+  Add(&stats->resize_ns, ns);
+  Max(&stats->max_resize_ns, ns);
+}
+
+static void Add(uint64_t *counter, uint64_t n) {
+  __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static void Max(uint64_t *counter, uint64_t value) {
+  uint64_t current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+  while (value > current &&
+         !__atomic_compare_exchange_n(counter, &current, value, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    // current now holds the latest value; try again.
+  }
+}
+
+static void WriteJSONHistogram(FILE *f, const char *name,
+                               const uint64_t *hist, const char *suffix) {
+  int i;
+
+  fprintf(f, "\"%s\": [", name);
+  for (i = 0; i < HT_STATS_SLOTS; i++)
+    fprintf(f, "%s%" PRIu64, (i > 0) ? ", " : "", hist[i]);
+  fprintf(f, "]%s", suffix);
+}
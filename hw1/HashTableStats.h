@@ -0,0 +1,98 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_HASHTABLESTATS_H_
+#define _HW1_HASHTABLESTATS_H_
+
+#include <stdbool.h>    // for bool, true, false
+#include <stdint.h>     // so we can use uint64_t, etc.
+#include <stdio.h>      // for FILE
+
+#include "./HashTable.h"  // for HashTable
+
+// HashTable statistics are an optional record of how a table's buckets
+// behave: how long its chains are, how many keys each lookup has to
+// compare, and how often (and for how long) the table resizes.  They
+// show up bad key distributions, which make for long chains and slow
+// lookups.
+//
+// Statistics are off until HashTableEnableStats turns them on for a
+// table; until then they cost the table a single branch per operation.
+// Building the library with -DHT_NO_STATS compiles them out altogether,
+// in which case HashTableEnableStats always fails.
+//
+// The counters are updated with relaxed atomic operations, so lookups
+// in several threads at once may safely count into them.  A snapshot
+// taken while the table is in use is consistent counter by counter, but
+// not as a whole.
+
+// The histograms count the values 0 through HT_STATS_SLOTS - 2
+// individually, and lump everything bigger into their last slot.
+#define HT_STATS_SLOTS  17
+
+typedef struct ht_stats {
+  uint64_t lookups_hit;     // # of LookupHashTable calls that found the key
+  uint64_t lookups_miss;    // ...and that didn't
+  uint64_t probes_hit;      // # of keys compared, over all hits
+  uint64_t probes_miss;     // ...and over all misses
+  uint64_t max_probes;      // the most keys any one lookup compared
+
+  // # of hits (misses) that compared 0, 1, 2, ... keys
+  uint64_t probe_hist_hit[HT_STATS_SLOTS];
+  uint64_t probe_hist_miss[HT_STATS_SLOTS];
+
+  // # of buckets whose chains are 0, 1, 2, ... entries long right now
+  uint64_t chain_hist[HT_STATS_SLOTS];
+  uint64_t max_chain_length;  // the longest chain since stats were enabled
+
+  uint64_t num_resizes;     // # of times the table has grown
+  uint64_t resize_ns;       // total time spent growing it, in ns
+  uint64_t max_resize_ns;   // the longest single resize, in ns
+} HTStats;
+
+// Start keeping statistics for a table.  The chain-length histogram
+// starts out describing the table's current chains; everything else
+// starts at zero.  Enabling statistics on a table that already keeps
+// them does nothing.  Statistics are freed along with the table.
+//
+// Returns true on success, false if out of memory or if statistics were
+// compiled out.
+bool HashTableEnableStats(HashTable table);
+
+// Take a snapshot of a table's statistics.
+//
+// Arguments:
+//
+// - table: the table to query.
+//
+// - stats: the snapshot is returned through this parameter.
+//
+// Returns true on success, false if the table doesn't keep statistics.
+bool HashTableGetStats(HashTable table, HTStats *stats);
+
+// Write a snapshot of statistics to f, as a few lines of human-readable
+// text or as a single JSON object (followed by a newline).  The JSON
+// object's members are named after HTStats's fields.
+//
+// Returns true on success, false on a write error.
+bool HTStatsWriteText(const HTStats *stats, FILE *f);
+bool HTStatsWriteJSON(const HTStats *stats, FILE *f);
+
+#endif  // _HW1_HASHTABLESTATS_H_
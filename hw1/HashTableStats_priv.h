@@ -0,0 +1,56 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_HASHTABLESTATS_PRIV_H_
+#define _HW1_HASHTABLESTATS_PRIV_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./HashTable.h"
+#include "./HashTableStats.h"
+
+// The hooks HashTable.c calls to keep a table's statistics.  Each goes
+// through HT_STATS, which skips the hook if the table doesn't keep
+// statistics, and compiles it out entirely under HT_NO_STATS:
+//
+//   HT_STATS(table, HTStatsNoteLookup(table->stats, true, probes));
+#ifdef HT_NO_STATS
+#define HT_STATS(table, hook) ((void) 0)
+#else
+#define HT_STATS(table, hook) \
+  do { if ((table)->stats != NULL) { hook; } } while (0)
+#endif
+
+// Note a lookup that compared probes keys, and found the key or not.
+void HTStatsNoteLookup(HTStats *stats, bool hit, uint64_t probes);
+
+// Note that a chain grew to, or shrank to, length entries.
+void HTStatsNoteChainGrew(HTStats *stats, uint64_t length);
+void HTStatsNoteChainShrank(HTStats *stats, uint64_t length);
+
+// Note a resize that took ns nanoseconds.
+void HTStatsNoteResize(HTStats *stats, uint64_t ns);
+
+// Return the histogram slot that counts value.
+#define HT_STATS_SLOT(value) \
+  ((value) < HT_STATS_SLOTS - 1 ? (value) : HT_STATS_SLOTS - 1)
+
+#endif  // _HW1_HASHTABLESTATS_PRIV_H_
@@ -22,7 +22,9 @@
 #define _HW1_HASHTABLE_PRIV_H_
 
 #include "./LinkedList.h"
+#include "./LinkedList_priv.h"  // for LLIterSt
 #include "./HashTable.h"
+#include "./Telemetry_priv.h"
 
 // Define the internal, private structs and helper functions associated with a
 // HashTable.
@@ -34,16 +36,51 @@ typedef struct htrec {
   uint64_t        num_buckets;   // # of buckets in this HT?
   uint64_t        num_elements;  // # of elements currently in this HT?
   LinkedList     *buckets;       // the array of buckets
+  struct ht_log  *log;           // write-ahead log, or NULL if none
+  struct ht_stats *stats;        // statistics, or NULL if not kept
+  const Allocator *allocator;    // where this HT's memory comes from
+  void           *alloc_ctx;     // the allocator's context
+  Arena           arena;         // the table's own arena, or NULL if it
+                                 // isn't arena-backed
+  uint64_t       *touched;       // for a sparse table, one bit per group
+                                 // of HT_SPARSE_GROUP buckets, set once
+                                 // a chain has been allocated in the
+                                 // group; NULL for other tables
+
+  // kept up to date for HashTableMemoryStats
+  uint64_t        num_chains;         // # of chains allocated
+  uint64_t        num_used_buckets;   // # of non-empty chains
+  uint64_t        num_touched_groups; // # of bits set in touched
 } HashTableRecord;
 
+// A sparse table (see AllocateHashTableSized) reserves its bucket array
+// without committing it, and allocates each bucket's chain when a key
+// first lands there; until then the bucket is NULL.  This many buckets
+// (4 KB of bucket array) share one bit of its touched bitmap, so that
+// walking the table can skip the parts of the array never written to.
+#define HT_SPARSE_GROUP  512
+
 // This is the struct we use to represent an iterator.
 typedef struct ht_itrec {
-  bool       is_valid;    // is this iterator valid?
-  HashTable  ht;          // the HT we're pointing into
-  uint64_t   bucket_num;  // which bucket are we in?
-  LLIter     bucket_it;   // iterator for the bucket, or NULL
+  bool       is_valid;     // is this iterator valid?
+  HashTable  ht;           // the HT we're pointing into
+  uint64_t   bucket_num;   // which bucket are we in?
+  LLIter     bucket_it;    // iterator for the bucket, or NULL
+  LLIterSt   bucket_itst;  // where bucket_it lives, so that moving from
+                           // bucket to bucket doesn't allocate
 } HTIterRecord;
 
+// Allocate and free memory for a table through its allocator.
+#define HTAlloc(ht, size) \
+  (TM_COUNT(TM_ALLOCATIONS), \
+   (ht)->allocator->alloc_function((ht)->alloc_ctx, (size)))
+#define HTDealloc(ht, ptr, size) \
+  ((ht)->allocator->dealloc_function((ht)->alloc_ctx, (ptr), (size)))
+
+// Returns true if the table is sparse, i.e., its empty buckets may be
+// NULL rather than empty chains.
+#define HTIsSparse(ht) ((ht)->touched != NULL)
+
 // This is the internal hash function we use to map from uint64_t keys to a
 // bucket number.
 uint64_t HashKeyToBucketNum(HashTable ht, uint64_t key);
@@ -73,4 +110,17 @@ uint64_t HashKeyToBucketNum(HashTable ht, uint64_t key);
 // - +1 if the key was found in the list
 int LookupKey(LinkedList chain, uint64_t key, HTKeyValue **resultkeyvalue, bool removeonfind);
 
+// These are the two halves of FreeHashTable for a table that isn't
+// arena-backed, split so that the chains can be freed piecemeal (see
+// HashTableReclaim.c).  HTFreeChains frees the values, entries and
+// chains in buckets [begin, end); once every chain is gone,
+// HTFreeRecord frees the bucket array and the record.
+void HTFreeChains(HashTable table, uint64_t begin, uint64_t end,
+                  ValueFreeFnPtr value_free_function);
+void HTFreeRecord(HashTable table);
+
+// Recompute the chain-length histogram of a table that keeps statistics
+// (see HashTableStats.h) from its chains.
+void HTStatsRecountChains(HashTable table);
+
 #endif  // _HW1_HASHTABLE_PRIV_H_
@@ -50,8 +50,17 @@ void CheckValidIterator(LLIter iter);
 
 
 LinkedList AllocateLinkedList(void) {
+  return AllocateLinkedListWithAllocator(&kMallocAllocator, NULL);
+}
+
+LinkedList AllocateLinkedListWithAllocator(const Allocator *allocator,
+                                           void *context) {
+  Assert333(allocator != NULL);
+
   // allocate the linked list record
-  LinkedList ll = (LinkedList) malloc(sizeof(LinkedListHead));
+  TM_COUNT(TM_ALLOCATIONS);
+  LinkedList ll =
+    (LinkedList) allocator->alloc_function(context, sizeof(LinkedListHead));
   if (ll == NULL) {
     // out of memory
     return (LinkedList) NULL;
@@ -60,6 +69,9 @@ LinkedList AllocateLinkedList(void) {
   // initialize the newly allocated record structure
 	ll->num_elements = 0U;
 	ll->head = ll->tail = NULL;
+	ll->allocator = allocator;
+	ll->alloc_ctx = context;
+	ll->sorted_by = NULL;
 
   // return our newly minted linked list
   return ll;
@@ -71,18 +83,30 @@ void FreeLinkedList(LinkedList list,
   Assert333(list != NULL);
   Assert333(payload_free_function != NULL);
 
+  if (list->allocator == &kLLNodeSlabAllocator && list->head != NULL) {
+    // slab nodes: free the payloads, then give the whole chain back to
+    // the slab at once.
+    LinkedListNodePtr node;
+    for (node = list->head; node != NULL; node = node->next) {
+      payload_free_function(node->payload);
+      node->payload = NULL;
+    }
+    LLNodeSlabFreeChain(list->head, list->tail, list->num_elements);
+    list->head = list->tail = NULL;
+  }
+
   // sweep through the list and free all of the nodes' payloads as
   // well as the nodes themselves
   while (list->head != NULL) {
 		payload_free_function(list->head->payload);
 		list->head->payload = NULL;
 		LinkedListNodePtr next = list->head->next;
-		free(list->head);
+		LLDealloc(list, list->head, sizeof(LinkedListNode));
 		list->head = next;
   }
 
   // free the list record
-  free(list);
+  LLDealloc(list, list, sizeof(LinkedListHead));
 	list = NULL;
 }
 
@@ -92,6 +116,22 @@ uint64_t NumElementsInLinkedList(LinkedList list) {
   return list->num_elements;
 }
 
+void LinkedListMemoryStats(LinkedList list, LLMemoryStats *stats) {
+  Assert333(list != NULL);
+  Assert333(stats != NULL);
+
+  // there's exactly one node per element, so the counts we already keep
+  // are enough.
+  stats->head_bytes = sizeof(LinkedListHead);
+  stats->node_bytes = list->num_elements * sizeof(LinkedListNode);
+  stats->overhead_bytes =
+    LLAllocatorOverhead(list->allocator, sizeof(LinkedListHead)) +
+    list->num_elements *
+    LLAllocatorOverhead(list->allocator, sizeof(LinkedListNode));
+  stats->total_bytes =
+    stats->head_bytes + stats->node_bytes + stats->overhead_bytes;
+}
+
 bool PushLinkedList(LinkedList list, void *payload) {
   // defensive programming: check argument for safety. The user-supplied
   // argument can be anything, of course, so we need to make sure it's
@@ -101,7 +141,7 @@ bool PushLinkedList(LinkedList list, void *payload) {
 
   // allocate space for the new node.
   LinkedListNodePtr ln =
-    (LinkedListNodePtr) malloc(sizeof(LinkedListNode));
+    (LinkedListNodePtr) LLAlloc(list, sizeof(LinkedListNode));
   if (ln == NULL) {
     // out of memory
     return false;
@@ -147,7 +187,7 @@ bool AppendLinkedList(LinkedList list, void *payload) {
 
   // allocate space for the new node.
   LinkedListNodePtr ln =
-    (LinkedListNodePtr) malloc(sizeof(LinkedListNode));
+    (LinkedListNodePtr) LLAlloc(list, sizeof(LinkedListNode));
   if (ln == NULL) {
     // out of memory; return failure
     return false;
@@ -192,6 +232,8 @@ static void InsertFirstNode(LinkedList list, LinkedListNodePtr ln) {
 	ln->next = ln->prev = NULL;
 	list->head = list->tail = ln;
 	list->num_elements = 1U;
+	list->sorted_by = NULL;
+	TM_COUNT(TM_LL_INSERTS);
 }
 
 static void PushOrAppendLinkedList(LinkedList list, LinkedListNodePtr ln, bool push)  {
@@ -209,12 +251,14 @@ static void PushOrAppendLinkedList(LinkedList list, LinkedListNodePtr ln, bool p
 		list->tail = ln;
 	}
 	list->num_elements++;
+	list->sorted_by = NULL;  // adding a node may unsort the list
+	TM_COUNT(TM_LL_INSERTS);
 }
 
 static void PopOrSliceLinkedList(LinkedList list, bool pop) {
 	if (NumElementsInLinkedList(list) == 1U) {
 		// edge case; a list with single element; list->head == list->tail
-		free(list->head);
+		LLDealloc(list, list->head, sizeof(LinkedListNode));
 		list->head = list->tail = NULL;
 	} else {
 		// typical case; list has >= 2 elements
@@ -230,44 +274,11 @@ static void PopOrSliceLinkedList(LinkedList list, bool pop) {
 			list->tail = oldNode->prev;
 			list->tail->next = NULL;
 		}
-		free(oldNode);
+		LLDealloc(list, oldNode, sizeof(LinkedListNode));
 		oldNode = NULL;
 	}
 	list->num_elements--;
-}
-
-void SortLinkedList(LinkedList list, unsigned int ascending,
-                    LLPayloadComparatorFnPtr comparator_function) {
-  Assert333(list != NULL);  // defensive programming
-  if (list->num_elements < 2) {
-    // no sorting needed
-    return;
-  }
-
-  // we'll implement bubblesort! nice and easy, and nice and slow :)
-  int swapped;
-  do {
-    LinkedListNodePtr curnode;
-
-    swapped = 0;
-    curnode = list->head;
-    while (curnode->next != NULL) {
-      int compare_result = comparator_function(curnode->payload,
-                                               curnode->next->payload);
-      if (ascending) {
-        compare_result *= -1;
-      }
-      if (compare_result < 0) {
-        // bubble-swap payloads
-        void *tmp;
-        tmp = curnode->payload;
-        curnode->payload = curnode->next->payload;
-        curnode->next->payload = tmp;
-        swapped = 1;
-      }
-      curnode = curnode->next;
-    }
-  } while (swapped);
+	TM_COUNT(TM_LL_REMOVES);
 }
 
 LLIter LLMakeIterator(LinkedList list, int pos) {
@@ -280,7 +291,7 @@ LLIter LLMakeIterator(LinkedList list, int pos) {
     return NULL;
 
   // OK, let's manufacture an iterator.
-  LLIter li = (LLIter) malloc(sizeof(LLIterSt));
+  LLIter li = (LLIter) LLAlloc(list, sizeof(LLIterSt));
   if (li == NULL) {
     // out of memory!
     return NULL;
@@ -301,7 +312,7 @@ LLIter LLMakeIterator(LinkedList list, int pos) {
 void LLIteratorFree(LLIter iter) {
   // defensive programming
   Assert333(iter != NULL);
-  free(iter);
+  LLDealloc(iter->list, iter, sizeof(LLIterSt));
 }
 
 bool LLIteratorHasNext(LLIter iter) {
@@ -373,9 +384,10 @@ bool LLIteratorDelete(LLIter iter,
 		LinkedListNodePtr successor = iter->node->next;
 		successor->prev = iter->node->prev;
 		iter->node->prev->next = successor;
-		free(iter->node);
+		LLDealloc(iter->list, iter->node, sizeof(LinkedListNode));
 		iter->node = successor;
 		iter->list->num_elements--;
+		TM_COUNT(TM_LL_REMOVES);
 	} else if (LLIteratorHasNext(iter)) {
 		// degenerate case: iter points at head
 		PopOrSliceLinkedList(iter->list, true);
@@ -410,7 +422,7 @@ bool LLIteratorInsertBefore(LLIter iter, void *payload) {
 
   // General case: we have to do some splicing.
   LinkedListNodePtr newnode =
-    (LinkedListNodePtr) malloc(sizeof(LinkedListNode));
+    (LinkedListNodePtr) LLAlloc(iter->list, sizeof(LinkedListNode));
   if (newnode == NULL)
     return false;  // out of memory
 
@@ -420,6 +432,8 @@ bool LLIteratorInsertBefore(LLIter iter, void *payload) {
   newnode->prev->next = newnode;
   newnode->next->prev = newnode;
   iter->list->num_elements += 1;
+  iter->list->sorted_by = NULL;
+  TM_COUNT(TM_LL_INSERTS);
   return true;
 }
 
@@ -23,6 +23,8 @@
 #include <stdbool.h>  // for bool type (true, false)
 #include <stdint.h>   // for uint64_t
 
+#include "./Allocator.h"  // for Allocator
+
 // A LinkedList is a doubly-linked list.  We provide the interface to the
 // LinkedList here; your job is to fill in the implementation holes that we
 // left in LinkedList.c.
@@ -49,6 +51,18 @@ typedef void(*LLPayloadFreeFnPtr)(void *payload);
 //    +1  if payload_a > payload_b
 typedef int(*LLPayloadComparatorFnPtr)(void *payload_a, void *payload_b);
 
+// When sorting a linked list by key, customers pass in a function that
+// returns a payload's sort key.
+typedef uint64_t(*LLPayloadKeyFnPtr)(void *payload);
+
+// When merging sorted linked lists, customers may pass in a function
+// that's called when a payload equal to the last one merged comes
+// along.  The duplicate is dropped from the merged list; the function
+// takes ownership of it, to free it, or to fold it into the payload
+// that was kept.
+typedef void(*LLPayloadDedupFnPtr)(void *kept_payload,
+                                   void *duplicate_payload);
+
 // Allocate and return a new linked list.  The caller takes responsibility for
 // eventually calling FreeLinkedList to free memory associated with the list.
 //
@@ -57,6 +71,45 @@ typedef int(*LLPayloadComparatorFnPtr)(void *payload_a, void *payload_b);
 // Returns: NULL on error, non-NULL on success.
 LinkedList AllocateLinkedList(void);
 
+// Allocate and return a new linked list whose memory -- the list record,
+// its nodes and its iterators -- all comes from the given allocator
+// rather than from malloc.  AllocateLinkedList() is the same as passing
+// &kMallocAllocator.
+//
+// Arguments:
+//
+// - allocator: the allocator's vtable; see Allocator.h.  It must stay
+//   valid for as long as the list does.
+//
+// - context: the context pointer to pass to the allocator's functions.
+//
+// Returns: NULL on error, non-NULL on success.
+LinkedList AllocateLinkedListWithAllocator(const Allocator *allocator,
+                                           void *context);
+
+// A built-in allocator tuned for list nodes, for lists that churn
+// through many of them (e.g., queues).  Nodes are carved out of large,
+// huge-page-backed slabs and recycled through a per-thread free list,
+// so pushing and popping normally costs no malloc() or free() at all;
+// freeing a list hands all of its nodes back at once.
+// Allocations that aren't nodes (the list record, iterators) go to
+// malloc.  Node memory is never returned to the OS, only reused.
+//
+// Pass it to AllocateLinkedListWithAllocator with a NULL context.
+extern const Allocator kLLNodeSlabAllocator;
+
+// A thread keeps at most this many free nodes to itself; beyond that,
+// they go to a spare list shared by all threads.
+#define LL_SLAB_MAX_FREE  1024
+
+// Return the number of nodes on the calling thread's slab free list,
+// and on the shared spare list.
+uint64_t LLNodeSlabNumFree(void);
+uint64_t LLNodeSlabNumSpare(void);
+
+// Return the number of bytes of slab that have been carved up so far.
+uint64_t LLNodeSlabBytes(void);
+
 // Free a linked list that was previously allocated by AllocateLinkedList.
 //
 // Arguments:
@@ -80,6 +133,24 @@ void FreeLinkedList(LinkedList list,
 // - list length
 uint64_t NumElementsInLinkedList(LinkedList list);
 
+// The memory a LinkedList uses for its own bookkeeping, not counting
+// the payloads it points to.
+typedef struct {
+  uint64_t head_bytes;      // the list record
+  uint64_t node_bytes;      // the list's nodes
+  uint64_t overhead_bytes;  // estimated allocator overhead on the above
+  uint64_t total_bytes;     // the sum of the above
+} LLMemoryStats;
+
+// Report the memory a LinkedList is using.  This takes constant time.
+//
+// Arguments:
+//
+// - list: the list to query
+//
+// - stats: the numbers are returned through this parameter
+void LinkedListMemoryStats(LinkedList list, LLMemoryStats *stats);
+
 // Adds a new element to the head of the linked list.
 //
 // Arguments:
@@ -128,7 +199,15 @@ bool AppendLinkedList(LinkedList list, void *payload);
 // Returns false on failure, true on success.
 bool SliceLinkedList(LinkedList list, void **payload_ptr);
 
-// Sorts a LinkedList in place.
+// Sorts a LinkedList in place.  The sort is stable (payloads that
+// compare equal keep their order) and takes O(n log n) comparisons.  It
+// moves nodes rather than payloads, so an iterator's node keeps its
+// payload, wherever that ends up in the list.
+//
+// A list remembers the comparator and direction it was last sorted by,
+// until a node is added to it, and sorting it again the same way
+// returns at once.  If payloads are changed in place in a way that
+// changes their order, call LinkedListMarkUnsorted before re-sorting.
 //
 // Arguments:
 //
@@ -141,6 +220,134 @@ bool SliceLinkedList(LinkedList list, void **payload_ptr);
 void SortLinkedList(LinkedList list, unsigned int ascending,
                     LLPayloadComparatorFnPtr comparator_function);
 
+// Sorts a LinkedList in place using several threads, for long lists.
+// The payloads are copied into an array, whose parts are sorted in
+// parallel and then merged in parallel, and the nodes are relinked in
+// their new order.  The result is the same as SortLinkedList's.  Short
+// lists are given fewer threads; lists too short to be worth copying
+// (or if memory runs out) are sorted with SortLinkedList.
+//
+// Arguments:
+//
+// - list: the list to sort
+//
+// - ascending: if 0, sorts descending, else sorts ascending.
+//
+// - comparator_function: a payload comparator, as for SortLinkedList.
+//   It's called from several threads at once.
+//
+// - num_threads: the most threads to use, including the calling thread.
+void SortLinkedListParallel(LinkedList list, unsigned int ascending,
+                            LLPayloadComparatorFnPtr comparator_function,
+                            int num_threads);
+
+// Sorts a LinkedList in place, like SortLinkedList, but makes use of
+// order already in the list: it finds the runs that are already sorted
+// (reversing descending ones) and merges them, galloping through long
+// stretches that come from one run.  A list made of a few sorted runs,
+// such as a sorted list with a few elements out of place, takes close
+// to O(n) comparisons; any list takes O(n log n).  The result is the
+// same as SortLinkedList's.
+//
+// Arguments:
+//
+// - list: the list to sort
+//
+// - ascending: if 0, sorts descending, else sorts ascending.
+//
+// - comparator_function: a payload comparator, as for SortLinkedList.
+void SortLinkedListAdaptive(LinkedList list, unsigned int ascending,
+                            LLPayloadComparatorFnPtr comparator_function);
+
+// Forget that a list is sorted (see SortLinkedList), so that the next
+// sort really sorts it.
+//
+// Arguments:
+//
+// - list: the list whose payloads have changed
+void LinkedListMarkUnsorted(LinkedList list);
+
+// Sorts a LinkedList in place by an integer key taken from each payload,
+// without comparisons: the keys are extracted once, into an array with
+// the nodes, which is radix sorted (8 bits at a time, skipping bytes
+// that all keys share), and the nodes are relinked in their new order.
+// The sort is stable, and (like SortLinkedList) a list that's known to
+// be sorted by the same key already is left alone.
+//
+// Arguments:
+//
+// - list: the list to sort
+//
+// - ascending: if 0, sorts by descending key, else by ascending key.
+//
+// - key_function: returns a payload's key.  It's called once per node.
+//
+// Returns false if out of memory (leaving the list as it was), else
+// true.
+bool SortLinkedListByKey(LinkedList list, unsigned int ascending,
+                         LLPayloadKeyFnPtr key_function);
+
+// Finds the first k payloads a stable sort of a LinkedList would put
+// first, without sorting it: the list is left untouched, and its best k
+// payloads are appended, in sorted order, to out_list.  It keeps a heap
+// of the best k seen so far, so it takes O(n log k) comparisons, and
+// little more than n of them when k is small; a list that's known to be
+// sorted already just has its first k payloads copied.
+//
+// The payloads are shared, not copied: out_list should be freed with a
+// free function that leaves them alone.
+//
+// Arguments:
+//
+// - list: the list to look through
+//
+// - k: how many payloads to find; if the list holds fewer, all of them
+//   are appended.
+//
+// - ascending: if 0, finds the k largest payloads, largest first; else
+//   the k smallest, smallest first.
+//
+// - comparator_function: a payload comparator, as for SortLinkedList.
+//
+// - out_list: the list to append the payloads to.  If it starts out
+//   empty, it's known to be sorted afterwards.
+//
+// Returns false if out of memory (out_list may then hold some of the
+// payloads), else true.
+bool LinkedListTopK(LinkedList list, uint64_t k, unsigned int ascending,
+                    LLPayloadComparatorFnPtr comparator_function,
+                    LinkedList out_list);
+
+// Merges several sorted LinkedLists into one, by splicing their nodes
+// together: there's no node allocation, and the input lists are left
+// empty (but still need freeing).  The merge plays the lists' heads off
+// against each other in a tournament tree, taking O(n log k)
+// comparisons for n payloads in k lists.  It's stable: payloads that
+// compare equal keep their order within a list, and those from earlier
+// lists come first.  The merged list is known to be sorted.
+//
+// Arguments:
+//
+// - lists: the lists to merge, each of them sorted the same way.  They
+//   must all have the same allocator, whose nodes the merged list then
+//   uses.
+//
+// - num_lists: how many lists there are.
+//
+// - ascending: if 0, the lists are sorted descending, else ascending.
+//
+// - comparator_function: the payload comparator they're sorted by.
+//
+// - dedup_function: if not NULL, only the first of each run of equal
+//   payloads is kept, and the rest are handed to dedup_function.
+//
+// Returns NULL if out of memory (leaving the lists as they were), else
+// the merged list.
+LinkedList MergeSortedLinkedLists(LinkedList *lists, uint64_t num_lists,
+                                  unsigned int ascending,
+                                  LLPayloadComparatorFnPtr comparator_function,
+                                  LLPayloadDedupFnPtr dedup_function);
+
 // Linked lists support the notion of an iterator, similar to Java iterators.
 // You use an iterator to navigate back and forth through the linked list and
 // to insert/remove elements from the list.  You use LLMakeIterator() to
@@ -0,0 +1,498 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Assert333.h"
+#include "LinkedList.h"
+#include "LinkedList_priv.h"
+#include "LinkedListExternalSort.h"
+
+// Runs are written and read through stdio buffers of at least this
+// size, so that the I/O that reaches the kernel is big and sequential.
+#define LL_SPILL_MIN_BUFFER  (64 * 1024)
+
+// A run that has been written out to a temporary file.
+typedef struct {
+  int      fd;           // the (already unlinked) file, or -1
+  uint64_t num_records;  // # payloads in it
+} SpillRun;
+
+// Reads a run back in during a merge.
+typedef struct {
+  FILE          *f;          // the run
+  uint64_t       remaining;  // # records in it not yet read
+  void          *payload;    // the payload read last, or NULL once
+                             // the run is used up
+  unsigned char *bytes;      // the bytes of the record read last
+  uint64_t       capacity;   // ...and how many bytes[] has room for
+} RunReader;
+
+// An external sort in progress: its arguments, and the runs it has
+// written out but not yet merged.
+typedef struct {
+  LinkedList                   list;
+  unsigned int                 ascending;
+  LLPayloadComparatorFnPtr     comparator;
+  const LLExternalSortOptions *options;
+  uint64_t                     budget;
+  uint64_t                     spill_buffer;  // runs are written
+                                              // through this much
+  LLSortedPayloadFnPtr         output_function;
+  void                        *output_arg;
+  LLExternalSortStats         *stats;
+  SpillRun                    *runs;
+  uint64_t                     num_runs;
+  uint64_t                     runs_capacity;
+} ExternalSort;
+
+// Internal helper that cuts the first num_nodes nodes off the front of
+// the list, sorts them, and writes them out as a new run.  The nodes and
+// their payloads are freed whether or not it succeeds.
+static bool SpillNodes(ExternalSort *sort, uint64_t num_nodes);
+
+// Internal helper that merges passes of fan_in runs at a time into
+// longer runs, until no more than fan_in are left.
+static bool MergePasses(ExternalSort *sort, uint64_t fan_in);
+
+// Internal helper that merges the k runs starting at runs through a
+// loser tree.  The output is written to a new run, which is returned
+// through out, or if out is NULL is the sort's final output.  The runs
+// are closed whether or not it succeeds.
+static bool MergeRuns(ExternalSort *sort, SpillRun *runs, uint64_t k,
+                      SpillRun *out);
+
+// Internal helper that hands a payload in sorted order to where the
+// sort's output goes: the list, or the output function.
+static bool OutputPayload(ExternalSort *sort, void *payload);
+
+// Internal helpers to create a new, unlinked, run file and return a
+// stream to write it through, and to write a record to that stream.
+static FILE *CreateRun(ExternalSort *sort, SpillRun *run,
+                       uint64_t buffer_size);
+static bool WriteRecord(ExternalSort *sort, FILE *f, SpillRun *run,
+                        void *payload);
+
+// Internal helpers to start reading a run from its beginning, and to
+// read its next record into reader->payload.
+static bool OpenReader(RunReader *reader, SpillRun *run,
+                       uint64_t buffer_size);
+static bool ReadRecord(ExternalSort *sort, RunReader *reader);
+
+// Internal helper for the run merge's loser tree (see
+// LinkedList_priv.h), whose contestants are the readers.  Beats
+// returns true if reader a's payload comes out before reader b's.
+typedef struct {
+  ExternalSort *sort;
+  RunReader    *readers;
+} MergeReaders;
+static bool Beats(void *arg, uint64_t a, uint64_t b);
+
+// Internal helper to close and forget any runs the sort is left with.
+static void CloseRuns(ExternalSort *sort);
+
+bool ExternalSortLinkedList(LinkedList list, unsigned int ascending,
+                            LLPayloadComparatorFnPtr comparator_function,
+                            const LLExternalSortOptions *options,
+                            LLSortedPayloadFnPtr output_function,
+                            void *output_arg,
+                            LLExternalSortStats *stats) {
+  LLExternalSortStats ignored;
+  ExternalSort sort;
+  LinkedListNodePtr node;
+  uint64_t run_limit, run_bytes, num_nodes, len, fan_in;
+  void *payload;
+  bool ok = true;
+
+  Assert333(list != NULL);  // defensive programming
+  Assert333(comparator_function != NULL);
+  Assert333(options != NULL);
+  Assert333(options->payload_bytes_function != NULL);
+  Assert333(options->payload_from_bytes_function != NULL);
+  Assert333(options->payload_free_function != NULL);
+
+  memset(&sort, 0, sizeof(sort));
+  sort.list = list;
+  sort.ascending = ascending;
+  sort.comparator = comparator_function;
+  sort.options = options;
+  sort.budget = options->memory_budget;
+  if (sort.budget < LL_EXTERNAL_SORT_MIN_BUDGET)
+    sort.budget = LL_EXTERNAL_SORT_MIN_BUDGET;
+  sort.output_function = output_function;
+  sort.output_arg = output_arg;
+  sort.stats = (stats != NULL) ? stats : &ignored;
+  memset(sort.stats, 0, sizeof(LLExternalSortStats));
+
+  // cut runs of up to run_limit bytes off the front of the list (less
+  // the buffer each is written out through) until it is used up.  If
+  // the first run would take the whole list, it fits in memory, and
+  // nothing needs writing out.
+  sort.spill_buffer = sort.budget / 16;
+  if (sort.spill_buffer < LL_SPILL_MIN_BUFFER)
+    sort.spill_buffer = LL_SPILL_MIN_BUFFER;
+  run_limit = sort.budget - sort.spill_buffer;
+  if (list->sorted_by != comparator_function ||
+      (list->sorted_ascending != 0) != (ascending != 0)) {
+    while (ok && list->num_elements > 0) {
+      run_bytes = 0;
+      num_nodes = 0;
+      for (node = list->head; node != NULL; node = node->next) {
+        options->payload_bytes_function(node->payload, &len);
+        if (num_nodes > 0 && run_bytes + sizeof(len) + len > run_limit)
+          break;
+        run_bytes += sizeof(len) + len;
+        num_nodes++;
+      }
+      if (node == NULL && sort.num_runs == 0)
+        break;
+      ok = SpillNodes(&sort, num_nodes);
+    }
+  }
+
+  if (ok && sort.num_runs == 0) {
+    // sort in memory.
+    SortLinkedList(list, ascending, comparator_function);
+    if (output_function != NULL) {
+      while (ok && PopLinkedList(list, &payload))
+        ok = output_function(payload, output_arg);
+    }
+  } else if (ok) {
+    // merge the runs; the budget leaves room for a buffer per run
+    // being merged, plus one for the output.
+    sort.stats->num_runs = sort.num_runs;
+    fan_in = sort.budget / LL_SPILL_MIN_BUFFER - 1;
+    ok = MergePasses(&sort, fan_in) &&
+         MergeRuns(&sort, sort.runs, sort.num_runs, NULL);
+    sort.stats->num_passes++;
+    if (ok && output_function == NULL) {
+      list->sorted_by = comparator_function;
+      list->sorted_ascending = ascending;
+    }
+  }
+
+  CloseRuns(&sort);
+  if (!ok) {
+    while (PopLinkedList(list, &payload))
+      options->payload_free_function(payload);
+  }
+  return ok;
+}
+
+static bool SpillNodes(ExternalSort *sort, uint64_t num_nodes) {
+  LinkedList list = sort->list, run;
+  LinkedListNodePtr last, node;
+  SpillRun *runs;
+  SpillRun out;
+  uint64_t i;
+  FILE *f;
+  bool ok;
+
+  run = AllocateLinkedListWithAllocator(list->allocator, list->alloc_ctx);
+  if (run == NULL)
+    return false;
+
+  // move the nodes over to run, then sort them there.
+  for (last = list->head, i = 1; i < num_nodes; i++)
+    last = last->next;
+  run->head = list->head;
+  run->tail = last;
+  run->num_elements = num_nodes;
+  list->head = last->next;
+  if (list->head != NULL) {
+    list->head->prev = NULL;
+  } else {
+    list->tail = NULL;
+  }
+  last->next = NULL;
+  list->num_elements -= num_nodes;
+  SortLinkedList(run, sort->ascending, sort->comparator);
+
+  f = CreateRun(sort, &out, sort->spill_buffer);
+  ok = (f != NULL);
+  for (node = run->head; ok && node != NULL; node = node->next)
+    ok = WriteRecord(sort, f, &out, node->payload);
+  if (f != NULL && fclose(f) != 0)
+    ok = false;
+  FreeLinkedList(run, sort->options->payload_free_function);
+
+  if (ok && sort->num_runs == sort->runs_capacity) {
+    sort->runs_capacity = (sort->runs_capacity > 0) ?
+      2 * sort->runs_capacity : 16;
+    runs = (SpillRun *) realloc(sort->runs,
+                                sort->runs_capacity * sizeof(SpillRun));
+    if (runs == NULL) {
+      ok = false;
+    } else {
+      sort->runs = runs;
+    }
+  }
+  if (!ok) {
+    if (f != NULL)
+      close(out.fd);
+    return false;
+  }
+  sort->runs[sort->num_runs++] = out;
+  return true;
+}
+
+static bool MergePasses(ExternalSort *sort, uint64_t fan_in) {
+  SpillRun *merged;
+  uint64_t i, k, num_merged;
+  bool ok = true;
+
+  while (ok && sort->num_runs > fan_in) {
+    num_merged = (sort->num_runs + fan_in - 1) / fan_in;
+    merged = (SpillRun *) malloc(num_merged * sizeof(SpillRun));
+    if (merged == NULL)
+      return false;
+    num_merged = 0;
+    for (i = 0; ok && i < sort->num_runs; i += k) {
+      k = sort->num_runs - i;
+      if (k > fan_in)
+        k = fan_in;
+      if (k == 1) {
+        // nothing to merge it with; carry it over as it is.
+        merged[num_merged] = sort->runs[i];
+        sort->runs[i].fd = -1;
+      } else {
+        ok = MergeRuns(sort, &sort->runs[i], k, &merged[num_merged]);
+      }
+      if (ok)
+        num_merged++;
+    }
+    sort->stats->num_passes++;
+
+    // swap in the merged runs; CloseRuns takes care of any that were
+    // left unmerged if a merge failed.
+    for (i = 0; i < sort->num_runs; i++) {
+      if (sort->runs[i].fd >= 0)
+        close(sort->runs[i].fd);
+    }
+    free(sort->runs);
+    sort->runs = merged;
+    sort->num_runs = num_merged;
+    sort->runs_capacity = num_merged;
+  }
+  return ok;
+}
+
+static bool MergeRuns(ExternalSort *sort, SpillRun *runs, uint64_t k,
+                      SpillRun *out) {
+  RunReader *readers;
+  MergeReaders merge;
+  uint64_t *tree, buffer_size, i, w;
+  FILE *f = NULL;
+  void *payload;
+  bool ok;
+
+  // split the budget evenly between the runs being read and the output.
+  buffer_size = sort->budget / (k + 1);
+  readers = (RunReader *) calloc(k, sizeof(RunReader));
+  tree = (uint64_t *) malloc(3 * k * sizeof(uint64_t));  // see LLBuildLoserTree
+  ok = (readers != NULL && tree != NULL);
+  for (i = 0; ok && i < k; i++) {
+    ok = OpenReader(&readers[i], &runs[i], buffer_size) &&
+         ReadRecord(sort, &readers[i]);
+  }
+  if (ok && out != NULL) {
+    f = CreateRun(sort, out, buffer_size);
+    ok = (f != NULL);
+  }
+
+  if (ok) {
+    merge.sort = sort;
+    merge.readers = readers;
+    LLBuildLoserTree(k, tree, &Beats, &merge);
+    while (ok && readers[tree[0]].payload != NULL) {
+      w = tree[0];
+      payload = readers[w].payload;
+      readers[w].payload = NULL;
+      if (out != NULL) {
+        ok = WriteRecord(sort, f, out, payload);
+        sort->options->payload_free_function(payload);
+      } else {
+        ok = OutputPayload(sort, payload);
+      }
+      ok = ok && ReadRecord(sort, &readers[w]);
+      if (ok)
+        LLReplayLoserTree(k, tree, &Beats, &merge);
+    }
+  }
+
+  if (f != NULL) {
+    if (fclose(f) != 0)
+      ok = false;
+    if (!ok)
+      close(out->fd);
+  }
+  for (i = 0; readers != NULL && i < k; i++) {
+    if (readers[i].payload != NULL)
+      sort->options->payload_free_function(readers[i].payload);
+    if (readers[i].f != NULL)
+      fclose(readers[i].f);
+    if (runs[i].fd >= 0)
+      close(runs[i].fd);
+    runs[i].fd = -1;
+    free(readers[i].bytes);
+  }
+  free(readers);
+  free(tree);
+  return ok;
+}
+
+static bool OutputPayload(ExternalSort *sort, void *payload) {
+  if (sort->output_function != NULL)
+    return sort->output_function(payload, sort->output_arg);
+  if (!AppendLinkedList(sort->list, payload)) {
+    sort->options->payload_free_function(payload);
+    return false;
+  }
+  return true;
+}
+
+static FILE *CreateRun(ExternalSort *sort, SpillRun *run,
+                       uint64_t buffer_size) {
+  static const char kTemplate[] = "/llsortXXXXXX";
+  const char *dir = sort->options->temp_dir;
+  char *path;
+  FILE *f;
+  int fd, wfd;
+
+  if (dir == NULL)
+    dir = getenv("TMPDIR");
+  if (dir == NULL)
+    dir = "/tmp";
+  path = (char *) malloc(strlen(dir) + sizeof(kTemplate));
+  if (path == NULL)
+    return NULL;
+  strcpy(path, dir);
+  strcat(path, kTemplate);
+  fd = mkstemp(path);
+  if (fd >= 0)
+    unlink(path);
+  free(path);
+  if (fd < 0)
+    return NULL;
+
+  // write through a stream on a dup of the file, so the stream can be
+  // closed when the run is done while the run keeps the file open.
+  wfd = dup(fd);
+  f = (wfd >= 0) ? fdopen(wfd, "wb") : NULL;
+  if (f == NULL) {
+    if (wfd >= 0)
+      close(wfd);
+    close(fd);
+    return NULL;
+  }
+  setvbuf(f, NULL, _IOFBF, buffer_size);
+  run->fd = fd;
+  run->num_records = 0;
+  return f;
+}
+
+static bool WriteRecord(ExternalSort *sort, FILE *f, SpillRun *run,
+                        void *payload) {
+  const void *bytes;
+  uint64_t len;
+
+  // each record is the payload's length, and then its bytes.
+  bytes = sort->options->payload_bytes_function(payload, &len);
+  if (fwrite(&len, sizeof(len), 1, f) != 1 ||
+      (len > 0 && fwrite(bytes, 1, len, f) != len))
+    return false;
+  run->num_records++;
+  sort->stats->bytes_written += sizeof(len) + len;
+  return true;
+}
+
+static bool OpenReader(RunReader *reader, SpillRun *run,
+                       uint64_t buffer_size) {
+  if (lseek(run->fd, 0, SEEK_SET) != 0)
+    return false;
+  reader->f = fdopen(run->fd, "rb");
+  if (reader->f == NULL)
+    return false;
+  setvbuf(reader->f, NULL, _IOFBF, buffer_size);
+  run->fd = -1;  // the reader owns it now
+  reader->remaining = run->num_records;
+  return true;
+}
+
+static bool ReadRecord(ExternalSort *sort, RunReader *reader) {
+  unsigned char *bytes;
+  uint64_t len;
+
+  reader->payload = NULL;
+  if (reader->remaining == 0)
+    return true;
+  if (fread(&len, sizeof(len), 1, reader->f) != 1)
+    return false;
+  if (len > reader->capacity) {
+    bytes = (unsigned char *) realloc(reader->bytes, len);
+    if (bytes == NULL)
+      return false;
+    reader->bytes = bytes;
+    reader->capacity = len;
+  }
+  if (len > 0 && fread(reader->bytes, 1, len, reader->f) != len)
+    return false;
+  reader->payload =
+    sort->options->payload_from_bytes_function(reader->bytes, len);
+  if (reader->payload == NULL)
+    return false;
+  reader->remaining--;
+  return true;
+}
+
+static bool Beats(void *arg, uint64_t a, uint64_t b) {
+  MergeReaders *merge = (MergeReaders *) arg;
+  ExternalSort *sort = merge->sort;
+  RunReader *readers = merge->readers;
+  int c;
+
+  // a used up run loses to everything; equal payloads come out in run
+  // order, which keeps the sort stable.
+  if (readers[a].payload == NULL)
+    return false;
+  if (readers[b].payload == NULL)
+    return true;
+  c = sort->comparator(readers[a].payload, readers[b].payload);
+  if (c == 0)
+    return a < b;
+  return sort->ascending ? (c < 0) : (c > 0);
+}
+
+static void CloseRuns(ExternalSort *sort) {
+  uint64_t i;
+
+  for (i = 0; i < sort->num_runs; i++) {
+    if (sort->runs[i].fd >= 0)
+      close(sort->runs[i].fd);
+  }
+  free(sort->runs);
+  sort->runs = NULL;
+  sort->num_runs = 0;
+  sort->runs_capacity = 0;
+}
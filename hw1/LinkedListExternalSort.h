@@ -0,0 +1,126 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_LINKEDLISTEXTERNALSORT_H_
+#define _HW1_LINKEDLISTEXTERNALSORT_H_
+
+#include <stdbool.h>    // for bool, true, false
+#include <stdint.h>     // so we can use uint64_t, etc.
+
+#include "./LinkedList.h"  // for LinkedList, LLPayloadComparatorFnPtr
+
+// An external sort sorts a LinkedList whose payloads take more memory,
+// all together, than the sort is allowed to use.  It cuts the list into
+// runs of at most a memory budget's worth of payloads, sorts each run in
+// memory with SortLinkedList, and writes it out to a temporary file,
+// freeing the run's payloads as it goes.  It then merges the runs back
+// together, several at a time through a loser tree, reading each run
+// through its own large buffer.  If there are more runs than the budget
+// has room for buffers, it merges them in more than one pass.
+//
+// The sorted payloads are either appended back onto the (by then empty)
+// list, or handed one at a time, in order, to a callback; a caller that
+// streams them out that way never has them all in memory at once.
+//
+// Payloads are opaque pointers, so customers need to tell us how to
+// turn a payload into bytes and back.  These work just like a
+// HashTableImage's ValueBytesFnPtr and ValueFromBytesFnPtr: the first
+// returns a pointer to a payload's bytes and sets *len to how many there
+// are (the bytes must stay valid until the next call, and it may be
+// called more than once per payload); the second allocates and returns
+// a new payload from len bytes, or NULL if out of memory.
+typedef const void *(*LLPayloadBytesFnPtr)(void *payload, uint64_t *len);
+typedef void *(*LLPayloadFromBytesFnPtr)(const void *bytes, uint64_t len);
+
+// The callback sorted payloads are handed to.  It takes ownership of the
+// payload, and returns false to abandon the sort (e.g., because it
+// couldn't write the payload out), true to carry on.
+typedef bool (*LLSortedPayloadFnPtr)(void *payload, void *arg);
+
+// The smallest memory budget an external sort will work with; smaller
+// budgets are rounded up to it.  It leaves room for the buffers of a
+// three-way merge.
+#define LL_EXTERNAL_SORT_MIN_BUDGET  (256 * 1024)
+
+// How to go about an external sort.
+typedef struct {
+  uint64_t    memory_budget;  // in bytes: the serialized size of the
+                              // payloads in one run, plus the I/O
+                              // buffers the merges read through
+  const char *temp_dir;       // where to write the runs; NULL for
+                              // $TMPDIR, or /tmp if that isn't set
+  LLPayloadBytesFnPtr     payload_bytes_function;
+  LLPayloadFromBytesFnPtr payload_from_bytes_function;
+  LLPayloadFreeFnPtr      payload_free_function;
+} LLExternalSortOptions;
+
+// What an external sort did.
+typedef struct {
+  uint64_t num_runs;       // # runs the list was cut into and written
+                           // out; 0 if it was sorted in memory
+  uint64_t num_passes;     // # merge passes over the runs
+  uint64_t bytes_written;  // # bytes written to run files, over all of
+                           // the passes
+} LLExternalSortStats;
+
+// Sort a list within a memory budget, spilling runs of it to temporary
+// files if it doesn't fit.  The sort is stable.  A list whose payloads
+// fit within the budget, or that is known to be sorted already, is
+// sorted in memory and nothing is written to disk.  The run files are
+// unlinked as soon as they are created, so nothing is left behind if the
+// process dies part way through.
+//
+// Besides the budget, the sort holds one deserialized payload per run
+// it is merging, and a buffer the size of the largest payload's bytes
+// for each.
+//
+// Arguments:
+//
+// - list: the list to sort.
+//
+// - ascending: if 0, sorts descending, otherwise sorts ascending.
+//
+// - comparator_function: this argument is a pointer to a payload
+//   comparator function; see above.
+//
+// - options: the budget, the temporary directory and the payload
+//   functions to use; see above.
+//
+// - output_function: if NULL, the sorted payloads are appended back
+//   onto list.  Otherwise list is left empty, and each payload is handed
+//   in turn to output_function, along with output_arg.
+//
+// - output_arg: passed through to output_function.
+//
+// - stats: if not NULL, what the sort did is returned through this
+//   parameter.
+//
+// Returns false on failure (out of memory, an I/O error such as a full
+// disk, or output_function abandoning the sort), true on success.  On
+// failure list is left empty, and the payloads that weren't handed to
+// output_function are freed.
+bool ExternalSortLinkedList(LinkedList list, unsigned int ascending,
+                            LLPayloadComparatorFnPtr comparator_function,
+                            const LLExternalSortOptions *options,
+                            LLSortedPayloadFnPtr output_function,
+                            void *output_arg,
+                            LLExternalSortStats *stats);
+
+#endif  // _HW1_LINKEDLISTEXTERNALSORT_H_
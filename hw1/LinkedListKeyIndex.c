@@ -0,0 +1,323 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "Assert333.h"
+#include "LinkedList.h"
+#include "LinkedList_priv.h"
+#include "LinkedListKeyIndex.h"
+#include "LinkedListKeyIndex_priv.h"
+
+// When one index is at least this many times longer than the other,
+// intersections and unions gallop through the longer one rather than
+// merging the two.
+#define LL_GALLOP_RATIO  16
+
+// A galloping search narrows down to a block of at most this many
+// keys, and then scans it.
+#define LL_SCAN_BLOCK  16
+
+// Where an intersection's or union's payloads go.
+typedef struct {
+  LinkedList           out_list;
+  LLPayloadVisitFnPtr  visit_function;
+  void                *visit_arg;
+  bool                 stopped;  // true once visit_function says stop
+} KeyIndexOutput;
+
+// Internal helper that hands payloads[begin, end) over to out.  Returns
+// false if that fails (out of memory) or the visit function says to
+// stop (and out->stopped is set); either way, the caller should stop,
+// returning out->stopped.
+static bool Emit(KeyIndexOutput *out, void **payloads, uint64_t begin,
+                 uint64_t end);
+
+// Internal helper that returns the position of the first of
+// keys[from, n) that is >= key, or n if there is none, galloping out
+// from from in steps of 1, 2, 4, ... and then narrowing down.
+static uint64_t Gallop(const uint64_t *keys, uint64_t from, uint64_t n,
+                       uint64_t key);
+
+// Internal helper that returns how many of keys[0, n) are < key.  It
+// doesn't branch on the keys, so the compiler can vectorize it.
+static uint64_t CountLess(const uint64_t *keys, uint64_t n, uint64_t key);
+
+// Internal helpers that do the work of IntersectLLKeyIndexes and
+// UnionLLKeyIndexes.
+static bool Intersect(LLKeyIndex a, LLKeyIndex b, KeyIndexOutput *out);
+static bool Union(LLKeyIndex a, LLKeyIndex b, KeyIndexOutput *out);
+
+LLKeyIndex MakeLLKeyIndex(LinkedList list, LLPayloadKeyFnPtr key_function) {
+  LinkedListNodePtr node;
+  LLKeyIndex index;
+  uint64_t i, n;
+
+  Assert333(list != NULL);  // defensive programming
+  Assert333(key_function != NULL);
+
+  // allocate at least one of each, so that malloc(0) can't fail.
+  n = list->num_elements;
+  index = (LLKeyIndex) malloc(sizeof(LLKeyIndexSt));
+  if (index == NULL)
+    return NULL;
+  index->num_keys = n;
+  index->keys = (uint64_t *) malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+  index->payloads = (void **) malloc((n > 0 ? n : 1) * sizeof(void *));
+  if (index->keys == NULL || index->payloads == NULL) {
+    FreeLLKeyIndex(index);
+    return NULL;
+  }
+
+  for (node = list->head, i = 0; node != NULL; node = node->next, i++) {
+    index->keys[i] = key_function(node->payload);
+    index->payloads[i] = node->payload;
+    Assert333(i == 0 || index->keys[i - 1] < index->keys[i]);
+  }
+  return index;
+}
+
+void FreeLLKeyIndex(LLKeyIndex index) {
+  Assert333(index != NULL);
+  free(index->keys);
+  free(index->payloads);
+  free(index);
+}
+
+uint64_t NumKeysInLLKeyIndex(LLKeyIndex index) {
+  Assert333(index != NULL);
+  return index->num_keys;
+}
+
+bool IntersectLLKeyIndexes(LLKeyIndex a, LLKeyIndex b, LinkedList out_list,
+                           LLPayloadVisitFnPtr visit_function,
+                           void *visit_arg) {
+  KeyIndexOutput out = { out_list, visit_function, visit_arg, false };
+
+  Assert333(a != NULL);  // defensive programming
+  Assert333(b != NULL);
+  Assert333(out_list != NULL || visit_function != NULL);
+  return Intersect(a, b, &out);
+}
+
+bool UnionLLKeyIndexes(LLKeyIndex a, LLKeyIndex b, LinkedList out_list,
+                       LLPayloadVisitFnPtr visit_function, void *visit_arg) {
+  KeyIndexOutput out = { out_list, visit_function, visit_arg, false };
+
+  Assert333(a != NULL);  // defensive programming
+  Assert333(b != NULL);
+  Assert333(out_list != NULL || visit_function != NULL);
+  return Union(a, b, &out);
+}
+
+bool IntersectSortedLinkedLists(LinkedList a, LinkedList b,
+                                LLPayloadKeyFnPtr key_function,
+                                LinkedList out_list,
+                                LLPayloadVisitFnPtr visit_function,
+                                void *visit_arg) {
+  LLKeyIndex a_index, b_index = NULL;
+  bool ok = false;
+
+  a_index = MakeLLKeyIndex(a, key_function);
+  if (a_index != NULL)
+    b_index = MakeLLKeyIndex(b, key_function);
+  if (b_index != NULL) {
+    ok = IntersectLLKeyIndexes(a_index, b_index, out_list, visit_function,
+                               visit_arg);
+    FreeLLKeyIndex(b_index);
+  }
+  if (a_index != NULL)
+    FreeLLKeyIndex(a_index);
+  return ok;
+}
+
+bool UnionSortedLinkedLists(LinkedList a, LinkedList b,
+                            LLPayloadKeyFnPtr key_function,
+                            LinkedList out_list,
+                            LLPayloadVisitFnPtr visit_function,
+                            void *visit_arg) {
+  LLKeyIndex a_index, b_index = NULL;
+  bool ok = false;
+
+  a_index = MakeLLKeyIndex(a, key_function);
+  if (a_index != NULL)
+    b_index = MakeLLKeyIndex(b, key_function);
+  if (b_index != NULL) {
+    ok = UnionLLKeyIndexes(a_index, b_index, out_list, visit_function,
+                           visit_arg);
+    FreeLLKeyIndex(b_index);
+  }
+  if (a_index != NULL)
+    FreeLLKeyIndex(a_index);
+  return ok;
+}
+
+static bool Intersect(LLKeyIndex a, LLKeyIndex b, KeyIndexOutput *out) {
+  LLKeyIndex shorter = a, longer = b;
+  uint64_t i, j;
+
+  if (a->num_keys > b->num_keys) {
+    shorter = b;
+    longer = a;
+  }
+  if (shorter->num_keys == 0)
+    return true;
+
+  if (longer->num_keys / shorter->num_keys < LL_GALLOP_RATIO) {
+    // a merge, one comparison per step.
+    for (i = 0, j = 0; i < a->num_keys && j < b->num_keys; ) {
+      if (a->keys[i] < b->keys[j]) {
+        i++;
+      } else if (a->keys[i] > b->keys[j]) {
+        j++;
+      } else {
+        if (!Emit(out, a->payloads, i, i + 1))
+          return out->stopped;
+        i++;
+        j++;
+      }
+    }
+    return true;
+  }
+
+  // look each of the shorter one's keys up in the longer one, starting
+  // from where the last one was found.
+  for (i = 0, j = 0; i < shorter->num_keys; i++) {
+    j = Gallop(longer->keys, j, longer->num_keys, shorter->keys[i]);
+    if (j == longer->num_keys)
+      break;
+    if (longer->keys[j] == shorter->keys[i]) {
+      if (shorter == a) {
+        if (!Emit(out, a->payloads, i, i + 1))
+          return out->stopped;
+      } else {
+        if (!Emit(out, a->payloads, j, j + 1))
+          return out->stopped;
+      }
+      j++;
+    }
+  }
+  return true;
+}
+
+static bool Union(LLKeyIndex a, LLKeyIndex b, KeyIndexOutput *out) {
+  LLKeyIndex shorter = a, longer = b;
+  uint64_t i, j, end;
+
+  if (a->num_keys > b->num_keys) {
+    shorter = b;
+    longer = a;
+  }
+
+  if (shorter->num_keys == 0 ||
+      longer->num_keys / shorter->num_keys < LL_GALLOP_RATIO) {
+    // a merge; a's payload goes first when the keys are equal.
+    for (i = 0, j = 0; i < a->num_keys && j < b->num_keys; ) {
+      if (a->keys[i] <= b->keys[j]) {
+        if (a->keys[i] == b->keys[j])
+          j++;
+        if (!Emit(out, a->payloads, i, i + 1))
+          return out->stopped;
+        i++;
+      } else {
+        if (!Emit(out, b->payloads, j, j + 1))
+          return out->stopped;
+        j++;
+      }
+    }
+    if (!Emit(out, a->payloads, i, a->num_keys) ||
+        !Emit(out, b->payloads, j, b->num_keys))
+      return out->stopped;
+    return true;
+  }
+
+  // hand over the stretch of the longer one before each of the shorter
+  // one's keys in one go, and then that key.
+  for (i = 0, j = 0; i < shorter->num_keys; i++) {
+    end = Gallop(longer->keys, j, longer->num_keys, shorter->keys[i]);
+    if (!Emit(out, longer->payloads, j, end))
+      return out->stopped;
+    j = end;
+    if (j < longer->num_keys && longer->keys[j] == shorter->keys[i]) {
+      if (!Emit(out, a->payloads, (shorter == a) ? i : j,
+                ((shorter == a) ? i : j) + 1))
+        return out->stopped;
+      j++;
+    } else {
+      if (!Emit(out, shorter->payloads, i, i + 1))
+        return out->stopped;
+    }
+  }
+  if (!Emit(out, longer->payloads, j, longer->num_keys))
+    return out->stopped;
+  return true;
+}
+
+static bool Emit(KeyIndexOutput *out, void **payloads, uint64_t begin,
+                 uint64_t end) {
+  uint64_t i;
+
+  for (i = begin; i < end; i++) {
+    if (out->out_list != NULL) {
+      if (!AppendLinkedList(out->out_list, payloads[i]))
+        return false;
+    } else if (!out->visit_function(payloads[i], out->visit_arg)) {
+      out->stopped = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint64_t Gallop(const uint64_t *keys, uint64_t from, uint64_t n,
+                       uint64_t key) {
+  uint64_t lo = from, hi, step, mid;
+
+  if (lo >= n || keys[lo] >= key)
+    return lo;
+
+  // gallop until keys[lo] < key <= keys[hi] (or hi is n)...
+  for (step = 1; lo + step < n && keys[lo + step] < key; step *= 2)
+    lo += step;
+  hi = (lo + step < n) ? lo + step : n;
+
+  // ...binary search (lo, hi] down to a small block...
+  lo++;
+  while (hi - lo > LL_SCAN_BLOCK) {
+    mid = lo + (hi - lo) / 2;
+    if (keys[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // ...and count the keys in the block that go before key.
+  return lo + CountLess(keys + lo, hi - lo, key);
+}
+
+static uint64_t CountLess(const uint64_t *keys, uint64_t n, uint64_t key) {
+  uint64_t i, count = 0;
+
+  for (i = 0; i < n; i++)
+    count += (keys[i] < key);
+  return count;
+}
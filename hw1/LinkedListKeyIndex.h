@@ -0,0 +1,122 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_LINKEDLISTKEYINDEX_H_
+#define _HW1_LINKEDLISTKEYINDEX_H_
+
+#include <stdbool.h>    // for bool, true, false
+#include <stdint.h>     // so we can use uint64_t, etc.
+
+#include "./LinkedList.h"  // for LinkedList, LLPayloadKeyFnPtr
+
+// A key index is a contiguous copy of a LinkedList whose payloads are
+// sorted by a uint64_t key, such as a posting list of document IDs: an
+// array of the keys, and a parallel array of the payloads.  Unlike the
+// list, it can be searched without chasing pointers, so the
+// intersection of a short list with a long one can skip over most of
+// the long one.
+//
+// An index is a snapshot: it doesn't change when the list does, and
+// it needs rebuilding if the list's payloads or their keys change.
+// Building it takes a pass over the list, so it pays to build an index
+// once per list and keep it for as long as the list is queried.
+//
+// As usual, the struct is defined in the private header
+// LinkedListKeyIndex_priv.h.
+struct ll_key_index;
+typedef struct ll_key_index *LLKeyIndex;
+
+// Intersections and unions hand their results either to a list or to a
+// function like this one, which returns false to stop early, true to
+// carry on.
+typedef bool(*LLPayloadVisitFnPtr)(void *payload, void *arg);
+
+// Build a key index for a list.
+//
+// Arguments:
+//
+// - list: the list to index.  Its payloads must be in ascending order
+//   of key, with no key appearing twice.
+//
+// - key_function: returns a payload's key.  It's called once per
+//   node.
+//
+// Returns NULL if out of memory, else the index.
+LLKeyIndex MakeLLKeyIndex(LinkedList list, LLPayloadKeyFnPtr key_function);
+
+// Free a key index.  The payloads it points to are left alone.
+void FreeLLKeyIndex(LLKeyIndex index);
+
+// Return the number of keys in a key index.
+uint64_t NumKeysInLLKeyIndex(LLKeyIndex index);
+
+// Find the payloads of a whose keys are in b too, in ascending order of
+// key.  Where the two are much the same size, it merges them; where
+// one is much shorter than the other, it looks each of the short one's
+// keys up in the long one with a galloping (exponential) search from
+// where the last one was found, finishing off with a scan of a small
+// block of keys that the compiler can vectorize.  That takes
+// O(m log(n / m)) comparisons for m keys in the short one and n in the
+// long one.
+//
+// Arguments:
+//
+// - a, b: the indexes to intersect.
+//
+// - out_list: if not NULL, the payloads are appended to it.  They're
+//   shared, not copied, so out_list should be freed with a free
+//   function that leaves them alone.
+//
+// - visit_function: if out_list is NULL, the payloads are handed to
+//   this instead, along with visit_arg.
+//
+// Returns false if out of memory (out_list may then hold some of the
+// payloads), else true.
+bool IntersectLLKeyIndexes(LLKeyIndex a, LLKeyIndex b, LinkedList out_list,
+                           LLPayloadVisitFnPtr visit_function,
+                           void *visit_arg);
+
+// Find the payloads whose keys are in a or b, in ascending order of
+// key; where a key is in both, a's payload is the one given.  Like
+// IntersectLLKeyIndexes, it gallops through the longer of the two
+// when their sizes differ a lot, handing over the stretches between
+// the shorter one's keys in one go.  The arguments and return value
+// are as for IntersectLLKeyIndexes.
+bool UnionLLKeyIndexes(LLKeyIndex a, LLKeyIndex b, LinkedList out_list,
+                       LLPayloadVisitFnPtr visit_function, void *visit_arg);
+
+// Intersect, or take the union of, two lists sorted by key, as above.
+// These build key indexes for both lists and free them again
+// afterwards; to query a list more than once, build its index with
+// MakeLLKeyIndex and use the functions above instead.  The arguments
+// are as for MakeLLKeyIndex and IntersectLLKeyIndexes, and they return
+// false if out of memory, else true.
+bool IntersectSortedLinkedLists(LinkedList a, LinkedList b,
+                                LLPayloadKeyFnPtr key_function,
+                                LinkedList out_list,
+                                LLPayloadVisitFnPtr visit_function,
+                                void *visit_arg);
+bool UnionSortedLinkedLists(LinkedList a, LinkedList b,
+                            LLPayloadKeyFnPtr key_function,
+                            LinkedList out_list,
+                            LLPayloadVisitFnPtr visit_function,
+                            void *visit_arg);
+
+#endif  // _HW1_LINKEDLISTKEYINDEX_H_
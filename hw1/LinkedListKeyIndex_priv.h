@@ -0,0 +1,36 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_LINKEDLISTKEYINDEX_PRIV_H_
+#define _HW1_LINKEDLISTKEYINDEX_PRIV_H_
+
+#include <stdint.h>
+
+#include "./LinkedListKeyIndex.h"
+
+// A key index: the keys of a sorted list's payloads, in ascending
+// order, and the payloads themselves in the same order.
+typedef struct ll_key_index {
+  uint64_t   num_keys;  // # of keys (and payloads)
+  uint64_t  *keys;      // the keys
+  void     **payloads;  // the payloads
+} LLKeyIndexSt;
+
+#endif  // _HW1_LINKEDLISTKEYINDEX_PRIV_H_
@@ -0,0 +1,236 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "Assert333.h"
+#include "LinkedList.h"
+#include "LinkedList_priv.h"
+
+// The slab allocator behind kLLNodeSlabAllocator.
+//
+// Each thread keeps its own free list of nodes, linked through their
+// next pointers, so the common case takes no locks.  When a thread's
+// list runs dry it refills a batch at a time, under a global lock:
+// first from the shared spare list, then by carving fresh nodes out of
+// the current slab.  When it grows past LL_SLAB_MAX_FREE, a batch goes
+// back to the spare list, as does the whole free list of a thread that
+// exits.  That way a thread that only frees nodes (say, the consumer
+// of a queue another thread produces into) hands them back to the
+// thread that allocates them, rather than hoarding them while the
+// other carves new slabs.  Slabs are big, huge-page-aligned blocks that
+// are never freed.
+
+#define LL_SLAB_BYTES   (2 * 1024 * 1024)
+#define LL_SLAB_BATCH   256
+
+// the calling thread's free list
+static __thread LinkedListNodePtr free_nodes = NULL;
+static __thread uint64_t num_free_nodes = 0;
+static __thread bool registered = false;
+
+// shared state, protected by slab_lock
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char *slab_next = NULL;   // uncarved part of the slab
+static size_t slab_left = 0;              // # bytes left in it
+static uint64_t slab_bytes = 0;           // # bytes of slabs carved
+static LinkedListNodePtr spare_nodes = NULL;  // handed back by threads
+static uint64_t num_spare_nodes = 0;
+
+// a key whose destructor hands an exiting thread's free list over to
+// the spare list.
+static pthread_key_t slab_key;
+static pthread_once_t slab_key_once = PTHREAD_ONCE_INIT;
+
+// The vtable entries.
+static void *SlabAlloc(void *context, size_t size);
+static void SlabDealloc(void *context, void *ptr, size_t size);
+
+// Internal helper that refills the calling thread's free list.  Returns
+// false if out of memory.
+static bool RefillFreeList(void);
+
+// Internal helper that moves the chain of num_nodes nodes from head to
+// tail onto the spare list.
+static void GiveSpareNodes(LinkedListNodePtr head, LinkedListNodePtr tail,
+                           uint64_t num_nodes);
+
+// Internal helpers for the thread-exit hook.
+static void MakeSlabKey(void);
+static void OrphanFreeList(void *unused);
+
+const Allocator kLLNodeSlabAllocator = { &SlabAlloc, &SlabDealloc };
+
+uint64_t LLNodeSlabNumFree(void) {
+  return num_free_nodes;
+}
+
+uint64_t LLNodeSlabNumSpare(void) {
+  uint64_t num;
+
+  pthread_mutex_lock(&slab_lock);
+  num = num_spare_nodes;
+  pthread_mutex_unlock(&slab_lock);
+  return num;
+}
+
+uint64_t LLNodeSlabBytes(void) {
+  uint64_t bytes;
+
+  pthread_mutex_lock(&slab_lock);
+  bytes = slab_bytes;
+  pthread_mutex_unlock(&slab_lock);
+  return bytes;
+}
+
+void LLNodeSlabFreeChain(LinkedListNodePtr head, LinkedListNodePtr tail,
+                         uint64_t num_nodes) {
+  Assert333(head != NULL);
+  Assert333(tail != NULL);
+  if (num_free_nodes + num_nodes > LL_SLAB_MAX_FREE) {
+    // too many to keep; the whole chain goes to the spare list.
+    GiveSpareNodes(head, tail, num_nodes);
+    return;
+  }
+  tail->next = free_nodes;
+  free_nodes = head;
+  num_free_nodes += num_nodes;
+}
+
+size_t LLAllocatorOverhead(const Allocator *allocator, size_t size) {
+  if (allocator != &kLLNodeSlabAllocator)
+    return AllocatorOverhead(allocator, size);
+  // nodes are packed back to back; anything else comes from malloc.
+  if (size == sizeof(LinkedListNode))
+    return 0;
+  return AllocatorOverhead(&kMallocAllocator, size);
+}
+
+static void *SlabAlloc(void *context, size_t size) {
+  LinkedListNodePtr node;
+
+  if (size != sizeof(LinkedListNode))
+    return malloc(size);
+  if (free_nodes == NULL && !RefillFreeList())
+    return NULL;
+  node = free_nodes;
+  free_nodes = node->next;
+  num_free_nodes--;
+  return node;
+}
+
+static void SlabDealloc(void *context, void *ptr, size_t size) {
+  LinkedListNodePtr node = (LinkedListNodePtr) ptr, head, tail;
+  int i;
+
+  if (size != sizeof(LinkedListNode)) {
+    free(ptr);
+    return;
+  }
+  node->next = free_nodes;
+  free_nodes = node;
+  num_free_nodes++;
+
+  if (num_free_nodes > LL_SLAB_MAX_FREE) {
+    // hand the most recently freed batch back to the spare list.
+    head = tail = free_nodes;
+    for (i = 1; i < LL_SLAB_BATCH; i++)
+      tail = tail->next;
+    free_nodes = tail->next;
+    num_free_nodes -= LL_SLAB_BATCH;
+    GiveSpareNodes(head, tail, LL_SLAB_BATCH);
+  }
+}
+
+static bool RefillFreeList(void) {
+  LinkedListNodePtr node;
+  void *slab;
+  int i;
+
+  // make sure this thread's nodes are saved when it exits.
+  if (!registered) {
+    pthread_once(&slab_key_once, &MakeSlabKey);
+    pthread_setspecific(slab_key, (void *) &registered);
+    registered = true;
+  }
+
+  pthread_mutex_lock(&slab_lock);
+  if (spare_nodes != NULL) {
+    // take a batch of spare nodes, leaving the rest for other threads.
+    node = spare_nodes;
+    for (i = 1; i < LL_SLAB_BATCH && node->next != NULL; i++)
+      node = node->next;
+    free_nodes = spare_nodes;
+    num_free_nodes = i;
+    spare_nodes = node->next;
+    num_spare_nodes -= i;
+    node->next = NULL;
+    pthread_mutex_unlock(&slab_lock);
+    return true;
+  }
+
+  for (i = 0; i < LL_SLAB_BATCH; i++) {
+    if (slab_left < sizeof(LinkedListNode)) {
+      if (posix_memalign(&slab, LL_SLAB_BYTES, LL_SLAB_BYTES) != 0)
+        break;
+#ifdef MADV_HUGEPAGE
+      madvise(slab, LL_SLAB_BYTES, MADV_HUGEPAGE);
+#endif
+      slab_next = (unsigned char *) slab;
+      slab_left = LL_SLAB_BYTES;
+      slab_bytes += LL_SLAB_BYTES;
+    }
+    node = (LinkedListNodePtr) slab_next;
+    slab_next += sizeof(LinkedListNode);
+    slab_left -= sizeof(LinkedListNode);
+    node->next = free_nodes;
+    free_nodes = node;
+    num_free_nodes++;
+  }
+  pthread_mutex_unlock(&slab_lock);
+  return free_nodes != NULL;
+}
+
+static void MakeSlabKey(void) {
+  Assert333(pthread_key_create(&slab_key, &OrphanFreeList) == 0);
+}
+
+static void OrphanFreeList(void *unused) {
+  LinkedListNodePtr tail;
+
+  if (free_nodes == NULL)
+    return;
+  for (tail = free_nodes; tail->next != NULL; tail = tail->next) { }
+  GiveSpareNodes(free_nodes, tail, num_free_nodes);
+  free_nodes = NULL;
+  num_free_nodes = 0;
+}
+
+static void GiveSpareNodes(LinkedListNodePtr head, LinkedListNodePtr tail,
+                           uint64_t num_nodes) {
+  pthread_mutex_lock(&slab_lock);
+  tail->next = spare_nodes;
+  spare_nodes = head;
+  num_spare_nodes += num_nodes;
+  pthread_mutex_unlock(&slab_lock);
+}
@@ -0,0 +1,1076 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Assert333.h"
+#include "LinkedList.h"
+#include "LinkedList_priv.h"
+
+// The sorts work on chains: nodes linked through next alone, ending in
+// NULL.  Each sort turns the list into a chain, sorts it, and then fixes
+// up the prev pointers, head and tail in one final pass.
+
+// Internal helper that cuts the chain starting at node after count
+// nodes, and returns the rest of the chain (NULL if there is none).
+static LinkedListNodePtr SplitChain(LinkedListNodePtr node, uint64_t count);
+
+// Internal helper that stably merges the sorted chains a and b onto
+// tail, and returns the last node of the merged chain.  Where a and b
+// hold equal payloads, a's come first.
+static LinkedListNodePtr MergeChains(LinkedListNodePtr a, LinkedListNodePtr b,
+                                     LinkedListNodePtr tail,
+                                     unsigned int ascending,
+                                     LLPayloadComparatorFnPtr comparator);
+
+// Internal helper that makes list hold the chain starting at head,
+// setting the prev pointers and the tail.
+static void RelinkChain(LinkedList list, LinkedListNodePtr head);
+
+// Internal helpers that check, and record, that list is sorted by
+// comparator in the given direction.
+static bool KnownSorted(LinkedList list, unsigned int ascending,
+                        LLPayloadComparatorFnPtr comparator);
+static void NoteSorted(LinkedList list, unsigned int ascending,
+                       LLPayloadComparatorFnPtr comparator);
+
+// The sorted_by of a list sorted by SortLinkedListByKey, whose
+// sorted_by_key then says which key.  Adding a node to the list clears
+// sorted_by, and so forgets both.  (It's never called.)
+static int SortedByKey(void *payload_a, void *payload_b) { return 0; }
+
+// SortLinkedListByKey sorts an array of these.
+typedef struct {
+  uint64_t           key;
+  LinkedListNodePtr  node;
+} KeyEntry;
+
+// LinkedListTopK keeps the best payloads it has seen so far in a heap
+// of these, with the worst of them at the root.  seq is the payload's
+// position in the list, so that equal payloads keep their order.
+typedef struct {
+  void     *payload;
+  uint64_t  seq;
+} TopKEntry;
+
+// Internal helpers for LinkedListTopK's heap: does a go after b in a
+// stable sort, and sift the entry at i down into place in a heap of n.
+static bool GoesAfter(const TopKEntry *a, const TopKEntry *b,
+                      unsigned int ascending,
+                      LLPayloadComparatorFnPtr comparator);
+static void SiftDown(TopKEntry *heap, uint64_t n, uint64_t i,
+                     unsigned int ascending,
+                     LLPayloadComparatorFnPtr comparator);
+
+// Internal helper for MergeSortedLinkedLists' loser tree (see
+// LinkedList_priv.h), whose contestants are the chains heads[0..k).
+// ChainBeats returns true if chain a's head goes before chain b's; an
+// empty chain loses to everything, and ties go to the earlier chain.
+typedef struct {
+  LinkedListNodePtr        *heads;
+  unsigned int              ascending;
+  LLPayloadComparatorFnPtr  comparator;
+} MergeHeads;
+static bool ChainBeats(void *arg, uint64_t a, uint64_t b);
+
+// SortLinkedListAdaptive keeps a stack of the sorted runs it has found
+// but not yet merged.  With its merge rules each run is at least as
+// long as the two after it put together, so 128 is plenty.
+typedef struct {
+  LinkedListNodePtr  head;
+  uint64_t           length;
+} SortRun;
+#define LL_MAX_RUNS  128
+
+// After this many nodes in a row come from the same run, a merge starts
+// galloping.
+#define LL_MIN_GALLOP  7
+
+// Internal helper that returns the run length below which
+// SortLinkedListAdaptive extends runs by insertion sort: between 32
+// and 64, chosen so that n / minrun is close to a power of two.
+static uint64_t MinRunLength(uint64_t n);
+
+// Internal helper that cuts the next run off the front of the chain
+// *rest, reversing it if it's (strictly) descending, and extending it
+// to min_run nodes by insertion if it's shorter.
+static SortRun NextRun(LinkedListNodePtr *rest, uint64_t min_run,
+                       unsigned int ascending,
+                       LLPayloadComparatorFnPtr comparator);
+
+// Internal helpers that merge the runs on a run stack: the runs at i and
+// i + 1, runs as needed to keep the stack's lengths in shape, and
+// finally all of them.
+static void MergeAt(SortRun *runs, int *num_runs, int i,
+                    unsigned int ascending,
+                    LLPayloadComparatorFnPtr comparator);
+static void MergeCollapse(SortRun *runs, int *num_runs,
+                          unsigned int ascending,
+                          LLPayloadComparatorFnPtr comparator);
+static void MergeForceCollapse(SortRun *runs, int *num_runs,
+                               unsigned int ascending,
+                               LLPayloadComparatorFnPtr comparator);
+
+// Internal helper that merges the sorted chains a and b like
+// MergeChains, galloping once one of them wins LL_MIN_GALLOP times in a
+// row, and returns the merged chain.
+static LinkedListNodePtr GallopMerge(LinkedListNodePtr a, LinkedListNodePtr b,
+                                     unsigned int ascending,
+                                     LLPayloadComparatorFnPtr comparator);
+
+// Internal helper for galloping: returns the last node of the longest
+// prefix of the chain at node whose payloads go before payload (or, if
+// or_equal, that don't go after it), or NULL if node itself doesn't.  It
+// takes O(log k) comparisons for a prefix of k nodes.
+static LinkedListNodePtr GallopEnd(LinkedListNodePtr node, void *payload,
+                                   bool or_equal, unsigned int ascending,
+                                   LLPayloadComparatorFnPtr comparator);
+
+// Does payload p go before payload q (or, if or_equal, not after it)?
+static bool Precedes(void *p, void *q, bool or_equal,
+                     unsigned int ascending,
+                     LLPayloadComparatorFnPtr comparator);
+
+// SortLinkedListParallel sorts an array of these, rather than the nodes
+// themselves, so that comparisons don't have to chase node pointers.
+typedef struct {
+  void              *payload;
+  LinkedListNodePtr  node;
+} SortEntry;
+
+// The minimum number of elements worth giving a thread of its own.
+// (Sorting the array is quicker than sorting the nodes even on one
+// thread, since it doesn't chase pointers, so any list this long is
+// sorted as an array.)
+#define LL_PARALLEL_SORT_MIN  8192
+
+// The state a parallel sort's threads share.  In each round, runs
+// bounds[0..num_runs) of src are merged pairwise into dst.
+typedef struct {
+  SortEntry                *src;
+  SortEntry                *dst;
+  uint64_t                  num_elements;
+  uint64_t                 *bounds;   // num_runs + 1 run boundaries
+  uint64_t                  num_runs;
+  int                       num_threads;
+  unsigned int              ascending;
+  LLPayloadComparatorFnPtr  comparator;
+} ParallelSort;
+
+// What each thread of a round is handed.
+typedef struct {
+  ParallelSort  *sort;
+  int            thread;
+} ParallelSortTask;
+
+// Internal helpers that run a round of a parallel sort: one task per
+// thread, on threads of their own where possible.  The first round
+// sorts each run; the rest merge them.
+static void RunRound(ParallelSort *sort, void *(*task_fn)(void *));
+static void *SortRunTask(void *arg);
+static void *MergeRunsTask(void *arg);
+
+// Internal helper that stably sorts entries[begin, end), using
+// tmp[begin, end) as scratch space.
+static void SortEntries(SortEntry *entries, SortEntry *tmp, uint64_t begin,
+                        uint64_t end, unsigned int ascending,
+                        LLPayloadComparatorFnPtr comparator);
+
+// Internal helper that stably merges the part of a and b (sorted, of
+// lengths m and n) that lands in out[begin, end) of their merge.
+static void MergeEntries(const SortEntry *a, uint64_t m, const SortEntry *b,
+                         uint64_t n, SortEntry *out, uint64_t begin,
+                         uint64_t end, unsigned int ascending,
+                         LLPayloadComparatorFnPtr comparator);
+
+// Internal helper that returns how many of the first k entries of the
+// stable merge of a and b come from a.
+static uint64_t CoRank(const SortEntry *a, uint64_t m, const SortEntry *b,
+                       uint64_t n, uint64_t k, unsigned int ascending,
+                       LLPayloadComparatorFnPtr comparator);
+
+// Does x go before y, where x is from the earlier run?  (Ties go to x,
+// which keeps the merge stable.)
+static bool GoesFirst(const SortEntry *x, const SortEntry *y,
+                      unsigned int ascending,
+                      LLPayloadComparatorFnPtr comparator);
+
+void SortLinkedList(LinkedList list, unsigned int ascending,
+                    LLPayloadComparatorFnPtr comparator_function) {
+  LinkedListNode first;  // a dummy node whose next is the chain
+  LinkedListNodePtr tail, rest, a, b;
+  uint64_t width;
+
+  Assert333(list != NULL);  // defensive programming
+  TM_COUNT(TM_LL_SORTS);
+  if (list->num_elements < 2 ||
+      KnownSorted(list, ascending, comparator_function)) {
+    // no sorting needed
+    return;
+  }
+
+  // a bottom-up merge sort: merge pairs of runs of width 1 into runs of
+  // width 2, then those into runs of 4, and so on.  It takes
+  // O(n log n) comparisons and no memory beyond the nodes themselves.
+  first.next = list->head;
+  for (width = 1; width < list->num_elements; width *= 2) {
+    tail = &first;
+    rest = first.next;
+    while (rest != NULL) {
+      a = rest;
+      b = SplitChain(a, width);
+      rest = SplitChain(b, width);
+      tail = MergeChains(a, b, tail, ascending, comparator_function);
+    }
+  }
+  RelinkChain(list, first.next);
+  NoteSorted(list, ascending, comparator_function);
+}
+
+void SortLinkedListAdaptive(LinkedList list, unsigned int ascending,
+                            LLPayloadComparatorFnPtr comparator_function) {
+  SortRun runs[LL_MAX_RUNS];
+  LinkedListNodePtr rest;
+  uint64_t min_run;
+  int num_runs = 0;
+
+  Assert333(list != NULL);  // defensive programming
+  TM_COUNT(TM_LL_SORTS);
+  if (list->num_elements < 2 ||
+      KnownSorted(list, ascending, comparator_function)) {
+    // no sorting needed
+    return;
+  }
+
+  // a natural merge sort, after TimSort: find the runs that are already
+  // in order (extending short ones to min_run), and merge them, keeping
+  // the stack of runs waiting to be merged balanced.  An input made of
+  // a few runs takes O(n) comparisons.
+  min_run = MinRunLength(list->num_elements);
+  rest = list->head;
+  while (rest != NULL) {
+    Assert333(num_runs < LL_MAX_RUNS);
+    runs[num_runs++] = NextRun(&rest, min_run, ascending,
+                               comparator_function);
+    MergeCollapse(runs, &num_runs, ascending, comparator_function);
+  }
+  MergeForceCollapse(runs, &num_runs, ascending, comparator_function);
+  Assert333(num_runs == 1 && runs[0].length == list->num_elements);
+  RelinkChain(list, runs[0].head);
+  NoteSorted(list, ascending, comparator_function);
+}
+
+bool SortLinkedListByKey(LinkedList list, unsigned int ascending,
+                         LLPayloadKeyFnPtr key_function) {
+  uint64_t counts[8][256], offset, next, i, n;
+  KeyEntry *entries, *tmp, *src, *dst, *swap;
+  LinkedListNodePtr node;
+  int digit, shift;
+
+  Assert333(list != NULL);  // defensive programming
+  Assert333(key_function != NULL);
+  TM_COUNT(TM_LL_SORTS);
+  n = list->num_elements;
+  if (n < 2 || (KnownSorted(list, ascending, &SortedByKey) &&
+                list->sorted_by_key == key_function)) {
+    // no sorting needed
+    return true;
+  }
+  entries = (KeyEntry *) malloc(n * sizeof(KeyEntry));
+  tmp = (KeyEntry *) malloc(n * sizeof(KeyEntry));
+  if (entries == NULL || tmp == NULL) {
+    free(entries);
+    free(tmp);
+    return false;
+  }
+
+  // extract the keys (inverted, to sort descending: that keeps equal
+  // keys in order) and count every byte of them, in one pass.
+  memset(counts, 0, sizeof(counts));
+  for (node = list->head, i = 0; node != NULL; node = node->next, i++) {
+    entries[i].key = ascending ? key_function(node->payload) :
+                                 ~key_function(node->payload);
+    entries[i].node = node;
+    for (digit = 0; digit < 8; digit++)
+      counts[digit][(entries[i].key >> (8 * digit)) & 0xff]++;
+  }
+
+  // an LSD radix sort, a byte at a time from the least significant.
+  // Each pass is stable, so the sort is.
+  src = entries;
+  dst = tmp;
+  for (digit = 0; digit < 8; digit++) {
+    shift = 8 * digit;
+    if (counts[digit][(src[0].key >> shift) & 0xff] == n)
+      continue;  // every key has the same byte here
+    for (offset = 0, i = 0; i < 256; i++) {
+      next = offset + counts[digit][i];
+      counts[digit][i] = offset;
+      offset = next;
+    }
+    for (i = 0; i < n; i++)
+      dst[counts[digit][(src[i].key >> shift) & 0xff]++] = src[i];
+    swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  // relink the nodes in their sorted order.
+  for (i = 0; i + 1 < n; i++)
+    src[i].node->next = src[i + 1].node;
+  src[n - 1].node->next = NULL;
+  RelinkChain(list, src[0].node);
+  NoteSorted(list, ascending, &SortedByKey);
+  list->sorted_by_key = key_function;
+  free(entries);
+  free(tmp);
+  return true;
+}
+
+bool LinkedListTopK(LinkedList list, uint64_t k, unsigned int ascending,
+                    LLPayloadComparatorFnPtr comparator_function,
+                    LinkedList out_list) {
+  TopKEntry *heap, entry;
+  LinkedListNodePtr node;
+  uint64_t m, i;
+  bool was_empty;
+
+  Assert333(list != NULL);  // defensive programming
+  Assert333(out_list != NULL);
+  Assert333(out_list != list);
+  was_empty = (out_list->num_elements == 0);
+  m = (k < list->num_elements) ? k : list->num_elements;
+
+  if (KnownSorted(list, ascending, comparator_function)) {
+    // the best k are just the first k.
+    for (node = list->head, i = 0; i < m; node = node->next, i++) {
+      if (!AppendLinkedList(out_list, node->payload))
+        return false;
+    }
+  } else if (m > 0) {
+    heap = (TopKEntry *) malloc(m * sizeof(TopKEntry));
+    if (heap == NULL)
+      return false;
+
+    // heapify the first m payloads.  After that most payloads lose to
+    // the root straight away, in one comparison; the rest replace it.
+    // A payload equal to the root comes after it in the list, so it
+    // loses too.
+    for (node = list->head, i = 0; i < m; node = node->next, i++) {
+      heap[i].payload = node->payload;
+      heap[i].seq = i;
+    }
+    for (i = m / 2; i > 0; i--)
+      SiftDown(heap, m, i - 1, ascending, comparator_function);
+    for (i = m; node != NULL; node = node->next, i++) {
+      if (Precedes(node->payload, heap[0].payload, false, ascending,
+                   comparator_function)) {
+        heap[0].payload = node->payload;
+        heap[0].seq = i;
+        SiftDown(heap, m, 0, ascending, comparator_function);
+      }
+    }
+
+    // heap sort what's left, moving the worst to the back each time.
+    for (i = m - 1; i > 0; i--) {
+      entry = heap[0];
+      heap[0] = heap[i];
+      heap[i] = entry;
+      SiftDown(heap, i, 0, ascending, comparator_function);
+    }
+    for (i = 0; i < m; i++) {
+      if (!AppendLinkedList(out_list, heap[i].payload)) {
+        free(heap);
+        return false;
+      }
+    }
+    free(heap);
+  }
+
+  if (was_empty)
+    NoteSorted(out_list, ascending, comparator_function);
+  return true;
+}
+
+LinkedList MergeSortedLinkedLists(LinkedList *lists, uint64_t num_lists,
+                                  unsigned int ascending,
+                                  LLPayloadComparatorFnPtr comparator_function,
+                                  LLPayloadDedupFnPtr dedup_function) {
+  LinkedListNode first;  // a dummy node whose next is the merged chain
+  LinkedListNodePtr *heads, tail, node;
+  LinkedList merged;
+  MergeHeads chains;
+  uint64_t *tree, i, w;
+
+  Assert333(lists != NULL || num_lists == 0);  // defensive programming
+  if (num_lists == 0)
+    return AllocateLinkedList();
+  for (i = 0; i < num_lists; i++) {
+    // the nodes all have to go back to the same allocator.
+    Assert333(lists[i] != NULL);
+    Assert333(lists[i]->allocator == lists[0]->allocator);
+    Assert333(lists[i]->alloc_ctx == lists[0]->alloc_ctx);
+  }
+  heads = (LinkedListNodePtr *) malloc(num_lists * sizeof(LinkedListNodePtr));
+  tree = (uint64_t *) malloc(3 * num_lists * sizeof(uint64_t));
+  merged = AllocateLinkedListWithAllocator(lists[0]->allocator,
+                                           lists[0]->alloc_ctx);
+  if (heads == NULL || tree == NULL || merged == NULL) {
+    free(heads);
+    free(tree);
+    if (merged != NULL)
+      LLDealloc(merged, merged, sizeof(LinkedListHead));
+    return NULL;
+  }
+
+  // take the chains from the lists, leaving them empty.
+  for (i = 0; i < num_lists; i++) {
+    heads[i] = lists[i]->head;
+    lists[i]->head = lists[i]->tail = NULL;
+    lists[i]->num_elements = 0;
+  }
+
+  // splice the winner of each round onto the merged chain, unless it's
+  // a duplicate of the last node there.
+  first.next = NULL;
+  tail = &first;
+  chains.heads = heads;
+  chains.ascending = ascending;
+  chains.comparator = comparator_function;
+  LLBuildLoserTree(num_lists, tree, &ChainBeats, &chains);
+  while ((node = heads[w = tree[0]]) != NULL) {
+    heads[w] = node->next;
+    if (dedup_function != NULL && tail != &first &&
+        comparator_function(tail->payload, node->payload) == 0) {
+      dedup_function(tail->payload, node->payload);
+      LLDealloc(merged, node, sizeof(LinkedListNode));
+    } else {
+      tail->next = node;
+      tail = node;
+      merged->num_elements++;
+    }
+    LLReplayLoserTree(num_lists, tree, &ChainBeats, &chains);
+  }
+  tail->next = NULL;
+  RelinkChain(merged, first.next);
+  NoteSorted(merged, ascending, comparator_function);
+  free(heads);
+  free(tree);
+  return merged;
+}
+
+void LinkedListMarkUnsorted(LinkedList list) {
+  Assert333(list != NULL);
+  list->sorted_by = NULL;
+}
+
+void SortLinkedListParallel(LinkedList list, unsigned int ascending,
+                            LLPayloadComparatorFnPtr comparator_function,
+                            int num_threads) {
+  ParallelSort sort;
+  SortEntry *entries, *tmp;
+  LinkedListNodePtr node;
+  uint64_t i, n;
+
+  Assert333(list != NULL);  // defensive programming
+  Assert333(num_threads > 0);
+  if (KnownSorted(list, ascending, comparator_function))
+    return;
+  n = list->num_elements;
+  if ((uint64_t) num_threads > n / LL_PARALLEL_SORT_MIN)
+    num_threads = (int) (n / LL_PARALLEL_SORT_MIN);
+  entries = NULL;
+  tmp = NULL;
+  sort.bounds = NULL;
+  if (num_threads > 0) {
+    entries = (SortEntry *) malloc(n * sizeof(SortEntry));
+    tmp = (SortEntry *) malloc(n * sizeof(SortEntry));
+    sort.bounds = (uint64_t *) malloc((num_threads + 1) * sizeof(uint64_t));
+  }
+  if (entries == NULL || tmp == NULL || sort.bounds == NULL) {
+    // too small to be worth it, or out of memory; sort on this thread.
+    free(entries);
+    free(tmp);
+    free(sort.bounds);
+    SortLinkedList(list, ascending, comparator_function);
+    return;
+  }
+  TM_COUNT(TM_LL_SORTS);
+
+  for (node = list->head, i = 0; node != NULL; node = node->next, i++) {
+    entries[i].payload = node->payload;
+    entries[i].node = node;
+  }
+
+  // sort a run per thread, and then merge pairs of runs until there's
+  // only one.
+  sort.src = entries;
+  sort.dst = tmp;
+  sort.num_elements = n;
+  sort.num_runs = num_threads;
+  for (i = 0; i <= sort.num_runs; i++)
+    sort.bounds[i] = n * i / num_threads;
+  sort.num_threads = num_threads;
+  sort.ascending = ascending;
+  sort.comparator = comparator_function;
+  RunRound(&sort, &SortRunTask);
+  while (sort.num_runs > 1) {
+    SortEntry *swap;
+
+    RunRound(&sort, &MergeRunsTask);
+    swap = sort.src;
+    sort.src = sort.dst;
+    sort.dst = swap;
+    for (i = 0; 2 * i < sort.num_runs; i++)
+      sort.bounds[i] = sort.bounds[2 * i];
+    sort.bounds[i] = n;
+    sort.num_runs = i;
+  }
+
+  // relink the nodes in their sorted order.
+  for (i = 0; i < n; i++)
+    sort.src[i].node->next = (i + 1 < n) ? sort.src[i + 1].node : NULL;
+  RelinkChain(list, sort.src[0].node);
+  NoteSorted(list, ascending, comparator_function);
+  free(entries);
+  free(tmp);
+  free(sort.bounds);
+}
+
+static void RunRound(ParallelSort *sort, void *(*task_fn)(void *)) {
+  pthread_t threads[sort->num_threads];
+  ParallelSortTask tasks[sort->num_threads];
+  bool started[sort->num_threads];
+  int t;
+
+  for (t = 0; t < sort->num_threads; t++) {
+    tasks[t].sort = sort;
+    tasks[t].thread = t;
+  }
+  // thread 0's task runs here; if a thread can't be started, its task
+  // runs here too.
+  for (t = 1; t < sort->num_threads; t++)
+    started[t] = (pthread_create(&threads[t], NULL, task_fn, &tasks[t]) == 0);
+  task_fn(&tasks[0]);
+  for (t = 1; t < sort->num_threads; t++) {
+    if (started[t])
+      pthread_join(threads[t], NULL);
+    else
+      task_fn(&tasks[t]);
+  }
+}
+
+static void *SortRunTask(void *arg) {
+  ParallelSortTask *task = (ParallelSortTask *) arg;
+  ParallelSort *sort = task->sort;
+
+  SortEntries(sort->src, sort->dst, sort->bounds[task->thread],
+              sort->bounds[task->thread + 1], sort->ascending,
+              sort->comparator);
+  return NULL;
+}
+
+static void *MergeRunsTask(void *arg) {
+  ParallelSortTask *task = (ParallelSortTask *) arg;
+  ParallelSort *sort = task->sort;
+  uint64_t begin, end, pair, a, b, c, from, to;
+
+  // each thread writes an equal share of the output, whichever pairs of
+  // runs it lands in.
+  begin = sort->num_elements * task->thread / sort->num_threads;
+  end = sort->num_elements * (task->thread + 1) / sort->num_threads;
+  for (pair = 0; 2 * pair < sort->num_runs; pair++) {
+    // runs [a, b) and [b, c), or just [a, c) if it has no partner.
+    a = sort->bounds[2 * pair];
+    c = sort->bounds[(2 * pair + 2 <= sort->num_runs) ?
+                     2 * pair + 2 : sort->num_runs];
+    b = (2 * pair + 2 <= sort->num_runs) ? sort->bounds[2 * pair + 1] : c;
+    from = (begin > a) ? begin : a;
+    to = (end < c) ? end : c;
+    if (from >= to)
+      continue;
+    MergeEntries(sort->src + a, b - a, sort->src + b, c - b, sort->dst + a,
+                 from - a, to - a, sort->ascending, sort->comparator);
+  }
+  return NULL;
+}
+
+static void SortEntries(SortEntry *entries, SortEntry *tmp, uint64_t begin,
+                        uint64_t end, unsigned int ascending,
+                        LLPayloadComparatorFnPtr comparator) {
+  SortEntry *src = entries, *dst = tmp, *swap;
+  uint64_t width, lo, mid, hi, i, j;
+
+  // insertion sort runs of 16, then merge them bottom-up, back and
+  // forth between entries and tmp.
+  for (lo = begin; lo < end; lo += 16) {
+    hi = (end - lo > 16) ? lo + 16 : end;
+    for (i = lo + 1; i < hi; i++) {
+      SortEntry e = entries[i];
+
+      for (j = i;
+           j > lo && !GoesFirst(&entries[j - 1], &e, ascending, comparator);
+           j--)
+        entries[j] = entries[j - 1];
+      entries[j] = e;
+    }
+  }
+  for (width = 16; width < end - begin; width *= 2) {
+    for (lo = begin; lo < end; lo += 2 * width) {
+      mid = (end - lo > width) ? lo + width : end;
+      hi = (end - mid > width) ? mid + width : end;
+      MergeEntries(src + lo, mid - lo, src + mid, hi - mid, dst + lo, 0,
+                   hi - lo, ascending, comparator);
+    }
+    swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != entries)
+    memcpy(entries + begin, src + begin, (end - begin) * sizeof(SortEntry));
+}
+
+static void MergeEntries(const SortEntry *a, uint64_t m, const SortEntry *b,
+                         uint64_t n, SortEntry *out, uint64_t begin,
+                         uint64_t end, unsigned int ascending,
+                         LLPayloadComparatorFnPtr comparator) {
+  uint64_t i, j, k;
+
+  i = CoRank(a, m, b, n, begin, ascending, comparator);
+  j = begin - i;
+  for (k = begin; k < end; k++) {
+    if (j >= n || (i < m && GoesFirst(&a[i], &b[j], ascending, comparator)))
+      out[k] = a[i++];
+    else
+      out[k] = b[j++];
+  }
+}
+
+static uint64_t CoRank(const SortEntry *a, uint64_t m, const SortEntry *b,
+                       uint64_t n, uint64_t k, unsigned int ascending,
+                       LLPayloadComparatorFnPtr comparator) {
+  uint64_t lo, hi, i;
+
+  // find the smallest i for which a[i] doesn't go before b[k - i - 1],
+  // by binary search.
+  lo = (k > n) ? k - n : 0;
+  hi = (k < m) ? k : m;
+  while (lo < hi) {
+    i = lo + (hi - lo) / 2;
+    if (GoesFirst(&a[i], &b[k - i - 1], ascending, comparator))
+      lo = i + 1;
+    else
+      hi = i;
+  }
+  return lo;
+}
+
+static bool GoesFirst(const SortEntry *x, const SortEntry *y,
+                      unsigned int ascending,
+                      LLPayloadComparatorFnPtr comparator) {
+  return Precedes(x->payload, y->payload, true, ascending, comparator);
+}
+
+static LinkedListNodePtr SplitChain(LinkedListNodePtr node, uint64_t count) {
+  LinkedListNodePtr rest;
+
+  while (node != NULL && count > 1) {
+    node = node->next;
+    count--;
+  }
+  if (node == NULL)
+    return NULL;
+  rest = node->next;
+  node->next = NULL;
+  return rest;
+}
+
+static LinkedListNodePtr MergeChains(LinkedListNodePtr a, LinkedListNodePtr b,
+                                     LinkedListNodePtr tail,
+                                     unsigned int ascending,
+                                     LLPayloadComparatorFnPtr comparator) {
+  int compare_result;
+
+  while (a != NULL && b != NULL) {
+    compare_result = comparator(a->payload, b->payload);
+    if (!ascending)
+      compare_result *= -1;
+    if (compare_result <= 0) {
+      tail->next = a;
+      a = a->next;
+    } else {
+      tail->next = b;
+      b = b->next;
+    }
+    tail = tail->next;
+  }
+
+  // append whichever chain is left, and find its end.
+  tail->next = (a != NULL) ? a : b;
+  while (tail->next != NULL)
+    tail = tail->next;
+  return tail;
+}
+
+static void RelinkChain(LinkedList list, LinkedListNodePtr head) {
+  LinkedListNodePtr node, prev = NULL;
+
+  for (node = head; node != NULL; node = node->next) {
+    node->prev = prev;
+    prev = node;
+  }
+  list->head = head;
+  list->tail = prev;
+}
+
+static bool KnownSorted(LinkedList list, unsigned int ascending,
+                        LLPayloadComparatorFnPtr comparator) {
+  return list->sorted_by == comparator &&
+         (list->sorted_ascending != 0) == (ascending != 0);
+}
+
+static void NoteSorted(LinkedList list, unsigned int ascending,
+                       LLPayloadComparatorFnPtr comparator) {
+  list->sorted_by = comparator;
+  list->sorted_ascending = ascending;
+}
+
+static uint64_t MinRunLength(uint64_t n) {
+  uint64_t r = 0;
+
+  while (n >= 64) {
+    r |= n & 1;
+    n >>= 1;
+  }
+  return n + r;
+}
+
+static SortRun NextRun(LinkedListNodePtr *rest, uint64_t min_run,
+                       unsigned int ascending,
+                       LLPayloadComparatorFnPtr comparator) {
+  LinkedListNodePtr nodes[64];  // min_run is at most 64
+  LinkedListNodePtr last, node, next, prev;
+  uint64_t lo, hi, mid, i;
+  SortRun run;
+
+  run.head = *rest;
+  run.length = 1;
+  last = run.head;
+  if (last->next != NULL &&
+      Precedes(last->next->payload, last->payload, false, ascending,
+               comparator)) {
+    // a strictly descending run; reverse it as we go.  (Strictly, so
+    // that reversing can't reorder equal payloads.)
+    prev = run.head;
+    node = run.head->next;
+    do {
+      next = node->next;
+      node->next = prev;
+      prev = node;
+      node = next;
+      run.length++;
+    } while (node != NULL &&
+             Precedes(node->payload, prev->payload, false, ascending,
+                      comparator));
+    last = run.head;  // the old head is now the run's last node
+    last->next = node;
+    run.head = prev;
+  } else {
+    // a non-descending run, whose first two nodes (if it has two) we
+    // already know are in order.
+    if (last->next != NULL) {
+      last = last->next;
+      run.length++;
+    }
+    while (last->next != NULL &&
+           !Precedes(last->next->payload, last->payload, false, ascending,
+                     comparator)) {
+      last = last->next;
+      run.length++;
+    }
+  }
+
+  if (run.length < min_run && last->next != NULL) {
+    // extend a short run to min_run nodes by binary insertion, in an
+    // array of its nodes: each node goes after every node that it
+    // doesn't go before.
+    for (node = run.head, i = 0; i < run.length; node = node->next, i++)
+      nodes[i] = node;
+    for (node = last->next; node != NULL && run.length < min_run;
+         node = node->next) {
+      lo = 0;
+      hi = run.length;
+      while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (Precedes(node->payload, nodes[mid]->payload, false, ascending,
+                     comparator))
+          hi = mid;
+        else
+          lo = mid + 1;
+      }
+      for (i = run.length; i > lo; i--)
+        nodes[i] = nodes[i - 1];
+      nodes[lo] = node;
+      run.length++;
+    }
+    // relink the run in its new order, leaving the rest after it.
+    for (i = 0; i + 1 < run.length; i++)
+      nodes[i]->next = nodes[i + 1];
+    run.head = nodes[0];
+    last = nodes[run.length - 1];
+    last->next = node;
+  }
+
+  *rest = last->next;
+  last->next = NULL;
+  return run;
+}
+
+static void MergeAt(SortRun *runs, int *num_runs, int i,
+                    unsigned int ascending,
+                    LLPayloadComparatorFnPtr comparator) {
+  runs[i].head = GallopMerge(runs[i].head, runs[i + 1].head, ascending,
+                             comparator);
+  runs[i].length += runs[i + 1].length;
+  if (i + 2 < *num_runs)
+    runs[i + 1] = runs[i + 2];
+  (*num_runs)--;
+}
+
+static void MergeCollapse(SortRun *runs, int *num_runs,
+                          unsigned int ascending,
+                          LLPayloadComparatorFnPtr comparator) {
+  int k;
+
+  // keep every run longer than the next two put together, and than the
+  // next one, so that merges stay balanced.
+  while (*num_runs > 1) {
+    k = *num_runs - 2;
+    if ((k > 0 && runs[k - 1].length <= runs[k].length + runs[k + 1].length) ||
+        (k > 1 && runs[k - 2].length <= runs[k - 1].length + runs[k].length)) {
+      if (runs[k - 1].length < runs[k + 1].length)
+        k--;
+    } else if (runs[k].length > runs[k + 1].length) {
+      break;
+    }
+    MergeAt(runs, num_runs, k, ascending, comparator);
+  }
+}
+
+static void MergeForceCollapse(SortRun *runs, int *num_runs,
+                               unsigned int ascending,
+                               LLPayloadComparatorFnPtr comparator) {
+  int k;
+
+  while (*num_runs > 1) {
+    k = *num_runs - 2;
+    if (k > 0 && runs[k - 1].length < runs[k + 1].length)
+      k--;
+    MergeAt(runs, num_runs, k, ascending, comparator);
+  }
+}
+
+static LinkedListNodePtr GallopMerge(LinkedListNodePtr a, LinkedListNodePtr b,
+                                     unsigned int ascending,
+                                     LLPayloadComparatorFnPtr comparator) {
+  LinkedListNode first;
+  LinkedListNodePtr tail = &first, end;
+  int a_wins = 0, b_wins = 0;
+
+  while (a != NULL && b != NULL) {
+    if (a_wins >= LL_MIN_GALLOP) {
+      // take all of a's nodes that don't go after b's head at once.
+      end = GallopEnd(a, b->payload, true, ascending, comparator);
+      if (end != NULL) {
+        tail->next = a;
+        tail = end;
+        a = end->next;
+      }
+      a_wins = 0;
+    } else if (b_wins >= LL_MIN_GALLOP) {
+      // take all of b's nodes that go before a's head.
+      end = GallopEnd(b, a->payload, false, ascending, comparator);
+      if (end != NULL) {
+        tail->next = b;
+        tail = end;
+        b = end->next;
+      }
+      b_wins = 0;
+    } else if (Precedes(a->payload, b->payload, true, ascending,
+                        comparator)) {
+      tail->next = a;
+      tail = a;
+      a = a->next;
+      a_wins++;
+      b_wins = 0;
+    } else {
+      tail->next = b;
+      tail = b;
+      b = b->next;
+      b_wins++;
+      a_wins = 0;
+    }
+  }
+  tail->next = (a != NULL) ? a : b;
+  return first.next;
+}
+
+static LinkedListNodePtr GallopEnd(LinkedListNodePtr node, void *payload,
+                                   bool or_equal, unsigned int ascending,
+                                   LLPayloadComparatorFnPtr comparator) {
+  LinkedListNodePtr last, probe;
+  uint64_t step, gap, i;
+
+  if (!Precedes(node->payload, payload, or_equal, ascending, comparator))
+    return NULL;
+
+  // last is the furthest node known to go first.  Probe 1, 2, 4, ...
+  // nodes past it until one doesn't, or the chain runs out; there are
+  // then gap nodes after last still to decide.
+  last = node;
+  for (step = 1; ; step *= 2) {
+    probe = last;
+    for (i = 0; i < step && probe->next != NULL; i++)
+      probe = probe->next;
+    if (i < step) {
+      // the chain ran out after i nodes; probe is its last node.
+      if (Precedes(probe->payload, payload, or_equal, ascending, comparator))
+        return probe;
+      gap = i - 1;
+      break;
+    }
+    if (!Precedes(probe->payload, payload, or_equal, ascending, comparator)) {
+      gap = step - 1;
+      break;
+    }
+    last = probe;
+  }
+
+  // binary search the gap.
+  while (gap > 0) {
+    uint64_t half = (gap + 1) / 2;
+
+    probe = last;
+    for (i = 0; i < half; i++)
+      probe = probe->next;
+    if (Precedes(probe->payload, payload, or_equal, ascending, comparator)) {
+      last = probe;
+      gap -= half;
+    } else {
+      gap = half - 1;
+    }
+  }
+  return last;
+}
+
+static bool Precedes(void *p, void *q, bool or_equal,
+                     unsigned int ascending,
+                     LLPayloadComparatorFnPtr comparator) {
+  int compare_result = comparator(p, q);
+
+  if (!ascending)
+    compare_result *= -1;
+  return or_equal ? (compare_result <= 0) : (compare_result < 0);
+}
+
+static bool GoesAfter(const TopKEntry *a, const TopKEntry *b,
+                      unsigned int ascending,
+                      LLPayloadComparatorFnPtr comparator) {
+  int compare_result = comparator(a->payload, b->payload);
+
+  if (!ascending)
+    compare_result *= -1;
+  return (compare_result != 0) ? (compare_result > 0) : (a->seq > b->seq);
+}
+
+static void SiftDown(TopKEntry *heap, uint64_t n, uint64_t i,
+                     unsigned int ascending,
+                     LLPayloadComparatorFnPtr comparator) {
+  TopKEntry entry = heap[i];
+  uint64_t child;
+
+  // move the entry down past any child that goes after it, the later
+  // of the two if both do.
+  while ((child = 2 * i + 1) < n) {
+    if (child + 1 < n &&
+        GoesAfter(&heap[child + 1], &heap[child], ascending, comparator))
+      child++;
+    if (!GoesAfter(&heap[child], &entry, ascending, comparator))
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = entry;
+}
+
+void LLBuildLoserTree(uint64_t k, uint64_t *tree,
+                      LLLoserTreeBeatsFnPtr beats, void *arg) {
+  uint64_t *winners = tree + k;  // the winner at each tree position
+  uint64_t node, a, b;
+
+  // play the matches bottom up; node's children are 2*node and
+  // 2*node+1, which works for any k, not just powers of two.
+  for (node = 0; node < k; node++)
+    winners[k + node] = node;
+  for (node = k - 1; node >= 1; node--) {
+    a = winners[2 * node];
+    b = winners[2 * node + 1];
+    if (beats(arg, b, a)) {
+      winners[node] = b;
+      tree[node] = a;
+    } else {
+      winners[node] = a;
+      tree[node] = b;
+    }
+  }
+  tree[0] = (k > 1) ? winners[1] : 0;
+}
+
+void LLReplayLoserTree(uint64_t k, uint64_t *tree,
+                       LLLoserTreeBeatsFnPtr beats, void *arg) {
+  uint64_t w = tree[0], node, t;
+
+  // replay the matches on the winner's path to the root against the
+  // losers stored there.
+  for (node = (k + w) / 2; node >= 1; node /= 2) {
+    if (beats(arg, tree[node], w)) {
+      t = tree[node];
+      tree[node] = w;
+      w = t;
+    }
+  }
+  tree[0] = w;
+}
+
+static bool ChainBeats(void *arg, uint64_t a, uint64_t b) {
+  MergeHeads *chains = (MergeHeads *) arg;
+  LinkedListNodePtr *heads = chains->heads;
+
+  if (heads[a] == NULL)
+    return false;
+  if (heads[b] == NULL)
+    return true;
+  return Precedes(heads[a]->payload, heads[b]->payload, a < b,
+                  chains->ascending, chains->comparator);
+}
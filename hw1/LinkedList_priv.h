@@ -22,6 +22,7 @@
 
 #include <stdint.h>      // for uint64_t
 #include "./LinkedList.h"  // for LinkedList and LLIter
+#include "./Telemetry_priv.h"  // for TM_COUNT
 
 // This file defines the internal structures associated with our LinkedList
 // implementation.  Customers should not include this file or assume anything
@@ -46,6 +47,13 @@ typedef struct ll_head {
   uint64_t          num_elements;  //  # elements in the list
   LinkedListNodePtr head;  // head of linked list, or NULL if empty
   LinkedListNodePtr tail;  // tail of linked list, or NULL if empty
+  const Allocator  *allocator;  // where this list's memory comes from
+  void             *alloc_ctx;  // the allocator's context
+  LLPayloadComparatorFnPtr sorted_by;  // the comparator the list is known
+                                       // to be sorted by, or NULL
+  unsigned int      sorted_ascending;  // ...and in which direction
+  LLPayloadKeyFnPtr sorted_by_key;  // the key it's sorted by, if it was
+                                    // sorted by SortLinkedListByKey
 } LinkedListHead;
 
 // This struct represents the state of an iterator.  We expose the struct
@@ -56,4 +64,38 @@ typedef struct ll_iter {
   LinkedListNodePtr node;  // the node we are at, or NULL if broken
 } LLIterSt;
 
+// Allocate and free memory for a list through its allocator.
+#define LLAlloc(list, size) \
+  (TM_COUNT(TM_ALLOCATIONS), \
+   (list)->allocator->alloc_function((list)->alloc_ctx, (size)))
+#define LLDealloc(list, ptr, size) \
+  ((list)->allocator->dealloc_function((list)->alloc_ctx, (ptr), (size)))
+
+// Hand a whole chain of num_nodes nodes, linked through their next
+// pointers from head to tail, back to kLLNodeSlabAllocator's free list
+// in one step.  FreeLinkedList uses this for slab-allocated lists.
+void LLNodeSlabFreeChain(LinkedListNodePtr head, LinkedListNodePtr tail,
+                         uint64_t num_nodes);
+
+// Estimate the overhead, as AllocatorOverhead does, of allocating size
+// bytes from allocator; this also knows about kLLNodeSlabAllocator.
+size_t LLAllocatorOverhead(const Allocator *allocator, size_t size);
+
+// A loser tree over k contestants numbered 0..k-1, shared by the k-way
+// merges (MergeSortedLinkedLists and the external sort's run merge).
+// The tree's leaves, one per contestant, are at positions k..2k-1, and
+// the internal nodes at positions 1..k-1 hold the contestant that lost
+// the match there; tree[0] holds the overall winner.  beats(arg, a, b)
+// returns true if contestant a goes before contestant b.
+//
+// LLBuildLoserTree plays every match and needs room for 3k entries in
+// tree.  Once the winner tree[0] has moved on to its next item,
+// LLReplayLoserTree replays its matches and leaves the new winner in
+// tree[0].
+typedef bool (*LLLoserTreeBeatsFnPtr)(void *arg, uint64_t a, uint64_t b);
+void LLBuildLoserTree(uint64_t k, uint64_t *tree,
+                      LLLoserTreeBeatsFnPtr beats, void *arg);
+void LLReplayLoserTree(uint64_t k, uint64_t *tree,
+                       LLLoserTreeBeatsFnPtr beats, void *arg);
+
 #endif  // _HW1_LINKEDLIST_PRIV_H_
@@ -0,0 +1,293 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "Assert333.h"
+#include "LinkedList.h"
+#include "LinkedList_priv.h"
+#include "PostingList.h"
+#include "PostingList_priv.h"
+
+// A gap takes at most this many bytes to code: 64 bits, 7 to a byte.
+#define PL_MAX_GAP_BYTES  10
+
+// Internal helper that decodes block b of list into values[], and
+// returns how many values it holds.
+static uint64_t DecodeBlock(PostingList list, uint64_t b, uint64_t *values);
+
+// Internal helper that moves iter to the first value in values[] from
+// pos on that is no less than target, returning false if there isn't
+// one (and leaving pos alone).
+static bool SeekInBlock(PLIter iter, uint64_t target);
+
+PostingList AllocatePostingList(void) {
+  PostingList list = (PostingList) malloc(sizeof(PostingListRec));
+  if (list == NULL) {
+    // out of memory
+    return NULL;
+  }
+  list->num_values = 0;
+  list->last_value = 0;
+  list->bytes = NULL;
+  list->num_bytes = 0;
+  list->bytes_capacity = 0;
+  list->skips = NULL;
+  list->num_blocks = 0;
+  list->skips_capacity = 0;
+  return list;
+}
+
+void FreePostingList(PostingList list) {
+  Assert333(list != NULL);  // defensive programming
+  free(list->bytes);
+  free(list->skips);
+  free(list);
+}
+
+uint64_t NumValuesInPostingList(PostingList list) {
+  Assert333(list != NULL);
+  return list->num_values;
+}
+
+uint64_t PostingListMemoryBytes(PostingList list) {
+  Assert333(list != NULL);
+  return sizeof(PostingListRec) + list->bytes_capacity +
+    list->skips_capacity * sizeof(PLSkipEntry);
+}
+
+bool AppendPostingList(PostingList list, uint64_t value) {
+  unsigned char *bytes;
+  PLSkipEntry *skips;
+  uint64_t gap, capacity;
+
+  Assert333(list != NULL);  // defensive programming
+  if (list->num_values > 0 && value < list->last_value)
+    return false;
+
+  if (list->num_values % PL_BLOCK_SIZE == 0) {
+    // start a new block, with value as its first value.
+    if (list->num_blocks == list->skips_capacity) {
+      capacity = (list->skips_capacity > 0) ? 2 * list->skips_capacity : 4;
+      skips = (PLSkipEntry *) realloc(list->skips,
+                                      capacity * sizeof(PLSkipEntry));
+      if (skips == NULL)
+        return false;
+      list->skips = skips;
+      list->skips_capacity = capacity;
+    }
+    list->skips[list->num_blocks].first_value = value;
+    list->skips[list->num_blocks].offset = list->num_bytes;
+    list->num_blocks++;
+  } else {
+    // code the gap from the last value.
+    if (list->num_bytes + PL_MAX_GAP_BYTES > list->bytes_capacity) {
+      capacity = (list->bytes_capacity > 0) ? 2 * list->bytes_capacity : 64;
+      bytes = (unsigned char *) realloc(list->bytes, capacity);
+      if (bytes == NULL)
+        return false;
+      list->bytes = bytes;
+      list->bytes_capacity = capacity;
+    }
+    gap = value - list->last_value;
+    while (gap >= 0x80) {
+      list->bytes[list->num_bytes++] = (unsigned char) (gap | 0x80);
+      gap >>= 7;
+    }
+    list->bytes[list->num_bytes++] = (unsigned char) gap;
+  }
+  list->last_value = value;
+  list->num_values++;
+  return true;
+}
+
+PostingList PostingListFromLinkedList(LinkedList list,
+                                      LLPayloadKeyFnPtr key_function) {
+  LinkedListNodePtr node;
+  PostingList posting_list;
+
+  Assert333(list != NULL);  // defensive programming
+  Assert333(key_function != NULL);
+  posting_list = AllocatePostingList();
+  if (posting_list == NULL)
+    return NULL;
+  for (node = list->head; node != NULL; node = node->next) {
+    if (!AppendPostingList(posting_list, key_function(node->payload))) {
+      FreePostingList(posting_list);
+      return NULL;
+    }
+  }
+  return posting_list;
+}
+
+LinkedList PostingListToLinkedList(PostingList list,
+                                   PLValueToPayloadFnPtr payload_function,
+                                   LLPayloadFreeFnPtr payload_free_function) {
+  uint64_t values[PL_BLOCK_SIZE], b, i, n;
+  LinkedList linked_list;
+  void *payload;
+
+  Assert333(list != NULL);  // defensive programming
+  Assert333(payload_function != NULL);
+  Assert333(payload_free_function != NULL);
+  linked_list = AllocateLinkedList();
+  if (linked_list == NULL)
+    return NULL;
+  for (b = 0; b < list->num_blocks; b++) {
+    n = DecodeBlock(list, b, values);
+    for (i = 0; i < n; i++) {
+      payload = payload_function(values[i]);
+      if (payload == NULL || !AppendLinkedList(linked_list, payload)) {
+        if (payload != NULL)
+          payload_free_function(payload);
+        FreeLinkedList(linked_list, payload_free_function);
+        return NULL;
+      }
+    }
+  }
+  return linked_list;
+}
+
+PLIter PLMakeIterator(PostingList list) {
+  PLIter iter;
+
+  Assert333(list != NULL);  // defensive programming
+
+  // if the list is empty, return failure.
+  if (list->num_values == 0)
+    return NULL;
+  iter = (PLIter) malloc(sizeof(PLIterSt));
+  if (iter == NULL)
+    return NULL;
+  iter->list = list;
+  iter->block = 0;
+  iter->num_decoded = DecodeBlock(list, 0, iter->values);
+  iter->pos = 0;
+  return iter;
+}
+
+void PLIteratorFree(PLIter iter) {
+  Assert333(iter != NULL);  // defensive programming
+  free(iter);
+}
+
+bool PLIteratorHasNext(PLIter iter) {
+  Assert333(iter != NULL);  // defensive programming
+  return iter->pos + 1 < iter->num_decoded ||
+    iter->block + 1 < iter->list->num_blocks;
+}
+
+bool PLIteratorNext(PLIter iter) {
+  Assert333(iter != NULL);  // defensive programming
+  if (iter->pos + 1 < iter->num_decoded) {
+    iter->pos++;
+    return true;
+  }
+  if (iter->block + 1 < iter->list->num_blocks) {
+    iter->block++;
+    iter->num_decoded = DecodeBlock(iter->list, iter->block, iter->values);
+    iter->pos = 0;
+    return true;
+  }
+  return false;
+}
+
+void PLIteratorGetValue(PLIter iter, uint64_t *value) {
+  Assert333(iter != NULL);  // defensive programming
+  Assert333(value != NULL);
+  *value = iter->values[iter->pos];
+}
+
+bool PLIteratorSeek(PLIter iter, uint64_t target) {
+  PostingList list;
+  uint64_t lo, hi, mid;
+
+  Assert333(iter != NULL);  // defensive programming
+  list = iter->list;
+  if (iter->values[iter->pos] >= target)
+    return true;
+  if (list->last_value < target)
+    return false;
+  if (SeekInBlock(iter, target))
+    return true;
+
+  // find the first later block that starts at or after target; the
+  // value we want is either in the block before it, or is its first.
+  lo = iter->block + 1;
+  hi = list->num_blocks;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (list->skips[mid].first_value < target) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo - 1 > iter->block) {
+    iter->block = lo - 1;
+    iter->num_decoded = DecodeBlock(list, iter->block, iter->values);
+    iter->pos = 0;
+    if (SeekInBlock(iter, target))
+      return true;
+  }
+  iter->block = lo;
+  iter->num_decoded = DecodeBlock(list, iter->block, iter->values);
+  iter->pos = 0;
+  return true;
+}
+
+static uint64_t DecodeBlock(PostingList list, uint64_t b, uint64_t *values) {
+  const unsigned char *p = list->bytes + list->skips[b].offset;
+  uint64_t n, i, value, gap;
+  unsigned int shift;
+
+  n = list->num_values - b * PL_BLOCK_SIZE;
+  if (n > PL_BLOCK_SIZE)
+    n = PL_BLOCK_SIZE;
+  value = values[0] = list->skips[b].first_value;
+  for (i = 1; i < n; i++) {
+    // most gaps fit in a single byte.
+    gap = *p++;
+    if (gap >= 0x80) {
+      gap &= 0x7f;
+      shift = 7;
+      do {
+        gap |= (uint64_t) (*p & 0x7f) << shift;
+        shift += 7;
+      } while (*p++ & 0x80);
+    }
+    value += gap;
+    values[i] = value;
+  }
+  return n;
+}
+
+static bool SeekInBlock(PLIter iter, uint64_t target) {
+  uint64_t pos;
+
+  for (pos = iter->pos; pos < iter->num_decoded; pos++) {
+    if (iter->values[pos] >= target) {
+      iter->pos = pos;
+      return true;
+    }
+  }
+  return false;
+}
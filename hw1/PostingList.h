@@ -0,0 +1,153 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_POSTINGLIST_H_
+#define _HW1_POSTINGLIST_H_
+
+#include <stdbool.h>    // for bool, true, false
+#include <stdint.h>     // so we can use uint64_t, etc.
+
+#include "./LinkedList.h"  // for LinkedList, LLPayloadKeyFnPtr
+
+// A PostingList is a compact, append-only sequence of sorted uint64_t
+// values, such as the document IDs in an inverted index's posting
+// list.  Holding a million IDs in a LinkedList takes a 24-byte node (and
+// malloc's overhead on it) per ID, plus whatever the payload takes;
+// a PostingList typically takes a byte or two per ID.
+//
+// The values are stored in blocks of PL_BLOCK_SIZE.  A block's first
+// value is kept in full in a skip index, and the rest as the gaps
+// between consecutive values, in a variable-byte code: 7 bits to a
+// byte, with the high bit set on all but a gap's last byte, so small
+// gaps take a single byte.  The skip index lets an iterator seek to a
+// value by binary searching the blocks and decoding just one of them.
+//
+// As usual, the structs are defined in the private header
+// PostingList_priv.h.
+#define PL_BLOCK_SIZE  128
+
+struct pl_rec;
+typedef struct pl_rec *PostingList;
+
+// Allocate and return a new, empty, posting list.  The caller takes
+// responsibility for eventually calling FreePostingList.
+//
+// Returns NULL on error (out of memory), non-NULL on success.
+PostingList AllocatePostingList(void);
+
+// Free a posting list.
+void FreePostingList(PostingList list);
+
+// Return the number of values in a posting list.
+uint64_t NumValuesInPostingList(PostingList list);
+
+// Return the number of bytes of memory a posting list takes, counting
+// the space it has allocated but not yet used.
+uint64_t PostingListMemoryBytes(PostingList list);
+
+// Append a value to the end of a posting list.
+//
+// Arguments:
+//
+// - list: the list to append to
+//
+// - value: the value to append; it must be no less than the last value
+//   in the list.
+//
+// Returns false on failure (out of memory, or value out of order, in
+// which case the list is left as it was), true on success.
+bool AppendPostingList(PostingList list, uint64_t value);
+
+// Build a posting list from the payloads of a LinkedList, whose keys
+// must be in ascending order.
+//
+// Arguments:
+//
+// - list: the list to take the values from; it is left as it was.
+//
+// - key_function: returns a payload's value.  It's called once per
+//   node.
+//
+// Returns NULL on failure (out of memory, or the keys out of order),
+// else the new posting list.
+PostingList PostingListFromLinkedList(LinkedList list,
+                                      LLPayloadKeyFnPtr key_function);
+
+// The inverse of a LLPayloadKeyFnPtr, used to turn a posting list back
+// into a LinkedList: allocate and return a payload for value, or NULL
+// if out of memory.
+typedef void *(*PLValueToPayloadFnPtr)(uint64_t value);
+
+// Build a LinkedList from a posting list, one payload per value, in
+// order.
+//
+// Arguments:
+//
+// - list: the posting list to take the values from; it is left as it
+//   was.
+//
+// - payload_function: makes each value's payload; see above.
+//
+// - payload_free_function: frees the payloads made so far, if building
+//   the list fails part way.
+//
+// Returns NULL on failure (out of memory), else the new LinkedList.
+LinkedList PostingListToLinkedList(PostingList list,
+                                   PLValueToPayloadFnPtr payload_function,
+                                   LLPayloadFreeFnPtr payload_free_function);
+
+// Posting lists have forward iterators, which work like LLIters: they
+// start at the first value, and move on one value at a time.  They
+// decode a whole block at a time into a buffer of their own, so most
+// steps don't decode anything.  As with LLIters, appending to a list
+// makes its iterators dangerous to use.
+struct pl_iter;
+typedef struct pl_iter *PLIter;
+
+// Manufacture an iterator for a posting list, at its first value.  The
+// caller is responsible for eventually calling PLIteratorFree.
+//
+// Returns NULL on failure (out of memory, empty list) or non-NULL on
+// success.
+PLIter PLMakeIterator(PostingList list);
+void PLIteratorFree(PLIter iter);
+
+// Test whether the iterator can advance: true unless it's at the last
+// value.
+bool PLIteratorHasNext(PLIter iter);
+
+// Advance the iterator to the next value.  Returns true if it has been
+// advanced, false if it is at the last value and cannot be.
+bool PLIteratorNext(PLIter iter);
+
+// Return the value the iterator is at through the "return parameter"
+// value.
+void PLIteratorGetValue(PLIter iter, uint64_t *value);
+
+// Move the iterator forward to the first value that is no less than
+// target, using the skip index to jump over whole blocks.  It never
+// moves backwards: if the value it's at is no less than target, it
+// stays there.
+//
+// Returns true if it found such a value, false if there is none (and
+// the iterator is left where it was).
+bool PLIteratorSeek(PLIter iter, uint64_t target);
+
+#endif  // _HW1_POSTINGLIST_H_
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_POSTINGLIST_PRIV_H_
+#define _HW1_POSTINGLIST_PRIV_H_
+
+#include <stdint.h>
+
+#include "./PostingList.h"
+
+// Block b of a posting list holds values b*PL_BLOCK_SIZE onwards.  Its
+// first value is in skips[b].first_value; the gaps to the rest are
+// variable-byte coded in bytes[skips[b].offset, skips[b + 1].offset),
+// or up to num_bytes for the last block.
+typedef struct {
+  uint64_t first_value;  // the block's first value
+  uint64_t offset;       // where its gaps start in bytes[]
+} PLSkipEntry;
+
+typedef struct pl_rec {
+  uint64_t       num_values;      // # values in the list
+  uint64_t       last_value;      // the last of them
+  unsigned char *bytes;           // the coded gaps
+  uint64_t       num_bytes;       // # bytes of them
+  uint64_t       bytes_capacity;  // # bytes bytes[] has room for
+  PLSkipEntry   *skips;           // the skip index, one per block
+  uint64_t       num_blocks;      // # blocks
+  uint64_t       skips_capacity;  // # blocks skips[] has room for
+} PostingListRec;
+
+// An iterator holds one block decoded.
+typedef struct pl_iter {
+  PostingList list;                   // the list we're for
+  uint64_t    block;                  // the block decoded in values[]
+  uint64_t    num_decoded;            // # values in values[]
+  uint64_t    pos;                    // the value we're at in values[]
+  uint64_t    values[PL_BLOCK_SIZE];  // the block's values
+} PLIterSt;
+
+#endif  // _HW1_POSTINGLIST_PRIV_H_
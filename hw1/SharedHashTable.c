@@ -0,0 +1,484 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "Assert333.h"
+#include "HashTable.h"
+#include "SharedHashTable.h"
+#include "SharedHashTable_priv.h"
+
+// Internal helper that maps a region, checks its header and wraps it in
+// a SharedHashTable.  Takes ownership of nothing; returns NULL on error.
+static SharedHashTable MapRegion(int fd, uint64_t size, bool check_header);
+
+// Internal helpers to convert between offsets and entries.
+static SHTEntry *EntryAt(SharedHashTable table, uint64_t offset);
+
+// Internal helpers for the region's allocator.  AllocBlock returns the
+// offset of a block big enough for an entry with len value bytes (and
+// sets *block_class), or 0 if the region is full.  Both must be called
+// with the write lock held.
+static uint64_t AllocBlock(SharedHashTable table, uint64_t len,
+                           uint64_t *block_class);
+static void FreeBlock(SharedHashTable table, uint64_t offset);
+
+// Internal helpers that take and release the region's lock.  If the
+// lock's last owner died holding it, LockRegion repairs the region
+// before returning.  LockRegion returns false if the lock can't be
+// taken at all, which only happens if a repair was abandoned.
+static bool LockRegion(SharedHashTable table);
+static void UnlockRegion(SharedHashTable table);
+
+// Internal helper that checks a region whose lock's owner died holding
+// it, with the lock held: any chain or free list link that doesn't
+// point at a plausible block in the heap is cut off there, and
+// num_elements is recounted from the chains.
+static void RepairRegion(SharedHashTable table);
+
+// Internal helper for RepairRegion: is offset the start of a block of
+// class c (or of any class, if c is SHT_NUM_CLASSES) lying wholly
+// inside the heap?
+static bool IsBlock(SharedHashTable table, uint64_t offset, uint64_t c);
+
+// Internal helper that finds the link (a bucket slot, or the previous
+// entry's next field) pointing at key's entry, or at the 0 ending its
+// chain if the key isn't present.
+static uint64_t *FindLink(SharedHashTable table, uint64_t key);
+
+SharedHashTable CreateSharedHashTable(const char *name,
+                                      uint64_t region_bytes,
+                                      uint64_t num_buckets) {
+  pthread_mutexattr_t attr;
+  SharedHashTable table;
+  SHTRegionHeader *header;
+  uint64_t heap_offset;
+  bool ok;
+  int fd;
+
+  Assert333(name != NULL);
+  if (num_buckets == 0)
+    return NULL;
+
+  // the header and the bucket array come first; make sure there is room
+  // for them and at least one entry.
+  if (num_buckets > (UINT64_MAX - sizeof(SHTRegionHeader)) / 8)
+    return NULL;
+  heap_offset = sizeof(SHTRegionHeader) + num_buckets * sizeof(uint64_t);
+  heap_offset = (heap_offset + 7) & ~7ULL;
+  if (region_bytes < heap_offset + (1ULL << SHT_MIN_BLOCK_LOG) ||
+      region_bytes > (uint64_t) SIZE_MAX)
+    return NULL;
+
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1)
+    return NULL;
+  // ftruncate zero-fills the region, which empties every bucket.
+  if (ftruncate(fd, (off_t) region_bytes) != 0) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  table = MapRegion(fd, region_bytes, false);
+  close(fd);
+  if (table == NULL) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  header = table->header;
+  header->version = SHT_VERSION;
+  header->region_size = region_bytes;
+  header->num_buckets = num_buckets;
+  header->num_elements = 0;
+  header->bucket_offset = sizeof(SHTRegionHeader);
+  header->heap_offset = heap_offset;
+  header->heap_top = heap_offset;
+  table->buckets = (uint64_t *) (table->base + header->bucket_offset);
+
+  // the lock is robust, so that a process dying while holding it
+  // doesn't leave everyone else waiting for it forever.
+  ok = pthread_mutexattr_init(&attr) == 0;
+  if (ok) {
+    ok = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) == 0 &&
+         pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) == 0 &&
+         pthread_mutex_init(&header->lock, &attr) == 0;
+    pthread_mutexattr_destroy(&attr);
+  }
+  if (!ok) {
+    DetachSharedHashTable(table);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  // publish the magic number last, so that a process attaching while
+  // we're still setting up sees an uninitialized region and backs off.
+  __atomic_store_n(&header->magic, SHT_MAGIC, __ATOMIC_RELEASE);
+  return table;
+}
+
+SharedHashTable AttachSharedHashTable(const char *name) {
+  SharedHashTable table;
+  struct stat st;
+  int fd;
+
+  Assert333(name != NULL);
+
+  fd = shm_open(name, O_RDWR, 0);
+  if (fd == -1)
+    return NULL;
+  if (fstat(fd, &st) != 0 ||
+      (uint64_t) st.st_size < sizeof(SHTRegionHeader)) {
+    close(fd);
+    return NULL;
+  }
+  table = MapRegion(fd, (uint64_t) st.st_size, true);
+  close(fd);
+  return table;
+}
+
+void DetachSharedHashTable(SharedHashTable table) {
+  Assert333(table != NULL);
+  munmap(table->base, table->size);
+  free(table);
+}
+
+bool UnlinkSharedHashTable(const char *name) {
+  Assert333(name != NULL);
+  return shm_unlink(name) == 0;
+}
+
+uint64_t NumElementsInSharedHashTable(SharedHashTable table) {
+  uint64_t num_elements;
+
+  Assert333(table != NULL);
+  if (!LockRegion(table))
+    return 0;
+  num_elements = table->header->num_elements;
+  UnlockRegion(table);
+  return num_elements;
+}
+
+int InsertSharedHashTable(SharedHashTable table, uint64_t key,
+                          const void *value, uint64_t len) {
+  uint64_t *link, offset, old, block_class;
+  SHTEntry *entry, *oldentry;
+  int res;
+
+  Assert333(table != NULL);
+  Assert333(value != NULL || len == 0);
+
+  if (!LockRegion(table))
+    return 0;
+  link = FindLink(table, key);
+  old = *link;
+  oldentry = EntryAt(table, old);
+
+  if (oldentry != NULL &&
+      sizeof(SHTEntry) + len <=
+      (1ULL << (oldentry->block_class + SHT_MIN_BLOCK_LOG))) {
+    // the new value fits in the old entry's block; overwrite it.
+    oldentry->value_len = len;
+    if (len > 0)
+      memcpy(oldentry + 1, value, len);
+    UnlockRegion(table);
+    return 2;
+  }
+
+  // otherwise we need a new block.  Get it before touching the chain, so
+  // that running out of space leaves the table unchanged.
+  offset = AllocBlock(table, len, &block_class);
+  if (offset == 0) {
+    UnlockRegion(table);
+    return 0;
+  }
+  entry = EntryAt(table, offset);
+  entry->key = key;
+  entry->value_len = len;
+  entry->block_class = block_class;
+  if (len > 0)
+    memcpy(entry + 1, value, len);
+
+  // link the entry in with a release store, so that the entry is
+  // complete before it's reachable, even to a RepairRegion after we
+  // die.
+  if (oldentry != NULL) {
+    // take the old entry's place in its chain.
+    entry->next = oldentry->next;
+    __atomic_store_n(link, offset, __ATOMIC_RELEASE);
+    FreeBlock(table, old);
+    res = 2;
+  } else {
+    // push the new entry on the front of its bucket's chain.
+    link = &table->buckets[key % table->header->num_buckets];
+    entry->next = *link;
+    __atomic_store_n(link, offset, __ATOMIC_RELEASE);
+    table->header->num_elements++;
+    res = 1;
+  }
+  UnlockRegion(table);
+  return res;
+}
+
+int LookupSharedHashTable(SharedHashTable table, uint64_t key,
+                          void *buf, uint64_t buflen, uint64_t *len) {
+  SHTEntry *entry;
+  int res = 0;
+
+  Assert333(table != NULL);
+  Assert333(buf != NULL || buflen == 0);
+  Assert333(len != NULL);
+
+  if (!LockRegion(table))
+    return 0;
+  entry = EntryAt(table, *FindLink(table, key));
+  if (entry != NULL) {
+    *len = entry->value_len;
+    if (buflen > entry->value_len)
+      buflen = entry->value_len;
+    if (buflen > 0)
+      memcpy(buf, entry + 1, buflen);
+    res = 1;
+  }
+  UnlockRegion(table);
+  return res;
+}
+
+int RemoveFromSharedHashTable(SharedHashTable table, uint64_t key) {
+  uint64_t *link, offset;
+  int res = 0;
+
+  Assert333(table != NULL);
+
+  if (!LockRegion(table))
+    return 0;
+  link = FindLink(table, key);
+  offset = *link;
+  if (offset != 0) {
+    *link = EntryAt(table, offset)->next;
+    FreeBlock(table, offset);
+    table->header->num_elements--;
+    res = 1;
+  }
+  UnlockRegion(table);
+  return res;
+}
+
+bool CopyHashTableToShared(HashTable source, SharedHashTable table,
+                           ValueBytesFnPtr value_bytes_function) {
+  HTIter iter;
+  HTKeyValue kv;
+  const void *bytes;
+  uint64_t len;
+  bool success = true;
+
+  Assert333(source != NULL);
+  Assert333(table != NULL);
+  Assert333(value_bytes_function != NULL);
+
+  iter = HashTableMakeIterator(source);
+  if (iter == NULL)
+    return false;
+  while (success && !HTIteratorPastEnd(iter)) {
+    Assert333(HTIteratorGet(iter, &kv) == 1);
+    bytes = value_bytes_function(kv.value, &len);
+    success = InsertSharedHashTable(table, kv.key, bytes, len) != 0;
+    HTIteratorNext(iter);
+  }
+  HTIteratorFree(iter);
+  return success;
+}
+
+static SharedHashTable MapRegion(int fd, uint64_t size, bool check_header) {
+  SharedHashTable table;
+  SHTRegionHeader *header;
+  void *base;
+
+  table = (SharedHashTable) malloc(sizeof(SharedHashTableRecord));
+  if (table == NULL)
+    return NULL;
+  base = mmap(NULL, (size_t) size, PROT_READ | PROT_WRITE, MAP_SHARED,
+              fd, 0);
+  if (base == MAP_FAILED) {
+    free(table);
+    return NULL;
+  }
+  table->base = (unsigned char *) base;
+  table->size = size;
+  table->header = header = (SHTRegionHeader *) base;
+  table->buckets = NULL;
+
+  if (check_header) {
+    // make sure the region was fully set up by its creator, and that
+    // everything the header points at lies inside the region.
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHT_MAGIC ||
+        header->version != SHT_VERSION ||
+        header->region_size != size ||
+        header->bucket_offset != sizeof(SHTRegionHeader) ||
+        header->num_buckets == 0 ||
+        header->num_buckets > (size - header->bucket_offset) / 8 ||
+        header->heap_offset < header->bucket_offset +
+                              header->num_buckets * sizeof(uint64_t) ||
+        header->heap_top < header->heap_offset ||
+        header->heap_top > size) {
+      DetachSharedHashTable(table);
+      return NULL;
+    }
+    table->buckets = (uint64_t *) (table->base + header->bucket_offset);
+  }
+  return table;
+}
+
+static SHTEntry *EntryAt(SharedHashTable table, uint64_t offset) {
+  if (offset == 0)
+    return NULL;
+  return (SHTEntry *) (table->base + offset);
+}
+
+static uint64_t AllocBlock(SharedHashTable table, uint64_t len,
+                           uint64_t *block_class) {
+  SHTRegionHeader *header = table->header;
+  uint64_t need, c, offset, block_size;
+
+  // find the smallest size class that fits the entry.
+  if (len > header->region_size)
+    return 0;
+  need = sizeof(SHTEntry) + len;
+  for (c = 0; c < SHT_NUM_CLASSES; c++) {
+    if ((1ULL << (c + SHT_MIN_BLOCK_LOG)) >= need)
+      break;
+  }
+  if (c == SHT_NUM_CLASSES)
+    return 0;
+  *block_class = c;
+
+  // reuse a freed block of that class if there is one...
+  offset = header->free_lists[c];
+  if (offset != 0) {
+    memcpy(&header->free_lists[c], table->base + offset, sizeof(uint64_t));
+    return offset;
+  }
+
+  // ...otherwise carve a new one off the top of the heap.
+  block_size = 1ULL << (c + SHT_MIN_BLOCK_LOG);
+  if (header->region_size - header->heap_top < block_size)
+    return 0;
+  offset = header->heap_top;
+  header->heap_top += block_size;
+  return offset;
+}
+
+static void FreeBlock(SharedHashTable table, uint64_t offset) {
+  SHTRegionHeader *header = table->header;
+  uint64_t c = EntryAt(table, offset)->block_class;
+
+  memcpy(table->base + offset, &header->free_lists[c], sizeof(uint64_t));
+  header->free_lists[c] = offset;
+}
+
+static uint64_t *FindLink(SharedHashTable table, uint64_t key) {
+  uint64_t *link;
+  SHTEntry *entry;
+
+  link = &table->buckets[key % table->header->num_buckets];
+  while ((entry = EntryAt(table, *link)) != NULL) {
+    if (entry->key == key)
+      break;
+    link = &entry->next;
+  }
+  return link;
+}
+
+static bool LockRegion(SharedHashTable table) {
+  int res = pthread_mutex_lock(&table->header->lock);
+
+  if (res == EOWNERDEAD) {
+    // we hold the lock, but its owner died part way through changing
+    // the region; put it right, then mark the lock usable again.
+    RepairRegion(table);
+    res = pthread_mutex_consistent(&table->header->lock);
+  }
+  return res == 0;
+}
+
+static void UnlockRegion(SharedHashTable table) {
+  pthread_mutex_unlock(&table->header->lock);
+}
+
+static bool IsBlock(SharedHashTable table, uint64_t offset, uint64_t c) {
+  SHTRegionHeader *header = table->header;
+  SHTEntry *entry;
+
+  if (offset < header->heap_offset || (offset & 7) != 0 ||
+      offset > header->heap_top - sizeof(SHTEntry))
+    return false;
+  entry = EntryAt(table, offset);
+  if (entry->block_class >= SHT_NUM_CLASSES ||
+      (c != SHT_NUM_CLASSES && entry->block_class != c))
+    return false;
+  return (1ULL << (entry->block_class + SHT_MIN_BLOCK_LOG)) <=
+         header->heap_top - offset;
+}
+
+static void RepairRegion(SharedHashTable table) {
+  SHTRegionHeader *header = table->header;
+  uint64_t *link, b, c, steps, max_blocks, num_elements = 0;
+  SHTEntry *entry;
+
+  // no chain or free list can be longer than the heap has blocks, so
+  // one that is has a cycle in it.
+  max_blocks = (header->heap_top - header->heap_offset) >> SHT_MIN_BLOCK_LOG;
+  for (b = 0; b < header->num_buckets; b++) {
+    link = &table->buckets[b];
+    for (steps = 0; *link != 0; steps++) {
+      entry = EntryAt(table, *link);
+      if (steps == max_blocks || !IsBlock(table, *link, SHT_NUM_CLASSES) ||
+          entry->key % header->num_buckets != b ||
+          sizeof(SHTEntry) + entry->value_len >
+          (1ULL << (entry->block_class + SHT_MIN_BLOCK_LOG))) {
+        *link = 0;
+        break;
+      }
+      num_elements++;
+      link = &entry->next;
+    }
+  }
+  header->num_elements = num_elements;
+
+  for (c = 0; c < SHT_NUM_CLASSES; c++) {
+    link = &header->free_lists[c];
+    for (steps = 0; *link != 0; steps++) {
+      if (steps == max_blocks || !IsBlock(table, *link, c)) {
+        *link = 0;
+        break;
+      }
+      link = (uint64_t *) (table->base + *link);
+    }
+  }
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_SHAREDHASHTABLE_H_
+#define _HW1_SHAREDHASHTABLE_H_
+
+#include <stdbool.h>    // for bool, true, false
+#include <stdint.h>     // so we can use uint64_t, etc.
+
+#include "./HashTable.h"       // for HashTable
+#include "./HashTableImage.h"  // for ValueBytesFnPtr
+
+// A SharedHashTable is a chained hash table that lives entirely inside
+// a POSIX shared memory region (shm_open + mmap), so that several
+// processes can attach to, and share, a single copy of it.
+//
+// Nothing in the region is a pointer: chains, buckets and the region's
+// own allocator all refer to each other by byte offsets from the start
+// of the region, so each process can map it at a different address.
+// Values are stored as byte blobs inside the region.
+//
+// Every operation holds the region's lock, a process-shared robust
+// mutex, for its duration.  A process that dies holding it (e.g.,
+// killed part way through an insert) doesn't leave the table locked:
+// the next process to take the lock checks and repairs the region
+// first.  The region has a fixed size and a fixed number of buckets,
+// chosen when it is created.
+struct shared_htrec;
+typedef struct shared_htrec *SharedHashTable;
+
+// Create a new shared table and attach to it.
+//
+// Arguments:
+//
+// - name: the shared memory object's name, e.g. "/mytable"; see
+//   shm_open(3).  Creation fails if the name is already in use.
+//
+// - region_bytes: the size of the region.  Everything (header, bucket
+//   array, entries and values) must fit in it.
+//
+// - num_buckets: the number of buckets.  The table never resizes, so
+//   this should be about the number of entries you expect.
+//
+// Returns NULL on error, non-NULL on success.
+SharedHashTable CreateSharedHashTable(const char *name,
+                                      uint64_t region_bytes,
+                                      uint64_t num_buckets);
+
+// Attach to an existing shared table, e.g. from another process.
+// Returns NULL on error (including if the table doesn't exist, or is
+// still being created), non-NULL on success.
+SharedHashTable AttachSharedHashTable(const char *name);
+
+// Detach from a shared table.  The table itself stays around for other
+// processes until it is unlinked and everyone has detached.
+void DetachSharedHashTable(SharedHashTable table);
+
+// Remove a shared table's name, as with shm_unlink(3).  Returns false
+// on error.
+bool UnlinkSharedHashTable(const char *name);
+
+// Return the number of elements in the table.
+uint64_t NumElementsInSharedHashTable(SharedHashTable table);
+
+// Inserts a key and a copy of the len value bytes into the table,
+// replacing any value the key already has.
+//
+// Returns:
+//
+//  - 0 on failure (the region is out of space)
+//
+//  - +1 if the key was inserted
+//
+//  - +2 if the key's old value was replaced
+int InsertSharedHashTable(SharedHashTable table, uint64_t key,
+                          const void *value, uint64_t len);
+
+// Looks up a key in the table, copying its value out.
+//
+// Arguments:
+//
+// - table: the table to look in
+//
+// - key: the key to look up
+//
+// - buf, buflen: if the key is present, up to buflen bytes of its value
+//   are copied into buf.
+//
+// - len: if the key is present, the full length of its value is
+//   returned through this parameter; if it is more than buflen, the
+//   copy was truncated.
+//
+// Returns 0 if the key wasn't found, +1 if it was.
+int LookupSharedHashTable(SharedHashTable table, uint64_t key,
+                          void *buf, uint64_t buflen, uint64_t *len);
+
+// Removes a key and its value from the table.
+//
+// Returns 0 if the key wasn't found, +1 if it was found and removed.
+int RemoveFromSharedHashTable(SharedHashTable table, uint64_t key);
+
+// Copy every key/value of a (process-local) HashTable into a shared
+// table, e.g. to publish a table that one process built.
+//
+// Returns false if the shared table ran out of space part way through.
+bool CopyHashTableToShared(HashTable source, SharedHashTable table,
+                           ValueBytesFnPtr value_bytes_function);
+
+#endif  // _HW1_SHAREDHASHTABLE_H_
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_SHAREDHASHTABLE_PRIV_H_
+#define _HW1_SHAREDHASHTABLE_PRIV_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./SharedHashTable.h"
+
+// Define the layout of a shared region, and the per-process struct
+// for an attached table.
+//
+// A region is laid out as:
+//
+//   [SHTRegionHeader]
+//   [bucket array: num_buckets uint64_t entry offsets]
+//   [heap: entries, carved out by the region's allocator]
+//
+// Offset 0 is the header, so an offset of 0 doubles as "none".
+//
+// The allocator hands out power-of-two sized blocks, from
+// SHT_MIN_BLOCK bytes up.  Freed blocks go on a per-size-class free
+// list (linked through their first 8 bytes); new blocks come off the
+// free list if possible, else off the top of the heap.
+//
+// Every change to the chains and free lists is a single 8-byte store of
+// an offset, made once whatever it points at is complete, so a process
+// that dies holding the lock leaves them intact; at worst a block it
+// was allocating or freeing leaks, num_elements is off by one, or a
+// value it was overwriting in place is torn.  The next process to take
+// the lock is told its owner died, and repairs the header before going
+// on (see RepairRegion in SharedHashTable.c).
+
+#define SHT_MAGIC          0x4D48535F33333348ULL  // "H333_SHM"
+#define SHT_VERSION        2U
+#define SHT_MIN_BLOCK_LOG  5                      // 32-byte blocks
+#define SHT_NUM_CLASSES    48
+
+typedef struct {
+  uint64_t         magic;          // SHT_MAGIC, once initialized
+  uint64_t         version;        // SHT_VERSION
+  uint64_t         region_size;    // total size of the region
+  uint64_t         num_buckets;    // # of buckets
+  uint64_t         num_elements;   // # of entries in the table
+  uint64_t         bucket_offset;  // offset of the bucket array
+  uint64_t         heap_offset;    // offset of the start of the heap
+  uint64_t         heap_top;       // offset of the unallocated heap
+  uint64_t         free_lists[SHT_NUM_CLASSES];  // per-class free blocks
+  pthread_mutex_t  lock;           // process-shared and robust
+} SHTRegionHeader;
+
+// An entry in a chain.  The value bytes follow the struct.
+typedef struct {
+  uint64_t next;         // offset of the next entry in the chain, or 0
+  uint64_t key;          // the key
+  uint64_t value_len;    // # of value bytes following this struct
+  uint64_t block_class;  // which size class this block came from
+} SHTEntry;
+
+// This is the per-process struct for an attached table.
+typedef struct shared_htrec {
+  unsigned char   *base;    // where the region is mapped in this process
+  uint64_t         size;    // size of the mapping
+  SHTRegionHeader *header;  // == base
+  uint64_t        *buckets; // the bucket array
+} SharedHashTableRecord;
+
+#endif  // _HW1_SHAREDHASHTABLE_PRIV_H_
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "Assert333.h"
+#include "Telemetry.h"
+#include "Telemetry_priv.h"
+
+// How each counter is exported: a metric name, an optional label, and
+// the metric's help text.  Counters that share a metric name must be
+// next to each other.
+typedef struct {
+  const char *metric;
+  const char *label;
+  const char *help;
+} TelemetryMetric;
+
+static const TelemetryMetric kMetrics[TM_NUM_COUNTERS] = {
+  { "hw1_hashtable_inserts_total", NULL,
+    "Successful HashTable inserts." },
+  { "hw1_hashtable_lookups_total", "result=\"hit\"",
+    "HashTable lookups, by result." },
+  { "hw1_hashtable_lookups_total", "result=\"miss\"",
+    "HashTable lookups, by result." },
+  { "hw1_hashtable_removes_total", NULL,
+    "HashTable removes that removed a key." },
+  { "hw1_hashtable_resizes_total", NULL,
+    "HashTable resizes." },
+  { "hw1_linkedlist_inserts_total", NULL,
+    "Nodes added to LinkedLists." },
+  { "hw1_linkedlist_removes_total", NULL,
+    "Nodes removed from LinkedLists." },
+  { "hw1_linkedlist_sorts_total", NULL,
+    "LinkedList sorts." },
+  { "hw1_allocations_total", NULL,
+    "Allocations made by LinkedLists and HashTables." },
+};
+
+// This is the struct we use to represent a running socket server.
+typedef struct tm_server {
+  int        listen_fd;
+  char      *path;
+  pthread_t  thread;
+} TelemetryServerRecord;
+
+__thread TelemetryBlock *tm_thread_block = NULL;
+
+// Every live thread's block, and the totals of threads that have exited.
+static pthread_mutex_t tm_lock = PTHREAD_MUTEX_INITIALIZER;
+static TelemetryBlock *tm_blocks = NULL;
+static uint64_t tm_retired[TM_NUM_COUNTERS];
+
+// Counted into, with atomic adds, by threads that couldn't get a block.
+static TelemetryBlock tm_fallback;
+
+// A key whose destructor retires a thread's block when the thread exits.
+static pthread_key_t tm_key;
+static pthread_once_t tm_key_once = PTHREAD_ONCE_INIT;
+
+// Internal helpers that create tm_key, and retire an exiting thread's
+// block.
+static void MakeTelemetryKey(void);
+static void RetireBlock(void *block);
+
+// The body of a socket server's thread.
+static void *ServerThread(void *arg);
+
+TelemetryBlock *TelemetryAttachThread(void) {
+  TelemetryBlock *block;
+
+  pthread_once(&tm_key_once, &MakeTelemetryKey);
+  if (posix_memalign((void **) &block, TM_CACHE_LINE,
+                     sizeof(TelemetryBlock)) != 0)
+    return &tm_fallback;
+  memset(block, 0, sizeof(TelemetryBlock));
+  if (pthread_setspecific(tm_key, block) != 0) {
+    free(block);
+    return &tm_fallback;
+  }
+
+  pthread_mutex_lock(&tm_lock);
+  block->next = tm_blocks;
+  if (tm_blocks != NULL)
+    tm_blocks->prev = block;
+  tm_blocks = block;
+  pthread_mutex_unlock(&tm_lock);
+  tm_thread_block = block;
+  return block;
+}
+
+bool TelemetryIsFallback(TelemetryBlock *block) {
+  return block == &tm_fallback;
+}
+
+void GetTelemetrySnapshot(TelemetrySnapshot *snapshot) {
+  TelemetryBlock *block;
+  int c;
+
+  Assert333(snapshot != NULL);
+  pthread_mutex_lock(&tm_lock);
+  for (c = 0; c < TM_NUM_COUNTERS; c++) {
+    snapshot->counts[c] = tm_retired[c] +
+      __atomic_load_n(&tm_fallback.counts[c], __ATOMIC_RELAXED);
+  }
+  for (block = tm_blocks; block != NULL; block = block->next) {
+    for (c = 0; c < TM_NUM_COUNTERS; c++)
+      snapshot->counts[c] +=
+        __atomic_load_n(&block->counts[c], __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&tm_lock);
+}
+
+bool WriteTelemetryPrometheus(const TelemetrySnapshot *snapshot, FILE *f) {
+  int c;
+
+  Assert333(snapshot != NULL);
+  Assert333(f != NULL);
+  for (c = 0; c < TM_NUM_COUNTERS; c++) {
+    const TelemetryMetric *m = &kMetrics[c];
+
+    // each metric gets its HELP and TYPE lines once, before its first
+    // sample.
+    if (c == 0 || strcmp(kMetrics[c - 1].metric, m->metric) != 0) {
+      fprintf(f, "# HELP %s %s\n", m->metric, m->help);
+      fprintf(f, "# TYPE %s counter\n", m->metric);
+    }
+    if (m->label != NULL) {
+      fprintf(f, "%s{%s} %" PRIu64 "\n", m->metric, m->label,
+              snapshot->counts[c]);
+    } else {
+      fprintf(f, "%s %" PRIu64 "\n", m->metric, snapshot->counts[c]);
+    }
+  }
+  return ferror(f) == 0;
+}
+
+bool ExportTelemetryToFile(const char *path) {
+  TelemetrySnapshot snapshot;
+  size_t len;
+  char *tmp;
+  FILE *f;
+  bool ok;
+
+  Assert333(path != NULL);
+  len = strlen(path) + sizeof(".tmp");
+  tmp = (char *) malloc(len);
+  if (tmp == NULL)
+    return false;
+  snprintf(tmp, len, "%s.tmp", path);
+
+  f = fopen(tmp, "w");
+  if (f == NULL) {
+    free(tmp);
+    return false;
+  }
+  GetTelemetrySnapshot(&snapshot);
+  ok = WriteTelemetryPrometheus(&snapshot, f);
+  ok = (fclose(f) == 0) && ok;
+  ok = ok && (rename(tmp, path) == 0);
+  if (!ok)
+    unlink(tmp);
+  free(tmp);
+  return ok;
+}
+
+TelemetryServer StartTelemetryServer(const char *path) {
+  TelemetryServer server;
+  struct sockaddr_un addr;
+
+  Assert333(path != NULL);
+  if (strlen(path) >= sizeof(addr.sun_path))
+    return NULL;
+  server = (TelemetryServer) malloc(sizeof(TelemetryServerRecord));
+  if (server == NULL)
+    return NULL;
+  server->path = strdup(path);
+  server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server->path == NULL || server->listen_fd < 0)
+    goto fail;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  if (bind(server->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+    goto fail;
+  if (listen(server->listen_fd, 16) != 0 ||
+      pthread_create(&server->thread, NULL, &ServerThread, server) != 0) {
+    unlink(path);
+    goto fail;
+  }
+  return server;
+
+ fail:
+  if (server->listen_fd >= 0)
+    close(server->listen_fd);
+  free(server->path);
+  free(server);
+  return NULL;
+}
+
+void StopTelemetryServer(TelemetryServer server) {
+  Assert333(server != NULL);
+
+  // shutting the listening socket down wakes the thread out of accept().
+  shutdown(server->listen_fd, SHUT_RDWR);
+  pthread_join(server->thread, NULL);
+  close(server->listen_fd);
+  unlink(server->path);
+  free(server->path);
+  free(server);
+}
+
+static void *ServerThread(void *arg) {
+  TelemetryServer server = (TelemetryServer) arg;
+  TelemetrySnapshot snapshot;
+  char *buf;
+  size_t len, sent;
+  ssize_t res;
+  FILE *f;
+  bool ok;
+  int fd;
+
+  while (true) {
+    fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;  // shut down
+    }
+
+    // format the snapshot into memory and send() it with MSG_NOSIGNAL,
+    // rather than writing to the socket through stdio, so that a client
+    // that has already hung up gets us EPIPE rather than a SIGPIPE that
+    // would kill the whole process.
+    buf = NULL;
+    len = 0;
+    f = open_memstream(&buf, &len);
+    if (f == NULL) {
+      close(fd);
+      continue;
+    }
+    GetTelemetrySnapshot(&snapshot);
+    ok = WriteTelemetryPrometheus(&snapshot, f);
+    ok = (fclose(f) == 0) && ok;
+    for (sent = 0; ok && sent < len; sent += res) {
+      res = send(fd, buf + sent, len - sent, MSG_NOSIGNAL);
+      if (res < 0) {
+        if (errno == EINTR) {
+          res = 0;
+          continue;
+        }
+        break;  // the client went away; that's its business
+      }
+    }
+    free(buf);
+    close(fd);
+  }
+  return NULL;
+}
+
+static void MakeTelemetryKey(void) {
+  Assert333(pthread_key_create(&tm_key, &RetireBlock) == 0);
+}
+
+static void RetireBlock(void *arg) {
+  TelemetryBlock *block = (TelemetryBlock *) arg;
+  int c;
+
+  pthread_mutex_lock(&tm_lock);
+  for (c = 0; c < TM_NUM_COUNTERS; c++)
+    tm_retired[c] += block->counts[c];
+  if (block->prev != NULL)
+    block->prev->next = block->next;
+  else
+    tm_blocks = block->next;
+  if (block->next != NULL)
+    block->next->prev = block->prev;
+  pthread_mutex_unlock(&tm_lock);
+
+  if (tm_thread_block == block)
+    tm_thread_block = NULL;
+  free(block);
+}
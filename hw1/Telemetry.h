@@ -0,0 +1,92 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_TELEMETRY_H_
+#define _HW1_TELEMETRY_H_
+
+#include <stdbool.h>    // for bool, true, false
+#include <stdint.h>     // so we can use uint64_t, etc.
+#include <stdio.h>      // for FILE
+
+// Telemetry is a set of process-wide counters of the operations done on
+// every LinkedList and HashTable in the process, meant for production
+// dashboards.  Each thread counts into its own block of counters, which
+// sits in cache lines of its own, so counting costs a thread-local
+// increment and threads never contend.  Taking a snapshot adds up all
+// of the threads' blocks (counts from threads that have exited are kept
+// in a separate total).
+//
+// Snapshots can be written out in the Prometheus text exposition
+// format, either to a file (e.g., for node_exporter's textfile
+// collector) or to whoever connects to a Unix domain socket.
+//
+// Building the library with -DTM_NO_TELEMETRY compiles the counting out
+// altogether; snapshots are then all zeroes.
+
+// The counters.
+typedef enum {
+  TM_HT_INSERTS,        // InsertHashTable calls that succeeded
+  TM_HT_LOOKUP_HITS,    // LookupHashTable calls that found the key
+  TM_HT_LOOKUP_MISSES,  // ...and that didn't
+  TM_HT_REMOVES,        // RemoveFromHashTable calls that removed a key
+  TM_HT_RESIZES,        // HashTable resizes
+  TM_LL_INSERTS,        // nodes added to LinkedLists
+  TM_LL_REMOVES,        // nodes removed from LinkedLists
+  TM_LL_SORTS,          // SortLinkedList calls
+  TM_ALLOCATIONS,       // allocations made by LinkedLists and HashTables
+  TM_NUM_COUNTERS
+} TelemetryCounter;
+
+// A snapshot of every counter, totalled over all threads.
+typedef struct {
+  uint64_t counts[TM_NUM_COUNTERS];
+} TelemetrySnapshot;
+
+// Take a snapshot of the counters.  Counters are read one at a time
+// while other threads go on counting, so the snapshot is not an atomic
+// picture of the whole process, but each counter only ever goes up.
+void GetTelemetrySnapshot(TelemetrySnapshot *snapshot);
+
+// Write a snapshot in the Prometheus text exposition format.  Returns
+// true on success, false on a write error.
+bool WriteTelemetryPrometheus(const TelemetrySnapshot *snapshot, FILE *f);
+
+// Take a snapshot and write it to the file at path, replacing it
+// atomically (the snapshot is written to a temporary file which is
+// then renamed over path), so that readers never see a partial file.
+// Returns true on success, false on error.
+bool ExportTelemetryToFile(const char *path);
+
+// A server that hands out snapshots over a Unix domain socket.
+struct tm_server;
+typedef struct tm_server *TelemetryServer;
+
+// Start a background thread that listens on a Unix domain socket at
+// path (which must not already exist) and, to each client that
+// connects, writes a fresh snapshot in Prometheus format and then
+// closes the connection.  A client that hangs up early is simply
+// dropped; it never raises SIGPIPE in the host process.  Returns NULL
+// on error.
+TelemetryServer StartTelemetryServer(const char *path);
+
+// Stop a server, wait for its thread to finish, and remove its socket.
+void StopTelemetryServer(TelemetryServer server);
+
+#endif  // _HW1_TELEMETRY_H_
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_TELEMETRY_PRIV_H_
+#define _HW1_TELEMETRY_PRIV_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./Telemetry.h"
+
+#define TM_CACHE_LINE  64
+
+// One thread's counters.  Blocks are cache-line aligned and padded to a
+// whole number of cache lines, so no two threads' counters ever share a
+// line.  Only the owning thread writes a block; snapshots read it
+// concurrently, which is why the counters are stored with (relaxed)
+// atomic stores.
+typedef struct tm_block {
+  uint64_t          counts[TM_NUM_COUNTERS];
+  struct tm_block  *next;   // the next registered block
+  struct tm_block  *prev;
+} __attribute__((aligned(TM_CACHE_LINE))) TelemetryBlock;
+
+// The calling thread's block, or NULL until it first counts something.
+extern __thread TelemetryBlock *tm_thread_block;
+
+// Register a block for the calling thread and return it.  If that's not
+// possible (out of memory), returns a shared fallback block, which is
+// counted into with atomic adds.
+TelemetryBlock *TelemetryAttachThread(void);
+
+// Is block the shared fallback block?
+bool TelemetryIsFallback(TelemetryBlock *block);
+
+// Count one occurrence of counter for the calling thread.  This is what
+// LinkedList.c and HashTable.c call on their hot paths.
+#ifdef TM_NO_TELEMETRY
+#define TM_COUNT(counter) ((void) 0)
+#else
+#define TM_COUNT(counter) TelemetryCount(counter)
+#endif
+
+static inline void TelemetryCount(TelemetryCounter counter) {
+  TelemetryBlock *block = tm_thread_block;
+
+  if (__builtin_expect(block == NULL, 0)) {
+    block = TelemetryAttachThread();
+    if (TelemetryIsFallback(block)) {
+      __atomic_fetch_add(&block->counts[counter], 1, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+  __atomic_store_n(&block->counts[counter], block->counts[counter] + 1,
+                   __ATOMIC_RELAXED);
+}
+
+#endif  // _HW1_TELEMETRY_PRIV_H_
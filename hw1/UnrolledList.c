@@ -0,0 +1,516 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Assert333.h"
+#include "Allocator.h"
+#include "LinkedList.h"
+#include "UnrolledList.h"
+#include "UnrolledList_priv.h"
+
+// Internal helpers that allocate a new, empty chunk and link it into
+// list after (or, if after is NULL, at the head of) the list.  Returns
+// NULL if out of memory.
+static ULChunkPtr InsertChunkAfter(UnrolledList list, ULChunkPtr after);
+
+// Internal helper that unlinks chunk from list and frees it.
+static void RemoveChunk(UnrolledList list, ULChunkPtr chunk);
+
+// Internal helper that moves all of the payloads of the chunk after
+// chunk onto the end of chunk and frees it, keeping iter (if it's in
+// the chunk that goes away) at the same payload.
+static void MergeWithNext(UnrolledList list, ULChunkPtr chunk, ULIter iter);
+
+// Internal helper that tells whether payload a must come before
+// payload b in a stable sort in the given direction: it does if it is
+// strictly smaller (or larger, when descending).
+static bool Before(void *a, void *b, unsigned int ascending,
+                   LLPayloadComparatorFnPtr comparator_function);
+
+UnrolledList AllocateUnrolledList(void) {
+  UnrolledList list = (UnrolledList) malloc(sizeof(UnrolledListHead));
+  if (list == NULL) {
+    // out of memory
+    return NULL;
+  }
+  list->num_elements = 0;
+  list->num_chunks = 0;
+  list->head = NULL;
+  list->tail = NULL;
+  return list;
+}
+
+void FreeUnrolledList(UnrolledList list,
+                      LLPayloadFreeFnPtr payload_free_function) {
+  ULChunkPtr chunk, next;
+  uint32_t i;
+
+  Assert333(list != NULL);  // defensive programming
+  Assert333(payload_free_function != NULL);
+
+  for (chunk = list->head; chunk != NULL; chunk = next) {
+    next = chunk->next;
+    for (i = 0; i < chunk->count; i++) {
+      payload_free_function(chunk->payloads[i]);
+    }
+    free(chunk);
+  }
+  free(list);
+}
+
+uint64_t NumElementsInUnrolledList(UnrolledList list) {
+  Assert333(list != NULL);
+  return list->num_elements;
+}
+
+void UnrolledListMemoryStats(UnrolledList list, LLMemoryStats *stats) {
+  Assert333(list != NULL);
+  Assert333(stats != NULL);
+
+  stats->head_bytes = sizeof(UnrolledListHead);
+  stats->node_bytes = list->num_chunks * sizeof(ULChunk);
+  stats->overhead_bytes =
+    AllocatorOverhead(&kMallocAllocator, sizeof(UnrolledListHead)) +
+    list->num_chunks * AllocatorOverhead(&kMallocAllocator, sizeof(ULChunk));
+  stats->total_bytes =
+    stats->head_bytes + stats->node_bytes + stats->overhead_bytes;
+}
+
+bool PushUnrolledList(UnrolledList list, void *payload) {
+  ULChunkPtr chunk;
+
+  Assert333(list != NULL);
+  Assert333(payload != NULL);
+
+  chunk = list->head;
+  if (chunk == NULL || chunk->count == UL_CHUNK_CAPACITY) {
+    chunk = InsertChunkAfter(list, NULL);
+    if (chunk == NULL) {
+      // out of memory
+      return false;
+    }
+  }
+
+  // the head chunk is at most UL_CHUNK_CAPACITY pointers, so shifting
+  // them up to make room at the front is cheap.
+  memmove(&chunk->payloads[1], &chunk->payloads[0],
+          chunk->count * sizeof(void *));
+  chunk->payloads[0] = payload;
+  chunk->count++;
+  list->num_elements++;
+  return true;
+}
+
+bool AppendUnrolledList(UnrolledList list, void *payload) {
+  ULChunkPtr chunk;
+
+  Assert333(list != NULL);
+  Assert333(payload != NULL);
+
+  chunk = list->tail;
+  if (chunk == NULL || chunk->count == UL_CHUNK_CAPACITY) {
+    chunk = InsertChunkAfter(list, list->tail);
+    if (chunk == NULL) {
+      // out of memory
+      return false;
+    }
+  }
+  chunk->payloads[chunk->count++] = payload;
+  list->num_elements++;
+  return true;
+}
+
+bool PopUnrolledList(UnrolledList list, void **payload_ptr) {
+  ULChunkPtr chunk;
+
+  Assert333(list != NULL);
+  Assert333(payload_ptr != NULL);
+
+  chunk = list->head;
+  if (chunk == NULL) {
+    // empty list
+    return false;
+  }
+
+  *payload_ptr = chunk->payloads[0];
+  chunk->count--;
+  memmove(&chunk->payloads[0], &chunk->payloads[1],
+          chunk->count * sizeof(void *));
+  list->num_elements--;
+  if (chunk->count == 0) {
+    RemoveChunk(list, chunk);
+  }
+  return true;
+}
+
+bool SliceUnrolledList(UnrolledList list, void **payload_ptr) {
+  ULChunkPtr chunk;
+
+  Assert333(list != NULL);
+  Assert333(payload_ptr != NULL);
+
+  chunk = list->tail;
+  if (chunk == NULL) {
+    // empty list
+    return false;
+  }
+
+  *payload_ptr = chunk->payloads[--chunk->count];
+  list->num_elements--;
+  if (chunk->count == 0) {
+    RemoveChunk(list, chunk);
+  }
+  return true;
+}
+
+bool SortUnrolledList(UnrolledList list, unsigned int ascending,
+                      LLPayloadComparatorFnPtr comparator_function) {
+  void **from, **to, **swap;
+  ULChunkPtr chunk;
+  uint64_t n, i, width, lo, mid, hi, a, b, k;
+
+  Assert333(list != NULL);
+  Assert333(comparator_function != NULL);
+
+  n = list->num_elements;
+  if (n < 2) {
+    // nothing to do
+    return true;
+  }
+
+  from = (void **) malloc(n * sizeof(void *));
+  to = (void **) malloc(n * sizeof(void *));
+  if (from == NULL || to == NULL) {
+    // out of memory
+    free(from);
+    free(to);
+    return false;
+  }
+
+  // copy the payloads out, which is a sequential walk over the chunks.
+  i = 0;
+  for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+    memcpy(&from[i], chunk->payloads, chunk->count * sizeof(void *));
+    i += chunk->count;
+  }
+
+  // a bottom-up merge sort, ping-ponging between the two arrays.  Taking
+  // from the left run unless the right one's payload comes strictly
+  // before it keeps the sort stable.
+  for (width = 1; width < n; width *= 2) {
+    for (lo = 0; lo < n; lo += 2 * width) {
+      mid = (lo + width < n) ? lo + width : n;
+      hi = (mid + width < n) ? mid + width : n;
+      a = lo;
+      b = mid;
+      for (k = lo; k < hi; k++) {
+        if (b < hi &&
+            (a == mid ||
+             Before(from[b], from[a], ascending, comparator_function))) {
+          to[k] = from[b++];
+        } else {
+          to[k] = from[a++];
+        }
+      }
+    }
+    swap = from;
+    from = to;
+    to = swap;
+  }
+
+  // copy them back into the chunks, which keep their counts.
+  i = 0;
+  for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+    memcpy(chunk->payloads, &from[i], chunk->count * sizeof(void *));
+    i += chunk->count;
+  }
+
+  free(from);
+  free(to);
+  return true;
+}
+
+ULIter ULMakeIterator(UnrolledList list, int pos) {
+  ULIter iter;
+
+  Assert333(list != NULL);
+  Assert333((pos == 0) || (pos == 1));
+
+  if (list->num_elements == 0) {
+    // empty list
+    return NULL;
+  }
+
+  iter = (ULIter) malloc(sizeof(ULIterSt));
+  if (iter == NULL) {
+    // out of memory
+    return NULL;
+  }
+
+  iter->list = list;
+  if (pos == 0) {
+    iter->chunk = list->head;
+    iter->index = 0;
+  } else {
+    iter->chunk = list->tail;
+    iter->index = list->tail->count - 1;
+  }
+  return iter;
+}
+
+void ULIteratorFree(ULIter iter) {
+  Assert333(iter != NULL);
+  free(iter);
+}
+
+bool ULIteratorHasNext(ULIter iter) {
+  Assert333(iter != NULL);
+  Assert333(iter->chunk != NULL);
+
+  // chunks are never empty, so there's a next payload if there's
+  // another one in this chunk or there's another chunk.
+  return (iter->index + 1 < iter->chunk->count) || (iter->chunk->next != NULL);
+}
+
+bool ULIteratorNext(ULIter iter) {
+  Assert333(iter != NULL);
+  Assert333(iter->chunk != NULL);
+
+  if (iter->index + 1 < iter->chunk->count) {
+    iter->index++;
+    return true;
+  }
+  if (iter->chunk->next == NULL) {
+    // at the tail
+    return false;
+  }
+  iter->chunk = iter->chunk->next;
+  iter->index = 0;
+  return true;
+}
+
+bool ULIteratorHasPrev(ULIter iter) {
+  Assert333(iter != NULL);
+  Assert333(iter->chunk != NULL);
+
+  return (iter->index > 0) || (iter->chunk->prev != NULL);
+}
+
+bool ULIteratorPrev(ULIter iter) {
+  Assert333(iter != NULL);
+  Assert333(iter->chunk != NULL);
+
+  if (iter->index > 0) {
+    iter->index--;
+    return true;
+  }
+  if (iter->chunk->prev == NULL) {
+    // at the head
+    return false;
+  }
+  iter->chunk = iter->chunk->prev;
+  iter->index = iter->chunk->count - 1;
+  return true;
+}
+
+void ULIteratorGetPayload(ULIter iter, void **payload) {
+  Assert333(iter != NULL);
+  Assert333(iter->chunk != NULL);
+  Assert333(payload != NULL);
+
+  *payload = iter->chunk->payloads[iter->index];
+}
+
+bool ULIteratorDelete(ULIter iter,
+                      LLPayloadFreeFnPtr payload_free_function) {
+  UnrolledList list;
+  ULChunkPtr chunk, neighbour;
+
+  Assert333(iter != NULL);
+  Assert333(iter->chunk != NULL);
+  Assert333(payload_free_function != NULL);
+
+  list = iter->list;
+  chunk = iter->chunk;
+  payload_free_function(chunk->payloads[iter->index]);
+  chunk->count--;
+  memmove(&chunk->payloads[iter->index], &chunk->payloads[iter->index + 1],
+          (chunk->count - iter->index) * sizeof(void *));
+  list->num_elements--;
+
+  if (chunk->count == 0) {
+    // that was the chunk's only payload, so the chunk goes, and the
+    // iterator moves to the next chunk's first payload or, failing
+    // that, the previous chunk's last one.
+    if (chunk->next != NULL) {
+      iter->chunk = chunk->next;
+      iter->index = 0;
+    } else if (chunk->prev != NULL) {
+      iter->chunk = chunk->prev;
+      iter->index = chunk->prev->count - 1;
+    } else {
+      iter->chunk = NULL;
+    }
+    RemoveChunk(list, chunk);
+    return (list->num_elements > 0);
+  }
+
+  if (iter->index == chunk->count) {
+    // that was the chunk's last payload, so the successor, if there is
+    // one, is at the start of the next chunk.
+    if (chunk->next != NULL) {
+      iter->chunk = chunk->next;
+      iter->index = 0;
+    } else {
+      iter->index--;
+    }
+  }
+
+  // if the chunk has got too empty, fold it into a neighbour it fits in
+  // with, so that chunks stay reasonably full.
+  if (chunk->count < UL_CHUNK_MIN) {
+    neighbour = chunk->next;
+    if (neighbour != NULL &&
+        chunk->count + neighbour->count <= UL_CHUNK_CAPACITY) {
+      MergeWithNext(list, chunk, iter);
+    } else {
+      neighbour = chunk->prev;
+      if (neighbour != NULL &&
+          neighbour->count + chunk->count <= UL_CHUNK_CAPACITY) {
+        MergeWithNext(list, neighbour, iter);
+      }
+    }
+  }
+  return true;
+}
+
+bool ULIteratorInsertBefore(ULIter iter, void *payload) {
+  UnrolledList list;
+  ULChunkPtr chunk, prev, fresh;
+  uint32_t half;
+
+  Assert333(iter != NULL);
+  Assert333(iter->chunk != NULL);
+  Assert333(payload != NULL);
+
+  list = iter->list;
+  chunk = iter->chunk;
+  prev = chunk->prev;
+
+  if (iter->index == 0 && prev != NULL && prev->count < UL_CHUNK_CAPACITY) {
+    // inserting before a chunk's first payload: the end of the previous
+    // chunk is the same place, and needs nothing moved.
+    prev->payloads[prev->count++] = payload;
+    list->num_elements++;
+    return true;
+  }
+
+  if (chunk->count == UL_CHUNK_CAPACITY) {
+    // the chunk is full, so split it in half, and carry on with the
+    // half the iterator is in.
+    fresh = InsertChunkAfter(list, chunk);
+    if (fresh == NULL) {
+      // out of memory
+      return false;
+    }
+    half = UL_CHUNK_CAPACITY / 2;
+    memcpy(fresh->payloads, &chunk->payloads[half],
+           (UL_CHUNK_CAPACITY - half) * sizeof(void *));
+    fresh->count = UL_CHUNK_CAPACITY - half;
+    chunk->count = half;
+    if (iter->index >= half) {
+      chunk = fresh;
+      iter->chunk = fresh;
+      iter->index -= half;
+    }
+  }
+
+  memmove(&chunk->payloads[iter->index + 1], &chunk->payloads[iter->index],
+          (chunk->count - iter->index) * sizeof(void *));
+  chunk->payloads[iter->index] = payload;
+  chunk->count++;
+  iter->index++;  // still at the same payload, which moved up one
+  list->num_elements++;
+  return true;
+}
+
+static ULChunkPtr InsertChunkAfter(UnrolledList list, ULChunkPtr after) {
+  ULChunkPtr chunk = (ULChunkPtr) malloc(sizeof(ULChunk));
+  if (chunk == NULL) {
+    // out of memory
+    return NULL;
+  }
+
+  chunk->count = 0;
+  chunk->prev = after;
+  chunk->next = (after == NULL) ? list->head : after->next;
+  if (chunk->next != NULL) {
+    chunk->next->prev = chunk;
+  } else {
+    list->tail = chunk;
+  }
+  if (after != NULL) {
+    after->next = chunk;
+  } else {
+    list->head = chunk;
+  }
+  list->num_chunks++;
+  return chunk;
+}
+
+static void RemoveChunk(UnrolledList list, ULChunkPtr chunk) {
+  if (chunk->prev != NULL) {
+    chunk->prev->next = chunk->next;
+  } else {
+    list->head = chunk->next;
+  }
+  if (chunk->next != NULL) {
+    chunk->next->prev = chunk->prev;
+  } else {
+    list->tail = chunk->prev;
+  }
+  list->num_chunks--;
+  free(chunk);
+}
+
+static void MergeWithNext(UnrolledList list, ULChunkPtr chunk, ULIter iter) {
+  ULChunkPtr next = chunk->next;
+
+  Assert333(next != NULL);
+  Assert333(chunk->count + next->count <= UL_CHUNK_CAPACITY);
+
+  memcpy(&chunk->payloads[chunk->count], next->payloads,
+         next->count * sizeof(void *));
+  if (iter->chunk == next) {
+    iter->chunk = chunk;
+    iter->index += chunk->count;
+  }
+  chunk->count += next->count;
+  RemoveChunk(list, next);
+}
+
+static bool Before(void *a, void *b, unsigned int ascending,
+                   LLPayloadComparatorFnPtr comparator_function) {
+  int cmp = comparator_function(a, b);
+  return ascending ? (cmp < 0) : (cmp > 0);
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_UNROLLEDLIST_H_
+#define _HW1_UNROLLEDLIST_H_
+
+#include <stdbool.h>  // for bool type (true, false)
+#include <stdint.h>   // for uint64_t
+
+#include "./LinkedList.h"  // for the payload function types, LLMemoryStats
+
+// An UnrolledList is a doubly-linked list that keeps up to
+// UL_CHUNK_CAPACITY payload pointers in each node (a "chunk"), rather
+// than one.  It offers the same operations as a LinkedList, with the
+// same meanings, but walking it mostly reads payload pointers that sit
+// next to each other in memory, rather than chasing a pointer to a
+// separately allocated node for each one, and it takes a node (and
+// malloc's overhead on it) per 8 to 32 payloads rather than per payload.
+//
+// The cost is that inserting or deleting in the middle moves up to
+// UL_CHUNK_CAPACITY pointers within a chunk.  A full chunk is split in
+// half when a payload is inserted into it; a chunk that an iterator
+// deletion leaves with fewer than UL_CHUNK_MIN payloads is merged with
+// a neighbour, if the two fit in one chunk.  Appending fills the tail
+// chunk before starting a new one, so a list built by appending is
+// packed full.
+//
+// As usual, the structs are defined in the private header
+// UnrolledList_priv.h.
+#define UL_CHUNK_CAPACITY  32
+#define UL_CHUNK_MIN       8
+
+struct ul_head;
+typedef struct ul_head *UnrolledList;
+
+// Allocate and return a new, empty, unrolled list.  The caller takes
+// responsibility for eventually calling FreeUnrolledList.
+//
+// Returns NULL on error (out of memory), non-NULL on success.
+UnrolledList AllocateUnrolledList(void);
+
+// Free an unrolled list, calling payload_free_function on each payload
+// first, as FreeLinkedList does.
+void FreeUnrolledList(UnrolledList list,
+                      LLPayloadFreeFnPtr payload_free_function);
+
+// Return the number of elements in an unrolled list.
+uint64_t NumElementsInUnrolledList(UnrolledList list);
+
+// Fill in *stats with the memory an unrolled list takes, counted as
+// LinkedListMemoryStats counts it, with node_bytes counting its chunks.
+void UnrolledListMemoryStats(UnrolledList list, LLMemoryStats *stats);
+
+// Add an element to the head, or the tail, of an unrolled list, as
+// PushLinkedList and AppendLinkedList do.
+//
+// Returns false on failure (out of memory), true on success.
+bool PushUnrolledList(UnrolledList list, void *payload);
+bool AppendUnrolledList(UnrolledList list, void *payload);
+
+// Remove an element from the head, or the tail, of an unrolled list,
+// returning its payload through payload_ptr, as PopLinkedList and
+// SliceLinkedList do.
+//
+// Returns false if the list is empty, true on success.
+bool PopUnrolledList(UnrolledList list, void **payload_ptr);
+bool SliceUnrolledList(UnrolledList list, void **payload_ptr);
+
+// Sorts an unrolled list in place.  As with SortLinkedList, the sort is
+// stable and takes O(n log n) comparisons.  Unlike SortLinkedList, it
+// moves payloads between chunks, so an iterator on the list ends up at
+// whichever payload is sorted into its place.
+//
+// Arguments:
+//
+// - list: the list to sort
+//
+// - ascending: if 0, sorts descending, else sorts ascending.
+//
+// - comparator_function: a payload comparator; see LinkedList.h.
+//
+// Returns false on failure (out of memory for the n-pointer scratch
+// space the sort needs, in which case the list is left as it was),
+// true on success.
+bool SortUnrolledList(UnrolledList list, unsigned int ascending,
+                      LLPayloadComparatorFnPtr comparator_function);
+
+// Unrolled lists have iterators that behave exactly as LLIters do; see
+// LinkedList.h.  Likewise, using an UnrolledList*() function to change
+// a list makes its iterators dangerous to use.
+struct ul_iter;
+typedef struct ul_iter *ULIter;
+
+// Manufacture an iterator for the list, at its head (pos = 0) or its
+// tail (pos = 1).  The caller is responsible for eventually calling
+// ULIteratorFree.
+//
+// Returns NULL on failure (out of memory, empty list) or non-NULL on
+// success.
+ULIter ULMakeIterator(UnrolledList list, int pos);
+void ULIteratorFree(ULIter iter);
+
+// Test whether the iterator can move forwards (it isn't at the tail),
+// or backwards (it isn't at the head).
+bool ULIteratorHasNext(ULIter iter);
+bool ULIteratorHasPrev(ULIter iter);
+
+// Move the iterator forwards, or backwards, one element.  Returns true
+// if it has been moved, false if it is at the tail (or head) and cannot
+// be.
+bool ULIteratorNext(ULIter iter);
+bool ULIteratorPrev(ULIter iter);
+
+// Return the payload the iterator is at through the "return parameter"
+// payload.
+void ULIteratorGetPayload(ULIter iter, void **payload);
+
+// Delete the element the iterator is at, calling payload_free_function
+// on its payload.  Afterwards the iterator is at the deleted element's
+// successor, or at its predecessor if it was the tail, or is invalid
+// (but must still be freed) if it was the only element.
+//
+// Returns false if the list is now empty, true if it is not.
+bool ULIteratorDelete(ULIter iter,
+                      LLPayloadFreeFnPtr payload_free_function);
+
+// Insert an element right before the one the iterator is at.  (To
+// insert at the end of a list, use AppendUnrolledList.)
+//
+// Returns false on failure (out of memory), or true on success; the
+// iterator is still at the same element, not the inserted one.
+bool ULIteratorInsertBefore(ULIter iter, void *payload);
+
+#endif  // _HW1_UNROLLEDLIST_H_
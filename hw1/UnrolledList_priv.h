@@ -0,0 +1,51 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HW1_UNROLLEDLIST_PRIV_H_
+#define _HW1_UNROLLEDLIST_PRIV_H_
+
+#include <stdint.h>
+
+#include "./UnrolledList.h"
+
+// A chunk holds count payloads, in payloads[0, count).  Only an empty
+// list has no chunks; a chunk is freed as soon as it becomes empty.
+typedef struct ul_chunk {
+  struct ul_chunk *next;   // next chunk in the list, or NULL
+  struct ul_chunk *prev;   // prev chunk in the list, or NULL
+  uint32_t         count;  // # payloads in the chunk
+  void            *payloads[UL_CHUNK_CAPACITY];  // the payloads
+} ULChunk, *ULChunkPtr;
+
+typedef struct ul_head {
+  uint64_t   num_elements;  // # elements in the list
+  uint64_t   num_chunks;    // # chunks holding them
+  ULChunkPtr head;          // first chunk, or NULL if empty
+  ULChunkPtr tail;          // last chunk, or NULL if empty
+} UnrolledListHead;
+
+// An iterator is at payloads[index] of its chunk.
+typedef struct ul_iter {
+  UnrolledList list;   // the list we're for
+  ULChunkPtr   chunk;  // the chunk we're in, or NULL if broken
+  uint32_t     index;  // where we are in it
+} ULIterSt;
+
+#endif  // _HW1_UNROLLEDLIST_PRIV_H_
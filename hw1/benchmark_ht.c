@@ -0,0 +1,827 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "Assert333.h"
+#include "Allocator.h"
+#include "HashTable.h"
+#include "FrozenHashTable.h"
+#include "HashTableImage.h"
+#include "HashTableLog.h"
+#include "HashTableSnapshot.h"
+#include "HashTableReclaim.h"
+#include "SharedHashTable.h"
+#include "Telemetry.h"
+#include "FlightRecorder.h"
+
+// A benchmark takes the number of elements to work with.
+typedef void (*BenchmarkFnPtr)(uint64_t num_elements);
+
+typedef struct {
+  const char     *name;
+  BenchmarkFnPtr  fn;
+} Benchmark;
+
+// the benchmarks themselves
+static void BenchFreeze(uint64_t num_elements);
+static void BenchImage(uint64_t num_elements);
+static void BenchLog(uint64_t num_elements);
+static void BenchSnapshot(uint64_t num_elements);
+static void BenchShared(uint64_t num_elements);
+static void BenchAllocators(uint64_t num_elements);
+static void BenchArena(uint64_t num_elements);
+static void BenchReclaim(uint64_t num_elements);
+static void BenchPages(uint64_t num_elements);
+static void BenchTelemetry(uint64_t num_elements);
+static void BenchRecorder(uint64_t num_elements);
+
+static const Benchmark kBenchmarks[] = {
+  { "freeze", &BenchFreeze },
+  { "image", &BenchImage },
+  { "wal", &BenchLog },
+  { "snapshot", &BenchSnapshot },
+  { "shm", &BenchShared },
+  { "alloc", &BenchAllocators },
+  { "arena", &BenchArena },
+  { "reclaim", &BenchReclaim },
+  { "pages", &BenchPages },
+  { "telemetry", &BenchTelemetry },
+  { "recorder", &BenchRecorder },
+};
+#define NUM_BENCHMARKS (sizeof(kBenchmarks) / sizeof(kBenchmarks[0]))
+
+// how this program was run (argv[0]); the telemetry benchmark uses it
+// to find benchmark_ht_notm, this program built against a copy of the
+// library compiled with -DTM_NO_TELEMETRY.
+static const char *program_name;
+
+// a free function that does nothing; the benchmarks store integers,
+// not pointers, as values.
+static void NullFree(void *freeme) { }
+
+// a value-to-bytes function for values that are integers stored
+// directly in the (void *); it hands back the integer's bytes.
+static const void *IntegerBytes(void *value, uint64_t *len);
+
+// the inverse of IntegerBytes
+static void *IntegerFromBytes(const void *bytes, uint64_t len);
+
+// return the current time, in seconds
+static double Now(void);
+
+// allocate a table and fill it with num_elements hashed keys, whose
+// values are the integers 1..num_elements (non-zero, so that they are
+// never mistaken for a NULL value).
+static HashTable BuildTable(uint64_t num_elements);
+
+// the same, but with the table's memory coming from an allocator.
+static HashTable BuildTableWithAllocator(uint64_t num_elements,
+                                         const Allocator *allocator,
+                                         void *context);
+
+// print one result line
+static void Report(const char *bench, const char *what,
+                   uint64_t ops, double secs);
+
+// usage: benchmark_ht [benchmark|all] [num_elements]
+int main(int argc, char **argv) {
+  const char *which = (argc > 1) ? argv[1] : "all";
+  uint64_t num_elements = (argc > 2) ? strtoull(argv[2], NULL, 10) : 1000000;
+  unsigned int i;
+  bool ran = false;
+
+  program_name = argv[0];
+  for (i = 0; i < NUM_BENCHMARKS; i++) {
+    if (strcmp(which, "all") == 0 || strcmp(which, kBenchmarks[i].name) == 0) {
+      kBenchmarks[i].fn(num_elements);
+      ran = true;
+    }
+  }
+  if (!ran) {
+    fprintf(stderr, "usage: %s [benchmark|all] [num_elements]\n", argv[0]);
+    fprintf(stderr, "benchmarks:");
+    for (i = 0; i < NUM_BENCHMARKS; i++)
+      fprintf(stderr, " %s", kBenchmarks[i].name);
+    fprintf(stderr, "\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static void BenchFreeze(uint64_t num_elements) {
+  HashTable ht;
+  FrozenHashTable ft;
+  HTKeyValue kv;
+  uint64_t i, found = 0;
+  double start;
+
+  // build time: chained table vs. chained table + freeze
+  start = Now();
+  ht = BuildTable(num_elements);
+  Report("freeze", "build chained", num_elements, Now() - start);
+
+  // lookup throughput on the live chained table
+  start = Now();
+  for (i = 0; i < num_elements; i++) {
+    found += LookupHashTable(ht, FNVHashInt64(i), &kv);
+  }
+  Report("freeze", "lookup chained", num_elements, Now() - start);
+  Assert333(found == num_elements);
+
+  start = Now();
+  ft = HashTableFreeze(ht);
+  Assert333(ft != NULL);
+  Report("freeze", "freeze", num_elements, Now() - start);
+  printf("%-8s %-20s %10.3f bits/key\n", "freeze", "index size",
+         (double) FrozenHashTableIndexBits(ft) / num_elements);
+
+  // lookup throughput on the frozen table
+  found = 0;
+  start = Now();
+  for (i = 0; i < num_elements; i++) {
+    found += LookupFrozenHashTable(ft, FNVHashInt64(i), &kv);
+  }
+  Report("freeze", "lookup frozen", num_elements, Now() - start);
+  Assert333(found == num_elements);
+
+  FreeFrozenHashTable(ft, &NullFree);
+}
+
+static void BenchImage(uint64_t num_elements) {
+  HashTable ht;
+  HTImage image;
+  HTKeyValue kv;
+  const void *value;
+  uint64_t i, len, found = 0;
+  const char *path = "/tmp/benchmark_ht.img";
+  double start;
+
+  // the alternative to an image: rebuilding the table with inserts
+  start = Now();
+  ht = BuildTable(num_elements);
+  Report("image", "build by insert", num_elements, Now() - start);
+
+  start = Now();
+  Assert333(WriteHashTableImage(ht, path, &IntegerBytes));
+  Report("image", "write image", num_elements, Now() - start);
+
+  start = Now();
+  for (i = 0; i < num_elements; i++) {
+    found += LookupHashTable(ht, FNVHashInt64(i), &kv);
+  }
+  Report("image", "lookup chained", num_elements, Now() - start);
+  Assert333(found == num_elements);
+  FreeHashTable(ht, &NullFree);
+
+  // opening an image is O(1): it just maps the file.
+  start = Now();
+  image = OpenHashTableImage(path);
+  Assert333(image != NULL);
+  Report("image", "open image", 1, Now() - start);
+
+  // the first pass faults the pages in; the second runs warm.
+  found = 0;
+  start = Now();
+  for (i = 0; i < num_elements; i++) {
+    found += LookupHashTableImage(image, FNVHashInt64(i), &value, &len);
+  }
+  Report("image", "lookup image cold", num_elements, Now() - start);
+  start = Now();
+  for (i = 0; i < num_elements; i++) {
+    found += LookupHashTableImage(image, FNVHashInt64(i), &value, &len);
+  }
+  Report("image", "lookup image warm", num_elements, Now() - start);
+  Assert333(found == 2 * num_elements);
+
+  CloseHashTableImage(image);
+  unlink(path);
+}
+
+static void BenchLog(uint64_t num_elements) {
+  static const struct {
+    const char      *name;
+    HTLogSyncPolicy  policy;
+    uint64_t         max_ops;  // an fsync per op is slow; cap it
+  } kPolicies[] = {
+    { "no log", HT_LOG_SYNC_NEVER, 0 },
+    { "sync never", HT_LOG_SYNC_NEVER, 0 },
+    { "sync 10ms", HT_LOG_SYNC_INTERVAL, 0 },
+    { "sync always", HT_LOG_SYNC_ALWAYS, 20000 },
+  };
+  const char *path = "/tmp/benchmark_ht.wal";
+  HashTable ht;
+  HTLog log;
+  HTKeyValue kv, old_kv;
+  uint64_t i, ops;
+  unsigned int p;
+  char what[64];
+  double start;
+
+  for (p = 0; p < sizeof(kPolicies) / sizeof(kPolicies[0]); p++) {
+    ops = num_elements;
+    if (kPolicies[p].max_ops > 0 && ops > kPolicies[p].max_ops)
+      ops = kPolicies[p].max_ops;
+
+    unlink(path);
+    ht = AllocateHashTable(1024);
+    Assert333(ht != NULL);
+    log = NULL;
+    if (p > 0) {
+      log = OpenHashTableLog(path, kPolicies[p].policy, 10, &IntegerBytes);
+      Assert333(log != NULL);
+      HashTableAttachLog(ht, log);
+    }
+
+    // time the inserts plus the final sync, so every policy ends with
+    // the same data on disk.
+    start = Now();
+    for (i = 0; i < ops; i++) {
+      kv.key = FNVHashInt64(i);
+      kv.value = (void *) (uintptr_t) i;
+      Assert333(InsertHashTable(ht, kv, &old_kv) == 1);
+    }
+    if (log != NULL) {
+      HashTableAttachLog(ht, NULL);
+      Assert333(SyncHashTableLog(log));
+    }
+    snprintf(what, sizeof(what), "insert, %s", kPolicies[p].name);
+    Report("wal", what, ops, Now() - start);
+    if (log != NULL) {
+      printf("%-8s %-20s %10" PRIu64 " syncs\n", "wal", what,
+             HashTableLogNumSyncs(log));
+      Assert333(CloseHashTableLog(log));
+    }
+    FreeHashTable(ht, &NullFree);
+  }
+  unlink(path);
+}
+
+static void BenchSnapshot(uint64_t num_elements) {
+  const char *path = "/tmp/benchmark_ht.snap";
+  HashTable ht, loaded;
+  HTSnapshot snapshot;
+  HTKeyValue kv, old_kv;
+  uint64_t ops = 0;
+  double start;
+
+  start = Now();
+  ht = BuildTable(num_elements);
+  Report("snapshot", "build by insert", num_elements, Now() - start);
+
+  // how long the serving thread is paused: just the fork.
+  start = Now();
+  snapshot = HashTableSnapshotAsync(ht, path, &IntegerBytes);
+  Assert333(snapshot != NULL);
+  Report("snapshot", "fork (pause)", 1, Now() - start);
+
+  // keep overwriting values while the child writes the snapshot.
+  start = Now();
+  while (!HashTableSnapshotIsDone(snapshot)) {
+    kv.key = FNVHashInt64(ops % num_elements);
+    kv.value = (void *) (uintptr_t) (ops + 1);
+    Assert333(InsertHashTable(ht, kv, &old_kv) == 2);
+    ops++;
+  }
+  Report("snapshot", "updates during save", ops, Now() - start);
+  Assert333(HashTableSnapshotWait(snapshot));
+  FreeHashTable(ht, &NullFree);
+
+  start = Now();
+  loaded = LoadHashTableSnapshot(path, &IntegerFromBytes, &NullFree);
+  Assert333(loaded != NULL);
+  Report("snapshot", "load snapshot", num_elements, Now() - start);
+  Assert333(NumElementsInHashTable(loaded) == num_elements);
+  FreeHashTable(loaded, &NullFree);
+  unlink(path);
+}
+
+static void BenchShared(uint64_t num_elements) {
+  const char *name = "/benchmark_ht_shm";
+  const int num_workers = 4;
+  SharedHashTable shared, attached;
+  HashTable ht;
+  HTKeyValue kv;
+  uint64_t i, value, len, found = 0, region_bytes;
+  double start;
+  pid_t pids[4];
+  int w, status;
+
+  // what each worker pays today: building its own private copy.
+  start = Now();
+  ht = BuildTable(num_elements);
+  Report("shm", "build private copy", num_elements, Now() - start);
+
+  start = Now();
+  for (i = 0; i < num_elements; i++) {
+    found += LookupHashTable(ht, FNVHashInt64(i), &kv);
+  }
+  Report("shm", "lookup private", num_elements, Now() - start);
+  Assert333(found == num_elements);
+
+  // publish one shared copy.  Each entry takes a 64-byte block plus an
+  // 8-byte bucket slot.
+  region_bytes = num_elements * 72 + (1 << 20);
+  UnlinkSharedHashTable(name);
+  start = Now();
+  shared = CreateSharedHashTable(name, region_bytes,
+                                 num_elements > 0 ? num_elements : 1);
+  Assert333(shared != NULL);
+  Assert333(CopyHashTableToShared(ht, shared, &IntegerBytes));
+  Report("shm", "publish shared copy", num_elements, Now() - start);
+  FreeHashTable(ht, &NullFree);
+  printf("%-8s %-20s %10.1f MB for all workers\n", "shm", "region size",
+         region_bytes / 1048576.0);
+
+  // what each worker pays instead: attaching.
+  start = Now();
+  attached = AttachSharedHashTable(name);
+  Assert333(attached != NULL);
+  Report("shm", "attach", 1, Now() - start);
+
+  found = 0;
+  start = Now();
+  for (i = 0; i < num_elements; i++) {
+    found += LookupSharedHashTable(attached, FNVHashInt64(i),
+                                   &value, sizeof(value), &len);
+  }
+  Report("shm", "lookup shared", num_elements, Now() - start);
+  Assert333(found == num_elements);
+  DetachSharedHashTable(attached);
+
+  // several worker processes attach and look up concurrently.
+  fflush(NULL);
+  start = Now();
+  for (w = 0; w < num_workers; w++) {
+    pids[w] = fork();
+    Assert333(pids[w] != -1);
+    if (pids[w] == 0) {
+      attached = AttachSharedHashTable(name);
+      found = 0;
+      for (i = 0; attached != NULL && i < num_elements; i++) {
+        found += LookupSharedHashTable(attached, FNVHashInt64(i),
+                                       &value, sizeof(value), &len);
+      }
+      _exit(found == num_elements ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  for (w = 0; w < num_workers; w++) {
+    Assert333(waitpid(pids[w], &status, 0) == pids[w]);
+    Assert333(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+  }
+  Report("shm", "lookup 4 workers", num_elements * num_workers,
+         Now() - start);
+
+  DetachSharedHashTable(shared);
+  UnlinkSharedHashTable(name);
+}
+
+static void BenchAllocators(uint64_t num_elements) {
+  const char *names[3] = { "malloc", "arena", "pool" };
+  char what[32];
+  HashTable ht;
+  HTKeyValue kv;
+  Arena arena = NULL;
+  Pool pool = NULL;
+  uint64_t i, found;
+  double start;
+  int a;
+
+  // run the same build / lookup / remove / free workload with the
+  // table's memory coming from each allocator in turn.  The arena and
+  // pool are created and destroyed as part of the workload.
+  for (a = 0; a < 3; a++) {
+    start = Now();
+    if (a == 0) {
+      ht = BuildTable(num_elements);
+    } else if (a == 1) {
+      arena = AllocateArena(1 << 20);
+      Assert333(arena != NULL);
+      ht = BuildTableWithAllocator(num_elements, &kArenaAllocator, arena);
+    } else {
+      pool = AllocatePool();
+      Assert333(pool != NULL);
+      ht = BuildTableWithAllocator(num_elements, &kPoolAllocator, pool);
+    }
+    snprintf(what, sizeof(what), "build %s", names[a]);
+    Report("alloc", what, num_elements, Now() - start);
+
+    found = 0;
+    start = Now();
+    for (i = 0; i < num_elements; i++) {
+      found += LookupHashTable(ht, FNVHashInt64(i), &kv);
+    }
+    snprintf(what, sizeof(what), "lookup %s", names[a]);
+    Report("alloc", what, num_elements, Now() - start);
+    Assert333(found == num_elements);
+
+    start = Now();
+    for (i = 0; i < num_elements; i++) {
+      Assert333(RemoveFromHashTable(ht, FNVHashInt64(i), &kv) == 1);
+    }
+    FreeHashTable(ht, &NullFree);
+    if (arena != NULL)
+      FreeArena(arena);
+    if (pool != NULL)
+      FreePool(pool);
+    arena = NULL;
+    pool = NULL;
+    snprintf(what, sizeof(what), "remove+free %s", names[a]);
+    Report("alloc", what, num_elements, Now() - start);
+  }
+}
+
+static void BenchArena(uint64_t num_elements) {
+  const uint64_t per_cycle = 1000;
+  const char *names[4] = { "malloc free", "malloc clear",
+                           "arena free", "arena clear" };
+  HashTable ht = NULL;
+  HTKeyValue kv, old_kv;
+  uint64_t i, c, cycles;
+  char what[32];
+  double start;
+  int mode;
+
+  // build a scratch table of per_cycle entries, then throw it away,
+  // either by freeing it or by clearing it for the next cycle.
+  cycles = num_elements / per_cycle;
+  if (cycles == 0)
+    cycles = 1;
+  for (mode = 0; mode < 4; mode++) {
+    start = Now();
+    for (c = 0; c < cycles; c++) {
+      if (ht == NULL) {
+        ht = (mode < 2) ? AllocateHashTable(per_cycle) :
+                          AllocateHashTableInArena(per_cycle, 1 << 16);
+        Assert333(ht != NULL);
+      }
+      for (i = 0; i < per_cycle; i++) {
+        kv.key = FNVHashInt64(c * per_cycle + i);
+        kv.value = (void *) (uintptr_t) (i + 1);
+        Assert333(InsertHashTable(ht, kv, &old_kv) == 1);
+      }
+      if (mode == 0) {
+        FreeHashTable(ht, &NullFree);
+        ht = NULL;
+      } else if (mode == 1) {
+        HashTableClear(ht, &NullFree);
+      } else if (mode == 2) {
+        FreeHashTable(ht, NULL);
+        ht = NULL;
+      } else {
+        HashTableClear(ht, NULL);
+      }
+    }
+    snprintf(what, sizeof(what), "cycles %s", names[mode]);
+    Report("arena", what, cycles, Now() - start);
+    if (ht != NULL) {
+      FreeHashTable(ht, (mode < 2) ? &NullFree : NULL);
+      ht = NULL;
+    }
+  }
+}
+
+static void BenchReclaim(uint64_t num_elements) {
+  unsigned int num_threads[2] = { 1, 4 };
+  HTReclaim reclaim;
+  HashTable ht;
+  char what[32];
+  double start, returned;
+  int t;
+
+  // how long the caller is blocked by a plain FreeHashTable...
+  ht = BuildTable(num_elements);
+  start = Now();
+  FreeHashTable(ht, &NullFree);
+  Report("reclaim", "free (blocked)", num_elements, Now() - start);
+
+  // ...vs. by FreeHashTableAsync, and how long the background free
+  // takes to finish.
+  for (t = 0; t < 2; t++) {
+    ht = BuildTable(num_elements);
+    start = Now();
+    reclaim = FreeHashTableAsync(ht, &NullFree, num_threads[t]);
+    Assert333(reclaim != NULL);
+    returned = Now();
+    HTReclaimWait(reclaim);
+    snprintf(what, sizeof(what), "async x%u (blocked)", num_threads[t]);
+    Report("reclaim", what, 1, returned - start);
+    snprintf(what, sizeof(what), "async x%u (done)", num_threads[t]);
+    Report("reclaim", what, num_elements, Now() - start);
+  }
+}
+
+// open a counter of this thread's dTLB read misses; returns -1 if the
+// kernel or the CPU won't give us one.
+static int OpenTLBMissCounter(void) {
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void BenchPages(uint64_t num_elements) {
+  const char *names[4] = { "malloc", "pool thp", "pool hugetlb",
+                           "pool interleave" };
+  PoolOptions options[4] = {
+    { POOL_PAGES_DEFAULT, POOL_NUMA_DEFAULT, 0 },
+    { POOL_PAGES_TRANSPARENT, POOL_NUMA_DEFAULT, 0 },
+    { POOL_PAGES_EXPLICIT, POOL_NUMA_DEFAULT, 0 },
+    { POOL_PAGES_TRANSPARENT, POOL_NUMA_INTERLEAVE, 0 },
+  };
+  PoolPageStats stats;
+  HashTable ht;
+  HTKeyValue kv;
+  Pool pool;
+  uint64_t i, key, found, misses;
+  char what[32];
+  double start, secs;
+  int a, fd;
+
+  // random lookups over a big table, whose bucket array and chains come
+  // from malloc or from a page-backed pool, and the dTLB misses they
+  // cause.
+  for (a = 0; a < 4; a++) {
+    pool = NULL;
+    if (a == 0) {
+      ht = BuildTable(num_elements);
+    } else {
+      pool = AllocatePoolWithOptions(&options[a]);
+      Assert333(pool != NULL);
+      ht = BuildTableWithAllocator(num_elements, &kPoolAllocator, pool);
+    }
+
+    fd = OpenTLBMissCounter();
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    found = 0;
+    key = 12345;
+    start = Now();
+    for (i = 0; i < num_elements; i++) {
+      key = key * 6364136223846793005ULL + 1442695040888963407ULL;
+      found += LookupHashTable(ht, FNVHashInt64(key % num_elements), &kv);
+    }
+    secs = Now() - start;
+    Assert333(found == num_elements);
+    snprintf(what, sizeof(what), "lookup %s", names[a]);
+    Report("pages", what, num_elements, secs);
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+        misses = 0;
+      close(fd);
+      printf("pages    %-20s %12" PRIu64 " dTLB misses (%.3f/lookup)\n",
+             names[a], misses, (double) misses / num_elements);
+    } else {
+      printf("pages    %-20s %12s dTLB misses\n", names[a], "n/a");
+    }
+    if (pool != NULL) {
+      GetPoolPageStats(pool, &stats);
+      printf("pages    %-20s %8zu MB mapped, %zu MB hugetlb, "
+             "%zu MB madvised, %zu MB numa\n", names[a],
+             stats.mapped_bytes >> 20, stats.hugetlb_bytes >> 20,
+             stats.madvised_bytes >> 20, stats.numa_bytes >> 20);
+    }
+
+    FreeHashTable(ht, &NullFree);
+    if (pool != NULL)
+      FreePool(pool);
+  }
+}
+
+// look up every key in ht, returning the number found
+static uint64_t LookupAll(HashTable ht, uint64_t num_elements) {
+  HTKeyValue kv;
+  uint64_t i, found = 0;
+
+  for (i = 0; i < num_elements; i++)
+    found += LookupHashTable(ht, FNVHashInt64(i), &kv);
+  return found;
+}
+
+// Time building a table of num_elements keys and looking up every key
+// in it, taking the best of three passes of each, and return the number
+// of telemetry counts the builds made.
+static uint64_t TimeInsertLookup(uint64_t num_elements, double *insert_secs,
+                                 double *lookup_secs) {
+  TelemetrySnapshot before, after;
+  HashTable ht;
+  uint64_t num_counts_built = 0;
+  double start, secs;
+  int pass, t;
+
+  *insert_secs = *lookup_secs = 1e9;
+  for (pass = 0; pass < 3; pass++) {
+    GetTelemetrySnapshot(&before);
+    start = Now();
+    ht = BuildTable(num_elements);
+    secs = Now() - start;
+    GetTelemetrySnapshot(&after);
+    *insert_secs = (secs < *insert_secs) ? secs : *insert_secs;
+    for (t = 0; t < TM_NUM_COUNTERS; t++)
+      num_counts_built += after.counts[t] - before.counts[t];
+
+    start = Now();
+    Assert333(LookupAll(ht, num_elements) == num_elements);
+    secs = Now() - start;
+    *lookup_secs = (secs < *lookup_secs) ? secs : *lookup_secs;
+    FreeHashTable(ht, &NullFree);
+  }
+  return num_counts_built / 3;
+}
+
+#ifdef TM_NO_TELEMETRY
+
+// This is benchmark_ht_notm: the counting is compiled out, so just time
+// the operations; benchmark_ht runs this and reads the results.
+static void BenchTelemetry(uint64_t num_elements) {
+  double insert_secs, lookup_secs;
+
+  TimeInsertLookup(num_elements, &insert_secs, &lookup_secs);
+  Report("telemetry", "insert/off", num_elements, insert_secs);
+  Report("telemetry", "lookup/off", num_elements, lookup_secs);
+}
+
+#else  // TM_NO_TELEMETRY
+
+static void BenchTelemetry(uint64_t num_elements) {
+  char notm[1024], cmd[1100], line[256], what[32];
+  double insert_secs, lookup_secs, secs;
+  double insert_off = 0, lookup_off = 0;
+  uint64_t num_counts_built;
+  FILE *f;
+
+  // the operations being counted, with the counting compiled in...
+  num_counts_built = TimeInsertLookup(num_elements, &insert_secs,
+                                      &lookup_secs);
+  Report("telemetry", "insert/on", num_elements, insert_secs);
+  Report("telemetry", "lookup/on", num_elements, lookup_secs);
+
+  // ...and with it compiled out, which takes the other build of the
+  // library, and so another program.
+  snprintf(notm, sizeof(notm), "%s_notm", program_name);
+  snprintf(cmd, sizeof(cmd), "%s telemetry %" PRIu64, notm, num_elements);
+  f = (access(notm, X_OK) == 0) ? popen(cmd, "r") : NULL;
+  while (f != NULL && fgets(line, sizeof(line), f) != NULL) {
+    fputs(line, stdout);
+    if (sscanf(line, "telemetry %31s %lf s", what, &secs) != 2)
+      continue;
+    if (strcmp(what, "insert/off") == 0)
+      insert_off = secs;
+    else if (strcmp(what, "lookup/off") == 0)
+      lookup_off = secs;
+  }
+  if (f != NULL)
+    pclose(f);
+  if (insert_off <= 0 || lookup_off <= 0) {
+    printf("telemetry %.2f counts/insert; no %s to compare with "
+           "(make benchmark_ht_notm)\n",
+           (double) num_counts_built / num_elements, notm);
+    return;
+  }
+
+  // inserts count the insert itself, plus the list node and the
+  // allocations it takes, and the occasional resize; lookups count a
+  // hit or a miss.
+  printf("telemetry %.2f counts/insert; overhead %.2f%% of insert, "
+         "%.2f%% of lookup\n",
+         (double) num_counts_built / num_elements,
+         100.0 * (insert_secs - insert_off) / insert_off,
+         100.0 * (lookup_secs - lookup_off) / lookup_off);
+}
+
+#endif  // TM_NO_TELEMETRY
+
+static void BenchRecorder(uint64_t num_elements) {
+  static FlightRecord records[4096];
+  HashTable ht;
+  uint64_t i, num_records, num_resized;
+  double start, secs, off_secs = 1e9, on_secs = 1e9;
+  int pass;
+
+  // the fast path: lookups with the recorder off, and then running with
+  // a threshold that none of them reach.  Passes alternate, and the
+  // best of each is reported.
+  ht = BuildTable(num_elements);
+  LookupAll(ht, num_elements);  // warm up
+  for (pass = 0; pass < 3; pass++) {
+    start = Now();
+    Assert333(LookupAll(ht, num_elements) == num_elements);
+    secs = Now() - start;
+    off_secs = (secs < off_secs) ? secs : off_secs;
+
+    StartFlightRecorder(1000000000ULL, 16);
+    start = Now();
+    Assert333(LookupAll(ht, num_elements) == num_elements);
+    secs = Now() - start;
+    StopFlightRecorder();
+    on_secs = (secs < on_secs) ? secs : on_secs;
+  }
+  Report("recorder", "lookup, off", num_elements, off_secs);
+  Report("recorder", "lookup, on", num_elements, on_secs);
+  printf("recorder overhead %.1f ns/op\n",
+         (on_secs - off_secs) * 1e9 / num_elements);
+  FreeHashTable(ht, &NullFree);
+
+  // what's caught building a table: inserts over 100us, which are
+  // mostly the ones that resized it.  (Each thread keeps only its last
+  // FR_RING_SIZE records.)
+  StartFlightRecorder(100000, 16);
+  ht = BuildTable(num_elements);
+  StopFlightRecorder();
+  FreeHashTable(ht, &NullFree);
+  num_records = GetFlightRecords(records, 4096);
+  for (i = 0, num_resized = 0; i < num_records; i++) {
+    if (records[i].flags & FR_RESIZED)
+      num_resized++;
+  }
+  printf("recorder caught %" PRIu64 " inserts over 100 us, "
+         "%" PRIu64 " of them resizes\n", num_records, num_resized);
+}
+
+static const void *IntegerBytes(void *value, uint64_t *len) {
+  static uintptr_t buf;
+
+  buf = (uintptr_t) value;
+  *len = sizeof(buf);
+  return &buf;
+}
+
+static void *IntegerFromBytes(const void *bytes, uint64_t len) {
+  uintptr_t value;
+
+  Assert333(len == sizeof(value));
+  memcpy(&value, bytes, sizeof(value));
+  return (void *) value;
+}
+
+static double Now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static HashTable BuildTable(uint64_t num_elements) {
+  return BuildTableWithAllocator(num_elements, &kMallocAllocator, NULL);
+}
+
+static HashTable BuildTableWithAllocator(uint64_t num_elements,
+                                         const Allocator *allocator,
+                                         void *context) {
+  HashTable ht;
+  HTKeyValue kv, old_kv;
+  uint64_t i;
+
+  ht = AllocateHashTableWithAllocator(1024, allocator, context);
+  Assert333(ht != NULL);
+  for (i = 0; i < num_elements; i++) {
+    kv.key = FNVHashInt64(i);
+    kv.value = (void *) (uintptr_t) (i + 1);
+    Assert333(InsertHashTable(ht, kv, &old_kv) == 1);
+  }
+  return ht;
+}
+
+static void Report(const char *bench, const char *what,
+                   uint64_t ops, double secs) {
+  printf("%-8s %-20s %10.3f s %12.0f ops/s\n", bench, what, secs,
+         (secs > 0) ? ops / secs : 0.0);
+}
@@ -0,0 +1,803 @@
+/*
+ * Copyright 2011 Steven Gribble
+ *
+ *  This file is part of the UW CSE 333 course project sequence
+ *  (333proj).
+ *
+ *  333proj is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  333proj is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Assert333.h"
+#include "Allocator.h"
+#include "LinkedList.h"
+#include "LinkedListExternalSort.h"
+#include "LinkedListKeyIndex.h"
+#include "PostingList.h"
+#include "UnrolledList.h"
+
+// A benchmark takes the number of elements to work with.
+typedef void (*BenchmarkFnPtr)(uint64_t num_elements);
+
+typedef struct {
+  const char     *name;
+  BenchmarkFnPtr  fn;
+} Benchmark;
+
+// the benchmarks themselves
+static void BenchSlab(uint64_t num_elements);
+static void BenchSort(uint64_t num_elements);
+static void BenchParallelSort(uint64_t num_elements);
+static void BenchAdaptiveSort(uint64_t num_elements);
+static void BenchKeySort(uint64_t num_elements);
+static void BenchExternalSort(uint64_t num_elements);
+static void BenchTopK(uint64_t num_elements);
+static void BenchMergeSorted(uint64_t num_elements);
+static void BenchIntersect(uint64_t num_elements);
+static void BenchPostingList(uint64_t num_elements);
+static void BenchUnrolled(uint64_t num_elements);
+
+static const Benchmark kBenchmarks[] = {
+  { "slab", &BenchSlab },
+  { "sort", &BenchSort },
+  { "psort", &BenchParallelSort },
+  { "adaptive", &BenchAdaptiveSort },
+  { "keysort", &BenchKeySort },
+  { "external", &BenchExternalSort },
+  { "topk", &BenchTopK },
+  { "kmerge", &BenchMergeSorted },
+  { "intersect", &BenchIntersect },
+  { "postings", &BenchPostingList },
+  { "unrolled", &BenchUnrolled },
+};
+#define NUM_BENCHMARKS (sizeof(kBenchmarks) / sizeof(kBenchmarks[0]))
+
+// a free function that does nothing; the benchmarks store integers,
+// not pointers, as payloads.
+static void NullFree(void *freeme) { }
+
+// The inputs the sort benchmarks use: return the i'th of n values.
+// Values are never 0, since payloads can't be NULL.
+typedef uint64_t (*SortInputFnPtr)(uint64_t i, uint64_t n);
+
+typedef struct {
+  const char     *name;
+  SortInputFnPtr  fn;
+} SortInput;
+
+static uint64_t RandomInput(uint64_t i, uint64_t n);
+static uint64_t SortedInput(uint64_t i, uint64_t n);
+static uint64_t ReversedInput(uint64_t i, uint64_t n);
+static uint64_t DuplicatesInput(uint64_t i, uint64_t n);
+static uint64_t NearlySortedInput(uint64_t i, uint64_t n);
+
+static const SortInput kSortInputs[] = {
+  { "random", &RandomInput },
+  { "sorted", &SortedInput },
+  { "reversed", &ReversedInput },
+  { "duplicates", &DuplicatesInput },
+  { "nearly", &NearlySortedInput },
+};
+#define NUM_SORT_INPUTS (sizeof(kSortInputs) / sizeof(kSortInputs[0]))
+
+// make a list of the n values input gives
+static LinkedList MakeInputList(const SortInput *input, uint64_t n);
+
+// compare two integer payloads
+static int CompareIntegers(void *p1, void *p2);
+
+// ...and count the comparisons in num_compares
+static uint64_t num_compares;
+static int CountCompareIntegers(void *p1, void *p2);
+
+// the key SortLinkedListByKey sorts integer payloads by
+static uint64_t IntegerKey(void *payload);
+
+// payload functions for ExternalSortLinkedList, and an output function
+// for it that just counts the payloads
+static const void *IntegerBytes(void *payload, uint64_t *len);
+static void *IntegerFromBytes(const void *bytes, uint64_t len);
+static bool CountOutput(void *payload, void *arg);
+
+// a list of n integers in ascending order, spread over about [1, span]
+// with random gaps; different seeds give different lists
+static LinkedList MakeKeyedInputList(uint64_t n, uint64_t span,
+                                     uint64_t seed);
+
+// return the current time, in seconds
+static double Now(void);
+
+// print one result line
+static void Report(const char *bench, const char *what,
+                   uint64_t ops, double secs);
+
+// usage: benchmark_ll [benchmark|all] [num_elements]
+int main(int argc, char **argv) {
+  const char *which = (argc > 1) ? argv[1] : "all";
+  uint64_t num_elements = (argc > 2) ? strtoull(argv[2], NULL, 10) : 1000000;
+  unsigned int i;
+  bool ran = false;
+
+  for (i = 0; i < NUM_BENCHMARKS; i++) {
+    if (strcmp(which, "all") == 0 || strcmp(which, kBenchmarks[i].name) == 0) {
+      kBenchmarks[i].fn(num_elements);
+      ran = true;
+    }
+  }
+  if (!ran) {
+    fprintf(stderr, "usage: %s [benchmark|all] [num_elements]\n", argv[0]);
+    fprintf(stderr, "benchmarks:");
+    for (i = 0; i < NUM_BENCHMARKS; i++)
+      fprintf(stderr, " %s", kBenchmarks[i].name);
+    fprintf(stderr, "\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// the arguments to a queue-churn thread
+typedef struct {
+  const Allocator *allocator;
+  uint64_t         num_ops;
+} ChurnArgs;
+
+// keep a queue 1000 deep, appending at the tail and popping at the head
+// num_ops times.
+static void *QueueChurn(void *arg) {
+  ChurnArgs *args = (ChurnArgs *) arg;
+  LinkedList ll;
+  void *payload;
+  uint64_t i;
+
+  ll = AllocateLinkedListWithAllocator(args->allocator, NULL);
+  Assert333(ll != NULL);
+  for (i = 1; i <= 1000; i++)
+    Assert333(AppendLinkedList(ll, (void *) (uintptr_t) i));
+  for (i = 0; i < args->num_ops; i++) {
+    Assert333(AppendLinkedList(ll, (void *) (uintptr_t) (i + 1)));
+    Assert333(PopLinkedList(ll, &payload));
+  }
+  FreeLinkedList(ll, &NullFree);
+  return NULL;
+}
+
+static void BenchSlab(uint64_t num_elements) {
+  const Allocator *allocators[2] = { &kMallocAllocator,
+                                     &kLLNodeSlabAllocator };
+  const char *names[2] = { "malloc", "slab" };
+  pthread_t threads[4];
+  ChurnArgs args;
+  LinkedList ll;
+  char what[32];
+  uint64_t i;
+  double start;
+  int a, t;
+
+  for (a = 0; a < 2; a++) {
+    // push/pop churn on one thread
+    args.allocator = allocators[a];
+    args.num_ops = num_elements;
+    start = Now();
+    QueueChurn(&args);
+    snprintf(what, sizeof(what), "push/pop %s", names[a]);
+    Report("slab", what, num_elements, Now() - start);
+
+    // the same on four threads at once
+    start = Now();
+    for (t = 0; t < 4; t++)
+      Assert333(pthread_create(&threads[t], NULL, &QueueChurn, &args) == 0);
+    for (t = 0; t < 4; t++)
+      pthread_join(threads[t], NULL);
+    snprintf(what, sizeof(what), "push/pop x4 %s", names[a]);
+    Report("slab", what, 4 * num_elements, Now() - start);
+
+    // build a long list, then free it all at once
+    start = Now();
+    ll = AllocateLinkedListWithAllocator(allocators[a], NULL);
+    Assert333(ll != NULL);
+    for (i = 0; i < num_elements; i++)
+      Assert333(PushLinkedList(ll, (void *) (uintptr_t) (i + 1)));
+    FreeLinkedList(ll, &NullFree);
+    snprintf(what, sizeof(what), "build+free %s", names[a]);
+    Report("slab", what, num_elements, Now() - start);
+  }
+}
+
+static void BenchSort(uint64_t num_elements) {
+  LinkedList ll;
+  char what[32];
+  uint64_t n, reps, r;
+  double start, secs;
+  unsigned int in;
+
+  // sort lists of 10, 100, ... up to num_elements values, repeating the
+  // small ones so that each size sorts num_elements values in all.  At
+  // the large sizes, the time goes on cache misses following next
+  // pointers more than on comparisons, so how the nodes happen to lie
+  // in memory (the first input sorted gets a fresh heap) shows up as
+  // much as the input's order does.
+  for (in = 0; in < NUM_SORT_INPUTS; in++) {
+    for (n = 10; n <= num_elements; n *= 10) {
+      reps = num_elements / n;
+      secs = 0;
+      for (r = 0; r < reps; r++) {
+        ll = MakeInputList(&kSortInputs[in], n);
+        start = Now();
+        SortLinkedList(ll, 1, &CompareIntegers);
+        secs += Now() - start;
+        FreeLinkedList(ll, &NullFree);
+      }
+      snprintf(what, sizeof(what), "%s %" PRIu64, kSortInputs[in].name, n);
+      Report("sort", what, reps * n, secs);
+    }
+  }
+}
+
+static void BenchParallelSort(uint64_t num_elements) {
+  LinkedList ll;
+  char what[32];
+  double start;
+  int threads;
+
+  // SortLinkedList, and then SortLinkedListParallel on 1, 2, 4, ... 16
+  // threads, on random values.
+  ll = MakeInputList(&kSortInputs[0], num_elements);
+  start = Now();
+  SortLinkedList(ll, 1, &CompareIntegers);
+  Report("psort", "SortLinkedList", num_elements, Now() - start);
+  FreeLinkedList(ll, &NullFree);
+
+  for (threads = 1; threads <= 16; threads *= 2) {
+    ll = MakeInputList(&kSortInputs[0], num_elements);
+    start = Now();
+    SortLinkedListParallel(ll, 1, &CompareIntegers, threads);
+    snprintf(what, sizeof(what), "%d threads", threads);
+    Report("psort", what, num_elements, Now() - start);
+    FreeLinkedList(ll, &NullFree);
+  }
+}
+
+static void BenchAdaptiveSort(uint64_t num_elements) {
+  LinkedList ll;
+  char what[32];
+  double start;
+  unsigned int in;
+
+  // SortLinkedList against SortLinkedListAdaptive on each input, and
+  // the comparisons each takes per element.  Then the adaptive sort
+  // again, on the list it has just sorted.
+  for (in = 0; in < NUM_SORT_INPUTS; in++) {
+    ll = MakeInputList(&kSortInputs[in], num_elements);
+    num_compares = 0;
+    start = Now();
+    SortLinkedList(ll, 1, &CountCompareIntegers);
+    snprintf(what, sizeof(what), "%s merge", kSortInputs[in].name);
+    Report("adaptive", what, num_elements, Now() - start);
+    printf("%.2f compares/element\n", (double) num_compares / num_elements);
+    FreeLinkedList(ll, &NullFree);
+
+    ll = MakeInputList(&kSortInputs[in], num_elements);
+    num_compares = 0;
+    start = Now();
+    SortLinkedListAdaptive(ll, 1, &CountCompareIntegers);
+    snprintf(what, sizeof(what), "%s adaptive", kSortInputs[in].name);
+    Report("adaptive", what, num_elements, Now() - start);
+    printf("%.2f compares/element\n", (double) num_compares / num_elements);
+
+    start = Now();
+    SortLinkedListAdaptive(ll, 1, &CountCompareIntegers);
+    snprintf(what, sizeof(what), "%s re-sort", kSortInputs[in].name);
+    Report("adaptive", what, num_elements, Now() - start);
+    FreeLinkedList(ll, &NullFree);
+  }
+}
+
+static void BenchKeySort(uint64_t num_elements) {
+  LinkedList ll;
+  char what[32];
+  double start;
+  unsigned int in;
+
+  // SortLinkedList against SortLinkedListByKey on each input.  The
+  // duplicates and sorted inputs have high bytes in common, which the
+  // radix sort skips.
+  for (in = 0; in < NUM_SORT_INPUTS; in++) {
+    ll = MakeInputList(&kSortInputs[in], num_elements);
+    start = Now();
+    SortLinkedList(ll, 1, &CompareIntegers);
+    snprintf(what, sizeof(what), "%s merge", kSortInputs[in].name);
+    Report("keysort", what, num_elements, Now() - start);
+    FreeLinkedList(ll, &NullFree);
+
+    ll = MakeInputList(&kSortInputs[in], num_elements);
+    start = Now();
+    Assert333(SortLinkedListByKey(ll, 1, &IntegerKey));
+    snprintf(what, sizeof(what), "%s radix", kSortInputs[in].name);
+    Report("keysort", what, num_elements, Now() - start);
+    FreeLinkedList(ll, &NullFree);
+  }
+}
+
+static void BenchExternalSort(uint64_t num_elements) {
+  static const uint64_t kBudgets[] = { 1ULL << 30, 16 << 20, 1 << 20, 0 };
+  LLExternalSortOptions options = { 0, NULL, &IntegerBytes,
+                                    &IntegerFromBytes, &NullFree };
+  LLExternalSortStats stats;
+  LinkedList ll;
+  char what[32];
+  uint64_t count;
+  double start;
+  unsigned int b;
+
+  // ExternalSortLinkedList on random values, from a budget that holds
+  // them all down to the smallest there is, streaming the output out
+  // through a callback.  Each record takes 16 bytes on disk.
+  for (b = 0; b < sizeof(kBudgets) / sizeof(kBudgets[0]); b++) {
+    ll = MakeInputList(&kSortInputs[0], num_elements);
+    options.memory_budget = kBudgets[b];
+    count = 0;
+    start = Now();
+    Assert333(ExternalSortLinkedList(ll, 1, &CompareIntegers, &options,
+                                     &CountOutput, &count, &stats));
+    snprintf(what, sizeof(what), "budget %" PRIu64 "K",
+             (kBudgets[b] > LL_EXTERNAL_SORT_MIN_BUDGET ? kBudgets[b] :
+              LL_EXTERNAL_SORT_MIN_BUDGET) >> 10);
+    Report("external", what, num_elements, Now() - start);
+    printf("%" PRIu64 " runs, %" PRIu64 " passes, %.1f MB written\n",
+           stats.num_runs, stats.num_passes, stats.bytes_written / 1e6);
+    Assert333(count == num_elements);
+    FreeLinkedList(ll, &NullFree);
+  }
+}
+
+static void BenchTopK(uint64_t num_elements) {
+  LinkedList ll, out;
+  char what[32];
+  uint64_t k, i;
+  double start;
+  void *payload;
+
+  // the best k of random values: LinkedListTopK, against sorting the
+  // whole list and taking the first k off the front.
+  for (k = 10; k <= 1000; k *= 10) {
+    ll = MakeInputList(&kSortInputs[0], num_elements);
+    out = AllocateLinkedList();
+    Assert333(out != NULL);
+    num_compares = 0;
+    start = Now();
+    Assert333(LinkedListTopK(ll, k, 1, &CountCompareIntegers, out));
+    snprintf(what, sizeof(what), "top %" PRIu64, k);
+    Report("topk", what, num_elements, Now() - start);
+    printf("%.2f compares/element\n", (double) num_compares / num_elements);
+    FreeLinkedList(out, &NullFree);
+
+    out = AllocateLinkedList();
+    Assert333(out != NULL);
+    start = Now();
+    SortLinkedList(ll, 1, &CompareIntegers);
+    for (i = 0; i < k && PopLinkedList(ll, &payload); i++)
+      Assert333(AppendLinkedList(out, payload));
+    snprintf(what, sizeof(what), "sort+slice %" PRIu64, k);
+    Report("topk", what, num_elements, Now() - start);
+    FreeLinkedList(out, &NullFree);
+    FreeLinkedList(ll, &NullFree);
+  }
+}
+
+static void BenchMergeSorted(uint64_t num_elements) {
+  LinkedList lists[256], ll, merged;
+  char what[32];
+  uint64_t k, i, j;
+  double start;
+  void *payload;
+  LLIter iter;
+
+  // k sorted lists of random values, num_elements in all: merging them
+  // with MergeSortedLinkedLists, against appending them all to one list
+  // and sorting that.
+  for (k = 4; k <= 256; k *= 4) {
+    for (i = 0; i < k; i++) {
+      lists[i] = AllocateLinkedList();
+      Assert333(lists[i] != NULL);
+    }
+    for (j = 0; j < num_elements; j++) {
+      Assert333(AppendLinkedList(lists[j % k],
+                                 (void *) (uintptr_t) RandomInput(j, 0)));
+    }
+    ll = AllocateLinkedList();
+    Assert333(ll != NULL);
+    for (i = 0; i < k; i++) {
+      SortLinkedList(lists[i], 1, &CompareIntegers);
+      iter = LLMakeIterator(lists[i], 0);
+      Assert333(iter != NULL);
+      do {
+        LLIteratorGetPayload(iter, &payload);
+        Assert333(AppendLinkedList(ll, payload));
+      } while (LLIteratorNext(iter));
+      LLIteratorFree(iter);
+    }
+
+    start = Now();
+    merged = MergeSortedLinkedLists(lists, k, 1, &CompareIntegers, NULL);
+    Assert333(merged != NULL);
+    snprintf(what, sizeof(what), "merge %" PRIu64 " lists", k);
+    Report("kmerge", what, num_elements, Now() - start);
+
+    start = Now();
+    SortLinkedList(ll, 1, &CompareIntegers);
+    snprintf(what, sizeof(what), "resort %" PRIu64 " lists", k);
+    Report("kmerge", what, num_elements, Now() - start);
+
+    for (i = 0; i < k; i++)
+      FreeLinkedList(lists[i], &NullFree);
+    FreeLinkedList(merged, &NullFree);
+    FreeLinkedList(ll, &NullFree);
+  }
+}
+
+static void BenchIntersect(uint64_t num_elements) {
+  LinkedList big, small;
+  LLKeyIndex big_index, small_index;
+  LLIter big_iter, small_iter;
+  char what[32];
+  uint64_t ratio, n, count, reps, r, k1, k2;
+  double start;
+  void *p1, *p2;
+  bool more;
+
+  // intersect a list of num_elements integers with lists 1 to 10000
+  // times shorter, spread over the same range: as key indexes (built
+  // beforehand), and by walking the two lists side by side.  Then the
+  // union of the key indexes.  Each is repeated, reps times for the
+  // walk and the union and ratio times more for the intersection of the
+  // indexes, to get measurable times; the times are the totals, and the
+  // ops are the elements of both lists, once per repeat.
+  big = MakeKeyedInputList(num_elements, 4 * num_elements, 1);
+  big_index = MakeLLKeyIndex(big, &IntegerKey);
+  Assert333(big_index != NULL);
+  for (ratio = 1; ratio <= 10000; ratio *= 10) {
+    n = num_elements / ratio;
+    small = MakeKeyedInputList(n, 4 * num_elements, 2);
+    small_index = MakeLLKeyIndex(small, &IntegerKey);
+    Assert333(small_index != NULL);
+    reps = 3;
+
+    start = Now();
+    for (r = 0; r < reps * ratio; r++) {
+      count = 0;
+      Assert333(IntersectLLKeyIndexes(small_index, big_index, NULL,
+                                      &CountOutput, &count));
+    }
+    snprintf(what, sizeof(what), "1:%" PRIu64 " index", ratio);
+    Report("intersect", what, reps * ratio * (n + num_elements),
+           Now() - start);
+    printf("%" PRIu64 " in common\n", count);
+
+    start = Now();
+    for (r = 0; r < reps; r++) {
+      count = 0;
+      small_iter = LLMakeIterator(small, 0);
+      big_iter = LLMakeIterator(big, 0);
+      Assert333(small_iter != NULL && big_iter != NULL);
+      more = (n > 0);
+      while (more) {
+        LLIteratorGetPayload(small_iter, &p1);
+        LLIteratorGetPayload(big_iter, &p2);
+        k1 = IntegerKey(p1);
+        k2 = IntegerKey(p2);
+        if (k1 == k2)
+          count++;
+        more = (k1 <= k2) ? LLIteratorNext(small_iter) :
+                            LLIteratorNext(big_iter);
+        if (k1 == k2 && more)
+          more = LLIteratorNext(big_iter);
+      }
+      LLIteratorFree(small_iter);
+      LLIteratorFree(big_iter);
+    }
+    snprintf(what, sizeof(what), "1:%" PRIu64 " list walk", ratio);
+    Report("intersect", what, reps * (n + num_elements), Now() - start);
+
+    start = Now();
+    for (r = 0; r < reps; r++) {
+      count = 0;
+      Assert333(UnionLLKeyIndexes(small_index, big_index, NULL,
+                                  &CountOutput, &count));
+    }
+    snprintf(what, sizeof(what), "1:%" PRIu64 " union", ratio);
+    Report("intersect", what, reps * (n + num_elements), Now() - start);
+
+    FreeLLKeyIndex(small_index);
+    FreeLinkedList(small, &NullFree);
+  }
+  FreeLLKeyIndex(big_index);
+  FreeLinkedList(big, &NullFree);
+}
+
+static void BenchPostingList(uint64_t num_elements) {
+  LinkedList ll;
+  PostingList pl;
+  LLMemoryStats stats;
+  LLIter ll_iter;
+  PLIter pl_iter;
+  uint64_t i, value, sum, pl_sum, reps = 10;
+  double start;
+  void *payload;
+
+  // num_elements document IDs with gaps of up to 8, as a LinkedList and
+  // as a PostingList: the memory each takes, and how fast each can be
+  // walked from end to end (reps times) and, for the posting list,
+  // sought through.
+  ll = MakeKeyedInputList(num_elements, 4 * num_elements, 3);
+  pl = PostingListFromLinkedList(ll, &IntegerKey);
+  Assert333(pl != NULL);
+  LinkedListMemoryStats(ll, &stats);
+  printf("LinkedList %.2f bytes/ID, PostingList %.2f bytes/ID (%.1fx)\n",
+         (double) stats.total_bytes / num_elements,
+         (double) PostingListMemoryBytes(pl) / num_elements,
+         (double) stats.total_bytes / PostingListMemoryBytes(pl));
+
+  start = Now();
+  for (i = 0, sum = 0; i < reps; i++) {
+    ll_iter = LLMakeIterator(ll, 0);
+    Assert333(ll_iter != NULL);
+    do {
+      LLIteratorGetPayload(ll_iter, &payload);
+      sum += (uintptr_t) payload;
+    } while (LLIteratorNext(ll_iter));
+    LLIteratorFree(ll_iter);
+  }
+  Report("postings", "LLIter walk", reps * num_elements, Now() - start);
+
+  start = Now();
+  for (i = 0, pl_sum = 0; i < reps; i++) {
+    pl_iter = PLMakeIterator(pl);
+    Assert333(pl_iter != NULL);
+    do {
+      PLIteratorGetValue(pl_iter, &value);
+      pl_sum += value;
+    } while (PLIteratorNext(pl_iter));
+    PLIteratorFree(pl_iter);
+  }
+  Report("postings", "PLIter decode", reps * num_elements, Now() - start);
+  Assert333(sum == pl_sum);
+
+  // seek forward by random strides averaging 1000 IDs
+  start = Now();
+  pl_iter = PLMakeIterator(pl);
+  Assert333(pl_iter != NULL);
+  for (i = 0, value = 0; ; i++) {
+    value += RandomInput(i, 0) % 8000;
+    if (!PLIteratorSeek(pl_iter, value))
+      break;
+  }
+  PLIteratorFree(pl_iter);
+  Report("postings", "PLIter seek", i, Now() - start);
+
+  FreePostingList(pl);
+  FreeLinkedList(ll, &NullFree);
+}
+
+static void BenchUnrolled(uint64_t num_elements) {
+  LinkedList ll;
+  UnrolledList ul;
+  LLMemoryStats ll_stats, ul_stats;
+  LLIter ll_iter;
+  ULIter ul_iter;
+  uint64_t i, sum, ul_sum, reps = 10;
+  uint64_t num_inserts = (num_elements < 100000) ? num_elements : 100000;
+  double start;
+  void *payload;
+
+  // build each list by appending random integers, and then sort it, so
+  // that the LinkedList's nodes end up scattered about memory the way
+  // they would after a while in a real program
+  start = Now();
+  ll = AllocateLinkedList();
+  Assert333(ll != NULL);
+  for (i = 0; i < num_elements; i++) {
+    payload = (void *) (uintptr_t) RandomInput(i, num_elements);
+    Assert333(AppendLinkedList(ll, payload));
+  }
+  Report("unrolled", "LL append", num_elements, Now() - start);
+  start = Now();
+  ul = AllocateUnrolledList();
+  Assert333(ul != NULL);
+  for (i = 0; i < num_elements; i++) {
+    payload = (void *) (uintptr_t) RandomInput(i, num_elements);
+    Assert333(AppendUnrolledList(ul, payload));
+  }
+  Report("unrolled", "UL append", num_elements, Now() - start);
+  LinkedListMemoryStats(ll, &ll_stats);
+  UnrolledListMemoryStats(ul, &ul_stats);
+  printf("LinkedList %.2f bytes/element, UnrolledList %.2f bytes/element\n",
+         (double) ll_stats.total_bytes / num_elements,
+         (double) ul_stats.total_bytes / num_elements);
+
+  start = Now();
+  SortLinkedList(ll, 1, &CompareIntegers);
+  Report("unrolled", "LL sort", num_elements, Now() - start);
+  start = Now();
+  Assert333(SortUnrolledList(ul, 1, &CompareIntegers));
+  Report("unrolled", "UL sort", num_elements, Now() - start);
+
+  // walk each from end to end, reps times
+  start = Now();
+  for (i = 0, sum = 0; i < reps; i++) {
+    ll_iter = LLMakeIterator(ll, 0);
+    Assert333(ll_iter != NULL);
+    do {
+      LLIteratorGetPayload(ll_iter, &payload);
+      sum += (uintptr_t) payload;
+    } while (LLIteratorNext(ll_iter));
+    LLIteratorFree(ll_iter);
+  }
+  Report("unrolled", "LLIter walk", reps * num_elements, Now() - start);
+  start = Now();
+  for (i = 0, ul_sum = 0; i < reps; i++) {
+    ul_iter = ULMakeIterator(ul, 0);
+    Assert333(ul_iter != NULL);
+    do {
+      ULIteratorGetPayload(ul_iter, &payload);
+      ul_sum += (uintptr_t) payload;
+    } while (ULIteratorNext(ul_iter));
+    ULIteratorFree(ul_iter);
+  }
+  Report("unrolled", "ULIter walk", reps * num_elements, Now() - start);
+  Assert333(sum == ul_sum);
+
+  // insert num_inserts payloads in the middle, stepping forward past
+  // each one's successor so they're spread over a stretch of the list
+  ll_iter = LLMakeIterator(ll, 0);
+  Assert333(ll_iter != NULL);
+  for (i = 0; i < num_elements / 2; i++)
+    LLIteratorNext(ll_iter);
+  start = Now();
+  for (i = 0; i < num_inserts; i++) {
+    Assert333(LLIteratorInsertBefore(ll_iter, (void *) (uintptr_t) (i + 1)));
+    LLIteratorNext(ll_iter);
+  }
+  Report("unrolled", "LLIter insert", num_inserts, Now() - start);
+  LLIteratorFree(ll_iter);
+  ul_iter = ULMakeIterator(ul, 0);
+  Assert333(ul_iter != NULL);
+  for (i = 0; i < num_elements / 2; i++)
+    ULIteratorNext(ul_iter);
+  start = Now();
+  for (i = 0; i < num_inserts; i++) {
+    Assert333(ULIteratorInsertBefore(ul_iter, (void *) (uintptr_t) (i + 1)));
+    ULIteratorNext(ul_iter);
+  }
+  Report("unrolled", "ULIter insert", num_inserts, Now() - start);
+  ULIteratorFree(ul_iter);
+
+  // use each as a queue: append at the tail, pop from the head
+  start = Now();
+  for (i = 0; i < num_elements; i++) {
+    Assert333(AppendLinkedList(ll, (void *) (uintptr_t) (i + 1)));
+    Assert333(PopLinkedList(ll, &payload));
+  }
+  Report("unrolled", "LL append/pop", num_elements, Now() - start);
+  start = Now();
+  for (i = 0; i < num_elements; i++) {
+    Assert333(AppendUnrolledList(ul, (void *) (uintptr_t) (i + 1)));
+    Assert333(PopUnrolledList(ul, &payload));
+  }
+  Report("unrolled", "UL append/pop", num_elements, Now() - start);
+
+  FreeUnrolledList(ul, &NullFree);
+  FreeLinkedList(ll, &NullFree);
+}
+
+static LinkedList MakeInputList(const SortInput *input, uint64_t n) {
+  LinkedList ll = AllocateLinkedList();
+  uint64_t i;
+
+  Assert333(ll != NULL);
+  for (i = 0; i < n; i++)
+    Assert333(AppendLinkedList(ll, (void *) (uintptr_t) input->fn(i, n)));
+  return ll;
+}
+
+static uint64_t RandomInput(uint64_t i, uint64_t n) {
+  // a splitmix64 step, so the values are repeatable
+  uint64_t z = (i + 1) * 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return ((z ^ (z >> 31)) >> 1) + 1;
+}
+
+static uint64_t SortedInput(uint64_t i, uint64_t n) {
+  return i + 1;
+}
+
+static uint64_t ReversedInput(uint64_t i, uint64_t n) {
+  return n - i;
+}
+
+static uint64_t DuplicatesInput(uint64_t i, uint64_t n) {
+  return RandomInput(i, n) % 16 + 1;
+}
+
+static uint64_t NearlySortedInput(uint64_t i, uint64_t n) {
+  // sorted, but for 1 in 100 values
+  return (RandomInput(i, n) % 100 == 0) ? RandomInput(n + i, n) % n + 1 : i + 1;
+}
+
+static int CompareIntegers(void *p1, void *p2) {
+  uintptr_t i1 = (uintptr_t) p1, i2 = (uintptr_t) p2;
+
+  return (i1 > i2) - (i1 < i2);
+}
+
+static int CountCompareIntegers(void *p1, void *p2) {
+  num_compares++;
+  return CompareIntegers(p1, p2);
+}
+
+static uint64_t IntegerKey(void *payload) {
+  return (uintptr_t) payload;
+}
+
+static const void *IntegerBytes(void *payload, uint64_t *len) {
+  static uint64_t value;
+
+  value = (uintptr_t) payload;
+  *len = sizeof(value);
+  return &value;
+}
+
+static void *IntegerFromBytes(const void *bytes, uint64_t len) {
+  uint64_t value;
+
+  memcpy(&value, bytes, sizeof(value));
+  return (void *) (uintptr_t) value;
+}
+
+static bool CountOutput(void *payload, void *arg) {
+  (*(uint64_t *) arg)++;
+  return true;
+}
+
+static LinkedList MakeKeyedInputList(uint64_t n, uint64_t span,
+                                     uint64_t seed) {
+  LinkedList ll = AllocateLinkedList();
+  uint64_t i, key = 0, gap = (n > 0) ? 2 * span / n : 1;
+
+  Assert333(ll != NULL);
+  for (i = 0; i < n; i++) {
+    key += 1 + RandomInput(i + seed * span, 0) % gap;
+    Assert333(AppendLinkedList(ll, (void *) (uintptr_t) key));
+  }
+  return ll;
+}
+
+static double Now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Report(const char *bench, const char *what,
+                   uint64_t ops, double secs) {
+  printf("%-8s %-20s %10.3f s %12.0f ops/s\n", bench, what, secs,
+         (secs > 0) ? ops / secs : 0.0);
+}
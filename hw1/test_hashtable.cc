@@ -18,9 +18,32 @@
  *  along with 333proj.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
 extern "C" {
   #include "./HashTable.h"
   #include "./HashTable_priv.h"
+  #include "./FrozenHashTable.h"
+  #include "./HashTableImage.h"
+  #include "./HashTableImage_priv.h"
+  #include "./HashTableLog.h"
+  #include "./HashTableSnapshot.h"
+  #include "./HashTableReclaim.h"
+  #include "./HashTableStats.h"
+  #include "./Telemetry.h"
+  #include "./FlightRecorder.h"
+  #include "./SharedHashTable.h"
+  #include "./SharedHashTable_priv.h"
   #include "./LinkedList.h"
   #include "./LinkedList_priv.h"
 }
@@ -301,4 +324,1223 @@ TEST_F(Test_HashTable, HTSTestIterator) {
   HW1Addpoints(10);
 }
 
+// our value-to-bytes function for writing images of Payloads
+const void *TestPayloadBytes(void *value, uint64_t *len) {
+  *len = sizeof(Payload);
+  return value;
+}
+
+TEST_F(Test_HashTable, HTSTestImage) {
+  HTKeyValue old, newkv;
+  const void *value;
+  uint64_t i, len;
+  char path[] = "/tmp/hw1_test_image_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  // write out and reopen an image of an empty table
+  HashTable table = AllocateHashTable(3);
+  ASSERT_TRUE(WriteHashTableImage(table, path, &TestPayloadBytes));
+  HTImage image = OpenHashTableImage(path);
+  ASSERT_NE(static_cast<HTImage>(NULL), image);
+  ASSERT_EQ(static_cast<uint64_t>(0), NumElementsInHashTableImage(image));
+  ASSERT_EQ(0, LookupHashTableImage(image, 0, &value, &len));
+  CloseHashTableImage(image);
+
+  // now a table with a bunch of elements in it
+  for (i = 0; i < 1000; i++) {
+    Payload *np = static_cast<Payload *>(malloc(sizeof(Payload)));
+    assert(np != NULL);
+    np->magic_num = 0xDEADBEEF;
+    np->payload_num = static_cast<int>(i);
+    newkv.key = FNVHashInt64(i);
+    newkv.value = static_cast<void *>(np);
+    ASSERT_EQ(1, InsertHashTable(table, newkv, &old));
+  }
+  ASSERT_TRUE(WriteHashTableImage(table, path, &TestPayloadBytes));
+  image = OpenHashTableImage(path);
+  ASSERT_NE(static_cast<HTImage>(NULL), image);
+  ASSERT_EQ(static_cast<uint64_t>(1000), NumElementsInHashTableImage(image));
+  HW1Addpoints(10);
+
+  // the values come back as copies living in the mapping
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(1, LookupHashTableImage(image, FNVHashInt64(i), &value, &len));
+    ASSERT_EQ(sizeof(Payload), len);
+    ASSERT_EQ(1, LookupHashTable(table, FNVHashInt64(i), &old));
+    ASSERT_NE(old.value, value);
+    ASSERT_EQ(0, memcmp(old.value, value, sizeof(Payload)));
+    ASSERT_EQ(0, LookupHashTableImage(image, FNVHashInt64(i + 1000),
+                                      &value, &len));
+  }
+  CloseHashTableImage(image);
+  FreeHashTable(table, &TestPayloadFree);
+
+  // a truncated image is rejected
+  ASSERT_EQ(0, truncate(path, 100));
+  ASSERT_EQ(static_cast<HTImage>(NULL), OpenHashTableImage(path));
+  unlink(path);
+  ASSERT_EQ(static_cast<HTImage>(NULL), OpenHashTableImage(path));
+  HW1Addpoints(10);
+}
+
+// our bytes-to-value function for rebuilding Payloads
+void *TestPayloadFromBytes(const void *bytes, uint64_t len) {
+  Payload *np = static_cast<Payload *>(malloc(sizeof(Payload)));
+  assert(len == sizeof(Payload));
+  memcpy(np, bytes, sizeof(Payload));
+  return np;
+}
+
+// insert a fresh Payload under key i
+static int InsertTestPayload(HashTable table, uint64_t i, int payload_num) {
+  Payload *np = static_cast<Payload *>(malloc(sizeof(Payload)));
+  HTKeyValue old, newkv;
+  int res;
+
+  np->magic_num = 0xDEADBEEF;
+  np->payload_num = payload_num;
+  newkv.key = i;
+  newkv.value = static_cast<void *>(np);
+  res = InsertHashTable(table, newkv, &old);
+  if (res == 2)
+    TestPayloadFree(old.value);
+  else if (res == 0)
+    free(np);
+  return res;
+}
+
+// a malloc-backed allocator that fails once it has made the number of
+// allocations its context points at
+static void *FailingAlloc(void *context, size_t size) {
+  uint64_t *allocs_left = static_cast<uint64_t *>(context);
+
+  if (*allocs_left == 0)
+    return NULL;
+  (*allocs_left)--;
+  return malloc(size);
+}
+
+static void FailingDealloc(void *context, void *ptr, size_t size) {
+  free(ptr);
+}
+
+static const Allocator kFailingAllocator = { &FailingAlloc,
+                                             &FailingDealloc };
+
+TEST_F(Test_HashTable, HTSTestLog) {
+  HTLogSyncPolicy policies[3] = { HT_LOG_SYNC_ALWAYS, HT_LOG_SYNC_INTERVAL,
+                                  HT_LOG_SYNC_NEVER };
+  HTKeyValue old;
+  uint64_t i;
+  int p;
+  char path[] = "/tmp/hw1_test_log_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  for (p = 0; p < 3; p++) {
+    // log a mix of inserts, replaces and removes
+    unlink(path);
+    HashTable table = AllocateHashTable(3);
+    HTLog log = OpenHashTableLog(path, policies[p], 5, &TestPayloadBytes);
+    ASSERT_NE(static_cast<HTLog>(NULL), log);
+    HashTableAttachLog(table, log);
+    for (i = 0; i < 200; i++) {
+      ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+    }
+    for (i = 0; i < 200; i += 3) {
+      ASSERT_EQ(2, InsertTestPayload(table, i, static_cast<int>(i + 1000)));
+    }
+    for (i = 0; i < 200; i += 2) {
+      ASSERT_EQ(1, RemoveFromHashTable(table, i, &old));
+      TestPayloadFree(old.value);
+    }
+    ASSERT_EQ(0, RemoveFromHashTable(table, 0, &old));
+    HashTableAttachLog(table, NULL);
+    ASSERT_TRUE(CloseHashTableLog(log));
+
+    // replay it into a new table and make sure we get the same thing
+    HashTable replayed = AllocateHashTable(3);
+    ASSERT_EQ(200 + 67 + 100,
+              ReplayHashTableLog(path, replayed, &TestPayloadFromBytes,
+                                 &TestPayloadFree));
+    ASSERT_EQ(NumElementsInHashTable(table),
+              NumElementsInHashTable(replayed));
+    for (i = 0; i < 200; i++) {
+      HTKeyValue kv;
+      int res = LookupHashTable(table, i, &old);
+      ASSERT_EQ(res, LookupHashTable(replayed, i, &kv));
+      if (res == 1) {
+        ASSERT_EQ(0, memcmp(old.value, kv.value, sizeof(Payload)));
+      }
+    }
+    FreeHashTable(replayed, &TestPayloadFree);
+    FreeHashTable(table, &TestPayloadFree);
+  }
+  HW1Addpoints(10);
+
+  // a torn record at the end of the log is dropped and truncated away,
+  // and the log can then be appended to again.
+  fd = open(path, O_WRONLY | O_APPEND);
+  ASSERT_NE(-1, fd);
+  ASSERT_EQ(5, write(fd, "\x01torn", 5));
+  close(fd);
+  HashTable table = AllocateHashTable(3);
+  ASSERT_EQ(367, ReplayHashTableLog(path, table, &TestPayloadFromBytes,
+                                    &TestPayloadFree));
+  HTLog log = OpenHashTableLog(path, HT_LOG_SYNC_ALWAYS, 0, &TestPayloadBytes);
+  ASSERT_NE(static_cast<HTLog>(NULL), log);
+  HashTableAttachLog(table, log);
+  ASSERT_EQ(1, InsertTestPayload(table, 1000, 1000));
+  HashTableAttachLog(table, NULL);
+  ASSERT_TRUE(CloseHashTableLog(log));
+  FreeHashTable(table, &TestPayloadFree);
+  table = AllocateHashTable(3);
+  ASSERT_EQ(368, ReplayHashTableLog(path, table, &TestPayloadFromBytes,
+                                    &TestPayloadFree));
+  ASSERT_EQ(1, LookupHashTable(table, 1000, &old));
+  FreeHashTable(table, &TestPayloadFree);
+
+  // inserts that run out of memory part way are not logged, so the log
+  // replays to exactly the keys the table took
+  unlink(path);
+  uint64_t allocs_left = UINT64_MAX;
+  table = AllocateHashTableWithAllocator(400, &kFailingAllocator,
+                                         &allocs_left);
+  ASSERT_NE(static_cast<HashTable>(NULL), table);
+  log = OpenHashTableLog(path, HT_LOG_SYNC_NEVER, 0, &TestPayloadBytes);
+  ASSERT_NE(static_cast<HTLog>(NULL), log);
+  HashTableAttachLog(table, log);
+  int num_failed = 0;
+  for (i = 0; i < 300; i++) {
+    allocs_left = i % 4;
+    int res = InsertTestPayload(table, i % 200, static_cast<int>(i));
+    ASSERT_NE(-1, res);
+    num_failed += (res == 0);
+  }
+  allocs_left = UINT64_MAX;
+  ASSERT_LT(0, num_failed);
+  HashTableAttachLog(table, NULL);
+  ASSERT_TRUE(CloseHashTableLog(log));
+  HashTable replayed = AllocateHashTable(3);
+  ASSERT_EQ(300 - num_failed,
+            ReplayHashTableLog(path, replayed, &TestPayloadFromBytes,
+                               &TestPayloadFree));
+  ASSERT_EQ(NumElementsInHashTable(table), NumElementsInHashTable(replayed));
+  for (i = 0; i < 200; i++) {
+    HTKeyValue kv;
+    int res = LookupHashTable(table, i, &old);
+    ASSERT_EQ(res, LookupHashTable(replayed, i, &kv));
+    if (res == 1) {
+      ASSERT_EQ(0, memcmp(old.value, kv.value, sizeof(Payload)));
+    }
+  }
+  FreeHashTable(replayed, &TestPayloadFree);
+  FreeHashTable(table, &TestPayloadFree);
+  unlink(path);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestSnapshot) {
+  HTKeyValue old;
+  uint64_t i;
+  char path[] = "/tmp/hw1_test_snapshot_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  HashTable table = AllocateHashTable(3);
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+
+  // start a snapshot, then mutate the table while it is being written
+  HTSnapshot snapshot = HashTableSnapshotAsync(table, path, &TestPayloadBytes);
+  ASSERT_NE(static_cast<HTSnapshot>(NULL), snapshot);
+  for (i = 0; i < 1000; i += 2) {
+    ASSERT_EQ(1, RemoveFromHashTable(table, i, &old));
+    TestPayloadFree(old.value);
+  }
+  for (i = 1; i < 1000; i += 2) {
+    ASSERT_EQ(2, InsertTestPayload(table, i, -1));
+  }
+  ASSERT_TRUE(HashTableSnapshotWait(snapshot));
+  HW1Addpoints(10);
+
+  // the snapshot holds the table as of the fork
+  HashTable loaded = LoadHashTableSnapshot(path, &TestPayloadFromBytes,
+                                           &TestPayloadFree);
+  ASSERT_NE(static_cast<HashTable>(NULL), loaded);
+  ASSERT_EQ(static_cast<uint64_t>(1000), NumElementsInHashTable(loaded));
+  ASSERT_EQ(static_cast<uint64_t>(1000), loaded->num_buckets);
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(1, LookupHashTable(loaded, i, &old));
+    ASSERT_EQ(static_cast<int>(i),
+              (static_cast<Payload *>(old.value))->payload_num);
+  }
+  FreeHashTable(loaded, &TestPayloadFree);
+  FreeHashTable(table, &TestPayloadFree);
+
+  // a corrupt snapshot that holds a key twice fails to load cleanly,
+  // freeing every value it rebuilt exactly once
+  HTImageHeader header;
+  HTImageEntry entry;
+  fd = open(path, O_RDWR);
+  ASSERT_NE(-1, fd);
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(header)),
+            pread(fd, &header, sizeof(header), 0));
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(entry)),
+            pread(fd, &entry, sizeof(entry), header.entry_offset));
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(entry.key)),
+            pwrite(fd, &entry.key, sizeof(entry.key),
+                   header.entry_offset + 5 * sizeof(entry)));
+  close(fd);
+  num_payload_frees = 0;
+  ASSERT_EQ(static_cast<HashTable>(NULL),
+            LoadHashTableSnapshot(path, &TestPayloadFromBytes,
+                                  &TestPayloadFree));
+  ASSERT_EQ(6U, num_payload_frees);
+
+  // a snapshot to somewhere we can't write fails
+  table = AllocateHashTable(3);
+  snapshot = HashTableSnapshotAsync(table, "/nonexistent/dir/snapshot",
+                                    &TestPayloadBytes);
+  ASSERT_NE(static_cast<HTSnapshot>(NULL), snapshot);
+  ASSERT_FALSE(HashTableSnapshotWait(snapshot));
+  FreeHashTable(table, &TestPayloadFree);
+  unlink(path);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestShared) {
+  HashTable table;
+  SharedHashTable shared, attached;
+  Payload p;
+  uint64_t i, len;
+  char name[64];
+  char big[200];
+  int status;
+  pid_t pid;
+
+  snprintf(name, sizeof(name), "/hw1_test_shared_%d",
+           static_cast<int>(getpid()));
+  UnlinkSharedHashTable(name);
+  ASSERT_EQ(static_cast<SharedHashTable>(NULL),
+            AttachSharedHashTable(name));
+
+  // publish a process-local table into shared memory
+  table = AllocateHashTable(3);
+  for (i = 0; i < 500; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  shared = CreateSharedHashTable(name, 1 << 20, 500);
+  ASSERT_NE(static_cast<SharedHashTable>(NULL), shared);
+  ASSERT_EQ(static_cast<SharedHashTable>(NULL),
+            CreateSharedHashTable(name, 1 << 20, 500));
+  ASSERT_TRUE(CopyHashTableToShared(table, shared, &TestPayloadBytes));
+  FreeHashTable(table, &TestPayloadFree);
+  ASSERT_EQ(static_cast<uint64_t>(500), NumElementsInSharedHashTable(shared));
+
+  // a second attachment (a different mapping) sees the same entries
+  attached = AttachSharedHashTable(name);
+  ASSERT_NE(static_cast<SharedHashTable>(NULL), attached);
+  for (i = 0; i < 500; i++) {
+    ASSERT_EQ(1, LookupSharedHashTable(attached, i, &p, sizeof(p), &len));
+    ASSERT_EQ(sizeof(Payload), len);
+    ASSERT_EQ(static_cast<int>(i), p.payload_num);
+  }
+  ASSERT_EQ(0, LookupSharedHashTable(attached, 500, &p, sizeof(p), &len));
+  HW1Addpoints(10);
+
+  // a child process attaches and writes; the parent sees its writes
+  fflush(NULL);
+  pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    SharedHashTable child = AttachSharedHashTable(name);
+    bool ok = child != NULL;
+    for (i = 0; ok && i < 500; i += 2) {
+      ok = RemoveFromSharedHashTable(child, i) == 1;
+    }
+    memset(big, 'x', sizeof(big));
+    ok = ok && InsertSharedHashTable(child, 1, big, sizeof(big)) == 2;
+    ok = ok && InsertSharedHashTable(child, 1000, "", 0) == 1;
+    if (child != NULL)
+      DetachSharedHashTable(child);
+    _exit(ok ? 0 : 1);
+  }
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+  ASSERT_EQ(static_cast<uint64_t>(251), NumElementsInSharedHashTable(shared));
+  ASSERT_EQ(0, LookupSharedHashTable(shared, 0, &p, sizeof(p), &len));
+  ASSERT_EQ(1, LookupSharedHashTable(shared, 3, &p, sizeof(p), &len));
+  ASSERT_EQ(3, p.payload_num);
+  ASSERT_EQ(1, LookupSharedHashTable(shared, 1, &p, sizeof(p), &len));
+  ASSERT_EQ(sizeof(big), len);  // truncated copy
+  ASSERT_EQ('x', reinterpret_cast<char *>(&p)[0]);
+  ASSERT_EQ(1, LookupSharedHashTable(shared, 1000, NULL, 0, &len));
+  ASSERT_EQ(static_cast<uint64_t>(0), len);
+  DetachSharedHashTable(attached);
+
+  // a full region refuses inserts without changing the table, and
+  // removed entries' space is reused
+  for (i = 2000; InsertSharedHashTable(shared, i, big, sizeof(big)) == 1;
+       i++) {
+  }
+  ASSERT_EQ(0, LookupSharedHashTable(shared, i, &p, sizeof(p), &len));
+  ASSERT_EQ(1, RemoveFromSharedHashTable(shared, 2000));
+  ASSERT_EQ(0, RemoveFromSharedHashTable(shared, 2000));
+  ASSERT_EQ(1, InsertSharedHashTable(shared, i, big, sizeof(big)));
+  ASSERT_EQ(0, InsertSharedHashTable(shared, i + 1, big, sizeof(big)));
+
+  DetachSharedHashTable(shared);
+  ASSERT_TRUE(UnlinkSharedHashTable(name));
+  ASSERT_EQ(static_cast<SharedHashTable>(NULL), AttachSharedHashTable(name));
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestSharedOwnerDeath) {
+  SharedHashTable shared;
+  uint64_t i, len;
+  char name[64], c;
+  int fds[2], status;
+  pid_t pid;
+
+  snprintf(name, sizeof(name), "/hw1_test_shared_death_%d",
+           static_cast<int>(getpid()));
+  UnlinkSharedHashTable(name);
+  shared = CreateSharedHashTable(name, 1 << 16, 16);
+  ASSERT_NE(static_cast<SharedHashTable>(NULL), shared);
+  for (i = 0; i < 10; i++) {
+    ASSERT_EQ(1, InsertSharedHashTable(shared, i, &i, sizeof(i)));
+  }
+
+  // a child takes the lock, gets part way through an insert (it has
+  // counted the element, but not linked it in) and is killed.
+  ASSERT_EQ(0, pipe(fds));
+  fflush(NULL);
+  pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    SharedHashTable child = AttachSharedHashTable(name);
+    if (child == NULL || pthread_mutex_lock(&child->header->lock) != 0)
+      _exit(1);
+    child->header->num_elements++;
+    c = 'x';
+    if (write(fds[1], &c, 1) != 1)
+      _exit(1);
+    for (;;)
+      pause();
+  }
+  close(fds[1]);
+  ASSERT_EQ(1, read(fds[0], &c, 1));
+  close(fds[0]);
+  ASSERT_EQ(0, kill(pid, SIGKILL));
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFSIGNALED(status));
+
+  // the parent isn't locked out, and finds the table repaired.
+  ASSERT_EQ(static_cast<uint64_t>(10), NumElementsInSharedHashTable(shared));
+  ASSERT_EQ(1, InsertSharedHashTable(shared, 10, &i, sizeof(i)));
+  for (i = 0; i <= 10; i++) {
+    uint64_t v;
+    ASSERT_EQ(1, LookupSharedHashTable(shared, i, &v, sizeof(v), &len));
+    ASSERT_EQ(i, v);
+  }
+  ASSERT_EQ(1, RemoveFromSharedHashTable(shared, 3));
+  ASSERT_EQ(static_cast<uint64_t>(10), NumElementsInSharedHashTable(shared));
+
+  DetachSharedHashTable(shared);
+  ASSERT_TRUE(UnlinkSharedHashTable(name));
+  HW1Addpoints(10);
+}
+
+// a malloc-backed allocator that counts its outstanding allocations;
+// its context is the count.
+static void *CountingAlloc(void *context, size_t size) {
+  (*static_cast<uint64_t *>(context))++;
+  return malloc(size);
+}
+
+static void CountingDealloc(void *context, void *ptr, size_t size) {
+  (*static_cast<uint64_t *>(context))--;
+  free(ptr);
+}
+
+static const Allocator kCountingAllocator = { &CountingAlloc,
+                                              &CountingDealloc };
+
+TEST_F(Test_HashTable, HTSTestAllocator) {
+  HTKeyValue kv, old;
+  uint64_t i, outstanding = 0;
+
+  // every allocation, through resizes, lookups and iteration, goes
+  // through the table's allocator and is given back to it
+  HashTable table = AllocateHashTableWithAllocator(2, &kCountingAllocator,
+                                                   &outstanding);
+  ASSERT_NE(static_cast<HashTable>(NULL), table);
+  ASSERT_EQ(static_cast<uint64_t>(4), outstanding);  // record, array, lists
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  ASSERT_LT(static_cast<uint64_t>(2), table->num_buckets);
+  ASSERT_EQ(2 + table->num_buckets + 2 * 1000, outstanding);  // kv, node
+  for (i = 0; i < 1000; i += 2) {
+    ASSERT_EQ(1, RemoveFromHashTable(table, i, &old));
+    TestPayloadFree(old.value);
+  }
+  HTIter iter = HashTableMakeIterator(table);
+  ASSERT_NE(static_cast<HTIter>(NULL), iter);
+  for (i = 0; !HTIteratorPastEnd(iter); i++) {
+    ASSERT_EQ(1, HTIteratorGet(iter, &kv));
+    HTIteratorNext(iter);
+  }
+  ASSERT_EQ(static_cast<uint64_t>(500), i);
+  HTIteratorFree(iter);
+  ASSERT_EQ(2 + table->num_buckets + 2 * 500, outstanding);
+  FreeHashTable(table, &TestPayloadFree);
+  ASSERT_EQ(static_cast<uint64_t>(0), outstanding);
+  HW1Addpoints(10);
+
+  // the same workload out of an arena and a pool
+  Arena arena = AllocateArena(1 << 16);
+  ASSERT_NE(static_cast<Arena>(NULL), arena);
+  Pool pool = AllocatePool();
+  ASSERT_NE(static_cast<Pool>(NULL), pool);
+  HashTable arenatable = AllocateHashTableWithAllocator(2, &kArenaAllocator,
+                                                        arena);
+  HashTable pooltable = AllocateHashTableWithAllocator(2, &kPoolAllocator,
+                                                       pool);
+  ASSERT_NE(static_cast<HashTable>(NULL), arenatable);
+  ASSERT_NE(static_cast<HashTable>(NULL), pooltable);
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(arenatable, i, static_cast<int>(i)));
+    ASSERT_EQ(1, InsertTestPayload(pooltable, i, static_cast<int>(i)));
+  }
+  for (i = 0; i < 1000; i += 2) {
+    ASSERT_EQ(1, RemoveFromHashTable(pooltable, i, &old));
+    TestPayloadFree(old.value);
+  }
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(1, LookupHashTable(arenatable, i, &kv));
+    ASSERT_EQ(static_cast<int>(i),
+              (static_cast<Payload *>(kv.value))->payload_num);
+    ASSERT_EQ(static_cast<int>(i % 2), LookupHashTable(pooltable, i, &kv));
+  }
+  FreeHashTable(arenatable, &TestPayloadFree);
+  FreeHashTable(pooltable, &TestPayloadFree);
+  FreeArena(arena);
+  FreePool(pool);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestArena) {
+  HTKeyValue kv, old;
+  uint64_t i;
+
+  // an arena-backed table, with its values in its arena too, grows and
+  // serves lookups like any other
+  HashTable table = AllocateHashTableInArena(2, 4096);
+  ASSERT_NE(static_cast<HashTable>(NULL), table);
+  for (i = 0; i < 1000; i++) {
+    Payload *np =
+      static_cast<Payload *>(HashTableArenaAlloc(table, sizeof(Payload)));
+    ASSERT_NE(static_cast<Payload *>(NULL), np);
+    np->magic_num = 0xDEADBEEF;
+    np->payload_num = static_cast<int>(i);
+    kv.key = i;
+    kv.value = np;
+    ASSERT_EQ(1, InsertHashTable(table, kv, &old));
+  }
+  ASSERT_LT(static_cast<uint64_t>(2), table->num_buckets);
+  for (i = 0; i < 1000; i += 3) {
+    ASSERT_EQ(1, RemoveFromHashTable(table, i, &old));
+  }
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(i % 3 == 0 ? 0 : 1, LookupHashTable(table, i, &kv));
+  }
+
+  // clearing keeps the buckets and makes the table reusable
+  uint64_t num_buckets = table->num_buckets;
+  HashTableClear(table, NULL);
+  ASSERT_EQ(static_cast<uint64_t>(0), NumElementsInHashTable(table));
+  ASSERT_EQ(num_buckets, table->num_buckets);
+  ASSERT_EQ(0, LookupHashTable(table, 1, &kv));
+  for (i = 0; i < 500; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  ASSERT_EQ(1, LookupHashTable(table, 499, &kv));
+  ASSERT_EQ(499, (static_cast<Payload *>(kv.value))->payload_num);
+  HW1Addpoints(10);
+
+  // freeing with a value free function still visits every value
+  num_payload_frees = 0;
+  FreeHashTable(table, &TestPayloadFree);
+  ASSERT_EQ(500U, num_payload_frees);
+
+  // and a regular table can be cleared and reused too
+  table = AllocateHashTable(10);
+  for (i = 0; i < 100; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  num_payload_frees = 0;
+  HashTableClear(table, &TestPayloadFree);
+  ASSERT_EQ(100U, num_payload_frees);
+  ASSERT_EQ(static_cast<uint64_t>(0), NumElementsInHashTable(table));
+  ASSERT_EQ(0, LookupHashTable(table, 1, &kv));
+  ASSERT_EQ(1, InsertTestPayload(table, 1, 1));
+  FreeHashTable(table, &TestPayloadFree);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestPagedPool) {
+  PoolPageMode modes[3] = { POOL_PAGES_DEFAULT, POOL_PAGES_TRANSPARENT,
+                            POOL_PAGES_EXPLICIT };
+  PoolPageStats stats;
+  HTKeyValue kv, old;
+  uint64_t i;
+  int m;
+
+  // a plain pool maps nothing
+  Pool pool = AllocatePool();
+  GetPoolPageStats(pool, &stats);
+  ASSERT_EQ(static_cast<size_t>(0), stats.mapped_bytes);
+  FreePool(pool);
+
+  // whatever the page mode, a table out of a page-backed pool works the
+  // same, and its slabs and bucket array are mapped in whole huge pages
+  for (m = 0; m < 3; m++) {
+    PoolOptions options = { modes[m], POOL_NUMA_DEFAULT, 0 };
+    pool = AllocatePoolWithOptions(&options);
+    ASSERT_NE(static_cast<Pool>(NULL), pool);
+    HashTable table = AllocateHashTableWithAllocator(10000, &kPoolAllocator,
+                                                     pool);
+    ASSERT_NE(static_cast<HashTable>(NULL), table);
+    for (i = 0; i < 50000; i++) {
+      ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+    }
+    for (i = 0; i < 50000; i += 2) {
+      ASSERT_EQ(1, RemoveFromHashTable(table, i, &old));
+      TestPayloadFree(old.value);
+    }
+    for (i = 0; i < 50000; i++) {
+      ASSERT_EQ(static_cast<int>(i % 2), LookupHashTable(table, i, &kv));
+    }
+    GetPoolPageStats(pool, &stats);
+    ASSERT_LT(static_cast<size_t>(0), stats.mapped_bytes);
+    ASSERT_EQ(static_cast<size_t>(0), stats.mapped_bytes % (2*1024*1024));
+    ASSERT_GE(stats.mapped_bytes, stats.hugetlb_bytes + stats.madvised_bytes);
+    if (modes[m] == POOL_PAGES_DEFAULT) {
+      ASSERT_EQ(static_cast<size_t>(0), stats.hugetlb_bytes);
+      ASSERT_EQ(static_cast<size_t>(0), stats.madvised_bytes);
+    }
+    FreeHashTable(table, &TestPayloadFree);
+    FreePool(pool);
+  }
+  HW1Addpoints(10);
+
+  // interleaving falls back quietly where there's no NUMA support
+  PoolOptions options = { POOL_PAGES_TRANSPARENT, POOL_NUMA_INTERLEAVE, 0 };
+  pool = AllocatePoolWithOptions(&options);
+  ASSERT_NE(static_cast<Pool>(NULL), pool);
+  HashTable table = AllocateHashTableWithAllocator(100000, &kPoolAllocator,
+                                                   pool);
+  ASSERT_NE(static_cast<HashTable>(NULL), table);
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  ASSERT_EQ(1, LookupHashTable(table, 999, &kv));
+  ASSERT_EQ(999, (static_cast<Payload *>(kv.value))->payload_num);
+  GetPoolPageStats(pool, &stats);
+  ASSERT_LE(stats.numa_bytes, stats.mapped_bytes);
+  FreeHashTable(table, &TestPayloadFree);
+  FreePool(pool);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestSized) {
+  HTKeyValue kv, old;
+  uint64_t i, num_buckets;
+
+  // a sized table holds what it was sized for without resizing, only
+  // allocates chains for the buckets it uses, and still grows past that
+  HashTable table = AllocateHashTableSized(3000);
+  ASSERT_NE(static_cast<HashTable>(NULL), table);
+  num_buckets = table->num_buckets;
+  ASSERT_EQ(static_cast<LinkedList>(NULL), table->buckets[0]);
+  for (i = 0; i < 3000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i * num_buckets,
+                                   static_cast<int>(i)));
+  }
+  ASSERT_EQ(num_buckets, table->num_buckets);
+  ASSERT_NE(static_cast<LinkedList>(NULL), table->buckets[0]);
+  ASSERT_EQ(static_cast<LinkedList>(NULL), table->buckets[1]);
+  ASSERT_EQ(0, LookupHashTable(table, 1, &kv));
+  ASSERT_EQ(0, RemoveFromHashTable(table, 1, &old));
+  for (i = 3000; i < 10000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i + (1ULL << 40),
+                                   static_cast<int>(i)));
+  }
+  ASSERT_LT(num_buckets, table->num_buckets);
+  for (i = 3000; i < 10000; i += 2) {
+    ASSERT_EQ(1, RemoveFromHashTable(table, i + (1ULL << 40), &old));
+    TestPayloadFree(old.value);
+  }
+  HTIter iter = HashTableMakeIterator(table);
+  for (i = 0; !HTIteratorPastEnd(iter); i++) {
+    ASSERT_EQ(1, HTIteratorGet(iter, &kv));
+    HTIteratorNext(iter);
+  }
+  HTIteratorFree(iter);
+  ASSERT_EQ(static_cast<uint64_t>(6500), i);
+  num_payload_frees = 0;
+  HashTableClear(table, &TestPayloadFree);
+  ASSERT_EQ(6500U, num_payload_frees);
+  ASSERT_EQ(1, InsertTestPayload(table, 7, 7));
+  FreeHashTable(table, &TestPayloadFree);
+  HW1Addpoints(10);
+
+  // more than 2^32 buckets: only the few pages of the bucket array that
+  // are written to are ever committed
+  table = AllocateHashTableSized(3ULL << 32);
+  ASSERT_NE(static_cast<HashTable>(NULL), table);
+  ASSERT_LT(static_cast<uint64_t>(1) << 32, table->num_buckets);
+  const uint64_t keys[4] = { 0, 1ULL << 31, (1ULL << 32) - 1,
+                             table->num_buckets - 1 };
+  for (i = 0; i < 4; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, keys[i], static_cast<int>(i)));
+    ASSERT_EQ(1, InsertTestPayload(table, keys[i] + table->num_buckets,
+                                   static_cast<int>(i)));
+  }
+  ASSERT_EQ(static_cast<uint64_t>(8), NumElementsInHashTable(table));
+  for (i = 0; i < 4; i++) {
+    ASSERT_EQ(1, LookupHashTable(table, keys[i], &kv));
+    ASSERT_EQ(static_cast<int>(i),
+              (static_cast<Payload *>(kv.value))->payload_num);
+    ASSERT_EQ(keys[i], HashKeyToBucketNum(table, keys[i]));
+  }
+  ASSERT_EQ(0, LookupHashTable(table, keys[1] + 1, &kv));
+  ASSERT_EQ(1, RemoveFromHashTable(table, keys[3], &old));
+  TestPayloadFree(old.value);
+
+  // iterating visits the buckets in order, past the 32-bit boundary
+  iter = HashTableMakeIterator(table);
+  ASSERT_NE(static_cast<HTIter>(NULL), iter);
+  uint64_t last = 0;
+  for (i = 0; !HTIteratorPastEnd(iter); i++) {
+    ASSERT_EQ(1, HTIteratorGet(iter, &kv));
+    ASSERT_LE(last, HashKeyToBucketNum(table, kv.key));
+    last = HashKeyToBucketNum(table, kv.key);
+    HTIteratorNext(iter);
+  }
+  HTIteratorFree(iter);
+  ASSERT_EQ(static_cast<uint64_t>(7), i);
+  ASSERT_EQ(table->num_buckets - 1, last);
+  num_payload_frees = 0;
+  FreeHashTable(table, &TestPayloadFree);
+  ASSERT_EQ(7U, num_payload_frees);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestMemoryStats) {
+  HTMemoryStats stats;
+  HTKeyValue old;
+  uint64_t i;
+
+  // a new table is its record, bucket array and empty chains
+  HashTable table = AllocateHashTable(10);
+  HashTableMemoryStats(table, &stats);
+  ASSERT_EQ(static_cast<uint64_t>(10), stats.num_buckets);
+  ASSERT_EQ(static_cast<uint64_t>(10), stats.num_empty_buckets);
+  ASSERT_EQ(10 * sizeof(LinkedList), stats.bucket_array_bytes);
+  ASSERT_EQ(10 * sizeof(LinkedListHead), stats.chain_bytes);
+  ASSERT_EQ(static_cast<uint64_t>(0), stats.node_bytes);
+  ASSERT_EQ(static_cast<uint64_t>(0), stats.entry_bytes);
+  ASSERT_LT(static_cast<uint64_t>(0), stats.overhead_bytes);
+  uint64_t empty_total = stats.total_bytes;
+
+  // every entry costs a node and a key/value record; the empty bucket
+  // count follows inserts, removes and clears
+  for (i = 0; i < 10; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  ASSERT_EQ(1, InsertTestPayload(table, 20, 20));
+  HashTableMemoryStats(table, &stats);
+  ASSERT_EQ(static_cast<uint64_t>(0), stats.num_empty_buckets);
+  ASSERT_EQ(11 * sizeof(LinkedListNode), stats.node_bytes);
+  ASSERT_EQ(11 * sizeof(HTKeyValue), stats.entry_bytes);
+  ASSERT_EQ(stats.record_bytes + stats.bucket_array_bytes +
+            stats.chain_bytes + stats.node_bytes + stats.entry_bytes +
+            stats.overhead_bytes, stats.total_bytes);
+  ASSERT_EQ(1, RemoveFromHashTable(table, 0, &old));
+  TestPayloadFree(old.value);
+  HashTableMemoryStats(table, &stats);
+  ASSERT_EQ(static_cast<uint64_t>(0), stats.num_empty_buckets);
+  ASSERT_EQ(1, RemoveFromHashTable(table, 20, &old));
+  TestPayloadFree(old.value);
+  HashTableMemoryStats(table, &stats);
+  ASSERT_EQ(static_cast<uint64_t>(1), stats.num_empty_buckets);
+  HashTableClear(table, &TestPayloadFree);
+  HashTableMemoryStats(table, &stats);
+  ASSERT_EQ(static_cast<uint64_t>(10), stats.num_empty_buckets);
+  ASSERT_EQ(empty_total, stats.total_bytes);
+
+  // and across a resize
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  HashTableMemoryStats(table, &stats);
+  ASSERT_EQ(table->num_buckets, stats.num_buckets);
+  ASSERT_EQ(table->num_buckets * sizeof(LinkedListHead), stats.chain_bytes);
+  uint64_t empty = 0;
+  for (i = 0; i < table->num_buckets; i++) {
+    empty += (NumElementsInLinkedList(table->buckets[i]) == 0) ? 1 : 0;
+  }
+  ASSERT_EQ(empty, stats.num_empty_buckets);
+  FreeHashTable(table, &TestPayloadFree);
+  HW1Addpoints(10);
+
+  // a sized table only counts the chains and bucket pages it uses
+  table = AllocateHashTableSized(1ULL << 30);
+  ASSERT_NE(static_cast<HashTable>(NULL), table);
+  for (i = 0; i < 3; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  HashTableMemoryStats(table, &stats);
+  ASSERT_EQ(table->num_buckets - 3, stats.num_empty_buckets);
+  ASSERT_EQ(3 * sizeof(LinkedListHead), stats.chain_bytes);
+  ASSERT_GT(static_cast<uint64_t>(1) << 20, stats.bucket_array_bytes);
+  ASSERT_EQ(static_cast<uint64_t>(0), stats.arena_extra_bytes);
+  FreeHashTable(table, &TestPayloadFree);
+  HW1Addpoints(10);
+
+  // an arena-backed table counts everything its arena has handed out,
+  // including what resizes and removes have left stranded in it
+  table = AllocateHashTableInArena(10, 1 << 16);
+  ASSERT_NE(static_cast<HashTable>(NULL), table);
+  HashTableMemoryStats(table, &stats);
+  ASSERT_EQ(static_cast<uint64_t>(0), stats.arena_extra_bytes);
+  uint64_t record_total = stats.total_bytes - ArenaBytesUsed(table->arena);
+  ASSERT_LT(stats.record_bytes, record_total);
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  ASSERT_LT(static_cast<uint64_t>(10), table->num_buckets);
+  HashTableMemoryStats(table, &stats);
+  ASSERT_LT(10 * sizeof(LinkedListHead) + 10 * sizeof(LinkedList),
+            stats.arena_extra_bytes);
+  ASSERT_EQ(record_total + ArenaBytesUsed(table->arena), stats.total_bytes);
+  uint64_t resized_total = stats.total_bytes;
+  for (i = 0; i < 1000; i += 2) {
+    ASSERT_EQ(1, RemoveFromHashTable(table, i, &old));
+    TestPayloadFree(old.value);
+  }
+  HashTableMemoryStats(table, &stats);
+  ASSERT_EQ(500 * sizeof(HTKeyValue), stats.entry_bytes);
+  ASSERT_LE(resized_total, stats.total_bytes);
+  ASSERT_EQ(record_total + ArenaBytesUsed(table->arena), stats.total_bytes);
+
+  // iterating over it takes nothing from the arena
+  size_t arena_used = ArenaBytesUsed(table->arena);
+  for (int pass = 0; pass < 10; pass++) {
+    HTIter iter = HashTableMakeIterator(table);
+    ASSERT_NE(static_cast<HTIter>(NULL), iter);
+    for (i = 0; !HTIteratorPastEnd(iter); i++) {
+      HTIteratorNext(iter);
+    }
+    ASSERT_EQ(static_cast<uint64_t>(500), i);
+    HTIteratorFree(iter);
+  }
+  ASSERT_EQ(arena_used, ArenaBytesUsed(table->arena));
+  FreeHashTable(table, &TestPayloadFree);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestStats) {
+  HTStats stats;
+  HTKeyValue kv, old;
+  uint64_t i;
+
+  // a table doesn't keep statistics until asked to
+  HashTable table = AllocateHashTable(4);
+  ASSERT_FALSE(HashTableGetStats(table, &stats));
+  for (i = 0; i < 8; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  ASSERT_TRUE(HashTableEnableStats(table));
+  ASSERT_TRUE(HashTableEnableStats(table));
+  ASSERT_TRUE(HashTableGetStats(table, &stats));
+  ASSERT_EQ(static_cast<uint64_t>(0), stats.lookups_hit);
+  ASSERT_EQ(static_cast<uint64_t>(4), stats.chain_hist[2]);
+  ASSERT_EQ(static_cast<uint64_t>(2), stats.max_chain_length);
+
+  // lookups count the keys they compare, for hits and misses apart
+  ASSERT_EQ(1, LookupHashTable(table, 0, &kv));  // first in its chain
+  ASSERT_EQ(1, LookupHashTable(table, 4, &kv));  // second
+  ASSERT_EQ(0, LookupHashTable(table, 8, &kv));  // compares 0 and 4
+  ASSERT_TRUE(HashTableGetStats(table, &stats));
+  ASSERT_EQ(static_cast<uint64_t>(2), stats.lookups_hit);
+  ASSERT_EQ(static_cast<uint64_t>(3), stats.probes_hit);
+  ASSERT_EQ(static_cast<uint64_t>(1), stats.probe_hist_hit[1]);
+  ASSERT_EQ(static_cast<uint64_t>(1), stats.probe_hist_hit[2]);
+  ASSERT_EQ(static_cast<uint64_t>(1), stats.lookups_miss);
+  ASSERT_EQ(static_cast<uint64_t>(2), stats.probes_miss);
+  ASSERT_EQ(static_cast<uint64_t>(2), stats.max_probes);
+
+  // the chain-length histogram follows inserts and removes
+  ASSERT_EQ(1, InsertTestPayload(table, 8, 8));
+  ASSERT_EQ(1, RemoveFromHashTable(table, 1, &old));
+  TestPayloadFree(old.value);
+  ASSERT_TRUE(HashTableGetStats(table, &stats));
+  ASSERT_EQ(static_cast<uint64_t>(1), stats.chain_hist[1]);
+  ASSERT_EQ(static_cast<uint64_t>(2), stats.chain_hist[2]);
+  ASSERT_EQ(static_cast<uint64_t>(1), stats.chain_hist[3]);
+  ASSERT_EQ(static_cast<uint64_t>(3), stats.max_chain_length);
+  HW1Addpoints(10);
+
+  // resizes are counted and timed, and the histogram is rebuilt
+  for (i = 100; i < 200; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  ASSERT_TRUE(HashTableGetStats(table, &stats));
+  ASSERT_LE(static_cast<uint64_t>(1), stats.num_resizes);
+  ASSERT_LE(stats.max_resize_ns, stats.resize_ns);
+  uint64_t total = 0, entries = 0;
+  for (i = 0; i < HT_STATS_SLOTS; i++) {
+    total += stats.chain_hist[i];
+    entries += i * stats.chain_hist[i];
+  }
+  ASSERT_EQ(table->num_buckets, total);
+  ASSERT_EQ(NumElementsInHashTable(table), entries);
+
+  // and the dumps
+  char buf[4096];
+  FILE *f = fmemopen(buf, sizeof(buf), "w");
+  ASSERT_NE(static_cast<FILE *>(NULL), f);
+  ASSERT_TRUE(HTStatsWriteJSON(&stats, f));
+  fclose(f);
+  ASSERT_EQ(buf, strstr(buf, "{\"lookups_hit\": 2, \"lookups_miss\": 1, "));
+  ASSERT_NE(static_cast<char *>(NULL),
+            strstr(buf, "\"probe_hist_hit\": [0, 1, 1, 0,"));
+  ASSERT_EQ('}', buf[strlen(buf) - 2]);
+  f = fmemopen(buf, sizeof(buf), "w");
+  ASSERT_TRUE(HTStatsWriteText(&stats, f));
+  fclose(f);
+  ASSERT_NE(static_cast<char *>(NULL), strstr(buf, "lookups: 2 hits"));
+  HashTableClear(table, &TestPayloadFree);
+  ASSERT_TRUE(HashTableGetStats(table, &stats));
+  ASSERT_EQ(table->num_buckets, stats.chain_hist[0]);
+  FreeHashTable(table, &TestPayloadFree);
+  HW1Addpoints(10);
+}
+
+// a list payload free function that does nothing
+static void NoOpFree(void *payload) { }
+
+// pushes 100 elements onto a list and frees it, on its own thread
+static void *TelemetryThread(void *arg) {
+  LinkedList ll = AllocateLinkedList();
+  for (int i = 0; i < 100; i++) {
+    PushLinkedList(ll, arg);
+  }
+  FreeLinkedList(ll, &NoOpFree);
+  return NULL;
+}
+
+TEST_F(Test_HashTable, HTSTestTelemetry) {
+  TelemetrySnapshot before, after;
+  HTKeyValue kv, old;
+  uint64_t i;
+
+  // counts are process-wide, so look at how they change
+  GetTelemetrySnapshot(&before);
+  HashTable table = AllocateHashTable(100);
+  for (i = 0; i < 10; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  for (i = 0; i < 15; i++) {
+    LookupHashTable(table, i, &kv);
+  }
+  for (i = 0; i < 3; i++) {
+    ASSERT_EQ(1, RemoveFromHashTable(table, i, &old));
+    TestPayloadFree(old.value);
+  }
+  GetTelemetrySnapshot(&after);
+  ASSERT_EQ(10U, after.counts[TM_HT_INSERTS] - before.counts[TM_HT_INSERTS]);
+  ASSERT_EQ(10U, after.counts[TM_HT_LOOKUP_HITS] -
+                 before.counts[TM_HT_LOOKUP_HITS]);
+  ASSERT_EQ(5U, after.counts[TM_HT_LOOKUP_MISSES] -
+                before.counts[TM_HT_LOOKUP_MISSES]);
+  ASSERT_EQ(3U, after.counts[TM_HT_REMOVES] - before.counts[TM_HT_REMOVES]);
+  ASSERT_EQ(10U, after.counts[TM_LL_INSERTS] - before.counts[TM_LL_INSERTS]);
+  ASSERT_EQ(3U, after.counts[TM_LL_REMOVES] - before.counts[TM_LL_REMOVES]);
+  ASSERT_LE(102U + 20U, after.counts[TM_ALLOCATIONS] -
+                        before.counts[TM_ALLOCATIONS]);
+
+  // a resize counts once, and doesn't count the entries it moves
+  for (i = 10; i < 400; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  GetTelemetrySnapshot(&after);
+  ASSERT_EQ(1U, after.counts[TM_HT_RESIZES] - before.counts[TM_HT_RESIZES]);
+  ASSERT_EQ(400U, after.counts[TM_HT_INSERTS] - before.counts[TM_HT_INSERTS]);
+  FreeHashTable(table, &TestPayloadFree);
+
+  // counts from threads that have exited are kept
+  pthread_t thread;
+  GetTelemetrySnapshot(&before);
+  ASSERT_EQ(0, pthread_create(&thread, NULL, &TelemetryThread, &old));
+  ASSERT_EQ(0, pthread_join(thread, NULL));
+  GetTelemetrySnapshot(&after);
+  ASSERT_EQ(100U, after.counts[TM_LL_INSERTS] - before.counts[TM_LL_INSERTS]);
+  HW1Addpoints(10);
+
+  // the Prometheus exports, to a file and over a socket
+  char path[64], buf[8192], line[128];
+  snprintf(path, sizeof(path), "/tmp/hw1_telemetry_%d.prom", getpid());
+  ASSERT_TRUE(ExportTelemetryToFile(path));
+  FILE *f = fopen(path, "r");
+  ASSERT_NE(static_cast<FILE *>(NULL), f);
+  size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+  buf[len] = '\0';
+  fclose(f);
+  unlink(path);
+  ASSERT_NE(static_cast<char *>(NULL),
+            strstr(buf, "# TYPE hw1_hashtable_lookups_total counter\n"));
+  GetTelemetrySnapshot(&after);
+  snprintf(line, sizeof(line), "\nhw1_linkedlist_inserts_total %llu\n",
+           static_cast<unsigned long long>(after.counts[TM_LL_INSERTS]));
+  ASSERT_NE(static_cast<char *>(NULL), strstr(buf, line));
+
+  snprintf(path, sizeof(path), "/tmp/hw1_telemetry_%d.sock", getpid());
+  TelemetryServer server = StartTelemetryServer(path);
+  ASSERT_NE(static_cast<TelemetryServer>(NULL), server);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  ASSERT_EQ(0, connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                       sizeof(addr)));
+  len = 0;
+  ssize_t res;
+  while ((res = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+    len += res;
+  }
+  buf[len] = '\0';
+  close(fd);
+
+  // clients that hang up without reading must not take the process
+  // down with SIGPIPE, nor stop the server answering the next one
+  for (int i = 0; i < 200; i++) {
+    int quitter = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_LE(0, quitter);
+    ASSERT_EQ(0, connect(quitter,
+                         reinterpret_cast<struct sockaddr *>(&addr),
+                         sizeof(addr)));
+    close(quitter);
+  }
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(0, connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                       sizeof(addr)));
+  char again[8192];
+  size_t again_len = 0;
+  while ((res = read(fd, again + again_len,
+                     sizeof(again) - 1 - again_len)) > 0) {
+    again_len += res;
+  }
+  again[again_len] = '\0';
+  close(fd);
+  ASSERT_NE(static_cast<char *>(NULL),
+            strstr(again, "# TYPE hw1_hashtable_lookups_total counter\n"));
+  StopTelemetryServer(server);
+  ASSERT_NE(0, access(path, F_OK));
+  ASSERT_NE(static_cast<char *>(NULL),
+            strstr(buf, "hw1_hashtable_lookups_total{result=\"hit\"} "));
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestFlightRecorder) {
+  FlightRecord records[FR_RING_SIZE], mine[FR_RING_SIZE];
+  HTKeyValue kv, old;
+  uint32_t tid = static_cast<uint32_t>(syscall(SYS_gettid));
+  size_t i, n, num_mine;
+
+  // record every operation, and call chains of 4 or more long.  Every
+  // key goes in bucket 0, both before and after the table resizes from
+  // 1 bucket to 9 on the fourth insert.
+  StartFlightRecorder(0, 4);
+  ASSERT_LT(0U, FlightRecorderCyclesPerUs());
+  HashTable table = AllocateHashTable(1);
+  for (i = 0; i < 8; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, 9 * i, static_cast<int>(i)));
+  }
+  ASSERT_EQ(0, LookupHashTable(table, 9 * 100, &kv));
+  ASSERT_EQ(1, RemoveFromHashTable(table, 0, &old));
+  TestPayloadFree(old.value);
+
+  // once stopped, or under a threshold, nothing is recorded
+  StopFlightRecorder();
+  ASSERT_EQ(1, LookupHashTable(table, 9, &kv));
+  StartFlightRecorder(1000000000ULL, 4);
+  ASSERT_EQ(1, LookupHashTable(table, 18, &kv));
+  StopFlightRecorder();
+
+  n = GetFlightRecords(records, FR_RING_SIZE);
+  for (i = 0, num_mine = 0; i < n; i++) {
+    if (records[i].thread == tid)
+      mine[num_mine++] = records[i];
+  }
+  ASSERT_EQ(10U, num_mine);
+  for (i = 0; i < 8; i++) {
+    ASSERT_EQ(FR_HT_INSERT, mine[i].op);
+    ASSERT_EQ(9 * i, mine[i].key);
+    ASSERT_EQ(i + 1, mine[i].chain_length);
+    ASSERT_EQ(i == 3, (mine[i].flags & FR_RESIZED) != 0);
+    ASSERT_EQ(i + 1 >= 4, (mine[i].flags & FR_LONG_CHAIN) != 0);
+    if (i > 0) {
+      ASSERT_LE(mine[i - 1].timestamp, mine[i].timestamp);
+    }
+  }
+  ASSERT_EQ(FR_HT_LOOKUP, mine[8].op);
+  ASSERT_EQ(900U, mine[8].key);
+  ASSERT_EQ(8U, mine[8].chain_length);
+  ASSERT_EQ(FR_LONG_CHAIN, mine[8].flags);
+  ASSERT_EQ(FR_HT_REMOVE, mine[9].op);
+  ASSERT_EQ(0U, mine[9].key);
+  ASSERT_EQ(7U, mine[9].chain_length);
+  FreeHashTable(table, &TestPayloadFree);
+  HW1Addpoints(10);
+
+  // dumps, on demand and on a signal
+  char buf[8192];
+  int fds[2];
+  ssize_t len;
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_TRUE(DumpFlightRecorder(fds[1]));
+  len = read(fds[0], buf, sizeof(buf) - 1);
+  ASSERT_LT(0, len);
+  buf[len] = '\0';
+  ASSERT_EQ(0, strncmp(buf, "flight recorder: ", 17));
+  ASSERT_NE(static_cast<char *>(NULL),
+            strstr(buf, " ht_insert key 0x1b took "));
+  ASSERT_NE(static_cast<char *>(NULL),
+            strstr(buf, " chain 4 resized long_chain\n"));
+  ASSERT_NE(static_cast<char *>(NULL), strstr(buf, " ht_remove key 0x0 took "));
+
+  ASSERT_TRUE(DumpFlightRecorderOnSignal(SIGUSR1, fds[1]));
+  ASSERT_EQ(0, raise(SIGUSR1));
+  signal(SIGUSR1, SIG_DFL);
+  char buf2[8192];
+  ASSERT_EQ(len, read(fds[0], buf2, sizeof(buf2)));
+  ASSERT_EQ(0, memcmp(buf, buf2, len));
+  close(fds[0]);
+  close(fds[1]);
+  HW1Addpoints(10);
+}
+
+// a payload free function that may be called from several threads
+static uint64_t num_concurrent_frees = 0;
+static void ConcurrentPayloadFree(void *payload) {
+  __atomic_fetch_add(&num_concurrent_frees, 1, __ATOMIC_RELAXED);
+  free(payload);
+}
+
+TEST_F(Test_HashTable, HTSTestReclaim) {
+  HashTable table;
+  uint64_t i;
+
+  // one reclaimer thread
+  table = AllocateHashTable(10);
+  for (i = 0; i < 10000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  num_payload_frees = 0;
+  HTReclaim reclaim = FreeHashTableAsync(table, &TestPayloadFree, 1);
+  ASSERT_NE(static_cast<HTReclaim>(NULL), reclaim);
+  HTReclaimWait(reclaim);
+  ASSERT_EQ(10000U, num_payload_frees);
+  HW1Addpoints(10);
+
+  // several, splitting the buckets between them
+  table = AllocateHashTable(10);
+  for (i = 0; i < 100000; i++) {
+    ASSERT_EQ(1, InsertTestPayload(table, i, static_cast<int>(i)));
+  }
+  ASSERT_LT(static_cast<uint64_t>(4096 * 4), table->num_buckets);
+  num_concurrent_frees = 0;
+  reclaim = FreeHashTableAsync(table, &ConcurrentPayloadFree, 4);
+  ASSERT_NE(static_cast<HTReclaim>(NULL), reclaim);
+  while (!HTReclaimIsDone(reclaim)) {
+    usleep(1000);
+  }
+  ASSERT_EQ(static_cast<uint64_t>(100000), num_concurrent_frees);
+  HTReclaimWait(reclaim);
+
+  // an empty table, and an arena-backed table freed without a value
+  // free function
+  reclaim = FreeHashTableAsync(AllocateHashTable(1), &TestPayloadFree, 8);
+  HTReclaimWait(reclaim);
+  table = AllocateHashTableInArena(10, 4096);
+  for (i = 0; i < 1000; i++) {
+    HTKeyValue kv, old;
+    kv.key = i;
+    kv.value = HashTableArenaAlloc(table, 8);
+    ASSERT_EQ(1, InsertHashTable(table, kv, &old));
+  }
+  reclaim = FreeHashTableAsync(table, NULL, 4);
+  HTReclaimWait(reclaim);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_HashTable, HTSTestFreeze) {
+  HTKeyValue old, newkv;
+  uint64_t i;
+
+  // freezing an empty table gives an empty frozen table
+  HashTable table = AllocateHashTable(3);
+  FrozenHashTable ft = HashTableFreeze(table);
+  ASSERT_NE(static_cast<FrozenHashTable>(NULL), ft);
+  ASSERT_EQ(static_cast<uint64_t>(0), NumElementsInFrozenHashTable(ft));
+  ASSERT_EQ(0, LookupFrozenHashTable(ft, 0, &old));
+  FreeFrozenHashTable(ft, &TestPayloadFree);
+
+  // freeze a table with a bunch of (sparse) keys
+  table = AllocateHashTable(3);
+  for (i = 0; i < 10000; i++) {
+    Payload *np = static_cast<Payload *>(malloc(sizeof(Payload)));
+    assert(np != NULL);
+    np->magic_num = 0xDEADBEEF;
+    np->payload_num = static_cast<int>(i);
+    newkv.key = FNVHashInt64(i);
+    newkv.value = static_cast<void *>(np);
+    ASSERT_EQ(1, InsertHashTable(table, newkv, &old));
+  }
+  ft = HashTableFreeze(table);
+  ASSERT_NE(static_cast<FrozenHashTable>(NULL), ft);
+  ASSERT_EQ(static_cast<uint64_t>(10000), NumElementsInFrozenHashTable(ft));
+  HW1Addpoints(10);
+
+  // every key is found in its slot, and nothing else is
+  for (i = 0; i < 10000; i++) {
+    ASSERT_EQ(1, LookupFrozenHashTable(ft, FNVHashInt64(i), &old));
+    ASSERT_EQ(FNVHashInt64(i), old.key);
+    ASSERT_EQ(static_cast<int>(i),
+              (static_cast<Payload *>(old.value))->payload_num);
+    ASSERT_EQ(0, LookupFrozenHashTable(ft, FNVHashInt64(i + 10000), &old));
+  }
+
+  // the perfect hash function should cost about 3 bits per key
+  ASSERT_GT(3.5, static_cast<double>(FrozenHashTableIndexBits(ft)) / 10000);
+  HW1Addpoints(10);
+
+  // free the frozen table, which now owns the values
+  num_payload_frees = 0;
+  FreeFrozenHashTable(ft, &TestPayloadFree);
+  ASSERT_EQ(10000U, num_payload_frees);
+}
+
 }  // namespace hw1
@@ -19,13 +19,23 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/select.h>
 
 extern "C" {
   #include "./LinkedList.h"
   #include "./LinkedList_priv.h"
+  #include "./LinkedListExternalSort.h"
+  #include "./LinkedListKeyIndex.h"
+  #include "./PostingList.h"
+  #include "./PostingList_priv.h"
+  #include "./UnrolledList.h"
+  #include "./UnrolledList_priv.h"
 }
 
 #include "./test_suite.h"
@@ -48,6 +58,47 @@ void PayloadFreeFunction(void *payload) {
   free_count++;
 }
 
+// a malloc-backed allocator that counts what passes through it; its
+// context is a CountingAllocatorStats.
+typedef struct {
+  uint64_t num_allocs;
+  uint64_t num_deallocs;
+  uint64_t bytes_outstanding;
+} CountingAllocatorStats;
+
+static void *CountingAlloc(void *context, size_t size) {
+  CountingAllocatorStats *stats =
+    static_cast<CountingAllocatorStats *>(context);
+  stats->num_allocs++;
+  stats->bytes_outstanding += size;
+  return malloc(size);
+}
+
+static void CountingDealloc(void *context, void *ptr, size_t size) {
+  CountingAllocatorStats *stats =
+    static_cast<CountingAllocatorStats *>(context);
+  stats->num_deallocs++;
+  stats->bytes_outstanding -= size;
+  free(ptr);
+}
+
+static const Allocator kCountingAllocator = { &CountingAlloc,
+                                              &CountingDealloc };
+
+// a thread that builds a slab-allocated list of 1000 nodes, frees it,
+// and exits, leaving its nodes on its free list.
+static void *SlabThread(void *arg) {
+  LinkedList llp = AllocateLinkedListWithAllocator(&kLLNodeSlabAllocator,
+                                                   NULL);
+  for (int i = 0; llp != NULL && i < 1000; i++) {
+    if (!PushLinkedList(llp, arg))
+      return NULL;
+  }
+  if (llp != NULL)
+    FreeLinkedList(llp, &PayloadFreeFunction);
+  return arg;
+}
+
 int TestPayloadComparator(void *p1, void *p2) {
   // A comparator used to test sort.
   uint64_t i1 = *reinterpret_cast<uint64_t*>(p1);
@@ -364,4 +415,1244 @@ TEST_F(Test_LinkedList, TestLLIteratorBasic) {
   FreeLinkedList(llp, &PayloadFreeFunction);
 }
 
+TEST_F(Test_LinkedList, TestLinkedListAllocator) {
+  CountingAllocatorStats stats = { 0, 0, 0 };
+  void *payload;
+
+  // the list record comes from the allocator
+  LinkedList llp = AllocateLinkedListWithAllocator(&kCountingAllocator,
+                                                   &stats);
+  ASSERT_NE((LinkedList) NULL, llp);
+  ASSERT_EQ(1U, stats.num_allocs);
+  ASSERT_EQ(sizeof(LinkedListHead), stats.bytes_outstanding);
+
+  // ...as do its nodes and iterators
+  ASSERT_TRUE(PushLinkedList(llp, &kOne));
+  ASSERT_TRUE(AppendLinkedList(llp, &kTwo));
+  ASSERT_TRUE(AppendLinkedList(llp, &kThree));
+  ASSERT_EQ(4U, stats.num_allocs);
+  LLIter lli = LLMakeIterator(llp, 1);
+  ASSERT_NE((LLIter) NULL, lli);
+  ASSERT_EQ(5U, stats.num_allocs);
+  ASSERT_TRUE(LLIteratorInsertBefore(lli, &kFour));
+  ASSERT_EQ(6U, stats.num_allocs);
+  ASSERT_EQ(sizeof(LinkedListHead) + 4 * sizeof(LinkedListNode) +
+            sizeof(LLIterSt), stats.bytes_outstanding);
+  HW1Addpoints(10);
+
+  // and everything goes back to it
+  free_count = 0;
+  ASSERT_TRUE(LLIteratorDelete(lli, &PayloadFreeFunction));
+  LLIteratorFree(lli);
+  ASSERT_TRUE(PopLinkedList(llp, &payload));
+  ASSERT_TRUE(SliceLinkedList(llp, &payload));
+  ASSERT_EQ(4U, stats.num_deallocs);
+  FreeLinkedList(llp, &PayloadFreeFunction);
+  ASSERT_EQ(2U, free_count);
+  ASSERT_EQ(stats.num_allocs, stats.num_deallocs);
+  ASSERT_EQ(0U, stats.bytes_outstanding);
+
+  // the same list operations work out of an arena and a pool
+  Arena arena = AllocateArena(4096);
+  ASSERT_NE((Arena) NULL, arena);
+  Pool pool = AllocatePool();
+  ASSERT_NE((Pool) NULL, pool);
+  LinkedList arenall = AllocateLinkedListWithAllocator(&kArenaAllocator,
+                                                       arena);
+  LinkedList poolll = AllocateLinkedListWithAllocator(&kPoolAllocator, pool);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(AppendLinkedList(arenall, &kFive));
+    ASSERT_TRUE(AppendLinkedList(poolll, &kFive));
+    if (i % 2 == 0) {
+      ASSERT_TRUE(PopLinkedList(poolll, &payload));
+    }
+  }
+  ASSERT_EQ(1000U, NumElementsInLinkedList(arenall));
+  ASSERT_EQ(500U, NumElementsInLinkedList(poolll));
+  ASSERT_LE(sizeof(LinkedListHead) + 1000 * sizeof(LinkedListNode),
+            ArenaBytesUsed(arena));
+  FreeLinkedList(arenall, &PayloadFreeFunction);
+  FreeLinkedList(poolll, &PayloadFreeFunction);
+  FreeArena(arena);
+  FreePool(pool);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_LinkedList, TestLinkedListSlab) {
+  void *payload;
+  uint64_t nfree;
+
+  LinkedList llp = AllocateLinkedListWithAllocator(&kLLNodeSlabAllocator,
+                                                   NULL);
+  ASSERT_NE((LinkedList) NULL, llp);
+
+  // a popped node goes on this thread's free list, and the next push
+  // takes it straight back off
+  ASSERT_TRUE(PushLinkedList(llp, &kOne));
+  LinkedListNodePtr node = llp->head;
+  nfree = LLNodeSlabNumFree();
+  ASSERT_TRUE(PopLinkedList(llp, &payload));
+  ASSERT_EQ(nfree + 1, LLNodeSlabNumFree());
+  ASSERT_TRUE(AppendLinkedList(llp, &kTwo));
+  ASSERT_EQ(node, llp->head);
+  ASSERT_EQ(nfree, LLNodeSlabNumFree());
+  HW1Addpoints(10);
+
+  // freeing a list returns all of its nodes at once, to this thread's
+  // free list if they fit under its cap and to the spare list if not,
+  // and either way they are reused by the next list
+  for (int i = 0; i < 999; i++) {
+    ASSERT_TRUE(AppendLinkedList(llp, &kThree));
+  }
+  nfree = LLNodeSlabNumFree() + LLNodeSlabNumSpare();
+  uint64_t bytes = LLNodeSlabBytes();
+  free_count = 0;
+  FreeLinkedList(llp, &PayloadFreeFunction);
+  ASSERT_EQ(1000U, free_count);
+  ASSERT_EQ(nfree + 1000, LLNodeSlabNumFree() + LLNodeSlabNumSpare());
+  ASSERT_GE(static_cast<uint64_t>(LL_SLAB_MAX_FREE), LLNodeSlabNumFree());
+  llp = AllocateLinkedListWithAllocator(&kLLNodeSlabAllocator, NULL);
+  ASSERT_NE((LinkedList) NULL, llp);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(PushLinkedList(llp, &kFour));
+  }
+  ASSERT_EQ(nfree, LLNodeSlabNumFree() + LLNodeSlabNumSpare());
+  ASSERT_EQ(bytes, LLNodeSlabBytes());
+  LLIter lli = LLMakeIterator(llp, 0);
+  ASSERT_TRUE(LLIteratorNext(lli));
+  ASSERT_TRUE(LLIteratorInsertBefore(lli, &kFive));
+  ASSERT_TRUE(LLIteratorDelete(lli, &PayloadFreeFunction));
+  LLIteratorFree(lli);
+  ASSERT_EQ(1000U, NumElementsInLinkedList(llp));
+  FreeLinkedList(llp, &PayloadFreeFunction);
+
+  // a thread's free nodes outlive it, on the spare list, and another
+  // thread takes a batch of them once its own free list runs dry
+  pthread_t thread;
+  void *result;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, &SlabThread, &kOne));
+  ASSERT_EQ(0, pthread_join(thread, &result));
+  ASSERT_EQ(&kOne, result);
+  uint64_t nspare = LLNodeSlabNumSpare();
+  ASSERT_LE(1000U, nspare);
+  llp = AllocateLinkedListWithAllocator(&kLLNodeSlabAllocator, NULL);
+  nfree = LLNodeSlabNumFree();
+  for (uint64_t i = 0; i <= nfree; i++) {
+    ASSERT_TRUE(PushLinkedList(llp, &kFive));
+  }
+  ASSERT_LT(0U, LLNodeSlabNumFree());
+  ASSERT_LT(0U, LLNodeSlabNumSpare());
+  ASSERT_EQ(nspare, LLNodeSlabNumFree() + LLNodeSlabNumSpare() + 1);
+  FreeLinkedList(llp, &PayloadFreeFunction);
+  HW1Addpoints(10);
+}
+
+// a queue shared by a producer thread, which appends to it, and a
+// consumer thread, which pops from it
+typedef struct {
+  pthread_mutex_t lock;
+  LinkedList      queue;
+  void           *payload;    // what the producer appends
+  uint64_t        num_items;
+  uint64_t        max_free;  // the most free nodes the consumer had
+} SlabQueue;
+
+static void *SlabProducer(void *arg) {
+  SlabQueue *q = static_cast<SlabQueue *>(arg);
+  uint64_t i = 0;
+
+  while (i < q->num_items) {
+    pthread_mutex_lock(&q->lock);
+    if (NumElementsInLinkedList(q->queue) < 1000) {
+      if (!AppendLinkedList(q->queue, q->payload)) {
+        pthread_mutex_unlock(&q->lock);
+        return NULL;
+      }
+      i++;
+    }
+    pthread_mutex_unlock(&q->lock);
+    if (i % 1000 == 0)
+      sched_yield();
+  }
+  return arg;
+}
+
+static void *SlabConsumer(void *arg) {
+  SlabQueue *q = static_cast<SlabQueue *>(arg);
+  uint64_t i = 0;
+  void *payload;
+
+  while (i < q->num_items) {
+    pthread_mutex_lock(&q->lock);
+    if (PopLinkedList(q->queue, &payload))
+      i++;
+    pthread_mutex_unlock(&q->lock);
+    if (LLNodeSlabNumFree() > q->max_free)
+      q->max_free = LLNodeSlabNumFree();
+    if (i % 1000 == 0)
+      sched_yield();
+  }
+  return arg;
+}
+
+TEST_F(Test_LinkedList, TestLinkedListSlabQueue) {
+  SlabQueue q;
+  pthread_t producer, consumer;
+  void *result;
+
+  // one thread allocates every node and another frees every one; the
+  // consumer's free list must stay capped, and hand its nodes back for
+  // the producer to reuse, rather than the producer carving a slab
+  // after slab
+  pthread_mutex_init(&q.lock, NULL);
+  q.queue = AllocateLinkedListWithAllocator(&kLLNodeSlabAllocator, NULL);
+  ASSERT_NE((LinkedList) NULL, q.queue);
+  q.payload = &kOne;
+  q.num_items = 500000;
+  q.max_free = 0;
+  uint64_t bytes = LLNodeSlabBytes();
+  ASSERT_EQ(0, pthread_create(&producer, NULL, &SlabProducer, &q));
+  ASSERT_EQ(0, pthread_create(&consumer, NULL, &SlabConsumer, &q));
+  ASSERT_EQ(0, pthread_join(producer, &result));
+  ASSERT_EQ(&q, result);
+  ASSERT_EQ(0, pthread_join(consumer, &result));
+  ASSERT_EQ(&q, result);
+  ASSERT_EQ(0U, NumElementsInLinkedList(q.queue));
+  ASSERT_GE(static_cast<uint64_t>(LL_SLAB_MAX_FREE), q.max_free);
+
+  // 500000 nodes would take nearly six 2 MB slabs
+  ASSERT_GE(2U * 1024 * 1024, LLNodeSlabBytes() - bytes);
+  FreeLinkedList(q.queue, &PayloadFreeFunction);
+  pthread_mutex_destroy(&q.lock);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_LinkedList, TestLinkedListMemoryStats) {
+  LLMemoryStats stats;
+
+  // an empty list is just its record, plus malloc's overhead on it
+  LinkedList llp = AllocateLinkedList();
+  LinkedListMemoryStats(llp, &stats);
+  ASSERT_EQ(sizeof(LinkedListHead), stats.head_bytes);
+  ASSERT_EQ(0U, stats.node_bytes);
+  ASSERT_LT(0U, stats.overhead_bytes);
+  ASSERT_EQ(stats.head_bytes + stats.overhead_bytes, stats.total_bytes);
+
+  // each element adds a node; the counts follow pushes and pops
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(PushLinkedList(llp, &kFour));
+  }
+  LinkedListMemoryStats(llp, &stats);
+  ASSERT_EQ(100 * sizeof(LinkedListNode), stats.node_bytes);
+  ASSERT_EQ(stats.head_bytes + stats.node_bytes + stats.overhead_bytes,
+            stats.total_bytes);
+  void *payload;
+  ASSERT_TRUE(PopLinkedList(llp, &payload));
+  ASSERT_TRUE(SliceLinkedList(llp, &payload));
+  LinkedListMemoryStats(llp, &stats);
+  ASSERT_EQ(98 * sizeof(LinkedListNode), stats.node_bytes);
+  FreeLinkedList(llp, &PayloadFreeFunction);
+  HW1Addpoints(10);
+
+  // slab nodes are packed back to back, so only the record has overhead
+  llp = AllocateLinkedListWithAllocator(&kLLNodeSlabAllocator, NULL);
+  ASSERT_NE((LinkedList) NULL, llp);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(AppendLinkedList(llp, &kFive));
+  }
+  LinkedListMemoryStats(llp, &stats);
+  ASSERT_EQ(100 * sizeof(LinkedListNode), stats.node_bytes);
+  ASSERT_EQ(LLAllocatorOverhead(&kMallocAllocator, sizeof(LinkedListHead)),
+            stats.overhead_bytes);
+  FreeLinkedList(llp, &PayloadFreeFunction);
+  HW1Addpoints(10);
+}
+
+// a payload for the sort tests: a key to sort on, and its original
+// position in the list, to check stability with.
+typedef struct {
+  uint64_t key;
+  uint64_t seq;
+} SortItem;
+
+// a free function for payloads the list doesn't own
+static void NullFreeFunction(void *payload) { }
+
+// counts its calls, which may come from several threads
+static uint64_t num_sort_compares = 0;
+static int SortItemComparator(void *p1, void *p2) {
+  uint64_t k1 = static_cast<SortItem *>(p1)->key;
+  uint64_t k2 = static_cast<SortItem *>(p2)->key;
+
+  __atomic_fetch_add(&num_sort_compares, 1, __ATOMIC_RELAXED);
+  return (k1 > k2) - (k1 < k2);
+}
+
+// a small, repeatable pseudo-random number generator (xorshift64)
+static uint64_t NextRandom(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// make a list of n SortItems, with random keys in [0, range)
+static LinkedList MakeSortList(SortItem *items, uint64_t n, uint64_t range,
+                               uint64_t *state) {
+  LinkedList llp = AllocateLinkedList();
+  for (uint64_t i = 0; i < n; i++) {
+    items[i].key = NextRandom(state) % range;
+    items[i].seq = i;
+    if (!AppendLinkedList(llp, &items[i]))
+      return NULL;
+  }
+  return llp;
+}
+
+// check that llp holds n SortItems, linked up properly in both
+// directions, sorted, with equal keys in their original order.
+static void CheckSortedList(LinkedList llp, unsigned int ascending,
+                            uint64_t n) {
+  LinkedListNodePtr node, prev = NULL;
+  uint64_t count = 0;
+
+  ASSERT_EQ(n, NumElementsInLinkedList(llp));
+  for (node = llp->head; node != NULL; node = node->next) {
+    ASSERT_EQ(prev, node->prev);
+    if (prev != NULL) {
+      SortItem *a = static_cast<SortItem *>(prev->payload);
+      SortItem *b = static_cast<SortItem *>(node->payload);
+      if (ascending) {
+        ASSERT_LE(a->key, b->key);
+      } else {
+        ASSERT_GE(a->key, b->key);
+      }
+      if (a->key == b->key) {
+        ASSERT_LT(a->seq, b->seq);
+      }
+    }
+    prev = node;
+    count++;
+  }
+  ASSERT_EQ(prev, llp->tail);
+  ASSERT_EQ(n, count);
+}
+
+TEST_F(Test_LinkedList, TestLinkedListMergeSort) {
+  static const uint64_t kSizes[] = { 0, 1, 2, 3, 5, 17, 1000, 1024, 1025 };
+  static const uint64_t kRanges[] = { 8, 1000000 };
+  static SortItem items[1025];
+  uint64_t state = 42;
+
+  // random keys, with and without duplicates, both ways
+  for (uint64_t r = 0; r < 2; r++) {
+    for (uint64_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); s++) {
+      uint64_t n = kSizes[s];
+      LinkedList llp = MakeSortList(items, n, kRanges[r], &state);
+      ASSERT_NE((LinkedList) NULL, llp);
+      num_sort_compares = 0;
+      SortLinkedList(llp, 1, &SortItemComparator);
+      CheckSortedList(llp, 1, n);
+      if (n == 1024) {
+        // n log n comparisons, not n^2
+        ASSERT_GE(1024U * 10, num_sort_compares);
+      }
+
+      // re-sorting descending keeps equal keys in the same order
+      SortLinkedList(llp, 0, &SortItemComparator);
+      CheckSortedList(llp, 0, n);
+      FreeLinkedList(llp, &NullFreeFunction);
+    }
+  }
+  HW1Addpoints(10);
+
+  // an iterator stays with its node, and so with its payload
+  LinkedList llp = MakeSortList(items, 100, 1000, &state);
+  ASSERT_NE((LinkedList) NULL, llp);
+  LLIter iter = LLMakeIterator(llp, 0);
+  ASSERT_TRUE(LLIteratorNext(iter));
+  SortItem *payload;
+  LLIteratorGetPayload(iter, reinterpret_cast<void **>(&payload));
+  ASSERT_EQ(1U, payload->seq);
+  SortLinkedList(llp, 1, &SortItemComparator);
+  SortItem *after;
+  LLIteratorGetPayload(iter, reinterpret_cast<void **>(&after));
+  ASSERT_EQ(payload, after);
+  LLIteratorFree(iter);
+  CheckSortedList(llp, 1, 100);
+  FreeLinkedList(llp, &NullFreeFunction);
+  HW1Addpoints(10);
+}
+
+// check that two lists hold the same payloads in the same order
+static void CheckSameOrder(LinkedList l1, LinkedList l2) {
+  LinkedListNodePtr n1, n2;
+
+  ASSERT_EQ(NumElementsInLinkedList(l1), NumElementsInLinkedList(l2));
+  n2 = l2->head;
+  for (n1 = l1->head; n1 != NULL; n1 = n1->next) {
+    ASSERT_EQ(n1->payload, n2->payload);
+    n2 = n2->next;
+  }
+}
+
+TEST_F(Test_LinkedList, TestLinkedListParallelSort) {
+  // 60000 elements are enough to give each of 7 threads a share.
+  static SortItem items[60000];
+  static const int kThreads[] = { 1, 2, 3, 7 };
+  static const uint64_t kRanges[] = { 8, 1000000 };
+  uint64_t state = 7;
+
+  for (uint64_t r = 0; r < 2; r++) {
+    for (uint64_t n = 100; n <= 60000; n *= 600) {
+      for (int t = 0; t < 4; t++) {
+        // both directions, over the thread counts
+        unsigned int ascending = (t + r) % 2;
+        LinkedList expected = MakeSortList(items, n, kRanges[r], &state);
+        ASSERT_NE((LinkedList) NULL, expected);
+        LinkedList llp = AllocateLinkedList();
+        for (uint64_t i = 0; i < n; i++) {
+          ASSERT_TRUE(AppendLinkedList(llp, &items[i]));
+        }
+
+        // exactly the same order as SortLinkedList gives
+        SortLinkedList(expected, ascending, &SortItemComparator);
+        SortLinkedListParallel(llp, ascending, &SortItemComparator,
+                               kThreads[t]);
+        CheckSortedList(llp, ascending, n);
+        CheckSameOrder(expected, llp);
+        FreeLinkedList(expected, &NullFreeFunction);
+        FreeLinkedList(llp, &NullFreeFunction);
+      }
+    }
+  }
+  HW1Addpoints(10);
+}
+
+// fill in the keys of n SortItems in one of several patterns: random,
+// sorted, reversed, sorted but for 1 in 100, runs of 1000 that go up
+// and down in turn, or two sorted halves, the larger first.
+static void FillSortKeys(SortItem *items, uint64_t n, int pattern,
+                         uint64_t *state) {
+  for (uint64_t i = 0; i < n; i++) {
+    switch (pattern) {
+      case 0: items[i].key = NextRandom(state) % 1000; break;
+      case 1: items[i].key = i / 3; break;
+      case 2: items[i].key = n - i / 3; break;
+      case 3: items[i].key = (NextRandom(state) % 100 == 0) ?
+                             NextRandom(state) % n : i; break;
+      case 4: items[i].key = ((i / 1000) % 2 == 0) ?
+                             i % 1000 : 1000 - i % 1000; break;
+      default: items[i].key = (i < n / 2) ? i + n / 2 : i - n / 2;
+    }
+    items[i].seq = i;
+  }
+}
+
+TEST_F(Test_LinkedList, TestLinkedListAdaptiveSort) {
+  static const uint64_t kSizes[] = { 0, 1, 2, 3, 31, 64, 65, 1000, 20000 };
+  static SortItem items[100000];
+  uint64_t state = 11;
+
+  // the same order as SortLinkedList, on every pattern
+  for (int pattern = 0; pattern < 6; pattern++) {
+    for (uint64_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); s++) {
+      for (unsigned int ascending = 0; ascending < 2; ascending++) {
+        uint64_t n = kSizes[s];
+        FillSortKeys(items, n, pattern, &state);
+        LinkedList expected = AllocateLinkedList();
+        LinkedList llp = AllocateLinkedList();
+        for (uint64_t i = 0; i < n; i++) {
+          ASSERT_TRUE(AppendLinkedList(expected, &items[i]));
+          ASSERT_TRUE(AppendLinkedList(llp, &items[i]));
+        }
+        SortLinkedList(expected, ascending, &SortItemComparator);
+        SortLinkedListAdaptive(llp, ascending, &SortItemComparator);
+        CheckSortedList(llp, ascending, n);
+        CheckSameOrder(expected, llp);
+        FreeLinkedList(expected, &NullFreeFunction);
+        FreeLinkedList(llp, &NullFreeFunction);
+      }
+    }
+  }
+  HW1Addpoints(10);
+
+  // nearly sorted lists take close to n comparisons: a sorted list
+  // takes n - 1, a few out of place don't take many more, and merging
+  // two long runs takes a few more besides, by galloping.
+  static const int kNearlySorted[] = { 1, 3, 5 };
+  static const uint64_t kMaxCompares[] = { 99999, 200000, 100100 };
+  for (int p = 0; p < 3; p++) {
+    FillSortKeys(items, 100000, kNearlySorted[p], &state);
+    LinkedList llp = AllocateLinkedList();
+    for (uint64_t i = 0; i < 100000; i++) {
+      ASSERT_TRUE(AppendLinkedList(llp, &items[i]));
+    }
+    num_sort_compares = 0;
+    SortLinkedListAdaptive(llp, 1, &SortItemComparator);
+    CheckSortedList(llp, 1, 100000);
+    ASSERT_GE(kMaxCompares[p], num_sort_compares);
+    FreeLinkedList(llp, &NullFreeFunction);
+  }
+
+  // a sorted list isn't sorted again, until it changes
+  LinkedList llp = MakeSortList(items, 1000, 100, &state);
+  ASSERT_NE((LinkedList) NULL, llp);
+  SortLinkedListAdaptive(llp, 1, &SortItemComparator);
+  num_sort_compares = 0;
+  SortLinkedList(llp, 1, &SortItemComparator);
+  SortLinkedListAdaptive(llp, 1, &SortItemComparator);
+  SortLinkedListParallel(llp, 1, &SortItemComparator, 2);
+  ASSERT_EQ(0U, num_sort_compares);
+  void *payload;
+  ASSERT_TRUE(PopLinkedList(llp, &payload));  // removing keeps it sorted
+  SortLinkedList(llp, 1, &SortItemComparator);
+  ASSERT_EQ(0U, num_sort_compares);
+  ASSERT_TRUE(PushLinkedList(llp, payload));  // adding doesn't
+  SortLinkedList(llp, 1, &SortItemComparator);
+  ASSERT_LT(0U, num_sort_compares);
+  num_sort_compares = 0;
+  SortLinkedList(llp, 0, &SortItemComparator);  // nor does another order
+  ASSERT_LT(0U, num_sort_compares);
+  CheckSortedList(llp, 0, 1000);
+  num_sort_compares = 0;
+  LinkedListMarkUnsorted(llp);
+  SortLinkedListAdaptive(llp, 0, &SortItemComparator);
+  ASSERT_LT(0U, num_sort_compares);
+  CheckSortedList(llp, 0, 1000);
+  FreeLinkedList(llp, &NullFreeFunction);
+  HW1Addpoints(10);
+}
+
+// returns a SortItem's key, counting its calls
+static uint64_t num_key_calls = 0;
+static uint64_t SortItemKey(void *payload) {
+  num_key_calls++;
+  return static_cast<SortItem *>(payload)->key;
+}
+
+TEST_F(Test_LinkedList, TestLinkedListSortByKey) {
+  static const uint64_t kSizes[] = { 0, 1, 2, 3, 255, 256, 257, 20000 };
+  static const uint64_t kRanges[] = { 8, 1000000, UINT64_MAX };
+  static SortItem items[20000];
+  uint64_t state = 5;
+
+  // the same order as SortLinkedList, without any comparisons
+  for (uint64_t r = 0; r < 3; r++) {
+    for (uint64_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); s++) {
+      for (unsigned int ascending = 0; ascending < 2; ascending++) {
+        uint64_t n = kSizes[s];
+        LinkedList expected = MakeSortList(items, n, kRanges[r], &state);
+        ASSERT_NE((LinkedList) NULL, expected);
+        LinkedList llp = AllocateLinkedList();
+        for (uint64_t i = 0; i < n; i++) {
+          ASSERT_TRUE(AppendLinkedList(llp, &items[i]));
+        }
+        SortLinkedList(expected, ascending, &SortItemComparator);
+        num_sort_compares = 0;
+        num_key_calls = 0;
+        ASSERT_TRUE(SortLinkedListByKey(llp, ascending, &SortItemKey));
+        ASSERT_EQ(0U, num_sort_compares);
+        ASSERT_EQ((n < 2) ? 0 : n, num_key_calls);
+        CheckSortedList(llp, ascending, n);
+        CheckSameOrder(expected, llp);
+        FreeLinkedList(expected, &NullFreeFunction);
+        FreeLinkedList(llp, &NullFreeFunction);
+      }
+    }
+  }
+  HW1Addpoints(10);
+
+  // a list sorted by key isn't sorted by that key again, until it changes
+  LinkedList llp = MakeSortList(items, 1000, 100, &state);
+  ASSERT_NE((LinkedList) NULL, llp);
+  ASSERT_TRUE(SortLinkedListByKey(llp, 1, &SortItemKey));
+  num_key_calls = 0;
+  ASSERT_TRUE(SortLinkedListByKey(llp, 1, &SortItemKey));
+  ASSERT_EQ(0U, num_key_calls);
+  ASSERT_TRUE(SortLinkedListByKey(llp, 0, &SortItemKey));
+  ASSERT_EQ(1000U, num_key_calls);
+  CheckSortedList(llp, 0, 1000);
+
+  // sorting by key forgets that the list was sorted by a comparator
+  SortLinkedList(llp, 1, &SortItemComparator);
+  ASSERT_TRUE(SortLinkedListByKey(llp, 0, &SortItemKey));
+  num_sort_compares = 0;
+  SortLinkedList(llp, 1, &SortItemComparator);
+  ASSERT_LT(0U, num_sort_compares);
+
+  // and adding a node forgets a sort by key
+  ASSERT_TRUE(SortLinkedListByKey(llp, 1, &SortItemKey));
+  ASSERT_TRUE(PushLinkedList(llp, &items[1000]));
+  items[1000].key = 50;
+  items[1000].seq = 1000;
+  num_key_calls = 0;
+  ASSERT_TRUE(SortLinkedListByKey(llp, 1, &SortItemKey));
+  ASSERT_EQ(1001U, num_key_calls);
+  FreeLinkedList(llp, &NullFreeFunction);
+  HW1Addpoints(10);
+}
+
+// payload functions for the external sort tests, whose SortItems are
+// malloc()'ed, since the sort frees them and makes new ones
+static int64_t num_live_items = 0;
+static const void *SortItemBytes(void *payload, uint64_t *len) {
+  *len = sizeof(SortItem);
+  return payload;
+}
+static void *SortItemFromBytes(const void *bytes, uint64_t len) {
+  SortItem *item = static_cast<SortItem *>(malloc(sizeof(SortItem)));
+  if (item == NULL || len != sizeof(SortItem))
+    return NULL;
+  memcpy(item, bytes, sizeof(SortItem));
+  num_live_items++;
+  return item;
+}
+static void SortItemFree(void *payload) {
+  num_live_items--;
+  free(payload);
+}
+
+// an output function that copies the items into sorted_items[], and
+// abandons the sort once it has max_sorted_items of them
+static SortItem sorted_items[100000];
+static uint64_t num_sorted_items, max_sorted_items;
+static bool CollectSortItem(void *payload, void *arg) {
+  EXPECT_EQ(static_cast<void *>(&num_sorted_items), arg);
+  if (num_sorted_items == max_sorted_items) {
+    SortItemFree(payload);
+    return false;
+  }
+  sorted_items[num_sorted_items++] = *static_cast<SortItem *>(payload);
+  SortItemFree(payload);
+  return true;
+}
+
+// make a list of n malloc()'ed SortItems with random keys in [0, range)
+static LinkedList MakeExternalSortList(uint64_t n, uint64_t range,
+                                       uint64_t *state) {
+  LinkedList llp = AllocateLinkedList();
+  for (uint64_t i = 0; i < n; i++) {
+    SortItem item = { NextRandom(state) % range, i };
+    if (!AppendLinkedList(llp, SortItemFromBytes(&item, sizeof(item))))
+      return NULL;
+  }
+  return llp;
+}
+
+TEST_F(Test_LinkedList, TestLinkedListExternalSort) {
+  LLExternalSortOptions options = { 0, NULL, &SortItemBytes,
+                                    &SortItemFromBytes, &SortItemFree };
+  LLExternalSortStats stats;
+  static bool seen[100000];
+  uint64_t state = 11, i;
+  LinkedList llp;
+
+  // a list that fits in the budget is sorted in memory
+  llp = MakeExternalSortList(1000, 100, &state);
+  ASSERT_NE((LinkedList) NULL, llp);
+  ASSERT_TRUE(ExternalSortLinkedList(llp, 1, &SortItemComparator, &options,
+                                     NULL, NULL, &stats));
+  ASSERT_EQ(0U, stats.num_runs);
+  ASSERT_EQ(0U, stats.bytes_written);
+  CheckSortedList(llp, 1, 1000);
+
+  // one that doesn't is spilled in runs of about 8000 items; with the
+  // smallest budget, they're merged three at a time, over several passes.
+  FreeLinkedList(llp, &SortItemFree);
+  llp = MakeExternalSortList(100000, 1000, &state);
+  ASSERT_NE((LinkedList) NULL, llp);
+  ASSERT_TRUE(ExternalSortLinkedList(llp, 1, &SortItemComparator, &options,
+                                     NULL, NULL, &stats));
+  ASSERT_LT(10U, stats.num_runs);
+  ASSERT_EQ(3U, stats.num_passes);
+  ASSERT_LT(2 * 100000 * (sizeof(uint64_t) + sizeof(SortItem)),
+            stats.bytes_written);
+  CheckSortedList(llp, 1, 100000);
+  memset(seen, 0, sizeof(seen));
+  for (LinkedListNodePtr node = llp->head; node != NULL; node = node->next) {
+    SortItem *item = static_cast<SortItem *>(node->payload);
+    ASSERT_FALSE(seen[item->seq]);
+    seen[item->seq] = true;
+  }
+  ASSERT_EQ(100000, num_live_items);
+
+  // the list knows it's sorted now
+  num_sort_compares = 0;
+  SortLinkedList(llp, 1, &SortItemComparator);
+  ASSERT_EQ(0U, num_sort_compares);
+  FreeLinkedList(llp, &SortItemFree);
+  ASSERT_EQ(0, num_live_items);
+  HW1Addpoints(10);
+
+  // streaming the output descending through a callback, with a budget
+  // that merges all the runs at once
+  llp = MakeExternalSortList(100000, 1000, &state);
+  ASSERT_NE((LinkedList) NULL, llp);
+  options.memory_budget = 1 << 20;
+  num_sorted_items = 0;
+  max_sorted_items = 100000;
+  ASSERT_TRUE(ExternalSortLinkedList(llp, 0, &SortItemComparator, &options,
+                                     &CollectSortItem, &num_sorted_items,
+                                     &stats));
+  ASSERT_EQ(0U, NumElementsInLinkedList(llp));
+  ASSERT_EQ(0, num_live_items);
+  ASSERT_LT(1U, stats.num_runs);
+  ASSERT_EQ(1U, stats.num_passes);
+  ASSERT_EQ(100000U, num_sorted_items);
+  for (i = 1; i < num_sorted_items; i++) {
+    ASSERT_GE(sorted_items[i - 1].key, sorted_items[i].key);
+    if (sorted_items[i - 1].key == sorted_items[i].key) {
+      ASSERT_LT(sorted_items[i - 1].seq, sorted_items[i].seq);
+    }
+  }
+
+  // a callback can abandon the sort part way; so can a failure to
+  // write out a run.  Either way, everything gets freed.
+  options.memory_budget = 0;
+  for (i = 0; i < 100000; i++) {
+    ASSERT_TRUE(PushLinkedList(llp,
+                               SortItemFromBytes(&sorted_items[i],
+                                                 sizeof(SortItem))));
+  }
+  num_sorted_items = 0;
+  max_sorted_items = 500;
+  ASSERT_FALSE(ExternalSortLinkedList(llp, 1, &SortItemComparator, &options,
+                                      &CollectSortItem, &num_sorted_items,
+                                      NULL));
+  ASSERT_EQ(500U, num_sorted_items);
+  ASSERT_EQ(0U, NumElementsInLinkedList(llp));
+  ASSERT_EQ(0, num_live_items);
+
+  FreeLinkedList(llp, &SortItemFree);
+  llp = MakeExternalSortList(100000, 1000, &state);
+  ASSERT_NE((LinkedList) NULL, llp);
+  options.temp_dir = "/nonexistent";
+  ASSERT_FALSE(ExternalSortLinkedList(llp, 1, &SortItemComparator, &options,
+                                      NULL, NULL, NULL));
+  ASSERT_EQ(0U, NumElementsInLinkedList(llp));
+  ASSERT_EQ(0, num_live_items);
+  FreeLinkedList(llp, &SortItemFree);
+  HW1Addpoints(10);
+}
+
+TEST_F(Test_LinkedList, TestLinkedListTopK) {
+  static const uint64_t kKs[] = { 0, 1, 2, 10, 1000, 19999, 20000, 25000 };
+  static SortItem items[20000];
+  uint64_t state = 13, i, k, m;
+  LinkedListNodePtr node, expected_node;
+
+  // the same payloads as the start of a stable sort, in the same order,
+  // leaving the list as it was
+  LinkedList llp = MakeSortList(items, 20000, 100, &state);
+  ASSERT_NE((LinkedList) NULL, llp);
+  for (unsigned int ascending = 0; ascending < 2; ascending++) {
+    LinkedList expected = AllocateLinkedList();
+    for (i = 0; i < 20000; i++)
+      ASSERT_TRUE(AppendLinkedList(expected, &items[i]));
+    SortLinkedList(expected, ascending, &SortItemComparator);
+    for (i = 0; i < sizeof(kKs) / sizeof(kKs[0]); i++) {
+      k = kKs[i];
+      m = (k < 20000) ? k : 20000;
+      LinkedList out = AllocateLinkedList();
+      ASSERT_TRUE(LinkedListTopK(llp, k, ascending, &SortItemComparator,
+                                 out));
+      ASSERT_EQ(m, NumElementsInLinkedList(out));
+      node = out->head;
+      expected_node = expected->head;
+      for (; node != NULL; node = node->next) {
+        ASSERT_EQ(expected_node->payload, node->payload);
+        expected_node = expected_node->next;
+      }
+      num_sort_compares = 0;
+      SortLinkedList(out, ascending, &SortItemComparator);
+      ASSERT_EQ(0U, num_sort_compares);
+      FreeLinkedList(out, &NullFreeFunction);
+    }
+    FreeLinkedList(expected, &NullFreeFunction);
+  }
+  for (node = llp->head, i = 0; node != NULL; node = node->next, i++)
+    ASSERT_EQ(&items[i], node->payload);
+  FreeLinkedList(llp, &NullFreeFunction);
+  HW1Addpoints(10);
+
+  // a small k takes little more than one comparison per payload, and a
+  // list known to be sorted takes none
+  llp = MakeSortList(items, 20000, 1000000000, &state);
+  ASSERT_NE((LinkedList) NULL, llp);
+  LinkedList out = AllocateLinkedList();
+  num_sort_compares = 0;
+  ASSERT_TRUE(LinkedListTopK(llp, 10, 0, &SortItemComparator, out));
+  ASSERT_GT(20000U + 2000U, num_sort_compares);
+  FreeLinkedList(out, &NullFreeFunction);
+  SortLinkedList(llp, 0, &SortItemComparator);
+  out = AllocateLinkedList();
+  num_sort_compares = 0;
+  ASSERT_TRUE(LinkedListTopK(llp, 10, 0, &SortItemComparator, out));
+  ASSERT_EQ(0U, num_sort_compares);
+  ASSERT_EQ(llp->head->payload, out->head->payload);
+  FreeLinkedList(out, &NullFreeFunction);
+  FreeLinkedList(llp, &NullFreeFunction);
+  HW1Addpoints(10);
+}
+
+// a dedup function that checks the duplicate is equal to the payload
+// kept, and counts its calls
+static uint64_t num_dedup_calls = 0;
+static void CountDuplicate(void *kept, void *duplicate) {
+  EXPECT_EQ(static_cast<SortItem *>(kept)->key,
+            static_cast<SortItem *>(duplicate)->key);
+  EXPECT_LT(static_cast<SortItem *>(kept)->seq,
+            static_cast<SortItem *>(duplicate)->seq);
+  num_dedup_calls++;
+}
+
+TEST_F(Test_LinkedList, TestLinkedListMergeSorted) {
+  static SortItem items[21 * 1500];
+  CountingAllocatorStats stats = { 0, 0, 0 };
+  LinkedList lists[21], merged, expected;
+  LinkedListNodePtr node, expected_node;
+  uint64_t state = 17, n = 0, num_lists, i, j, len, allocs;
+
+  for (unsigned int ascending = 0; ascending < 2; ascending++) {
+    for (num_lists = 0; num_lists <= 21; num_lists += 7) {
+      // lists of assorted lengths (some empty) of keys with lots of
+      // duplicates, each sorted; and the same items all in one list,
+      // sorted, for the merge to match.
+      expected = AllocateLinkedList();
+      n = 0;
+      for (i = 0; i < num_lists; i++) {
+        lists[i] = AllocateLinkedListWithAllocator(&kCountingAllocator,
+                                                   &stats);
+        len = (i % 5 == 2) ? 0 : NextRandom(&state) % 1500;
+        for (j = 0; j < len; j++, n++) {
+          items[n].key = NextRandom(&state) % 100;
+          items[n].seq = n;
+          ASSERT_TRUE(AppendLinkedList(lists[i], &items[n]));
+          ASSERT_TRUE(AppendLinkedList(expected, &items[n]));
+        }
+        SortLinkedList(lists[i], ascending, &SortItemComparator);
+      }
+      SortLinkedList(expected, ascending, &SortItemComparator);
+
+      // the merge just moves the nodes over
+      allocs = stats.num_allocs;
+      merged = MergeSortedLinkedLists(lists, num_lists, ascending,
+                                      &SortItemComparator, NULL);
+      ASSERT_NE((LinkedList) NULL, merged);
+      ASSERT_LE(stats.num_allocs, allocs + 1);
+      CheckSortedList(merged, ascending, n);
+      CheckSameOrder(expected, merged);
+      for (i = 0; i < num_lists; i++) {
+        ASSERT_EQ(0U, NumElementsInLinkedList(lists[i]));
+        ASSERT_EQ((LinkedListNodePtr) NULL, lists[i]->head);
+        FreeLinkedList(lists[i], &NullFreeFunction);
+      }
+      num_sort_compares = 0;
+      SortLinkedList(merged, ascending, &SortItemComparator);
+      ASSERT_EQ(0U, num_sort_compares);
+      FreeLinkedList(merged, &NullFreeFunction);
+      FreeLinkedList(expected, &NullFreeFunction);
+    }
+  }
+  ASSERT_EQ(0U, stats.bytes_outstanding);
+  HW1Addpoints(10);
+
+  // with a dedup function, the first of each key is kept, and the rest
+  // handed to the function, their nodes freed
+  expected = AllocateLinkedList();
+  for (i = 0, n = 0; i < 10; i++) {
+    lists[i] = AllocateLinkedListWithAllocator(&kCountingAllocator, &stats);
+    for (j = 0; j < 1000; j++, n++) {
+      items[n].key = NextRandom(&state) % 500;
+      items[n].seq = n;
+      ASSERT_TRUE(AppendLinkedList(lists[i], &items[n]));
+      ASSERT_TRUE(AppendLinkedList(expected, &items[n]));
+    }
+    SortLinkedList(lists[i], 1, &SortItemComparator);
+  }
+  SortLinkedList(expected, 1, &SortItemComparator);
+  num_dedup_calls = 0;
+  merged = MergeSortedLinkedLists(lists, 10, 1, &SortItemComparator,
+                                  &CountDuplicate);
+  ASSERT_NE((LinkedList) NULL, merged);
+  ASSERT_EQ(n, NumElementsInLinkedList(merged) + num_dedup_calls);
+  expected_node = expected->head;
+  for (node = merged->head; node != NULL; node = node->next) {
+    ASSERT_EQ(expected_node->payload, node->payload);
+    SortItem *item = static_cast<SortItem *>(node->payload);
+    while (expected_node != NULL &&
+           static_cast<SortItem *>(expected_node->payload)->key ==
+           item->key) {
+      expected_node = expected_node->next;
+    }
+  }
+  ASSERT_EQ((LinkedListNodePtr) NULL, expected_node);
+  for (i = 0; i < 10; i++)
+    FreeLinkedList(lists[i], &NullFreeFunction);
+  FreeLinkedList(merged, &NullFreeFunction);
+  FreeLinkedList(expected, &NullFreeFunction);
+  ASSERT_EQ(0U, stats.bytes_outstanding);
+  HW1Addpoints(10);
+}
+
+// make a list of n SortItems with strictly ascending keys, the gaps
+// between them random in [1, max_gap]
+static LinkedList MakeKeyedList(SortItem *items, uint64_t n,
+                                uint64_t max_gap, uint64_t *state) {
+  LinkedList llp = AllocateLinkedList();
+  uint64_t key = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    key += 1 + NextRandom(state) % max_gap;
+    items[i].key = key;
+    items[i].seq = i;
+    if (!AppendLinkedList(llp, &items[i]))
+      return NULL;
+  }
+  return llp;
+}
+
+// check that out holds the intersection (or union) of a[0, na) and
+// b[0, nb), by key, with a's payloads for keys in both
+static void CheckSetOperation(SortItem *a, uint64_t na, SortItem *b,
+                              uint64_t nb, bool intersect, LinkedList out) {
+  LinkedListNodePtr node = out->head;
+  uint64_t i = 0, j = 0;
+  SortItem *expected;
+
+  while (i < na || j < nb) {
+    if (j == nb || (i < na && a[i].key < b[j].key)) {
+      expected = intersect ? NULL : &a[i];
+      i++;
+    } else if (i == na || b[j].key < a[i].key) {
+      expected = intersect ? NULL : &b[j];
+      j++;
+    } else {
+      expected = &a[i];
+      i++;
+      j++;
+    }
+    if (expected != NULL) {
+      ASSERT_NE((LinkedListNodePtr) NULL, node);
+      ASSERT_EQ(expected, node->payload);
+      node = node->next;
+    }
+  }
+  ASSERT_EQ((LinkedListNodePtr) NULL, node);
+}
+
+// a visit function that appends payloads to the list it's handed,
+// asking to stop once the list holds 10
+static bool AppendUpToTen(void *payload, void *arg) {
+  LinkedList llp = static_cast<LinkedList>(arg);
+  EXPECT_TRUE(AppendLinkedList(llp, payload));
+  return NumElementsInLinkedList(llp) < 10;
+}
+
+TEST_F(Test_LinkedList, TestLinkedListKeyIndex) {
+  static const uint64_t kSmallSizes[] = { 0, 1, 5, 300, 3000, 50000 };
+  static SortItem big[50000], small[50000];
+  uint64_t state = 19, n, i;
+  LinkedList big_list, small_list, out;
+
+  // against a plain merge, with the short list first and second, both
+  // merging (similar sizes) and galloping (very different ones)
+  big_list = MakeKeyedList(big, 50000, 4, &state);
+  ASSERT_NE((LinkedList) NULL, big_list);
+  LLKeyIndex big_index = MakeLLKeyIndex(big_list, &SortItemKey);
+  ASSERT_NE((LLKeyIndex) NULL, big_index);
+  ASSERT_EQ(50000U, NumKeysInLLKeyIndex(big_index));
+  for (i = 0; i < sizeof(kSmallSizes) / sizeof(kSmallSizes[0]); i++) {
+    n = kSmallSizes[i];
+    small_list = MakeKeyedList(small, n, 2 * 125000 / (n + 1) + 1, &state);
+    ASSERT_NE((LinkedList) NULL, small_list);
+    LLKeyIndex small_index = MakeLLKeyIndex(small_list, &SortItemKey);
+    ASSERT_NE((LLKeyIndex) NULL, small_index);
+
+    out = AllocateLinkedList();
+    ASSERT_TRUE(IntersectLLKeyIndexes(small_index, big_index, out, NULL,
+                                      NULL));
+    CheckSetOperation(small, n, big, 50000, true, out);
+    FreeLinkedList(out, &NullFreeFunction);
+    out = AllocateLinkedList();
+    ASSERT_TRUE(IntersectLLKeyIndexes(big_index, small_index, out, NULL,
+                                      NULL));
+    CheckSetOperation(big, 50000, small, n, true, out);
+    FreeLinkedList(out, &NullFreeFunction);
+
+    out = AllocateLinkedList();
+    ASSERT_TRUE(UnionLLKeyIndexes(small_index, big_index, out, NULL, NULL));
+    CheckSetOperation(small, n, big, 50000, false, out);
+    FreeLinkedList(out, &NullFreeFunction);
+    out = AllocateLinkedList();
+    ASSERT_TRUE(UnionSortedLinkedLists(big_list, small_list, &SortItemKey,
+                                       out, NULL, NULL));
+    CheckSetOperation(big, 50000, small, n, false, out);
+    FreeLinkedList(out, &NullFreeFunction);
+
+    FreeLLKeyIndex(small_index);
+    FreeLinkedList(small_list, &NullFreeFunction);
+  }
+  HW1Addpoints(10);
+
+  // a visit function can stop an intersection or union part way
+  small_list = MakeKeyedList(small, 3000, 80, &state);
+  ASSERT_NE((LinkedList) NULL, small_list);
+  out = AllocateLinkedList();
+  ASSERT_TRUE(IntersectSortedLinkedLists(small_list, big_list, &SortItemKey,
+                                         NULL, &AppendUpToTen, out));
+  ASSERT_EQ(10U, NumElementsInLinkedList(out));
+  FreeLinkedList(out, &NullFreeFunction);
+  out = AllocateLinkedList();
+  ASSERT_TRUE(UnionSortedLinkedLists(small_list, big_list, &SortItemKey,
+                                     NULL, &AppendUpToTen, out));
+  ASSERT_EQ(10U, NumElementsInLinkedList(out));
+  FreeLinkedList(out, &NullFreeFunction);
+  FreeLinkedList(small_list, &NullFreeFunction);
+
+  FreeLLKeyIndex(big_index);
+  FreeLinkedList(big_list, &NullFreeFunction);
+  HW1Addpoints(10);
+}
+
+// makes a malloc()'ed SortItem payload for a posting list value
+static void *NewSortItem(uint64_t value) {
+  SortItem item = { value, 0 };
+  return SortItemFromBytes(&item, sizeof(item));
+}
+
+TEST_F(Test_LinkedList, TestPostingList) {
+  static const uint64_t kGaps[] = { 1, 0, 3, 200, 1 << 20, 1ULL << 40 };
+  static uint64_t values[1000];
+  uint64_t state = 23, value, i, j, target;
+  PostingList pl;
+  PLIter iter;
+
+  // an empty list has no iterator
+  pl = AllocatePostingList();
+  ASSERT_NE((PostingList) NULL, pl);
+  ASSERT_EQ((PLIter) NULL, PLMakeIterator(pl));
+
+  // gaps of all sizes, including none, and a partial last block
+  for (i = 0; i < 1000; i++) {
+    values[i] = (i == 0) ? 0 : values[i - 1] + kGaps[NextRandom(&state) % 6];
+    ASSERT_TRUE(AppendPostingList(pl, values[i]));
+  }
+  ASSERT_FALSE(AppendPostingList(pl, values[999] - 1));
+  ASSERT_EQ(1000U, NumValuesInPostingList(pl));
+  ASSERT_EQ((1000U + PL_BLOCK_SIZE - 1) / PL_BLOCK_SIZE, pl->num_blocks);
+  iter = PLMakeIterator(pl);
+  ASSERT_NE((PLIter) NULL, iter);
+  for (i = 0; i < 1000; i++) {
+    PLIteratorGetValue(iter, &value);
+    ASSERT_EQ(values[i], value);
+    ASSERT_EQ(i < 999, PLIteratorHasNext(iter));
+    ASSERT_EQ(i < 999, PLIteratorNext(iter));
+  }
+  PLIteratorGetValue(iter, &value);
+  ASSERT_EQ(values[999], value);
+  PLIteratorFree(iter);
+
+  // seeking, from the start and onwards from the last seek
+  PLIter onwards = PLMakeIterator(pl);
+  ASSERT_NE((PLIter) NULL, onwards);
+  target = 0;
+  for (i = 0; i < 200; i++) {
+    target += NextRandom(&state) % (values[999] / 100);
+    for (j = 0; j < 1000 && values[j] < target; j++) { }
+    iter = PLMakeIterator(pl);
+    ASSERT_NE((PLIter) NULL, iter);
+    ASSERT_EQ(j < 1000, PLIteratorSeek(iter, target));
+    ASSERT_EQ(j < 1000, PLIteratorSeek(onwards, target));
+    if (j < 1000) {
+      PLIteratorGetValue(iter, &value);
+      ASSERT_EQ(values[j], value);
+      PLIteratorGetValue(onwards, &value);
+      ASSERT_EQ(values[j], value);
+    }
+    PLIteratorFree(iter);
+  }
+  PLIteratorFree(onwards);
+  FreePostingList(pl);
+  HW1Addpoints(10);
+
+  // to and from a LinkedList; dense IDs take over 10x less memory
+  LinkedList llp = AllocateLinkedList();
+  for (i = 0, value = 5; i < 100000; i++) {
+    value += 1 + NextRandom(&state) % 8;
+    ASSERT_TRUE(AppendLinkedList(llp, NewSortItem(value)));
+  }
+  pl = PostingListFromLinkedList(llp, &SortItemKey);
+  ASSERT_NE((PostingList) NULL, pl);
+  LLMemoryStats stats;
+  LinkedListMemoryStats(llp, &stats);
+  ASSERT_LT(10 * PostingListMemoryBytes(pl), stats.total_bytes);
+  LinkedList copy = PostingListToLinkedList(pl, &NewSortItem, &SortItemFree);
+  ASSERT_NE((LinkedList) NULL, copy);
+  ASSERT_EQ(100000U, NumElementsInLinkedList(copy));
+  LinkedListNodePtr node = llp->head, copy_node = copy->head;
+  for (; node != NULL; node = node->next, copy_node = copy_node->next) {
+    ASSERT_EQ(static_cast<SortItem *>(node->payload)->key,
+              static_cast<SortItem *>(copy_node->payload)->key);
+  }
+  FreeLinkedList(copy, &SortItemFree);
+  FreePostingList(pl);
+
+  // a list that's out of order can't be converted
+  ASSERT_TRUE(AppendLinkedList(llp, NewSortItem(1)));
+  ASSERT_EQ((PostingList) NULL, PostingListFromLinkedList(llp, &SortItemKey));
+  FreeLinkedList(llp, &SortItemFree);
+  ASSERT_EQ(0, num_live_items);
+  HW1Addpoints(10);
+}
+
+// check that ulp's chunks are linked up properly in both directions,
+// hold between 1 and UL_CHUNK_CAPACITY payloads each, and hold the same
+// payloads, in the same order, as llp.  If compact, also check that no
+// two neighbouring chunks are both below UL_CHUNK_MIN.
+static void CheckUnrolledList(UnrolledList ulp, LinkedList llp,
+                              bool compact) {
+  ULChunkPtr chunk, prev = NULL;
+  LinkedListNodePtr node = llp->head;
+  uint64_t num_chunks = 0;
+
+  ASSERT_EQ(NumElementsInLinkedList(llp), NumElementsInUnrolledList(ulp));
+  for (chunk = ulp->head; chunk != NULL; prev = chunk, chunk = chunk->next) {
+    ASSERT_EQ(prev, chunk->prev);
+    ASSERT_LT(0U, chunk->count);
+    ASSERT_GE(static_cast<uint32_t>(UL_CHUNK_CAPACITY), chunk->count);
+    if (compact && prev != NULL) {
+      ASSERT_FALSE(prev->count < UL_CHUNK_MIN && chunk->count < UL_CHUNK_MIN);
+    }
+    for (uint32_t i = 0; i < chunk->count; i++, node = node->next) {
+      ASSERT_NE((LinkedListNodePtr) NULL, node);
+      ASSERT_EQ(node->payload, chunk->payloads[i]);
+    }
+    num_chunks++;
+  }
+  ASSERT_EQ((LinkedListNodePtr) NULL, node);
+  ASSERT_EQ(prev, ulp->tail);
+  ASSERT_EQ(num_chunks, ulp->num_chunks);
+}
+
+TEST_F(Test_LinkedList, TestUnrolledList) {
+  static SortItem items[3000];
+  uint64_t state = 29, i;
+  void *payload, *ll_payload;
+  bool ok;
+  UnrolledList ulp;
+  LinkedList llp;
+  ULIter iter;
+  LLIter ll_iter;
+
+  // an empty list has nothing to pop and no iterator
+  ulp = AllocateUnrolledList();
+  ASSERT_NE((UnrolledList) NULL, ulp);
+  ASSERT_FALSE(PopUnrolledList(ulp, &payload));
+  ASSERT_FALSE(SliceUnrolledList(ulp, &payload));
+  ASSERT_EQ((ULIter) NULL, ULMakeIterator(ulp, 0));
+
+  // pushes, appends, pops and slices, mirrored on a LinkedList
+  llp = AllocateLinkedList();
+  for (i = 0; i < 3000; i++) {
+    items[i].key = NextRandom(&state) % 100;
+    items[i].seq = i;
+  }
+  for (i = 0; i < 20000; i++) {
+    SortItem *item = &items[NextRandom(&state) % 3000];
+    switch (NextRandom(&state) % 4) {
+      case 0:
+        ASSERT_TRUE(PushUnrolledList(ulp, item));
+        ASSERT_TRUE(PushLinkedList(llp, item));
+        break;
+      case 1:
+        ASSERT_TRUE(AppendUnrolledList(ulp, item));
+        ASSERT_TRUE(AppendLinkedList(llp, item));
+        break;
+      case 2:
+        ok = PopLinkedList(llp, &ll_payload);
+        ASSERT_EQ(ok, PopUnrolledList(ulp, &payload));
+        if (ok) {
+          ASSERT_EQ(ll_payload, payload);
+        }
+        break;
+      default:
+        ok = SliceLinkedList(llp, &ll_payload);
+        ASSERT_EQ(ok, SliceUnrolledList(ulp, &payload));
+        if (ok) {
+          ASSERT_EQ(ll_payload, payload);
+        }
+        break;
+    }
+    if (i % 1000 == 0)
+      CheckUnrolledList(ulp, llp, false);
+  }
+  CheckUnrolledList(ulp, llp, false);
+  FreeUnrolledList(ulp, &NullFreeFunction);
+  FreeLinkedList(llp, &NullFreeFunction);
+
+  // appending packs the chunks full, which takes a lot less memory
+  ulp = AllocateUnrolledList();
+  llp = AllocateLinkedList();
+  for (i = 0; i < 3000; i++) {
+    ASSERT_TRUE(AppendUnrolledList(ulp, &items[i]));
+    ASSERT_TRUE(AppendLinkedList(llp, &items[i]));
+  }
+  ASSERT_EQ((3000U + UL_CHUNK_CAPACITY - 1) / UL_CHUNK_CAPACITY,
+            ulp->num_chunks);
+  LLMemoryStats ul_stats, ll_stats;
+  UnrolledListMemoryStats(ulp, &ul_stats);
+  LinkedListMemoryStats(llp, &ll_stats);
+  ASSERT_EQ(ul_stats.head_bytes + ul_stats.node_bytes +
+            ul_stats.overhead_bytes, ul_stats.total_bytes);
+  ASSERT_LT(2 * ul_stats.total_bytes, ll_stats.total_bytes);
+
+  // sorting is stable, and matches SortLinkedList both ways
+  for (unsigned int ascending = 0; ascending < 2; ascending++) {
+    ASSERT_TRUE(SortUnrolledList(ulp, ascending, &SortItemComparator));
+    SortLinkedList(llp, ascending, &SortItemComparator);
+    CheckUnrolledList(ulp, llp, true);
+  }
+  HW1Addpoints(10);
+
+  // a random walk of iterator moves, deletes and inserts, mirrored on
+  // the LinkedList's iterator, ending with the list emptied
+  iter = ULMakeIterator(ulp, 1);
+  ll_iter = LLMakeIterator(llp, 1);
+  ASSERT_NE((ULIter) NULL, iter);
+  ASSERT_NE((LLIter) NULL, ll_iter);
+  for (i = 0; NumElementsInLinkedList(llp) > 0; i++) {
+    uint64_t op = NextRandom(&state) % 16;
+    ASSERT_EQ(LLIteratorHasNext(ll_iter), ULIteratorHasNext(iter));
+    ASSERT_EQ(LLIteratorHasPrev(ll_iter), ULIteratorHasPrev(iter));
+    if (op < 5) {
+      ASSERT_EQ(LLIteratorNext(ll_iter), ULIteratorNext(iter));
+    } else if (op < 10) {
+      ASSERT_EQ(LLIteratorPrev(ll_iter), ULIteratorPrev(iter));
+    } else if (op < 13 || i > 30000) {
+      ASSERT_EQ(LLIteratorDelete(ll_iter, &NullFreeFunction),
+                ULIteratorDelete(iter, &NullFreeFunction));
+    } else {
+      SortItem *item = &items[NextRandom(&state) % 3000];
+      ASSERT_TRUE(ULIteratorInsertBefore(iter, item));
+      ASSERT_TRUE(LLIteratorInsertBefore(ll_iter, item));
+    }
+    if (NumElementsInLinkedList(llp) > 0) {
+      LLIteratorGetPayload(ll_iter, &ll_payload);
+      ULIteratorGetPayload(iter, &payload);
+      ASSERT_EQ(ll_payload, payload);
+    }
+    if (i % 500 == 0)
+      CheckUnrolledList(ulp, llp, true);
+  }
+  CheckUnrolledList(ulp, llp, true);
+  ASSERT_EQ((ULChunkPtr) NULL, iter->chunk);
+  ASSERT_EQ(0U, ulp->num_chunks);
+  ULIteratorFree(iter);
+  LLIteratorFree(ll_iter);
+  FreeUnrolledList(ulp, &NullFreeFunction);
+  FreeLinkedList(llp, &NullFreeFunction);
+  HW1Addpoints(10);
+}
+
 }  // namespace hw1